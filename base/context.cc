@@ -24,8 +24,10 @@ Context::Context()
           return options;
         }())),
       remote_debug(std::make_unique<TelemetryRemoteDebugServer>(executor)),
+      shm_telemetry(std::make_unique<TelemetryShmServer>(context)),
       telemetry_registry(std::make_unique<TelemetryRegistry>(
-                             context, telemetry_log.get(), remote_debug.get())),
+                             context, telemetry_log.get(), remote_debug.get(),
+                             shm_telemetry.get())),
       factory(std::make_unique<mjlib::io::StreamFactory>(executor))
 {
 }
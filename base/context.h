@@ -29,6 +29,7 @@ namespace base {
 
 class TelemetryRemoteDebugServer;
 class TelemetryRegistry;
+class TelemetryShmServer;
 
 struct Context : boost::noncopyable {
   Context();
@@ -39,6 +40,7 @@ struct Context : boost::noncopyable {
   boost::asio::any_io_executor executor{rt_executor};
   std::unique_ptr<mjlib::telemetry::FileWriter> telemetry_log;
   std::unique_ptr<TelemetryRemoteDebugServer> remote_debug;
+  std::unique_ptr<TelemetryShmServer> shm_telemetry;
   std::unique_ptr<TelemetryRegistry> telemetry_registry;
   std::unique_ptr<mjlib::io::StreamFactory> factory;
 };
@@ -21,3 +21,4 @@
 
 #include "telemetry_registry.h"
 #include "telemetry_remote_debug_server.h"
+#include "telemetry_shm_server.h"
@@ -0,0 +1,303 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/fast_log.h"
+
+#include <pthread.h>
+#include <time.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <fmt/format.h>
+
+#include <log4cpp/LoggingEvent.hh>
+
+#include "base/spsc_ring.h"
+
+namespace mjmech {
+namespace base {
+
+namespace {
+constexpr auto kPollPeriod = std::chrono::milliseconds(5);
+
+int64_t ReadClock(clockid_t clock) {
+  struct timespec ts = {};
+  ::clock_gettime(clock, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+std::string FormatArg(const FastLogEntry& entry, const FastLogArg& arg,
+                      const std::string& spec) {
+  switch (arg.type) {
+    case FastLogArg::kInt: {
+      return fmt::vformat(spec, fmt::make_format_args(arg.i));
+    }
+    case FastLogArg::kUint: {
+      return fmt::vformat(spec, fmt::make_format_args(arg.u));
+    }
+    case FastLogArg::kDouble: {
+      return fmt::vformat(spec, fmt::make_format_args(arg.d));
+    }
+    case FastLogArg::kBool: {
+      const bool value = arg.u != 0;
+      return fmt::vformat(spec, fmt::make_format_args(value));
+    }
+    case FastLogArg::kString: {
+      const std::string_view value(&entry.text[arg.offset], arg.size);
+      return fmt::vformat(spec, fmt::make_format_args(value));
+    }
+  }
+  return {};
+}
+
+/// Each thread which logs gets its own ring, so that producers never
+/// contend with one another.
+struct ThreadRing {
+  static constexpr std::size_t kCapacity = 256;
+
+  SpscRing<FastLogEntry, kCapacity> ring;
+  std::string thread_name;
+};
+
+class FastLogBackend {
+ public:
+  static FastLogBackend* get() {
+    static std::once_flag once;
+    static FastLogBackend* singleton;
+    std::call_once(once, &FastLogBackend::MakeSingleton, &singleton);
+    return singleton;
+  }
+
+  ThreadRing* ring() {
+    thread_local std::shared_ptr<ThreadRing> ring = [&]() {
+      auto result = std::make_shared<ThreadRing>();
+      // This matches the thread names log4cpp uses for its own events.
+      result->thread_name = std::to_string(
+          static_cast<long>(::pthread_self()));
+      std::lock_guard<std::mutex> lock(rings_mutex_);
+      rings_.push_back(result);
+      return result;
+    }();
+    return ring.get();
+  }
+
+  void Register(FastLogSite* site) {
+    site->next = sites_.load(std::memory_order_relaxed);
+    while (!sites_.compare_exchange_weak(
+               site->next, site, std::memory_order_release,
+               std::memory_order_relaxed)) {}
+  }
+
+  FastLogSite* sites() const {
+    return sites_.load(std::memory_order_acquire);
+  }
+
+  void Flush() {
+    Drain();
+  }
+
+ private:
+  FastLogBackend() {
+    // Ensure log4cpp's static state is constructed before our exit
+    // handler is registered, so that it is destroyed after the final
+    // drain.
+    log4cpp::Category::getRoot();
+
+    thread_ = std::thread([this]() { Run(); });
+    std::atexit([]() { FastLogBackend::get()->Stop(); });
+  }
+
+  static void MakeSingleton(FastLogBackend** out) {
+    *out = new FastLogBackend();
+  }
+
+  void Run() {
+    ::pthread_setname_np(::pthread_self(), "log");
+
+    std::unique_lock<std::mutex> lock(stop_mutex_);
+    while (!done_) {
+      stop_cv_.wait_for(lock, kPollPeriod);
+      lock.unlock();
+      Drain();
+      lock.lock();
+    }
+  }
+
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> lock(stop_mutex_);
+      done_ = true;
+    }
+    stop_cv_.notify_all();
+    thread_.join();
+    Drain();
+  }
+
+  void Drain() {
+    std::lock_guard<std::mutex> drain_lock(drain_mutex_);
+
+    {
+      std::lock_guard<std::mutex> lock(rings_mutex_);
+      drain_rings_ = rings_;
+    }
+
+    for (const auto& thread_ring : drain_rings_) {
+      while (thread_ring->ring.Pop(&entry_)) {
+        Emit(*thread_ring, entry_);
+      }
+    }
+
+    {
+      // Forget about threads which have exited and whose messages
+      // have all been emitted.
+      std::lock_guard<std::mutex> lock(rings_mutex_);
+      drain_rings_.clear();
+      rings_.erase(
+          std::remove_if(
+              rings_.begin(), rings_.end(),
+              [](const auto& item) {
+                return item.use_count() == 1 && item->ring.empty();
+              }),
+          rings_.end());
+    }
+  }
+
+  void Emit(const ThreadRing& thread_ring, const FastLogEntry& entry) {
+    std::string message = FormatFastLogEntry(entry);
+    if (entry.suppressed) {
+      message += fmt::format(" ({} similar suppressed)", entry.suppressed);
+    }
+
+    log4cpp::LoggingEvent event(
+        entry.category->getName(), message, "",
+        static_cast<log4cpp::Priority::Value>(entry.site->priority));
+    event.timeStamp = log4cpp::TimeStamp(
+        entry.realtime_us / 1000000, entry.realtime_us % 1000000);
+    event.threadName = thread_ring.thread_name;
+    entry.category->callAppenders(event);
+  }
+
+  std::thread thread_;
+
+  std::mutex stop_mutex_;
+  std::condition_variable stop_cv_;
+  bool done_ = false;
+
+  std::mutex rings_mutex_;
+  std::vector<std::shared_ptr<ThreadRing>> rings_;
+
+  // Only accessed with drain_mutex_ held.
+  std::mutex drain_mutex_;
+  std::vector<std::shared_ptr<ThreadRing>> drain_rings_;
+  FastLogEntry entry_;
+
+  std::atomic<FastLogSite*> sites_{nullptr};
+};
+}
+
+std::string FormatFastLogEntry(const FastLogEntry& entry) {
+  std::string result;
+  int next_arg = 0;
+
+  const std::string_view format = entry.site->format;
+  for (std::size_t i = 0; i < format.size(); i++) {
+    const char c = format[i];
+    if ((c == '{' || c == '}') &&
+        (i + 1) < format.size() && format[i + 1] == c) {
+      result.push_back(c);
+      i++;
+      continue;
+    }
+    if (c != '{') {
+      result.push_back(c);
+      continue;
+    }
+
+    const auto end = format.find('}', i);
+    if (end == std::string_view::npos) {
+      result.append(format.substr(i));
+      break;
+    }
+    if (next_arg >= entry.num_args) {
+      result.append(format.substr(i, end - i + 1));
+    } else {
+      result.append(FormatArg(entry, entry.args[next_arg++],
+                              std::string(format.substr(i, end - i + 1))));
+    }
+    i = end;
+  }
+
+  return result;
+}
+
+void FlushFastLog() {
+  FastLogBackend::get()->Flush();
+}
+
+std::vector<FastLogStats> GetFastLogStats() {
+  std::vector<FastLogStats> result;
+  for (auto* site = FastLogBackend::get()->sites();
+       site != nullptr; site = site->next) {
+    FastLogStats stats;
+    stats.format = site->format;
+    stats.count = site->count.load();
+    stats.suppressed = site->suppressed.load();
+    stats.dropped = site->dropped.load();
+    result.push_back(std::move(stats));
+  }
+  return result;
+}
+
+namespace detail {
+bool FastLogAdmit(FastLogSite* site, log4cpp::Category& category,
+                  uint32_t* suppressed) {
+  if (!category.isPriorityEnabled(site->priority)) { return false; }
+
+  if (!site->registered.exchange(true, std::memory_order_relaxed)) {
+    FastLogBackend::get()->Register(site);
+  }
+
+  site->count.fetch_add(1, std::memory_order_relaxed);
+
+  if (site->period_ns > 0) {
+    const int64_t now = ReadClock(CLOCK_MONOTONIC);
+    const int64_t last = site->last_ns.load(std::memory_order_relaxed);
+    if (last != 0 && (now - last) < site->period_ns) {
+      site->suppressed.fetch_add(1, std::memory_order_relaxed);
+      site->suppressed_since_last.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    site->last_ns.store(now, std::memory_order_relaxed);
+    *suppressed = site->suppressed_since_last.exchange(
+        0, std::memory_order_relaxed);
+  }
+
+  return true;
+}
+
+void FastLogPush(FastLogEntry* entry) {
+  entry->realtime_us = ReadClock(CLOCK_REALTIME) / 1000;
+  if (!FastLogBackend::get()->ring()->ring.Push(*entry)) {
+    entry->site->dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+}
+
+}
+}
@@ -0,0 +1,227 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <log4cpp/Category.hh>
+
+#include "mjlib/base/visitor.h"
+
+/// Log a message from a time critical thread.
+///
+///  MJMECH_LOG(log_, WARN, "Reply from unknown servo {}", reply.id);
+///
+/// The first argument is a LogRef, and the second the name of a
+/// log4cpp::Priority.  Only the format string and the arguments are
+/// captured on the calling thread, without allocating.  Formatting
+/// and the log4cpp appenders, and thus the stderr output and the
+/// "text_log" telemetry record, run later on a background thread.
+///
+/// The format string must be a literal.  Each "{}" or "{:spec}" is
+/// replaced by the next argument as with fmt::format.  Arguments may
+/// be integers, enums, floating point, bool, or strings.  Strings are
+/// copied, but the total for one message is limited to
+/// FastLogEntry::kTextSize bytes.
+#define MJMECH_LOG(category, priority, format, ...)                     \
+  do {                                                                  \
+    static ::mjmech::base::FastLogSite mjmech_log_site_(                \
+        format, ::log4cpp::Priority::priority, 0.0);                    \
+    ::mjmech::base::detail::FastLog(                                    \
+        &mjmech_log_site_, category, ##__VA_ARGS__);                    \
+  } while (0)
+
+/// As MJMECH_LOG, but this call site emits at most one message every
+/// @p period_s.  The number of messages suppressed in between is
+/// appended to the next one which is emitted.
+#define MJMECH_LOG_RATE_LIMITED(category, priority, period_s, format, ...) \
+  do {                                                                  \
+    static ::mjmech::base::FastLogSite mjmech_log_site_(                \
+        format, ::log4cpp::Priority::priority, period_s);               \
+    ::mjmech::base::detail::FastLog(                                    \
+        &mjmech_log_site_, category, ##__VA_ARGS__);                    \
+  } while (0)
+
+namespace mjmech {
+namespace base {
+
+/// The static state for one MJMECH_LOG call site.
+class FastLogSite {
+ public:
+  constexpr FastLogSite(const char* format, int priority, double period_s)
+      : format(format),
+        priority(priority),
+        period_ns(static_cast<int64_t>(period_s * 1e9)) {}
+
+  const char* const format;
+  const int priority;
+  const int64_t period_ns;
+
+  // Messages which were enabled by the category's priority.
+  std::atomic<uint64_t> count{0};
+  // Messages discarded by the rate limit.
+  std::atomic<uint64_t> suppressed{0};
+  // Messages discarded because the background thread fell behind.
+  std::atomic<uint64_t> dropped{0};
+
+  // The remainder is private to the implementation.
+  std::atomic<int64_t> last_ns{0};
+  std::atomic<uint32_t> suppressed_since_last{0};
+  std::atomic<bool> registered{false};
+  FastLogSite* next = nullptr;
+};
+
+struct FastLogArg {
+  enum Type : uint8_t {
+    kInt,
+    kUint,
+    kDouble,
+    kBool,
+    kString,
+  };
+
+  Type type = kInt;
+
+  // For kString, the location within FastLogEntry::text.
+  uint8_t offset = 0;
+  uint8_t size = 0;
+
+  union {
+    int64_t i;
+    uint64_t u;
+    double d;
+  };
+};
+
+/// Everything needed to format one message later.
+struct FastLogEntry {
+  static constexpr int kMaxArgs = 6;
+  static constexpr int kTextSize = 96;
+
+  FastLogSite* site = nullptr;
+  log4cpp::Category* category = nullptr;
+  int64_t realtime_us = 0;
+  uint32_t suppressed = 0;
+  uint8_t num_args = 0;
+  uint8_t text_size = 0;
+  FastLogArg args[kMaxArgs] = {};
+  char text[kTextSize] = {};
+};
+
+static_assert(std::is_trivially_copyable_v<FastLogEntry>);
+
+/// @return the formatted message for @p entry, without any
+/// suppression note.
+std::string FormatFastLogEntry(const FastLogEntry& entry);
+
+/// Block until everything logged so far by any thread has been
+/// passed to the log4cpp appenders.
+void FlushFastLog();
+
+struct FastLogStats {
+  std::string format;
+  uint64_t count = 0;
+  uint64_t suppressed = 0;
+  uint64_t dropped = 0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(format));
+    a->Visit(MJ_NVP(count));
+    a->Visit(MJ_NVP(suppressed));
+    a->Visit(MJ_NVP(dropped));
+  }
+};
+
+/// @return the counters for every call site which has been reached
+/// at least once.
+std::vector<FastLogStats> GetFastLogStats();
+
+namespace detail {
+/// Apply the priority check and rate limit for @p site.  @return
+/// false if the message should be discarded.  Otherwise, @p
+/// suppressed is set to the number of messages the rate limit
+/// discarded since the last one was admitted.
+bool FastLogAdmit(FastLogSite* site, log4cpp::Category& category,
+                  uint32_t* suppressed);
+
+/// Timestamp @p entry and queue it for the background thread.
+void FastLogPush(FastLogEntry* entry);
+
+inline void FastLogAppendText(FastLogEntry* entry, FastLogArg* arg,
+                              std::string_view value) {
+  const std::size_t size = std::min<std::size_t>(
+      value.size(), FastLogEntry::kTextSize - entry->text_size);
+  arg->type = FastLogArg::kString;
+  arg->offset = entry->text_size;
+  arg->size = static_cast<uint8_t>(size);
+  for (std::size_t i = 0; i < size; i++) {
+    entry->text[entry->text_size + i] = value[i];
+  }
+  entry->text_size += size;
+}
+
+template <typename T>
+void FastLogAddArg(FastLogEntry* entry, const T& value) {
+  if (entry->num_args >= FastLogEntry::kMaxArgs) { return; }
+  FastLogArg* const arg = &entry->args[entry->num_args++];
+
+  using U = std::decay_t<T>;
+  if constexpr (std::is_same_v<U, bool>) {
+    arg->type = FastLogArg::kBool;
+    arg->u = value ? 1 : 0;
+  } else if constexpr (std::is_enum_v<U>) {
+    arg->type = FastLogArg::kInt;
+    arg->i = static_cast<int64_t>(value);
+  } else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>) {
+    arg->type = FastLogArg::kInt;
+    arg->i = value;
+  } else if constexpr (std::is_integral_v<U>) {
+    arg->type = FastLogArg::kUint;
+    arg->u = value;
+  } else if constexpr (std::is_floating_point_v<U>) {
+    arg->type = FastLogArg::kDouble;
+    arg->d = value;
+  } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+    FastLogAppendText(entry, arg, std::string_view(value));
+  } else {
+    static_assert(std::is_same_v<U, void>,
+                  "unsupported MJMECH_LOG argument type");
+  }
+}
+
+template <typename... Args>
+void FastLog(FastLogSite* site, log4cpp::Category& category,
+             const Args&... args) {
+  uint32_t suppressed = 0;
+  if (!FastLogAdmit(site, category, &suppressed)) { return; }
+
+  FastLogEntry entry;
+  entry.site = site;
+  entry.category = &category;
+  entry.suppressed = suppressed;
+  (FastLogAddArg(&entry, args), ...);
+  FastLogPush(&entry);
+}
+}
+
+}
+}
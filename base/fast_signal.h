@@ -0,0 +1,85 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+namespace mjmech {
+namespace base {
+
+template <typename Signature>
+class FastSignal;
+
+/// A minimal replacement for boost::signals2::signal, for use where
+/// all slots are connected once at startup and the signal is only
+/// ever emitted from a single thread.
+///
+/// Emitting takes no lock and performs no allocation, it is just one
+/// indirect call per slot.  Slots cannot be disconnected, and must
+/// not be connected while the signal is being emitted.
+template <typename... Args>
+class FastSignal<void (Args...)> : boost::noncopyable {
+ public:
+  template <typename Functor>
+  void connect(Functor functor) {
+    using Stored = std::decay_t<Functor>;
+    auto holder = std::make_unique<Holder<Stored>>(std::move(functor));
+    slots_.push_back({&Holder<Stored>::Invoke, holder.get()});
+    holders_.push_back(std::move(holder));
+  }
+
+  void operator()(Args... args) const {
+    for (const auto& slot : slots_) {
+      slot.invoke(slot.holder, args...);
+    }
+  }
+
+  bool empty() const { return slots_.empty(); }
+  std::size_t num_slots() const { return slots_.size(); }
+
+ private:
+  struct HolderBase {
+    virtual ~HolderBase() {}
+  };
+
+  template <typename Functor>
+  struct Holder : HolderBase {
+    Holder(Functor functor_in) : functor(std::move(functor_in)) {}
+
+    static void Invoke(HolderBase* base, Args... args) {
+      static_cast<Holder*>(base)->functor(args...);
+    }
+
+    Functor functor;
+  };
+
+  struct Slot {
+    void (*invoke)(HolderBase*, Args...) = nullptr;
+    HolderBase* holder = nullptr;
+  };
+
+  // The slots are kept contiguous, separate from the storage which
+  // owns them, so that emission is a linear scan.
+  std::vector<Slot> slots_;
+  std::vector<std::unique_ptr<HolderBase>> holders_;
+};
+
+}
+}
@@ -0,0 +1,377 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "mjlib/base/stream.h"
+#include "mjlib/base/visitor.h"
+#include "mjlib/telemetry/binary_write_archive.h"
+
+namespace mjmech {
+namespace base {
+
+/// The sequence of operations needed to encode one Serializable type
+/// in the mjlib telemetry binary format.
+///
+/// Runs of fixed size fields which are laid out contiguously in
+/// memory, and whose wire format is the same as their in-memory
+/// representation (integers, floating point, and bool on a little
+/// endian host), are collapsed into single memcpy operations.
+/// Everything else is written by a per-type function.
+struct FusedBinaryPlan {
+  using EncodeFunction = void (*)(std::string* out, const char* field);
+
+  struct Op {
+    // If non-null, call this on the field at offset.  Otherwise, copy
+    // size bytes from offset.
+    EncodeFunction encode = nullptr;
+    uint32_t offset = 0;
+    uint32_t size = 0;
+  };
+
+  std::vector<Op> ops;
+
+  void Encode(std::string* out, const void* object) const {
+    const char* const base = static_cast<const char*>(object);
+    for (const auto& op : ops) {
+      if (op.encode) {
+        op.encode(out, base + op.offset);
+      } else {
+        out->append(base + op.offset, op.size);
+      }
+    }
+  }
+
+  /// @return the number of bytes which are written with memcpy.
+  std::size_t fused_bytes() const {
+    std::size_t result = 0;
+    for (const auto& op : ops) {
+      if (!op.encode) { result += op.size; }
+    }
+    return result;
+  }
+};
+
+namespace detail {
+inline void WriteVaruint(std::string* out, uint64_t value) {
+  do {
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    if (value) { byte |= 0x80; }
+    out->push_back(static_cast<char>(byte));
+  } while (value);
+}
+
+inline bool IsLittleEndian() {
+  const uint16_t value = 1;
+  uint8_t first = 0;
+  std::memcpy(&first, &value, 1);
+  return first == 1;
+}
+
+/// Appends everything written to it onto a std::string.
+class StringWriteStream : public mjlib::base::WriteStream {
+ public:
+  StringWriteStream(std::string* out) : out_(out) {}
+
+  void write(const std::string_view& data) override {
+    out_->append(data.data(), data.size());
+  }
+
+ private:
+  std::string* const out_;
+};
+
+/// Presents a single value as a Serializable, so that
+/// BinaryWriteArchive will write just that value.
+template <typename T>
+struct SingleField {
+  T* value;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(mjlib::base::MakeNameValuePair(value, ""));
+  }
+};
+
+template <typename T>
+void EncodeWithArchive(std::string* out, const char* field) {
+  SingleField<T> single{
+    const_cast<T*>(reinterpret_cast<const T*>(field))};
+  StringWriteStream stream(out);
+  mjlib::telemetry::BinaryWriteArchive(stream).Accept(&single);
+}
+
+template <typename T>
+void EncodeEnum(std::string* out, const char* field) {
+  const T value = *reinterpret_cast<const T*>(field);
+  WriteVaruint(
+      out,
+      static_cast<uint64_t>(
+          static_cast<std::underlying_type_t<T>>(value)));
+}
+
+inline void EncodeString(std::string* out, const char* field) {
+  const auto& value = *reinterpret_cast<const std::string*>(field);
+  WriteVaruint(out, value.size());
+  out->append(value);
+}
+
+template <typename T>
+const FusedBinaryPlan& GetPlan();
+
+template <typename T>
+void EncodeVector(std::string* out, const char* field) {
+  const auto& value = *reinterpret_cast<const std::vector<T>*>(field);
+  WriteVaruint(out, value.size());
+  const auto& plan = GetPlan<T>();
+  for (const auto& item : value) {
+    plan.Encode(out, &item);
+  }
+}
+
+template <typename T>
+void EncodeOptional(std::string* out, const char* field) {
+  const auto& value = *reinterpret_cast<const std::optional<T>*>(field);
+  // An optional is a union of null and T.
+  WriteVaruint(out, value ? 1 : 0);
+  if (value) {
+    GetPlan<T>().Encode(out, &*value);
+  }
+}
+
+template <typename T>
+struct IsVector : std::false_type {};
+
+template <typename T>
+struct IsVector<std::vector<T>> : std::true_type {};
+
+// vector<bool> elements are not addressable.
+template <>
+struct IsVector<std::vector<bool>> : std::false_type {};
+
+template <typename T>
+struct IsArray : std::false_type {};
+
+template <typename T, std::size_t N>
+struct IsArray<std::array<T, N>> : std::true_type {};
+
+template <typename T>
+struct IsOptional : std::false_type {};
+
+template <typename T>
+struct IsOptional<std::optional<T>> : std::true_type {};
+
+/// Walks the Serialize methods of a default constructed instance,
+/// and records where each field lives relative to the start of the
+/// object.
+class PlanBuilder {
+ public:
+  PlanBuilder(FusedBinaryPlan* plan, const void* base, std::size_t size)
+      : plan_(plan),
+        base_(static_cast<const char*>(base)),
+        size_(size) {}
+
+  template <typename NameValuePair>
+  void Visit(const NameValuePair& pair) {
+    Add(pair.value());
+  }
+
+  template <typename T>
+  void Add(T* value) {
+    using U = std::remove_cv_t<T>;
+    if constexpr (std::is_arithmetic_v<U> &&
+                  !std::is_same_v<U, long double>) {
+      if (little_endian_) {
+        AddCopy(value, sizeof(U));
+      } else {
+        AddEncode(value, &EncodeWithArchive<U>);
+      }
+    } else if constexpr (std::is_enum_v<U>) {
+      AddEncode(value, &EncodeEnum<U>);
+    } else if constexpr (std::is_same_v<U, std::string>) {
+      AddEncode(value, &EncodeString);
+    } else if constexpr (IsVector<U>::value) {
+      AddEncode(value, &EncodeVector<typename U::value_type>);
+    } else if constexpr (IsOptional<U>::value) {
+      AddEncode(value, &EncodeOptional<typename U::value_type>);
+    } else if constexpr (IsArray<U>::value) {
+      // A fixed array has no header, just the elements.
+      for (auto& item : *const_cast<U*>(value)) {
+        Add(&item);
+      }
+    } else {
+      AddStructure(const_cast<U*>(value), 0);
+    }
+  }
+
+  /// Set if any field could not be located within the object, in
+  /// which case this plan must not be used.
+  bool failed() const { return failed_; }
+
+ private:
+  template <typename T>
+  auto AddStructure(T* value, int) -> decltype(value->Serialize(this)) {
+    value->Serialize(this);
+  }
+
+  struct Receiver {
+    PlanBuilder* builder;
+
+    template <typename NameValuePair>
+    void operator()(const NameValuePair& pair) const {
+      builder->Visit(pair);
+    }
+  };
+
+  template <typename T>
+  auto AddStructure(T* value, long) ->
+      decltype(mjlib::base::ExternalSerializer<T>().Serialize(
+                   value, std::declval<Receiver>())) {
+    mjlib::base::ExternalSerializer<T>().Serialize(value, Receiver{this});
+  }
+
+  template <typename T>
+  void AddStructure(T* value, ...) {
+    AddEncode(value, &EncodeWithArchive<T>);
+  }
+
+  std::optional<uint32_t> Offset(const void* field, std::size_t size) {
+    const char* const ptr = static_cast<const char*>(field);
+    if (ptr < base_ || (ptr + size) > (base_ + size_)) {
+      failed_ = true;
+      return {};
+    }
+    return static_cast<uint32_t>(ptr - base_);
+  }
+
+  void AddCopy(const void* field, std::size_t size) {
+    const auto offset = Offset(field, size);
+    if (!offset) { return; }
+
+    auto& ops = plan_->ops;
+    if (!ops.empty() && !ops.back().encode &&
+        (ops.back().offset + ops.back().size) == *offset) {
+      ops.back().size += size;
+      return;
+    }
+    FusedBinaryPlan::Op op;
+    op.offset = *offset;
+    op.size = size;
+    ops.push_back(op);
+  }
+
+  template <typename T>
+  void AddEncode(T* field, FusedBinaryPlan::EncodeFunction encode) {
+    const auto offset = Offset(field, sizeof(T));
+    if (!offset) { return; }
+
+    FusedBinaryPlan::Op op;
+    op.encode = encode;
+    op.offset = *offset;
+    plan_->ops.push_back(op);
+  }
+
+  FusedBinaryPlan* const plan_;
+  const char* const base_;
+  const std::size_t size_;
+  const bool little_endian_ = IsLittleEndian();
+  bool failed_ = false;
+};
+
+template <typename T>
+FusedBinaryPlan MakePlan() {
+  T sample{};
+  FusedBinaryPlan result;
+  PlanBuilder builder(&result, &sample, sizeof(sample));
+  builder.Add(&sample);
+  if (builder.failed()) {
+    // Something in the Serialize method referred to storage outside
+    // of the object itself.  Encode the whole thing the slow way.
+    result.ops.clear();
+    FusedBinaryPlan::Op op;
+    op.encode = &EncodeWithArchive<T>;
+    result.ops.push_back(op);
+  }
+  return result;
+}
+
+template <typename T>
+const FusedBinaryPlan& GetPlan() {
+  static const FusedBinaryPlan plan = MakePlan<T>();
+  return plan;
+}
+}
+
+/// Write Serializable objects in exactly the format that
+/// mjlib::telemetry::BinaryWriteArchive does, but using a plan which
+/// is computed once per type.
+///
+/// As a guard against the two drifting apart, the first few records
+/// are also encoded with BinaryWriteArchive and compared.  If they
+/// ever differ, this writer permanently reverts to
+/// BinaryWriteArchive.
+template <typename T>
+class FusedBinaryWriter {
+ public:
+  static constexpr int kVerifyCount = 8;
+
+  void Write(mjlib::base::WriteStream& stream, const T* data) {
+    if (!fused_) {
+      mjlib::telemetry::BinaryWriteArchive(stream).Accept(data);
+      return;
+    }
+
+    scratch_.clear();
+    detail::GetPlan<T>().Encode(&scratch_, data);
+
+    if (verify_remaining_ > 0) {
+      verify_remaining_--;
+
+      reference_.clear();
+      detail::StringWriteStream reference_stream(&reference_);
+      mjlib::telemetry::BinaryWriteArchive(reference_stream).Accept(data);
+      if (reference_ != scratch_) {
+        fused_ = false;
+        stream.write(reference_);
+        return;
+      }
+    }
+
+    stream.write(scratch_);
+  }
+
+  /// @return false if a mismatch caused this writer to revert to
+  /// BinaryWriteArchive.
+  bool fused() const { return fused_; }
+
+ private:
+  bool fused_ = true;
+  int verify_remaining_ = kVerifyCount;
+  std::string scratch_;
+  std::string reference_;
+};
+
+}
+}
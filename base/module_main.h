@@ -67,6 +67,8 @@ int safe_main(int argc, char**argv) {
 
   group.push_back(mjlib::base::ClippArchive("remote_debug.")
                   .Accept(context.remote_debug->parameters()).release());
+  group.push_back(mjlib::base::ClippArchive("shm_telemetry.")
+                  .Accept(context.shm_telemetry->parameters()).release());
 
   group.push_back(module.program_options());
 
@@ -146,6 +148,7 @@ int safe_main(int argc, char**argv) {
           });
 
   context.remote_debug->AsyncStart(joiner->Wrap("starting remote_debug"));
+  context.shm_telemetry->AsyncStart(joiner->Wrap("starting shm_telemetry"));
   module.AsyncStart(joiner->Wrap("starting main module"));
 
 
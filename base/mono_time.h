@@ -0,0 +1,147 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <time.h>
+
+#include <cstdint>
+
+#include <boost/asio/execution_context.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "mjlib/io/debug_deadline_service.h"
+#include "mjlib/io/now.h"
+
+namespace mjmech {
+namespace base {
+
+/// A point in time as integer nanoseconds.  Normally these come from
+/// CLOCK_MONOTONIC, so are only meaningful relative to one another
+/// within a single process.  A default constructed MonoTime is
+/// "unset", analogous to a not_a_date_time ptime.
+class MonoTime {
+ public:
+  constexpr MonoTime() {}
+
+  static constexpr MonoTime FromNanoseconds(int64_t ns) {
+    return MonoTime(ns);
+  }
+
+  constexpr int64_t nanoseconds() const { return ns_; }
+  constexpr bool is_set() const { return ns_ != 0; }
+
+  constexpr MonoTime operator+(int64_t ns) const { return MonoTime(ns_ + ns); }
+  constexpr int64_t operator-(MonoTime rhs) const { return ns_ - rhs.ns_; }
+
+  constexpr bool operator==(MonoTime rhs) const { return ns_ == rhs.ns_; }
+  constexpr bool operator!=(MonoTime rhs) const { return ns_ != rhs.ns_; }
+  constexpr bool operator<(MonoTime rhs) const { return ns_ < rhs.ns_; }
+  constexpr bool operator<=(MonoTime rhs) const { return ns_ <= rhs.ns_; }
+  constexpr bool operator>(MonoTime rhs) const { return ns_ > rhs.ns_; }
+  constexpr bool operator>=(MonoTime rhs) const { return ns_ >= rhs.ns_; }
+
+ private:
+  constexpr explicit MonoTime(int64_t ns) : ns_(ns) {}
+
+  int64_t ns_ = 0;
+};
+
+/// @return the number of seconds between two MonoTimes, or 0 if
+/// either is unset.
+inline double MonoSeconds(MonoTime end, MonoTime start) {
+  if (!end.is_set() || !start.is_set()) { return 0.0; }
+  return static_cast<double>(end - start) * 1e-9;
+}
+
+constexpr int64_t MonoNanoseconds(double seconds) {
+  return static_cast<int64_t>(seconds * 1e9);
+}
+
+/// Reads MonoTime for a given io context.
+///
+/// If the context has a mjlib::io::DebugDeadlineService installed, as
+/// in the simulator, time follows it.  That is decided once at
+/// construction, so the service must be installed before any clock
+/// is created.  Otherwise time comes straight from CLOCK_MONOTONIC,
+/// which is much cheaper than constructing a ptime.
+///
+/// ptimes are only needed for serialization, and ToPtime converts
+/// using the offset between the two clocks.  That is re-sampled at
+/// least once a second, so that timestamps follow the wall clock, and
+/// mjlib::io::Now, when it is slewed or stepped, as by NTP after boot.
+/// ToPtime is therefore not safe to call concurrently from several
+/// threads.
+class MonoClock {
+ public:
+  explicit MonoClock(boost::asio::execution_context& context)
+      : context_(context),
+        debug_(boost::asio::has_service<mjlib::io::DebugDeadlineService>(
+                   context)) {
+    if (!debug_) { Resample(); }
+  }
+
+  MonoTime Now() const {
+    if (debug_) {
+      return MonoTime::FromNanoseconds(
+          (mjlib::io::Now(context_) - Epoch()).total_microseconds() * 1000);
+    }
+    return ReadMonotonic();
+  }
+
+  boost::posix_time::ptime ToPtime(MonoTime time) const {
+    if (!time.is_set()) { return {}; }
+    if (debug_) {
+      return Epoch() +
+          boost::posix_time::microseconds(time.nanoseconds() / 1000);
+    }
+    if (time - mono_base_ > kResampleNs) { Resample(); }
+    return wall_base_ +
+        boost::posix_time::microseconds((time - mono_base_) / 1000);
+  }
+
+  /// A shortcut for ToPtime(Now()).
+  boost::posix_time::ptime PtimeNow() const { return ToPtime(Now()); }
+
+  /// Read CLOCK_MONOTONIC directly.  Unlike Now(), this may be used
+  /// from any thread, but does not follow a debug clock.
+  static MonoTime ReadMonotonic() {
+    struct timespec ts = {};
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return MonoTime::FromNanoseconds(
+        static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec);
+  }
+
+ private:
+  static constexpr int64_t kResampleNs = 1000000000;
+
+  void Resample() const {
+    wall_base_ = boost::posix_time::microsec_clock::universal_time();
+    mono_base_ = ReadMonotonic();
+  }
+
+  static const boost::posix_time::ptime& Epoch() {
+    static const boost::posix_time::ptime epoch(
+        boost::gregorian::date(1970, 1, 1));
+    return epoch;
+  }
+
+  boost::asio::execution_context& context_;
+  const bool debug_;
+  mutable boost::posix_time::ptime wall_base_;
+  mutable MonoTime mono_base_;
+};
+
+}
+}
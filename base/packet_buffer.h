@@ -0,0 +1,186 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <boost/assert.hpp>
+
+namespace mjmech {
+namespace base {
+
+namespace detail {
+struct PacketPoolState;
+
+struct PacketBlock {
+  PacketPoolState* state = nullptr;
+  int refcount = 0;
+  std::size_t size = 0;
+  std::size_t capacity = 0;
+  std::unique_ptr<char[]> data;
+};
+
+struct PacketPoolState {
+  // One for the pool itself, and one for each block which is
+  // currently allocated.
+  int refcount = 1;
+  bool closed = false;
+  std::size_t block_size = 0;
+  std::vector<PacketBlock*> free;
+
+  void Unref() {
+    refcount--;
+    if (refcount == 0) { delete this; }
+  }
+
+  void Release(PacketBlock* block) {
+    if (closed || block->capacity != block_size) {
+      delete block;
+    } else {
+      free.push_back(block);
+    }
+    Unref();
+  }
+};
+}
+
+/// A reference counted handle to one packet's worth of bytes.
+///
+/// Copying a PacketBuffer shares the underlying storage, so the same
+/// bytes can be queued for sending to any number of destinations.
+/// When the last copy is destroyed, the storage returns to the pool
+/// it came from.  Neither the counts nor the pool are thread safe,
+/// so a pool and all of its buffers must be used from one executor.
+class PacketBuffer {
+ public:
+  PacketBuffer() {}
+
+  PacketBuffer(const PacketBuffer& rhs) : block_(rhs.block_) {
+    if (block_) { block_->refcount++; }
+  }
+
+  PacketBuffer(PacketBuffer&& rhs) : block_(rhs.block_) {
+    rhs.block_ = nullptr;
+  }
+
+  PacketBuffer& operator=(const PacketBuffer& rhs) {
+    PacketBuffer copy(rhs);
+    std::swap(block_, copy.block_);
+    return *this;
+  }
+
+  PacketBuffer& operator=(PacketBuffer&& rhs) {
+    std::swap(block_, rhs.block_);
+    return *this;
+  }
+
+  ~PacketBuffer() {
+    if (block_ && --block_->refcount == 0) {
+      block_->state->Release(block_);
+    }
+  }
+
+  explicit operator bool() const { return block_ != nullptr; }
+
+  char* data() { return block_->data.get(); }
+  const char* data() const { return block_->data.get(); }
+  std::size_t size() const { return block_ ? block_->size : 0; }
+  std::size_t capacity() const { return block_ ? block_->capacity : 0; }
+
+  void resize(std::size_t size) {
+    BOOST_ASSERT(size <= capacity());
+    block_->size = size;
+  }
+
+  std::string_view view() const {
+    return block_ ? std::string_view(data(), size()) : std::string_view();
+  }
+
+  /// @return the number of PacketBuffers sharing this storage.
+  int use_count() const { return block_ ? block_->refcount : 0; }
+
+ private:
+  friend class PacketBufferPool;
+
+  explicit PacketBuffer(detail::PacketBlock* block) : block_(block) {
+    block_->refcount = 1;
+  }
+
+  detail::PacketBlock* block_ = nullptr;
+};
+
+/// Hands out PacketBuffers, recycling their storage, so that sending
+/// does not normally allocate.
+class PacketBufferPool {
+ public:
+  /// Buffers of up to @p block_size bytes come from the pool.  Larger
+  /// ones are allocated individually.
+  explicit PacketBufferPool(std::size_t block_size = 2048)
+      : state_(new detail::PacketPoolState()) {
+    state_->block_size = block_size;
+  }
+
+  ~PacketBufferPool() {
+    // Buffers which are still in use will free themselves.
+    for (auto* block : state_->free) { delete block; }
+    state_->free.clear();
+    state_->closed = true;
+    state_->Unref();
+  }
+
+  PacketBufferPool(const PacketBufferPool&) = delete;
+  PacketBufferPool& operator=(const PacketBufferPool&) = delete;
+
+  /// @return a buffer with size() == @p size.
+  PacketBuffer Allocate(std::size_t size) {
+    detail::PacketBlock* block = nullptr;
+    if (size <= state_->block_size && !state_->free.empty()) {
+      block = state_->free.back();
+      state_->free.pop_back();
+    } else {
+      block = new detail::PacketBlock();
+      block->state = state_;
+      block->capacity = std::max(size, state_->block_size);
+      block->data.reset(new char[block->capacity]);
+    }
+    state_->refcount++;
+    block->size = size;
+    return PacketBuffer(block);
+  }
+
+  /// @return a buffer holding a copy of @p data.
+  PacketBuffer Copy(std::string_view data) {
+    auto result = Allocate(data.size());
+    if (!data.empty()) {
+      std::memcpy(result.data(), data.data(), data.size());
+    }
+    return result;
+  }
+
+  /// The number of buffers available for reuse.
+  std::size_t free_count() const { return state_->free.size(); }
+
+ private:
+  detail::PacketPoolState* const state_;
+};
+
+}
+}
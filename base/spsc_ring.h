@@ -0,0 +1,78 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace mjmech {
+namespace base {
+
+/// A fixed capacity, lock-free ring buffer for exactly one producer
+/// thread and one consumer thread.  No allocation is performed after
+/// construction.  When full, new items are rejected rather than
+/// overwriting old ones, since the consumer may be reading them.
+template <typename T, std::size_t Capacity>
+class SpscRing {
+ public:
+  static_assert(Capacity >= 2, "capacity must be at least 2");
+  static_assert((Capacity & (Capacity - 1)) == 0,
+                "capacity must be a power of 2");
+
+  static constexpr std::size_t capacity() { return Capacity; }
+
+  /// Producer only.  @return false if the ring was full and @p value
+  /// was discarded.
+  bool Push(const T& value) {
+    const auto head = head_.load(std::memory_order_relaxed);
+    const auto tail = tail_.load(std::memory_order_acquire);
+    if (head - tail >= Capacity) { return false; }
+    data_[head & kMask] = value;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// Consumer only.  @return false if the ring was empty.
+  bool Pop(T* value) {
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    const auto head = head_.load(std::memory_order_acquire);
+    if (head == tail) { return false; }
+    *value = data_[tail & kMask];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// May be called from either thread, but is only a snapshot.
+  std::size_t size() const {
+    return head_.load(std::memory_order_acquire) -
+        tail_.load(std::memory_order_acquire);
+  }
+
+  bool empty() const { return size() == 0; }
+
+ private:
+  static constexpr std::size_t kMask = Capacity - 1;
+
+  std::array<T, Capacity> data_ = {};
+
+  // Keep the two indices on separate cache lines so the producer and
+  // consumer do not contend.
+  alignas(64) std::atomic<std::size_t> head_{0};
+  alignas(64) std::atomic<std::size_t> tail_{0};
+};
+
+}
+}
@@ -0,0 +1,316 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cmath>
+
+#include <Eigen/Core>
+#include <Eigen/Cholesky>
+#include <Eigen/Dense>
+
+#include <boost/assert.hpp>
+
+namespace mjmech {
+namespace base {
+
+/// A square-root Unscented Kalman Filter, as described in "The
+/// Square-Root Unscented Kalman Filter for State and
+/// Parameter-Estimation", by van der Merwe and Wan.
+///
+/// Unlike UkfFilter, the lower triangular factor S of the covariance
+/// (P = S * S') is propagated directly using QR decompositions and
+/// rank-1 Cholesky updates, so P is guaranteed to remain symmetric
+/// and positive semi-definite without any after-the-fact
+/// conditioning.  All storage is sized at compile time, and the
+/// scaled 2N+1 sigma point set is held in a single matrix so that
+/// process and measurement functions may optionally be evaluated
+/// across all sigma points at once.
+template <typename _Scalar, int _NumStates>
+class SrUkfFilter {
+ public:
+  static_assert(_NumStates > 0, "state must be fixed size");
+
+  static constexpr int kNumStates = _NumStates;
+  static constexpr int kNumSigma = 2 * _NumStates + 1;
+
+  typedef Eigen::Matrix<_Scalar, _NumStates, 1> State;
+  typedef Eigen::Matrix<_Scalar, _NumStates, _NumStates> Covariance;
+  typedef Eigen::Matrix<_Scalar, _NumStates, kNumSigma> SigmaPoints;
+  typedef Eigen::Matrix<_Scalar, kNumSigma, 1> Weights;
+
+  /// Parameters of the scaled sigma point set.  The defaults place
+  /// the symmetric points at the same sqrt(N) spread as UkfFilter,
+  /// with a central point weighted to capture the fourth moment of a
+  /// gaussian prior.
+  struct SigmaOptions {
+    _Scalar alpha = 1.0;
+    _Scalar beta = 2.0;
+    _Scalar kappa = 0.0;
+  };
+
+  SrUkfFilter(const State& initial_state,
+              const Covariance& initial_covariance,
+              const Covariance& process_noise,
+              const SigmaOptions& sigma_options = SigmaOptions())
+      : state_(initial_state),
+        sqrt_covariance_(initial_covariance.llt().matrixL()),
+        sqrt_process_noise_(process_noise.llt().matrixL()) {
+    const _Scalar n = _NumStates;
+    const _Scalar a2 = sigma_options.alpha * sigma_options.alpha;
+    const _Scalar lambda = a2 * (n + sigma_options.kappa) - n;
+    BOOST_ASSERT(n + lambda > 0);
+
+    gamma_ = std::sqrt(n + lambda);
+    mean_weights_.setConstant(0.5 / (n + lambda));
+    mean_weights_(0) = lambda / (n + lambda);
+    covariance_weights_ = mean_weights_;
+    covariance_weights_(0) += (1 - a2 + sigma_options.beta);
+  }
+
+  const State& state() const { return state_; }
+  State& state() { return state_; }
+
+  /// The lower triangular square root of the covariance.
+  const Covariance& sqrt_covariance() const { return sqrt_covariance_; }
+  Covariance& sqrt_covariance() { return sqrt_covariance_; }
+
+  Covariance covariance() const {
+    return sqrt_covariance_ * sqrt_covariance_.transpose();
+  }
+
+  /// The number of rank-1 downdates which would have made the
+  /// covariance indefinite, and were instead skipped.
+  int downdate_failures() const { return downdate_failures_; }
+
+  /// Propagate the state using a function of the signature:
+  ///   State process_function(const State&, _Scalar dt_s)
+  template <typename ProcessFunction>
+  void UpdateState(_Scalar dt_s, ProcessFunction process_function) {
+    UpdateStateBatch(
+        dt_s, [&](const SigmaPoints& x, _Scalar dt) {
+          SigmaPoints result;
+          for (int i = 0; i < kNumSigma; i++) {
+            result.col(i) = process_function(State(x.col(i)), dt);
+          }
+          return result;
+        });
+  }
+
+  /// Propagate the state using a function which operates on every
+  /// sigma point at once, with the signature:
+  ///   SigmaPoints process_function(const SigmaPoints&, _Scalar dt_s)
+  template <typename ProcessFunction>
+  void UpdateStateBatch(_Scalar dt_s, ProcessFunction process_function) {
+    SigmaPoints sigma_points;
+    StoreSigmaPoints(&sigma_points);
+
+    const SigmaPoints xhat = process_function(sigma_points, dt_s);
+    const State xhatminus = xhat * mean_weights_;
+
+    typedef Eigen::Matrix<_Scalar, 3 * _NumStates, _NumStates> Compound;
+    Compound compound;
+    const _Scalar wc = std::sqrt(covariance_weights_(1));
+    compound.template topRows<2 * _NumStates>() =
+        wc * (xhat.template rightCols<2 * _NumStates>().colwise() -
+              xhatminus).transpose();
+    compound.template bottomRows<_NumStates>() =
+        std::sqrt(dt_s) * sqrt_process_noise_.transpose();
+
+    Covariance S = QrFactor<_NumStates>(compound);
+    const State c0 = xhat.col(0) - xhatminus;
+    UpdateZeroth(&S, c0);
+
+    for (int i = 0; i < _NumStates; i++) {
+      BOOST_ASSERT(std::isfinite(xhatminus[i]));
+    }
+
+    state_ = xhatminus;
+    sqrt_covariance_ = S;
+  }
+
+  /// Incorporate a measurement using a function of the signature:
+  ///   Measurement measurement_function(const State&)
+  template <typename MeasurementFunction,
+            typename Measurement,
+            typename MeasurementNoise>
+  void UpdateMeasurement(MeasurementFunction measurement_function,
+                         const Measurement& measurement,
+                         const MeasurementNoise& measurement_noise) {
+    typedef Eigen::Matrix<_Scalar, Measurement::RowsAtCompileTime,
+                          kNumSigma> MeasurementPoints;
+    UpdateMeasurementBatch(
+        [&](const SigmaPoints& x) {
+          MeasurementPoints result;
+          for (int i = 0; i < kNumSigma; i++) {
+            result.col(i) = measurement_function(State(x.col(i)));
+          }
+          return result;
+        },
+        measurement, measurement_noise);
+  }
+
+  /// Incorporate a measurement using a function which operates on
+  /// every sigma point at once, with the signature:
+  ///   Eigen::Matrix<_Scalar, M, kNumSigma>
+  ///        measurement_function(const SigmaPoints&)
+  template <typename MeasurementFunction,
+            typename Measurement,
+            typename MeasurementNoise>
+  void UpdateMeasurementBatch(MeasurementFunction measurement_function,
+                              const Measurement& measurement,
+                              const MeasurementNoise& measurement_noise) {
+    static_assert(Measurement::ColsAtCompileTime == 1,
+                  "measurement must be column vector");
+    constexpr int M = Measurement::RowsAtCompileTime;
+    static_assert(M > 0, "measurement must be fixed size");
+
+    typedef Eigen::Matrix<_Scalar, M, 1> MeasurementVector;
+    typedef Eigen::Matrix<_Scalar, M, M> MeasurementCovariance;
+    typedef Eigen::Matrix<_Scalar, M, kNumSigma> MeasurementPoints;
+
+    SigmaPoints sigma_points;
+    StoreSigmaPoints(&sigma_points);
+
+    const MeasurementPoints yhatin = measurement_function(sigma_points);
+    const MeasurementVector yhat = yhatin * mean_weights_;
+
+    const MeasurementCovariance sqrt_noise =
+        MeasurementCovariance(measurement_noise).llt().matrixL();
+
+    typedef Eigen::Matrix<_Scalar, 2 * _NumStates + M, M> Compound;
+    Compound compound;
+    const _Scalar wc = std::sqrt(covariance_weights_(1));
+    const MeasurementPoints dy = yhatin.colwise() - yhat;
+    compound.template topRows<2 * _NumStates>() =
+        wc * dy.template rightCols<2 * _NumStates>().transpose();
+    compound.template bottomRows<M>() = sqrt_noise.transpose();
+
+    MeasurementCovariance Sy = QrFactor<M>(compound);
+    const MeasurementVector dy0 = dy.col(0);
+    UpdateZeroth(&Sy, dy0);
+
+    const SigmaPoints dx = sigma_points.colwise() - state_;
+    typedef Eigen::Matrix<_Scalar, _NumStates, M> KMatrix;
+    const KMatrix Pxy =
+        dx * covariance_weights_.asDiagonal() * dy.transpose();
+
+    // K = Pxy * (Sy * Sy')^-1, solved with two triangular
+    // back-substitutions rather than an explicit inverse.
+    typedef Eigen::Matrix<_Scalar, M, _NumStates> KTranspose;
+    KTranspose Kt = Sy.template triangularView<Eigen::Lower>().solve(
+        Pxy.transpose());
+    Sy.transpose().template triangularView<Eigen::Upper>().solveInPlace(Kt);
+    const KMatrix K = Kt.transpose();
+
+    const State xplus = state_ + K * (measurement - yhat);
+
+    const KMatrix U = K * Sy;
+    Covariance S = sqrt_covariance_;
+    for (int i = 0; i < M; i++) {
+      State u = U.col(i);
+      Covariance trial = S;
+      if (CholeskyUpdate(&trial, &u, -1)) {
+        S = trial;
+      } else {
+        downdate_failures_++;
+      }
+    }
+
+    for (int i = 0; i < _NumStates; i++) {
+      BOOST_ASSERT(std::isfinite(xplus[i]));
+    }
+
+    state_ = xplus;
+    sqrt_covariance_ = S;
+  }
+
+  void StoreSigmaPoints(SigmaPoints* sigma_points) const {
+    auto& x = *sigma_points;
+    x.col(0) = state_;
+    x.template middleCols<_NumStates>(1) =
+        (gamma_ * sqrt_covariance_).colwise() + state_;
+    x.template rightCols<_NumStates>() =
+        (-gamma_ * sqrt_covariance_).colwise() + state_;
+  }
+
+  /// Perform an in-place rank-1 update (sign > 0) or downdate (sign <
+  /// 0) of the lower triangular factor @p L, such that L' * L'^T = L
+  /// * L^T + sign * x * x^T.  @p x is used as scratch space.
+  ///
+  /// @return false if a downdate would leave the result indefinite,
+  /// in which case @p L is left partially modified.
+  template <typename Factor, typename Vector>
+  static bool CholeskyUpdate(Factor* L_ptr, Vector* x_ptr, _Scalar sign) {
+    auto& L = *L_ptr;
+    auto& x = *x_ptr;
+    const int n = L.rows();
+    for (int k = 0; k < n; k++) {
+      const _Scalar lkk = L(k, k);
+      const _Scalar r2 = lkk * lkk + sign * x(k) * x(k);
+      if (!(r2 > 0) || lkk == 0) { return false; }
+      const _Scalar r = std::sqrt(r2);
+      const _Scalar c = r / lkk;
+      const _Scalar s = x(k) / lkk;
+      L(k, k) = r;
+      for (int i = k + 1; i < n; i++) {
+        L(i, k) = (L(i, k) + sign * s * x(i)) / c;
+        x(i) = c * x(i) - s * L(i, k);
+      }
+    }
+    return true;
+  }
+
+ private:
+  /// Return the lower triangular factor S such that S * S' = A' * A.
+  template <int Size, typename Compound>
+  static Eigen::Matrix<_Scalar, Size, Size> QrFactor(const Compound& A) {
+    typedef Eigen::Matrix<_Scalar, Size, Size> Result;
+    const Eigen::HouseholderQR<Compound> qr(A);
+    Result S = qr.matrixQR().template topLeftCorner<Size, Size>()
+               .template triangularView<Eigen::Upper>().toDenseMatrix()
+               .transpose();
+    // Householder QR does not constrain the sign of the diagonal, but
+    // the Cholesky update below requires a positive one.
+    for (int i = 0; i < Size; i++) {
+      if (S(i, i) < 0) { S.col(i) *= -1; }
+    }
+    return S;
+  }
+
+  template <typename Factor, typename Vector>
+  void UpdateZeroth(Factor* S, const Vector& delta) {
+    const _Scalar w0 = covariance_weights_(0);
+    if (w0 == 0) { return; }
+    Vector u = std::sqrt(std::abs(w0)) * delta;
+    Factor trial = *S;
+    if (CholeskyUpdate(&trial, &u, w0 > 0 ? 1 : -1)) {
+      *S = trial;
+    } else {
+      downdate_failures_++;
+    }
+  }
+
+  State state_;
+  Covariance sqrt_covariance_;
+  Covariance sqrt_process_noise_;
+
+  _Scalar gamma_ = 0;
+  Weights mean_weights_;
+  Weights covariance_weights_;
+  int downdate_failures_ = 0;
+};
+
+}
+}
@@ -0,0 +1,197 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <Eigen/Core>
+
+#include "mjlib/base/visitor.h"
+
+namespace mjmech {
+namespace base {
+
+/// Describes, as JSON, how a Serializable type is laid out in the
+/// mjlib telemetry binary format, so that clients which cannot parse
+/// the binary schema, like a web browser, can still decode the data.
+///
+/// Each type is one of:
+///
+///   "bool", "i8", "u8", "i16", "u16", "i32", "u32", "i64", "u64",
+///     "f32", "f64": little endian, of the given size
+///   "string": varuint size, then the bytes
+///   "timestamp", "duration": i64 microseconds
+///   {"enum": {"value": "name", ...}}: varuint
+///   {"object": [["name", type], ...]}: each field in turn
+///   {"vector": type}: varuint count, then the elements
+///   {"array": [count, type]}: just the elements
+///   {"optional": type}: varuint 0 for empty, or 1 and the value
+///   "unknown": a type which cannot be described
+class TelemetryLayoutWriter {
+ public:
+  template <typename T>
+  static std::string Write() {
+    T sample{};
+    TelemetryLayoutWriter writer;
+    writer.Add(&sample);
+    return writer.out_;
+  }
+
+  template <typename NameValuePair>
+  void Visit(const NameValuePair& pair) {
+    if (!first_field_) { out_ += ","; }
+    first_field_ = false;
+    out_ += "[\"";
+    out_ += pair.name();
+    out_ += "\",";
+    Add(pair.value());
+    out_ += "]";
+  }
+
+ private:
+  template <typename T>
+  void Add(T* value) {
+    using U = std::remove_cv_t<T>;
+    if constexpr (std::is_same_v<U, bool>) {
+      out_ += "\"bool\"";
+    } else if constexpr (std::is_integral_v<U>) {
+      out_ += std::is_signed_v<U> ? "\"i" : "\"u";
+      out_ += std::to_string(sizeof(U) * 8);
+      out_ += "\"";
+    } else if constexpr (std::is_same_v<U, float>) {
+      out_ += "\"f32\"";
+    } else if constexpr (std::is_same_v<U, double>) {
+      out_ += "\"f64\"";
+    } else if constexpr (std::is_enum_v<U>) {
+      AddEnum<U>(0);
+    } else if constexpr (std::is_same_v<U, std::string>) {
+      out_ += "\"string\"";
+    } else if constexpr (std::is_same_v<U, boost::posix_time::ptime>) {
+      out_ += "\"timestamp\"";
+    } else if constexpr (
+        std::is_same_v<U, boost::posix_time::time_duration>) {
+      out_ += "\"duration\"";
+    } else if constexpr (IsVector<U>::value) {
+      out_ += "{\"vector\":";
+      typename U::value_type item{};
+      Add(&item);
+      out_ += "}";
+    } else if constexpr (IsOptional<U>::value) {
+      out_ += "{\"optional\":";
+      typename U::value_type item{};
+      Add(&item);
+      out_ += "}";
+    } else if constexpr (IsArray<U>::value) {
+      out_ += "{\"array\":[" + std::to_string(IsArray<U>::size) + ",";
+      typename IsArray<U>::value_type item{};
+      Add(&item);
+      out_ += "]}";
+    } else {
+      AddStructure(const_cast<U*>(value), 0);
+    }
+  }
+
+  template <typename T>
+  auto AddEnum(int) -> decltype(mjlib::base::IsEnum<T>::map(), void()) {
+    out_ += "{\"enum\":{";
+    bool first = true;
+    for (const auto& pair : mjlib::base::IsEnum<T>::map()) {
+      if (!first) { out_ += ","; }
+      first = false;
+      out_ += "\"" + std::to_string(static_cast<int64_t>(pair.first)) +
+          "\":\"" + pair.second + "\"";
+    }
+    out_ += "}}";
+  }
+
+  template <typename T>
+  void AddEnum(...) {
+    out_ += "{\"enum\":{}}";
+  }
+
+  template <typename T>
+  auto AddStructure(T* value, int) -> decltype(value->Serialize(this)) {
+    out_ += "{\"object\":[";
+    const bool old_first = first_field_;
+    first_field_ = true;
+    value->Serialize(this);
+    first_field_ = old_first;
+    out_ += "]}";
+  }
+
+  struct Receiver {
+    TelemetryLayoutWriter* writer;
+
+    // An external serializer presents a single unnamed wrapper
+    // which stands in for the whole value.
+    template <typename NameValuePair>
+    void operator()(const NameValuePair& pair) const {
+      writer->Add(pair.value());
+    }
+  };
+
+  template <typename T>
+  auto AddStructure(T* value, long) ->
+      decltype(mjlib::base::ExternalSerializer<T>().Serialize(
+                   value, std::declval<Receiver>())) {
+    mjlib::base::ExternalSerializer<T>().Serialize(value, Receiver{this});
+  }
+
+  template <typename T>
+  void AddStructure(T*, ...) {
+    out_ += "\"unknown\"";
+  }
+
+  template <typename T>
+  struct IsVector : std::false_type {};
+
+  template <typename T>
+  struct IsVector<std::vector<T>> : std::true_type {};
+
+  template <typename T>
+  struct IsOptional : std::false_type {};
+
+  template <typename T>
+  struct IsOptional<std::optional<T>> : std::true_type {};
+
+  template <typename T>
+  struct IsArray : std::false_type {};
+
+  template <typename T, std::size_t N>
+  struct IsArray<std::array<T, N>> : std::true_type {
+    using value_type = T;
+    static constexpr std::size_t size = N;
+  };
+
+  // Vectors are fixed arrays of their elements in the binary format.
+  template <typename Scalar, int Rows, int Options, int MaxRows>
+  struct IsArray<Eigen::Matrix<Scalar, Rows, 1, Options, MaxRows, 1>>
+      : std::true_type {
+    using value_type = Scalar;
+    static constexpr std::size_t size = Rows;
+  };
+
+  std::string out_;
+  bool first_field_ = true;
+};
+
+}
+}
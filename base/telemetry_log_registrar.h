@@ -15,12 +15,14 @@
 #pragma once
 
 #include <boost/asio/io_context.hpp>
-#include <boost/signals2/signal.hpp>
 
 #include "mjlib/io/now.h"
 #include "mjlib/telemetry/binary_write_archive.h"
 #include "mjlib/telemetry/file_writer.h"
 
+#include "base/fast_signal.h"
+#include "base/fused_binary_writer.h"
+
 
 namespace mjmech {
 namespace base {
@@ -42,24 +44,27 @@ class TelemetryLogRegistrar {
 
   template <typename T>
   void Register(const std::string& name,
-                boost::signals2::signal<void (const T*)>* signal) {
+                FastSignal<void (const T*)>* signal) {
     const auto identifier = telemetry_log_->AllocateIdentifier(name);
     telemetry_log_->WriteSchema(
         identifier,
         mjlib::telemetry::BinarySchemaArchive::template schema<T>());
-    signal->connect(std::bind(&TelemetryLogRegistrar::HandleData<T>,
-                              this, identifier,
-                              std::placeholders::_1));
+    signal->connect(
+        [this, identifier, writer = FusedBinaryWriter<T>()](
+            const T* data) mutable {
+          this->HandleData(identifier, &writer, data);
+        });
   }
 
   template <typename T>
   void HandleData(mjlib::telemetry::FileWriter::Identifier identifier,
+                  FusedBinaryWriter<T>* writer,
                   const T* data) {
     // If the log isn't open, don't even bother serializing things.
     if (!telemetry_log_->IsOpen()) { return; }
 
     auto buffer = telemetry_log_->GetBuffer();
-    mjlib::telemetry::BinaryWriteArchive(*buffer).Accept(data);
+    writer->Write(*buffer, data);
     telemetry_log_->WriteData(
         mjlib::io::Now(context_), identifier, std::move(buffer));
   }
@@ -21,8 +21,10 @@
 
 #include "mjlib/telemetry/file_writer.h"
 
+#include "base/fast_signal.h"
 #include "base/telemetry_log_registrar.h"
 #include "base/telemetry_remote_debug_registrar.h"
+#include "base/telemetry_shm_server.h"
 
 namespace mjmech {
 namespace base {
@@ -31,8 +33,9 @@ class TelemetryRegistry : boost::noncopyable {
  public:
   TelemetryRegistry(boost::asio::io_context& context,
                     mjlib::telemetry::FileWriter* log,
-                    TelemetryRemoteDebugServer* debug)
-      : log_(context, log), debug_(debug) {}
+                    TelemetryRemoteDebugServer* debug,
+                    TelemetryShmServer* shm = nullptr)
+      : log_(context, log), debug_(debug), shm_(shm) {}
 
   /// Register a serializable object, and return a function object
   /// which when called will disseminate the
@@ -48,8 +51,7 @@ class TelemetryRegistry : boost::noncopyable {
     auto* ptr = new Concrete<DataObject>();
     auto result = [ptr](const DataObject* object) { ptr->signal(object); };
 
-    log_.Register(record_name, &ptr->signal);
-    debug_.Register(record_name, &ptr->signal);
+    Register(record_name, &ptr->signal);
 
     records_.insert(
         std::make_pair(
@@ -58,6 +60,21 @@ class TelemetryRegistry : boost::noncopyable {
     return result;
   };
 
+  /// Register a signal which is emitted from the main thread.  The
+  /// log and debug handlers are connected directly to it, so an
+  /// emission costs one indirect call per handler.
+  template <typename DataObject>
+  void Register(const std::string& record_name,
+                FastSignal<void (const DataObject*)>* signal) {
+    log_.Register(record_name, signal);
+    debug_.Register(record_name, signal);
+    if (shm_) {
+      shm_->Register(record_name, signal);
+    }
+  }
+
+  /// Register a signal which may be emitted from any thread, or which
+  /// needs the other features of boost::signals2.
   template <typename DataObject>
   void Register(const std::string& record_name,
                 boost::signals2::signal<void (const DataObject*)>* signal) {
@@ -73,13 +90,14 @@ class TelemetryRegistry : boost::noncopyable {
   struct Concrete : public Base {
     virtual ~Concrete() {}
 
-    boost::signals2::signal<void (const Serializable*)> signal;
+    FastSignal<void (const Serializable*)> signal;
   };
 
   std::map<std::string, std::unique_ptr<Base> > records_;
 
   TelemetryLogRegistrar log_;
   TelemetryRemoteDebugRegistrar debug_;
+  TelemetryShmServer* const shm_;
 };
 
 }
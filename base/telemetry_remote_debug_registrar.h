@@ -14,9 +14,8 @@
 
 #pragma once
 
-#include <boost/signals2/signal.hpp>
-
-#include "telemetry_remote_debug_server.h"
+#include "base/fast_signal.h"
+#include "base/telemetry_remote_debug_server.h"
 
 namespace mjmech {
 namespace base {
@@ -35,7 +34,7 @@ class TelemetryRemoteDebugRegistrar {
 
   template <typename T>
   void Register(const std::string& name,
-                boost::signals2::signal<void (const T*)>* signal) {
+                FastSignal<void (const T*)>* signal) {
     server_->Register(name, signal);
   }
 
@@ -16,11 +16,12 @@
 
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/ip/udp.hpp>
-#include <boost/signals2/signal.hpp>
 
 #include "mjlib/base/json5_write_archive.h"
 #include "mjlib/io/async_types.h"
 
+#include "base/fast_signal.h"
+
 namespace mjmech {
 namespace base {
 
@@ -46,7 +47,7 @@ class TelemetryRemoteDebugServer : boost::noncopyable {
 
   template <typename T>
   void Register(const std::string& name,
-                boost::signals2::signal<void (const T*)>* signal) {
+                FastSignal<void (const T*)>* signal) {
     std::unique_ptr<Handler> handler(
         new ConcreteHandler<T>(this, name, signal));
     RegisterHandler(name, std::move(handler));
@@ -108,11 +109,10 @@ class TelemetryRemoteDebugServer : boost::noncopyable {
    public:
     ConcreteHandler(TelemetryRemoteDebugServer* parent,
                     const std::string& name,
-                    boost::signals2::signal<void (const T*)>* signal)
+                    FastSignal<void (const T*)>* signal)
         : parent_(parent),
           name_(name) {
-      signal->connect(std::bind(&ConcreteHandler::HandleData, this,
-                                std::placeholders::_1));
+      signal->connect([this](const T* data) { this->HandleData(data); });
     }
     virtual ~ConcreteHandler() {}
 
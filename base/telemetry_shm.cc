@@ -0,0 +1,401 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/telemetry_shm.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <new>
+
+#include "mjlib/base/fail.h"
+#include "mjlib/base/system_error.h"
+
+#include "base/system_fd.h"
+#include "base/system_mmap.h"
+
+namespace mjmech {
+namespace base {
+
+namespace {
+constexpr int kMaxSequenceRetries = 10000;
+
+constexpr uint64_t Align(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+constexpr uint64_t FrameSize(uint64_t data_size) {
+  return Align(sizeof(TelemetryShmFrame) + data_size, 8);
+}
+
+/// Where each part of the region lives.
+struct Layout {
+  uint64_t records = 0;
+  uint64_t schema = 0;
+  uint64_t data = 0;
+  uint64_t total = 0;
+
+  Layout(uint32_t max_records, uint32_t schema_size, uint64_t data_size) {
+    records = Align(sizeof(TelemetryShmHeader), 64);
+    schema = Align(records + max_records * sizeof(TelemetryShmRecord), 64);
+    data = Align(schema + schema_size, 64);
+    total = data + data_size;
+  }
+};
+}
+
+class TelemetryShmWriter::Impl {
+ public:
+  Impl(const std::string& name, const Options& options)
+      : name_(name) {
+    if (options.data_size % 8 != 0 || options.data_size < 1024) {
+      mjlib::base::Fail(
+          "shared memory data size must be a multiple of 8 and >= 1024");
+    }
+
+    // Remove anything left over by a previous instance which did not
+    // shut down cleanly.
+    ::shm_unlink(name_.c_str());
+
+    fd_ = SystemFd(::shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644));
+    mjlib::base::system_error::throw_if(fd_ < 0, "creating " + name_);
+
+    const Layout layout(
+        options.max_records, options.schema_size, options.data_size);
+    mjlib::base::system_error::throw_if(
+        ::ftruncate(fd_, layout.total) < 0, "sizing " + name_);
+    mmap_ = SystemMmap(fd_, layout.total, 0);
+
+    char* const base = static_cast<char*>(mmap_.ptr());
+    header_ = new (base) TelemetryShmHeader();
+    records_ = reinterpret_cast<TelemetryShmRecord*>(base + layout.records);
+    for (uint32_t i = 0; i < options.max_records; i++) {
+      new (&records_[i]) TelemetryShmRecord();
+    }
+    schema_ = base + layout.schema;
+    data_ = base + layout.data;
+
+    header_->version = TelemetryShmHeader::kVersion;
+    header_->max_records = options.max_records;
+    header_->schema_size = options.schema_size;
+    header_->data_size = options.data_size;
+    std::atomic_thread_fence(std::memory_order_release);
+    header_->magic = TelemetryShmHeader::kMagic;
+  }
+
+  ~Impl() {
+    ::shm_unlink(name_.c_str());
+  }
+
+  int AddRecord(const std::string& name, std::string_view schema) {
+    const auto index = header_->num_records.load(std::memory_order_relaxed);
+    if (index >= header_->max_records) {
+      mjlib::base::Fail("too many shared memory telemetry records");
+    }
+    if (name.size() >= TelemetryShmRecord::kMaxNameSize) {
+      mjlib::base::Fail("shared memory record name too long: " + name);
+    }
+    if (schema_used_ + schema.size() > header_->schema_size) {
+      mjlib::base::Fail("shared memory schema area full at: " + name);
+    }
+
+    auto& record = records_[index];
+    std::memcpy(record.name, name.data(), name.size());
+    record.schema_offset = schema_used_;
+    record.schema_size = schema.size();
+    std::memcpy(schema_ + schema_used_, schema.data(), schema.size());
+    schema_used_ += schema.size();
+
+    header_->num_records.store(index + 1, std::memory_order_release);
+    return index;
+  }
+
+  void Write(int record_index, int64_t timestamp_us, std::string_view data) {
+    const uint64_t data_size = header_->data_size;
+    const uint64_t frame_size = FrameSize(data.size());
+    if (frame_size > data_size / 2) {
+      oversize_++;
+      return;
+    }
+
+    uint64_t start = position_;
+    const uint64_t offset = start % data_size;
+    const uint64_t remaining = data_size - offset;
+    const bool wrap = frame_size > remaining;
+    if (wrap) { start += remaining; }
+    const uint64_t end = start + frame_size;
+
+    // Let readers know what is about to be overwritten before
+    // touching anything.
+    header_->reserve_position.store(end, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    if (wrap && remaining >= sizeof(TelemetryShmFrame)) {
+      TelemetryShmFrame marker;
+      marker.record = TelemetryShmFrame::kWrap;
+      std::memcpy(data_ + offset, &marker, sizeof(marker));
+    }
+
+    char* const dest = data_ + (start % data_size);
+    TelemetryShmFrame frame;
+    frame.record = record_index;
+    frame.size = data.size();
+    frame.timestamp_us = timestamp_us;
+    std::memcpy(dest, &frame, sizeof(frame));
+    std::memcpy(dest + sizeof(frame), data.data(), data.size());
+
+    header_->write_position.store(end, std::memory_order_release);
+    position_ = end;
+
+    auto& record = records_[record_index];
+    const auto sequence = record.sequence.load(std::memory_order_relaxed);
+    record.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    record.position.store(start, std::memory_order_relaxed);
+    record.size.store(data.size(), std::memory_order_relaxed);
+    record.timestamp_us.store(timestamp_us, std::memory_order_relaxed);
+    record.count.store(
+        record.count.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+    record.sequence.store(sequence + 2, std::memory_order_release);
+  }
+
+  const std::string name_;
+  SystemFd fd_;
+  SystemMmap mmap_;
+
+  TelemetryShmHeader* header_ = nullptr;
+  TelemetryShmRecord* records_ = nullptr;
+  char* schema_ = nullptr;
+  char* data_ = nullptr;
+
+  uint32_t schema_used_ = 0;
+  uint64_t position_ = 0;
+  uint64_t oversize_ = 0;
+};
+
+TelemetryShmWriter::TelemetryShmWriter(const std::string& name)
+    : TelemetryShmWriter(name, Options()) {}
+
+TelemetryShmWriter::TelemetryShmWriter(const std::string& name,
+                                       const Options& options)
+    : impl_(std::make_unique<Impl>(name, options)) {}
+
+TelemetryShmWriter::~TelemetryShmWriter() {}
+
+int TelemetryShmWriter::AddRecord(const std::string& name,
+                                  std::string_view schema) {
+  return impl_->AddRecord(name, schema);
+}
+
+void TelemetryShmWriter::Write(int record, int64_t timestamp_us,
+                               std::string_view data) {
+  impl_->Write(record, timestamp_us, data);
+}
+
+uint64_t TelemetryShmWriter::oversize() const {
+  return impl_->oversize_;
+}
+
+class TelemetryShmReader::Impl {
+ public:
+  Impl(const std::string& name) {
+    fd_ = SystemFd(::shm_open(name.c_str(), O_RDONLY, 0));
+    mjlib::base::system_error::throw_if(fd_ < 0, "opening " + name);
+
+    struct stat info = {};
+    mjlib::base::system_error::throw_if(
+        ::fstat(fd_, &info) < 0, "examining " + name);
+    if (static_cast<uint64_t>(info.st_size) < sizeof(TelemetryShmHeader)) {
+      mjlib::base::Fail("shared memory region too small: " + name);
+    }
+    mmap_ = SystemMmap(fd_, info.st_size, 0, PROT_READ);
+
+    const char* const base = static_cast<const char*>(mmap_.ptr());
+    header_ = reinterpret_cast<const TelemetryShmHeader*>(base);
+    if (header_->magic != TelemetryShmHeader::kMagic ||
+        header_->version != TelemetryShmHeader::kVersion) {
+      mjlib::base::Fail("not a telemetry region, or wrong version: " + name);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    const Layout layout(
+        header_->max_records, header_->schema_size, header_->data_size);
+    if (layout.total > static_cast<uint64_t>(info.st_size)) {
+      mjlib::base::Fail("shared memory region truncated: " + name);
+    }
+    records_ = reinterpret_cast<const TelemetryShmRecord*>(
+        base + layout.records);
+    schema_ = base + layout.schema;
+    data_ = base + layout.data;
+    data_size_ = header_->data_size;
+
+    // Start streaming from whatever is written next.
+    read_position_ =
+        header_->write_position.load(std::memory_order_acquire);
+  }
+
+  bool Intact(uint64_t position) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return header_->reserve_position.load(std::memory_order_relaxed) <=
+        position + data_size_;
+  }
+
+  void Resynchronize() {
+    overruns_++;
+    read_position_ =
+        header_->write_position.load(std::memory_order_acquire);
+  }
+
+  SystemFd fd_;
+  SystemMmap mmap_;
+
+  const TelemetryShmHeader* header_ = nullptr;
+  const TelemetryShmRecord* records_ = nullptr;
+  const char* schema_ = nullptr;
+  const char* data_ = nullptr;
+  uint64_t data_size_ = 0;
+
+  std::vector<Record> records_cache_;
+  uint64_t read_position_ = 0;
+  uint64_t overruns_ = 0;
+};
+
+TelemetryShmReader::TelemetryShmReader(const std::string& name)
+    : impl_(std::make_unique<Impl>(name)) {}
+
+TelemetryShmReader::~TelemetryShmReader() {}
+
+const std::vector<TelemetryShmReader::Record>& TelemetryShmReader::records() {
+  const auto count =
+      impl_->header_->num_records.load(std::memory_order_acquire);
+  auto& cache = impl_->records_cache_;
+  while (cache.size() < count) {
+    const auto& record = impl_->records_[cache.size()];
+    Record item;
+    item.name = std::string(
+        record.name, ::strnlen(record.name, sizeof(record.name)));
+    item.schema = std::string(
+        impl_->schema_ + record.schema_offset, record.schema_size);
+    cache.push_back(std::move(item));
+  }
+  return cache;
+}
+
+int TelemetryShmReader::Find(std::string_view name) {
+  const auto& all = records();
+  for (size_t i = 0; i < all.size(); i++) {
+    if (all[i].name == name) { return i; }
+  }
+  return -1;
+}
+
+uint64_t TelemetryShmReader::overruns() const {
+  return impl_->overruns_;
+}
+
+bool TelemetryShmReader::LocateLatest(
+    int record_index, Sample* sample, uint64_t* position) {
+  if (record_index < 0 ||
+      static_cast<uint32_t>(record_index) >=
+      impl_->header_->num_records.load(std::memory_order_acquire)) {
+    return false;
+  }
+
+  const auto& record = impl_->records_[record_index];
+  uint64_t count = 0;
+  uint32_t size = 0;
+  bool consistent = false;
+  // The writer holds the sequence odd for only a few stores, so this
+  // should succeed almost immediately unless it died mid-update.
+  for (int i = 0; i < kMaxSequenceRetries && !consistent; i++) {
+    const auto before = record.sequence.load(std::memory_order_acquire);
+    if (before & 1) { continue; }
+    *position = record.position.load(std::memory_order_relaxed);
+    size = record.size.load(std::memory_order_relaxed);
+    count = record.count.load(std::memory_order_relaxed);
+    sample->timestamp_us = record.timestamp_us.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    consistent = record.sequence.load(std::memory_order_relaxed) == before;
+  }
+
+  if (!consistent || count == 0) { return false; }
+  if (!impl_->Intact(*position)) { return false; }
+
+  sample->record = record_index;
+  sample->count = count;
+  sample->data = std::string_view(
+      impl_->data_ + (*position % impl_->data_size_) +
+      sizeof(TelemetryShmFrame),
+      size);
+  return true;
+}
+
+bool TelemetryShmReader::NextFrame(Sample* sample, uint64_t* position) {
+  auto& read = impl_->read_position_;
+  const uint64_t data_size = impl_->data_size_;
+
+  while (true) {
+    const auto written =
+        impl_->header_->write_position.load(std::memory_order_acquire);
+    if (read >= written) { return false; }
+    if (written - read > data_size) {
+      Resynchronize();
+      continue;
+    }
+
+    const uint64_t offset = read % data_size;
+    const uint64_t remaining = data_size - offset;
+    if (remaining < sizeof(TelemetryShmFrame)) {
+      // Too small even for a wrap marker.
+      read += remaining;
+      continue;
+    }
+
+    TelemetryShmFrame frame;
+    std::memcpy(&frame, impl_->data_ + offset, sizeof(frame));
+    if (!impl_->Intact(read)) {
+      Resynchronize();
+      continue;
+    }
+
+    if (frame.record == TelemetryShmFrame::kWrap) {
+      read += remaining;
+      continue;
+    }
+
+    *position = read;
+    sample->record = frame.record;
+    sample->timestamp_us = frame.timestamp_us;
+    sample->count = 0;
+    sample->data = std::string_view(
+        impl_->data_ + offset + sizeof(frame), frame.size);
+    read += FrameSize(frame.size);
+    return true;
+  }
+}
+
+bool TelemetryShmReader::Intact(uint64_t position) const {
+  return impl_->Intact(position);
+}
+
+void TelemetryShmReader::Resynchronize() {
+  impl_->Resynchronize();
+}
+
+}
+}
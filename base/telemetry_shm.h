@@ -0,0 +1,198 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mjmech {
+namespace base {
+
+/// A telemetry bus in POSIX shared memory, for other processes on the
+/// same machine.  There is exactly one writer and any number of
+/// readers.  Readers never block or otherwise slow the writer, and if
+/// they fall behind, they lose data rather than the writer waiting.
+///
+/// The region is laid out as:
+///
+///   TelemetryShmHeader
+///   TelemetryShmRecord[max_records]
+///   schema area
+///   data ring
+///
+/// Each record has a name and the same binary schema that is written
+/// to telemetry log files.  The data ring holds a sequence of frames,
+/// each a TelemetryShmFrame followed by the binary encoding of one
+/// instance of a record, padded to 8 bytes.
+struct TelemetryShmHeader {
+  static constexpr uint32_t kMagic = 0x73746a6d;  // "mjts"
+  static constexpr uint32_t kVersion = 1;
+
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  uint32_t max_records = 0;
+  uint32_t schema_size = 0;
+  uint64_t data_size = 0;
+  std::atomic<uint32_t> num_records{0};
+
+  // Both are absolute byte counts since the region was created.  The
+  // writer advances reserve_position before it overwrites anything,
+  // and write_position once a frame is complete.  A reader which has
+  // finished with the bytes at position p can tell they were intact
+  // if reserve_position <= p + data_size afterwards.
+  alignas(64) std::atomic<uint64_t> reserve_position{0};
+  alignas(64) std::atomic<uint64_t> write_position{0};
+};
+
+struct TelemetryShmRecord {
+  static constexpr int kMaxNameSize = 64;
+
+  char name[kMaxNameSize] = {};
+  uint32_t schema_offset = 0;
+  uint32_t schema_size = 0;
+
+  // A seqlock protecting the remaining fields, odd while they are
+  // being updated.
+  std::atomic<uint64_t> sequence{0};
+  std::atomic<uint64_t> position{0};
+  std::atomic<uint64_t> count{0};
+  std::atomic<int64_t> timestamp_us{0};
+  std::atomic<uint32_t> size{0};
+};
+
+struct TelemetryShmFrame {
+  // The record index, or kWrap if the rest of the ring is unused and
+  // the next frame starts at the beginning.
+  static constexpr uint32_t kWrap = 0xffffffff;
+
+  uint32_t record = 0;
+  uint32_t size = 0;
+  int64_t timestamp_us = 0;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "shared memory requires lock free 64 bit atomics");
+
+class TelemetryShmWriter {
+ public:
+  struct Options {
+    uint32_t max_records = 256;
+    uint32_t schema_size = 1 << 20;
+    uint64_t data_size = 8 << 20;
+  };
+
+  /// Create (or replace) the shared memory object @p name, which
+  /// should start with a '/'.  It is unlinked when this is destroyed.
+  TelemetryShmWriter(const std::string& name);
+  TelemetryShmWriter(const std::string& name, const Options&);
+  ~TelemetryShmWriter();
+
+  /// @return the index to use with Write.  Throws if there is no room.
+  int AddRecord(const std::string& name, std::string_view schema);
+
+  void Write(int record, int64_t timestamp_us, std::string_view data);
+
+  /// The number of writes which were discarded for being larger than
+  /// half the data ring.
+  uint64_t oversize() const;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+class TelemetryShmReader {
+ public:
+  /// Map the existing shared memory object @p name read only.
+  TelemetryShmReader(const std::string& name);
+  ~TelemetryShmReader();
+
+  struct Record {
+    std::string name;
+    std::string schema;
+  };
+
+  /// Records may be added by the writer at any time.  This returns
+  /// all those that exist now.
+  const std::vector<Record>& records();
+
+  /// @return the index of the named record, or -1 if there is none.
+  int Find(std::string_view name);
+
+  struct Sample {
+    int record = -1;
+    int64_t timestamp_us = 0;
+    uint64_t count = 0;
+
+    /// Points directly into shared memory.
+    std::string_view data;
+  };
+
+  /// Call @p callback with the most recent instance of @p record.
+  ///
+  /// The data passed to the callback is not copied and may be
+  /// overwritten by the writer while the callback runs.  @return true
+  /// if it was intact for the whole callback.  If false, anything
+  /// derived from it must be discarded.  Also returns false if the
+  /// record has never been written.
+  template <typename Callback>
+  bool ReadLatest(int record, Callback callback) {
+    Sample sample;
+    uint64_t position = 0;
+    if (!LocateLatest(record, &sample, &position)) { return false; }
+    callback(sample);
+    return Intact(position);
+  }
+
+  /// Call @p callback, as with ReadLatest, for every frame which has
+  /// been written since the last call.  Frames the writer overwrote
+  /// before they could be read are skipped and counted in overruns().
+  /// @return the number of intact frames delivered.
+  template <typename Callback>
+  int ReadNew(Callback callback) {
+    int result = 0;
+    Sample sample;
+    uint64_t position = 0;
+    while (NextFrame(&sample, &position)) {
+      callback(sample);
+      if (!Intact(position)) {
+        Resynchronize();
+        continue;
+      }
+      result++;
+    }
+    return result;
+  }
+
+  /// The number of times the reader fell so far behind that it lost
+  /// data.
+  uint64_t overruns() const;
+
+ private:
+  bool LocateLatest(int record, Sample*, uint64_t* position);
+  bool NextFrame(Sample*, uint64_t* position);
+  bool Intact(uint64_t position) const;
+  void Resynchronize();
+
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}
+}
@@ -0,0 +1,97 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/telemetry_shm_server.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/asio/post.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "mjlib/io/now.h"
+
+#include "base/telemetry_shm.h"
+
+namespace mjmech {
+namespace base {
+
+class TelemetryShmServer::Impl {
+ public:
+  Impl(boost::asio::io_context& context) : context_(context) {}
+
+  boost::asio::io_context& context_;
+  Parameters parameters_;
+
+  struct Record {
+    std::string name;
+    std::string schema;
+  };
+  std::vector<Record> records_;
+
+  std::unique_ptr<TelemetryShmWriter> writer_;
+
+  const boost::posix_time::ptime epoch_{boost::gregorian::date(1970, 1, 1)};
+};
+
+TelemetryShmServer::TelemetryShmServer(boost::asio::io_context& context)
+    : impl_(std::make_unique<Impl>(context)) {}
+
+TelemetryShmServer::~TelemetryShmServer() {}
+
+TelemetryShmServer::Parameters* TelemetryShmServer::parameters() {
+  return &impl_->parameters_;
+}
+
+void TelemetryShmServer::AsyncStart(mjlib::io::ErrorCallback handler) {
+  if (!impl_->parameters_.name.empty()) {
+    TelemetryShmWriter::Options options;
+    options.max_records = std::max<uint32_t>(
+        options.max_records, impl_->records_.size());
+    options.data_size =
+        static_cast<uint64_t>(impl_->parameters_.data_size_kb) * 1024;
+    impl_->writer_ = std::make_unique<TelemetryShmWriter>(
+        impl_->parameters_.name, options);
+
+    // Everything registered so far was given an index in order, which
+    // the writer will reproduce.
+    for (const auto& record : impl_->records_) {
+      impl_->writer_->AddRecord(record.name, record.schema);
+    }
+    enabled_ = true;
+  }
+
+  boost::asio::post(
+      impl_->context_,
+      std::bind(std::move(handler), mjlib::base::error_code()));
+}
+
+int TelemetryShmServer::AddRecord(const std::string& name,
+                                  std::string_view schema) {
+  const int result = impl_->records_.size();
+  impl_->records_.push_back({name, std::string(schema)});
+  if (impl_->writer_) {
+    impl_->writer_->AddRecord(name, schema);
+  }
+  return result;
+}
+
+void TelemetryShmServer::Publish(int index, std::string_view data) {
+  const auto now = mjlib::io::Now(impl_->context_);
+  impl_->writer_->Write(
+      index, (now - impl_->epoch_).total_microseconds(), data);
+}
+
+}
+}
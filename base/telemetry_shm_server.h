@@ -0,0 +1,88 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "mjlib/base/visitor.h"
+#include "mjlib/io/async_types.h"
+#include "mjlib/telemetry/binary_write_archive.h"
+
+#include "base/fast_signal.h"
+#include "base/fused_binary_writer.h"
+
+namespace mjmech {
+namespace base {
+
+/// Publishes every registered telemetry record into a
+/// TelemetryShmWriter, so that other processes on the same machine
+/// can read it with TelemetryShmReader.
+class TelemetryShmServer : boost::noncopyable {
+ public:
+  TelemetryShmServer(boost::asio::io_context&);
+  ~TelemetryShmServer();
+
+  struct Parameters {
+    // The POSIX shared memory object to create, for instance
+    // "/mjmech_telemetry".  If empty, nothing is published.
+    std::string name;
+    int data_size_kb = 8192;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(name));
+      a->Visit(MJ_NVP(data_size_kb));
+    }
+  };
+
+  Parameters* parameters();
+
+  void AsyncStart(mjlib::io::ErrorCallback handler);
+
+  template <typename T>
+  void Register(const std::string& name,
+                FastSignal<void (const T*)>* signal) {
+    const int index = AddRecord(
+        name, mjlib::telemetry::BinarySchemaArchive::template schema<T>());
+    signal->connect(
+        [this, index, writer = FusedBinaryWriter<T>()](
+            const T* data) mutable {
+          if (!enabled_) { return; }
+
+          buffer_.clear();
+          detail::StringWriteStream stream(&buffer_);
+          writer.Write(stream, data);
+          Publish(index, buffer_);
+        });
+  }
+
+ private:
+  int AddRecord(const std::string& name, std::string_view schema);
+  void Publish(int index, std::string_view data);
+
+  bool enabled_ = false;
+  std::string buffer_;
+
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}
+}
@@ -0,0 +1,115 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/fast_log.h"
+
+#include <thread>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "base/logging.h"
+
+namespace base = mjmech::base;
+
+namespace {
+struct Fixture {
+  Fixture() {
+    base::InitLogging();
+    base::GetLogMessageSignal()->connect(
+        [this](const base::TextLogMessage* message) {
+          messages.push_back(*message);
+        });
+  }
+
+  ~Fixture() {
+    base::GetLogMessageSignal()->disconnect_all_slots();
+  }
+
+  std::vector<base::TextLogMessage> messages;
+};
+
+enum class Color {
+  kRed,
+  kBlue,
+};
+}
+
+BOOST_AUTO_TEST_CASE(FastLogFormat) {
+  base::FastLogSite site("a={} b={:.2f} c={} d={} e={} {{}} f={}", 0, 0.0);
+  base::FastLogEntry entry;
+  entry.site = &site;
+  base::detail::FastLogAddArg(&entry, -3);
+  base::detail::FastLogAddArg(&entry, 1.2345);
+  base::detail::FastLogAddArg(&entry, std::string("str"));
+  base::detail::FastLogAddArg(&entry, true);
+  base::detail::FastLogAddArg(&entry, Color::kBlue);
+
+  BOOST_TEST(base::FormatFastLogEntry(entry) ==
+             "a=-3 b=1.23 c=str d=true e=1 {} f={}");
+}
+
+BOOST_FIXTURE_TEST_CASE(FastLogAppenders, Fixture) {
+  auto& log = base::GetLogInstance("fast_log_test");
+
+  const std::string name = "servo";
+  MJMECH_LOG(log, WARN, "Reply from unknown {} {}", name, 12);
+  base::FlushFastLog();
+
+  BOOST_TEST_REQUIRE(messages.size() == 1);
+  BOOST_TEST(messages[0].message == "Reply from unknown servo 12");
+  BOOST_TEST(messages[0].category == "fast_log_test");
+  BOOST_TEST(messages[0].priority == "WARN");
+
+  // Messages from other threads are delivered the same way.
+  std::thread thread([&]() {
+      MJMECH_LOG(log, ERROR, "from thread");
+    });
+  thread.join();
+  base::FlushFastLog();
+
+  BOOST_TEST_REQUIRE(messages.size() == 2);
+  BOOST_TEST(messages[1].message == "from thread");
+  BOOST_TEST(messages[1].thread != messages[0].thread);
+}
+
+BOOST_FIXTURE_TEST_CASE(FastLogRateLimit, Fixture) {
+  auto& log = base::GetLogInstance("fast_log_test");
+
+  auto emit = [&](int value) {
+    MJMECH_LOG_RATE_LIMITED(log, WARN, 0.2, "limited {}", value);
+  };
+
+  for (int i = 0; i < 10; i++) { emit(i); }
+  base::FlushFastLog();
+
+  BOOST_TEST_REQUIRE(messages.size() == 1);
+  BOOST_TEST(messages[0].message == "limited 0");
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(250));
+  emit(10);
+  base::FlushFastLog();
+
+  BOOST_TEST_REQUIRE(messages.size() == 2);
+  BOOST_TEST(messages[1].message == "limited 10 (9 similar suppressed)");
+
+  bool found = false;
+  for (const auto& stats : base::GetFastLogStats()) {
+    if (stats.format != std::string("limited {}")) { continue; }
+    found = true;
+    BOOST_TEST(stats.count == 11);
+    BOOST_TEST(stats.suppressed == 9);
+    BOOST_TEST(stats.dropped == 0);
+  }
+  BOOST_TEST(found);
+}
@@ -0,0 +1,120 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// @file
+///
+/// Compare the cost of emitting a telemetry record through
+/// boost::signals2 and through base::FastSignal.
+///
+/// The signals2 case reproduces the telemetry path as it used to be:
+/// the module's signal calls the registry's std::function, which
+/// emits the registry's own signal, which calls the log and the
+/// remote debug handlers through std::bind.  The FastSignal case is
+/// the current path, where both handlers are connected directly to
+/// the module's signal.  The handlers themselves do about as much
+/// work as the real ones do when no log file is open.
+
+#include <chrono>
+#include <functional>
+
+#include <boost/signals2/signal.hpp>
+
+#include <fmt/format.h>
+
+#include "base/fast_signal.h"
+
+namespace {
+constexpr int kIterations = 4000000;
+
+// About the size of a small status record.
+struct Record {
+  double values[16] = {};
+  int counter = 0;
+};
+
+struct LogHandler {
+  bool open = false;
+  int written = 0;
+
+  void HandleData(int identifier, const Record* data) {
+    if (!open) { return; }
+    written += identifier + data->counter;
+  }
+};
+
+struct DebugHandler {
+  Record data;
+
+  void HandleData(const Record* record) { data = *record; }
+};
+
+template <typename Emit>
+double Time(Emit emit) {
+  Record record;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; i++) {
+    record.counter = i;
+    emit(&record);
+  }
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+      kIterations;
+}
+
+double RunSignals2(LogHandler* log, DebugHandler* debug) {
+  using Signal = boost::signals2::signal<void (const Record*)>;
+
+  Signal registry_signal;
+  registry_signal.connect(std::bind(&LogHandler::HandleData, log, 3,
+                                    std::placeholders::_1));
+  registry_signal.connect(std::bind(&DebugHandler::HandleData, debug,
+                                    std::placeholders::_1));
+  std::function<void (const Record*)> registry_function =
+      [&](const Record* record) { registry_signal(record); };
+
+  Signal module_signal;
+  module_signal.connect(registry_function);
+
+  return Time([&](const Record* record) { module_signal(record); });
+}
+
+double RunFastSignal(LogHandler* log, DebugHandler* debug) {
+  mjmech::base::FastSignal<void (const Record*)> module_signal;
+  module_signal.connect([log](const Record* record) {
+      log->HandleData(3, record);
+    });
+  module_signal.connect([debug](const Record* record) {
+      debug->HandleData(record);
+    });
+
+  return Time([&](const Record* record) { module_signal(record); });
+}
+}
+
+extern "C" {
+int main(int argc, char** argv) {
+  LogHandler log;
+  DebugHandler debug;
+
+  const double signals2_ns = RunSignals2(&log, &debug);
+  const double fast_ns = RunFastSignal(&log, &debug);
+
+  fmt::print("signals2    {:8.1f} ns/emit\n", signals2_ns);
+  fmt::print("FastSignal  {:8.1f} ns/emit\n", fast_ns);
+  fmt::print("ratio       {:8.1f}x\n", signals2_ns / fast_ns);
+
+  // Keep the handlers from being optimized away.
+  return (log.written + debug.data.counter) == -1 ? 1 : 0;
+}
+}
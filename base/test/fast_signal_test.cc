@@ -0,0 +1,52 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/fast_signal.h"
+
+#include <memory>
+#include <vector>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using mjmech::base::FastSignal;
+
+BOOST_AUTO_TEST_CASE(FastSignalBasic) {
+  FastSignal<void (const int*)> dut;
+  BOOST_TEST(dut.empty());
+
+  // Emitting with no slots is fine.
+  const int value = 3;
+  dut(&value);
+
+  std::vector<int> calls;
+  dut.connect([&](const int* v) { calls.push_back(*v); });
+  dut.connect([&](const int* v) { calls.push_back(*v * 10); });
+  BOOST_TEST(dut.num_slots() == 2);
+
+  dut(&value);
+  BOOST_TEST(calls == (std::vector<int>{3, 30}));
+}
+
+BOOST_AUTO_TEST_CASE(FastSignalOwnsFunctors) {
+  auto counter = std::make_shared<int>(0);
+  {
+    FastSignal<void (int)> dut;
+    dut.connect([counter](int v) { *counter += v; });
+    BOOST_TEST(counter.use_count() == 2);
+    dut(2);
+    dut(5);
+    BOOST_TEST(*counter == 7);
+  }
+  BOOST_TEST(counter.use_count() == 1);
+}
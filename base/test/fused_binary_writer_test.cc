@@ -0,0 +1,128 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/fused_binary_writer.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/fast_stream.h"
+#include "mjlib/base/visitor.h"
+#include "mjlib/telemetry/binary_write_archive.h"
+
+#include "base/point3d.h"
+
+using namespace mjmech::base;
+
+namespace {
+enum class Color : int8_t {
+  kRed = -1,
+  kGreen = 3,
+  kBlue = 200 - 256,
+};
+
+struct Inner {
+  int id = 0;
+  double angle = 0.0;
+  Point3D position;
+  std::optional<double> limit;
+  Color color = Color::kRed;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(id));
+    a->Visit(MJ_NVP(angle));
+    a->Visit(MJ_NVP(position));
+    a->Visit(MJ_NVP(limit));
+    a->Visit(MJ_NVP(color));
+  }
+};
+
+struct Outer {
+  boost::posix_time::ptime timestamp;
+  bool flag = false;
+  uint16_t count = 0;
+  std::array<float, 3> fixed = {};
+  std::vector<Inner> inners;
+  std::vector<double> doubles;
+  std::string text;
+  Inner single;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(timestamp));
+    a->Visit(MJ_NVP(flag));
+    a->Visit(MJ_NVP(count));
+    a->Visit(MJ_NVP(fixed));
+    a->Visit(MJ_NVP(inners));
+    a->Visit(MJ_NVP(doubles));
+    a->Visit(MJ_NVP(text));
+    a->Visit(MJ_NVP(single));
+  }
+};
+
+std::string Reference(const Outer& value) {
+  mjlib::base::FastOStringStream stream;
+  mjlib::telemetry::BinaryWriteArchive(stream).Accept(&value);
+  return stream.str();
+}
+
+std::string Fused(FusedBinaryWriter<Outer>* dut, const Outer& value) {
+  mjlib::base::FastOStringStream stream;
+  dut->Write(stream, &value);
+  return stream.str();
+}
+}
+
+BOOST_AUTO_TEST_CASE(FusedBinaryWriterMatchesArchive) {
+  FusedBinaryWriter<Outer> dut;
+
+  Outer value;
+  BOOST_TEST(Fused(&dut, value) == Reference(value));
+
+  value.timestamp = boost::posix_time::ptime(
+      boost::gregorian::date(2020, 5, 4),
+      boost::posix_time::milliseconds(1234));
+  value.flag = true;
+  value.count = 1000;
+  value.fixed = {1.0f, 2.0f, -3.0f};
+  for (int i = 0; i < 12; i++) {
+    Inner inner;
+    inner.id = i;
+    inner.angle = i * 1.5;
+    inner.position = Point3D(i, -i, 2 * i);
+    if (i % 2) { inner.limit = 0.25 * i; }
+    inner.color = (i % 3) == 0 ? Color::kGreen : Color::kBlue;
+    value.inners.push_back(inner);
+  }
+  for (int i = 0; i < 200; i++) { value.doubles.push_back(i); }
+  value.text = std::string(300, 'x');
+  value.single.limit = 4.0;
+
+  BOOST_TEST(Fused(&dut, value) == Reference(value));
+  BOOST_TEST(dut.fused());
+
+  // Everything except the header fields of the outer structure, and
+  // the optional and enum of the inner structure, should be fused.
+  const auto& inner_plan = mjmech::base::detail::GetPlan<Inner>();
+  BOOST_TEST(inner_plan.fused_bytes() ==
+             sizeof(int) + sizeof(double) + 3 * sizeof(double));
+}
+
+BOOST_AUTO_TEST_CASE(FusedBinaryWriterPlanMerges) {
+  // A structure of only fixed size fields is a single copy.
+  const auto& plan = mjmech::base::detail::GetPlan<Point3D>();
+  BOOST_TEST(plan.ops.size() == 1);
+  BOOST_TEST(plan.fused_bytes() == sizeof(Point3D));
+}
@@ -0,0 +1,111 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// @file
+///
+/// Compare the per-cycle cost of the timing bookkeeping in a control
+/// loop when done with ptime and with base::MonoClock.
+///
+/// Each simulated cycle reads the clock five times, as ControlTiming
+/// does, and then computes the six durations reported in its Status.
+
+#include <chrono>
+
+#include <boost/asio/io_context.hpp>
+
+#include <fmt/format.h>
+
+#include "mjlib/io/now.h"
+
+#include "base/common.h"
+#include "base/mono_time.h"
+
+namespace {
+constexpr int kIterations = 2000000;
+
+template <typename Cycle>
+double Time(Cycle cycle) {
+  double sum = 0.0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; i++) {
+    sum += cycle();
+  }
+  const auto end = std::chrono::steady_clock::now();
+  if (sum < 0.0) { fmt::print("impossible\n"); }
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+      kIterations;
+}
+
+double RunPtime(boost::asio::io_context& context) {
+  using mjmech::base::ConvertDurationToSeconds;
+  boost::posix_time::ptime last = mjlib::io::Now(context);
+
+  return Time([&]() {
+      const auto start = mjlib::io::Now(context);
+      const auto query = mjlib::io::Now(context);
+      const auto status = mjlib::io::Now(context);
+      const auto control = mjlib::io::Now(context);
+      const auto command = mjlib::io::Now(context);
+
+      const double result =
+          ConvertDurationToSeconds(query - start) +
+          ConvertDurationToSeconds(status - query) +
+          ConvertDurationToSeconds(control - status) +
+          ConvertDurationToSeconds(command - control) +
+          ConvertDurationToSeconds(command - start) +
+          ConvertDurationToSeconds(start - last);
+      last = start;
+      return result;
+    });
+}
+
+double RunMono(boost::asio::io_context& context) {
+  using mjmech::base::MonoSeconds;
+  mjmech::base::MonoClock clock(context);
+  auto last = clock.Now();
+
+  return Time([&]() {
+      const auto start = clock.Now();
+      const auto query = clock.Now();
+      const auto status = clock.Now();
+      const auto control = clock.Now();
+      const auto command = clock.Now();
+
+      const double result =
+          MonoSeconds(query, start) +
+          MonoSeconds(status, query) +
+          MonoSeconds(control, status) +
+          MonoSeconds(command, control) +
+          MonoSeconds(command, start) +
+          MonoSeconds(start, last);
+      last = start;
+      return result;
+    });
+}
+}
+
+extern "C" {
+int main(int argc, char** argv) {
+  boost::asio::io_context context;
+
+  const double ptime_ns = RunPtime(context);
+  const double mono_ns = RunMono(context);
+
+  fmt::print("ptime      {:8.1f} ns/cycle\n", ptime_ns);
+  fmt::print("MonoClock  {:8.1f} ns/cycle\n", mono_ns);
+  fmt::print("ratio      {:8.1f}x\n", ptime_ns / mono_ns);
+
+  return 0;
+}
+}
@@ -0,0 +1,76 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/mono_time.h"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+using mjmech::base::MonoClock;
+using mjmech::base::MonoSeconds;
+using mjmech::base::MonoTime;
+
+BOOST_AUTO_TEST_CASE(MonoTimeArithmetic) {
+  const MonoTime unset;
+  BOOST_TEST(!unset.is_set());
+
+  const auto a = MonoTime::FromNanoseconds(1000000000);
+  const auto b = a + mjmech::base::MonoNanoseconds(0.25);
+  BOOST_TEST(b.is_set());
+  BOOST_TEST(a.nanoseconds() < b.nanoseconds());
+  BOOST_TEST((b - a) == 250000000);
+  BOOST_TEST(MonoSeconds(b, a) == 0.25);
+  BOOST_TEST(MonoSeconds(b, unset) == 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(MonoClockMonotonic) {
+  boost::asio::io_context context;
+  MonoClock dut(context);
+
+  const auto wall = boost::posix_time::microsec_clock::universal_time();
+  const auto start = dut.Now();
+  const auto end = dut.Now();
+  BOOST_TEST(start.is_set());
+  BOOST_TEST(end.nanoseconds() >= start.nanoseconds());
+
+  // The ptime conversion should agree with the wall clock.
+  const auto error = dut.ToPtime(start) - wall;
+  BOOST_TEST(std::abs(error.total_milliseconds()) < 100);
+  BOOST_TEST(dut.ToPtime(MonoTime()).is_not_a_date_time());
+
+  // Times long after the offset was sampled cause it to be sampled
+  // again, which should not change the result.
+  const auto later = dut.ToPtime(start + 1500000000) - wall;
+  BOOST_TEST(std::abs(later.total_milliseconds() - 1500) < 100);
+  const auto again = dut.ToPtime(start) - wall;
+  BOOST_TEST(std::abs(again.total_milliseconds()) < 100);
+}
+
+BOOST_AUTO_TEST_CASE(MonoClockDebugTime) {
+  boost::asio::io_context context;
+  auto* const debug = mjlib::io::DebugDeadlineService::Install(context);
+  const auto time = boost::posix_time::ptime(
+      boost::gregorian::date(2030, 1, 1),
+      boost::posix_time::milliseconds(1500));
+  debug->SetTime(time);
+
+  MonoClock dut(context);
+  const auto start = dut.Now();
+  BOOST_TEST(dut.ToPtime(start) == time);
+
+  debug->SetTime(time + boost::posix_time::milliseconds(10));
+  BOOST_TEST(MonoSeconds(dut.Now(), start) == 0.01,
+             boost::test_tools::tolerance(1e-9));
+  BOOST_TEST(dut.PtimeNow() == time + boost::posix_time::milliseconds(10));
+}
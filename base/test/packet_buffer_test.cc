@@ -0,0 +1,66 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/packet_buffer.h"
+
+#include <boost/test/auto_unit_test.hpp>
+
+using mjmech::base::PacketBuffer;
+using mjmech::base::PacketBufferPool;
+
+BOOST_AUTO_TEST_CASE(PacketBufferShare) {
+  PacketBufferPool pool(64);
+  BOOST_TEST(pool.free_count() == 0);
+
+  {
+    auto buffer = pool.Copy("hello");
+    BOOST_TEST(buffer.view() == "hello");
+    BOOST_TEST(buffer.use_count() == 1);
+
+    PacketBuffer copy = buffer;
+    BOOST_TEST(buffer.use_count() == 2);
+    BOOST_TEST(static_cast<const void*>(copy.data()) ==
+               static_cast<const void*>(buffer.data()));
+
+    PacketBuffer moved = std::move(copy);
+    BOOST_TEST(!copy);
+    BOOST_TEST(moved.use_count() == 2);
+  }
+
+  // The storage went back to the pool, and is reused.
+  BOOST_TEST(pool.free_count() == 1);
+  auto again = pool.Allocate(10);
+  BOOST_TEST(pool.free_count() == 0);
+  BOOST_TEST(again.size() == 10);
+  BOOST_TEST(again.capacity() == 64);
+}
+
+BOOST_AUTO_TEST_CASE(PacketBufferLarge) {
+  PacketBufferPool pool(16);
+  {
+    auto buffer = pool.Allocate(100);
+    BOOST_TEST(buffer.capacity() == 100);
+  }
+  // Oversize buffers are not kept.
+  BOOST_TEST(pool.free_count() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(PacketBufferOutlivesPool) {
+  PacketBuffer buffer;
+  {
+    PacketBufferPool pool;
+    buffer = pool.Copy("data");
+  }
+  BOOST_TEST(buffer.view() == "data");
+}
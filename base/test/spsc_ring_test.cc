@@ -0,0 +1,75 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/spsc_ring.h"
+
+#include <thread>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using mjmech::base::SpscRing;
+
+BOOST_AUTO_TEST_CASE(SpscRingBasic) {
+  SpscRing<int, 4> dut;
+  BOOST_TEST(dut.empty());
+
+  int value = 0;
+  BOOST_TEST(!dut.Pop(&value));
+
+  for (int i = 0; i < 4; i++) {
+    BOOST_TEST(dut.Push(i));
+  }
+  BOOST_TEST(dut.size() == 4);
+  BOOST_TEST(!dut.Push(10));
+
+  for (int i = 0; i < 4; i++) {
+    BOOST_TEST(dut.Pop(&value));
+    BOOST_TEST(value == i);
+  }
+  BOOST_TEST(dut.empty());
+
+  // Wrap around a few times.
+  for (int i = 0; i < 10; i++) {
+    BOOST_TEST(dut.Push(i));
+    BOOST_TEST(dut.Push(i + 100));
+    BOOST_TEST(dut.Pop(&value));
+    BOOST_TEST(value == i);
+    BOOST_TEST(dut.Pop(&value));
+    BOOST_TEST(value == i + 100);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(SpscRingThreaded) {
+  SpscRing<int, 16> dut;
+  constexpr int kCount = 100000;
+
+  std::thread producer([&]() {
+      for (int i = 0; i < kCount; i++) {
+        while (!dut.Push(i)) { std::this_thread::yield(); }
+      }
+    });
+
+  int expected = 0;
+  bool in_order = true;
+  while (expected < kCount) {
+    int value = 0;
+    if (!dut.Pop(&value)) { continue; }
+    if (value != expected) { in_order = false; }
+    expected++;
+  }
+  producer.join();
+
+  BOOST_TEST(in_order);
+  BOOST_TEST(dut.empty());
+}
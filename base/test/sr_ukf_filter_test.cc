@@ -0,0 +1,170 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/sr_ukf_filter.h"
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "base/ukf_filter.h"
+
+namespace {
+typedef mjmech::base::SrUkfFilter<double, 3> SrUkfFilter;
+
+SrUkfFilter::State TestProcess(const SrUkfFilter::State& s, double dt_s) {
+  SrUkfFilter::State delta;
+  delta(0, 0) = 0.;
+  delta(1, 0) = s(0) * dt_s;
+  delta(2, 0) = s(1) * dt_s + 0.5 * s(0) * dt_s * dt_s;
+  return s + delta;
+}
+
+Eigen::Matrix<double, 1, 1> TestMeasurement(const SrUkfFilter::State& s) {
+  Eigen::Matrix<double, 1, 1> r;
+  r(0, 0) = s(2);
+  return r;
+}
+
+SrUkfFilter::Covariance MakeDiagonal(double a, double b, double c) {
+  SrUkfFilter::Covariance result = SrUkfFilter::Covariance::Zero();
+  result(0, 0) = a;
+  result(1, 1) = b;
+  result(2, 2) = c;
+  return result;
+}
+}
+
+BOOST_AUTO_TEST_CASE(BasicSrUkfFilter) {
+  SrUkfFilter dut(SrUkfFilter::State(0.2, 0.0, 0.0),
+                  MakeDiagonal(1.0, 2.0, 3.0),
+                  MakeDiagonal(0.1, 0.1, 0.1));
+
+  Eigen::Matrix<double, 1, 1> meas;
+  meas(0, 0) = 0.5;
+  Eigen::Matrix<double, 1, 1> meas_noise;
+  meas_noise(0, 0) = 2.0;
+
+  for (int i = 0; i < 200; i++) {
+    meas(0, 0) += 0.5;
+    dut.UpdateState(0.1, TestProcess);
+    dut.UpdateMeasurement(TestMeasurement, meas, meas_noise);
+  }
+
+  BOOST_CHECK_SMALL(dut.state()(2) - meas(0), 1e-2);
+  BOOST_CHECK_SMALL(dut.state()(1) - 0.5 / 0.1, 1e-2);
+  BOOST_CHECK(dut.covariance()(0, 0) > 0.0);
+  BOOST_CHECK_EQUAL(dut.downdate_failures(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(SrUkfFilterBatch) {
+  // Evaluating the functions across all sigma points at once must
+  // give the same answer as evaluating them one at a time.
+  SrUkfFilter single(SrUkfFilter::State(0.2, 0.0, 0.0),
+                     MakeDiagonal(1.0, 2.0, 3.0),
+                     MakeDiagonal(0.1, 0.1, 0.1));
+  SrUkfFilter batch = single;
+
+  auto batch_process = [](const SrUkfFilter::SigmaPoints& s, double dt_s) {
+    SrUkfFilter::SigmaPoints result = s;
+    result.row(1) += s.row(0) * dt_s;
+    result.row(2) += s.row(1) * dt_s + 0.5 * s.row(0) * dt_s * dt_s;
+    return result;
+  };
+  auto batch_measurement = [](const SrUkfFilter::SigmaPoints& s) {
+    Eigen::Matrix<double, 1, SrUkfFilter::kNumSigma> result = s.row(2);
+    return result;
+  };
+
+  Eigen::Matrix<double, 1, 1> meas;
+  meas(0, 0) = 0.5;
+  Eigen::Matrix<double, 1, 1> meas_noise;
+  meas_noise(0, 0) = 2.0;
+
+  for (int i = 0; i < 20; i++) {
+    meas(0, 0) += 0.5;
+    single.UpdateState(0.1, TestProcess);
+    single.UpdateMeasurement(TestMeasurement, meas, meas_noise);
+    batch.UpdateStateBatch(0.1, batch_process);
+    batch.UpdateMeasurementBatch(batch_measurement, meas, meas_noise);
+  }
+
+  for (int i = 0; i < 3; i++) {
+    BOOST_CHECK_SMALL(single.state()(i) - batch.state()(i), 1e-9);
+    for (int j = 0; j < 3; j++) {
+      BOOST_CHECK_SMALL(single.sqrt_covariance()(i, j) -
+                        batch.sqrt_covariance()(i, j), 1e-9);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(SrUkfFilterMatchesUkfFilter) {
+  // With a linear process and measurement, both filters reduce to
+  // the Kalman filter and should agree closely.
+  typedef mjmech::base::UkfFilter<double, 3> UkfFilter;
+
+  auto process = [](const SrUkfFilter::State& s, double dt_s) {
+    SrUkfFilter::State result = s;
+    result(1) += s(0) * dt_s;
+    result(2) += s(1) * dt_s;
+    return result;
+  };
+
+  const auto cov = MakeDiagonal(1.0, 2.0, 3.0);
+  const auto proc = MakeDiagonal(0.1, 0.1, 0.1);
+  UkfFilter reference(UkfFilter::State(0.2, 0.0, 0.0), cov, proc);
+  SrUkfFilter dut(SrUkfFilter::State(0.2, 0.0, 0.0), cov, proc);
+
+  Eigen::Matrix<double, 1, 1> meas;
+  meas(0, 0) = 0.0;
+  Eigen::Matrix<double, 1, 1> meas_noise;
+  meas_noise(0, 0) = 2.0;
+
+  for (int i = 0; i < 50; i++) {
+    meas(0, 0) += 0.3;
+    reference.UpdateState(0.1, process);
+    reference.UpdateMeasurement(TestMeasurement, meas, meas_noise);
+    dut.UpdateState(0.1, process);
+    dut.UpdateMeasurement(TestMeasurement, meas, meas_noise);
+  }
+
+  const SrUkfFilter::Covariance P = dut.covariance();
+  for (int i = 0; i < 3; i++) {
+    BOOST_CHECK_SMALL(reference.state()(i) - dut.state()(i), 1e-6);
+    for (int j = 0; j < 3; j++) {
+      BOOST_CHECK_SMALL(reference.covariance()(i, j) - P(i, j), 1e-6);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(SrUkfFilterCholeskyUpdate) {
+  SrUkfFilter::Covariance P;
+  P << 4.0, 1.0, 0.5,
+       1.0, 3.0, 0.2,
+       0.5, 0.2, 2.0;
+  SrUkfFilter::State x(0.3, -0.2, 0.7);
+
+  SrUkfFilter::Covariance L = P.llt().matrixL();
+  SrUkfFilter::State scratch = x;
+  BOOST_TEST(SrUkfFilter::CholeskyUpdate(&L, &scratch, 1.0));
+  const SrUkfFilter::Covariance updated = P + x * x.transpose();
+  BOOST_CHECK_SMALL(
+      (L * L.transpose() - updated).cwiseAbs().maxCoeff(), 1e-12);
+
+  scratch = x;
+  BOOST_TEST(SrUkfFilter::CholeskyUpdate(&L, &scratch, -1.0));
+  BOOST_CHECK_SMALL((L * L.transpose() - P).cwiseAbs().maxCoeff(), 1e-12);
+
+  // A downdate which would leave the matrix indefinite must fail.
+  scratch = SrUkfFilter::State(10.0, 0.0, 0.0);
+  BOOST_TEST(!SrUkfFilter::CholeskyUpdate(&L, &scratch, -1.0));
+}
@@ -0,0 +1,120 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/telemetry_layout.h"
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/visitor.h"
+
+#include "base/point3d.h"
+
+using mjmech::base::TelemetryLayoutWriter;
+
+namespace {
+enum class Color : int8_t {
+  kRed = -1,
+  kGreen = 3,
+};
+
+struct Inner {
+  int id = 0;
+  std::optional<double> limit;
+  Color color = Color::kRed;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(id));
+    a->Visit(MJ_NVP(limit));
+    a->Visit(MJ_NVP(color));
+  }
+};
+
+struct Outer {
+  boost::posix_time::ptime timestamp;
+  bool flag = false;
+  uint16_t count = 0;
+  std::array<float, 3> fixed = {};
+  std::vector<Inner> inners;
+  std::string text;
+  mjmech::base::Point3D position;
+  boost::posix_time::time_duration age;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(timestamp));
+    a->Visit(MJ_NVP(flag));
+    a->Visit(MJ_NVP(count));
+    a->Visit(MJ_NVP(fixed));
+    a->Visit(MJ_NVP(inners));
+    a->Visit(MJ_NVP(text));
+    a->Visit(MJ_NVP(position));
+    a->Visit(MJ_NVP(age));
+  }
+};
+
+struct Opaque {
+  int value = 0;
+};
+
+struct WithOpaque {
+  Opaque opaque;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(opaque));
+  }
+};
+}
+
+namespace mjlib {
+namespace base {
+template <>
+struct IsEnum<Color> {
+  static constexpr bool value = true;
+
+  using M = Color;
+  static std::map<M, const char*> map() {
+    return {
+      { M::kRed, "red" },
+      { M::kGreen, "green" },
+    };
+  }
+};
+}
+}
+
+BOOST_AUTO_TEST_CASE(TelemetryLayoutBasicTest) {
+  const auto layout = TelemetryLayoutWriter::Write<Outer>();
+  BOOST_TEST(layout ==
+             "{\"object\":["
+             "[\"timestamp\",\"timestamp\"],"
+             "[\"flag\",\"bool\"],"
+             "[\"count\",\"u16\"],"
+             "[\"fixed\",{\"array\":[3,\"f32\"]}],"
+             "[\"inners\",{\"vector\":{\"object\":["
+             "[\"id\",\"i32\"],"
+             "[\"limit\",{\"optional\":\"f64\"}],"
+             "[\"color\",{\"enum\":{\"-1\":\"red\",\"3\":\"green\"}}]"
+             "]}}],"
+             "[\"text\",\"string\"],"
+             "[\"position\",{\"array\":[3,\"f64\"]}],"
+             "[\"age\",\"duration\"]"
+             "]}");
+}
+
+BOOST_AUTO_TEST_CASE(TelemetryLayoutUnknownTest) {
+  const auto layout = TelemetryLayoutWriter::Write<WithOpaque>();
+  BOOST_TEST(layout == "{\"object\":[[\"opaque\",\"unknown\"]]}");
+}
@@ -0,0 +1,116 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// @file
+///
+/// Measure the cost to the writer of publishing telemetry records into
+/// shared memory, both alone and with readers streaming and polling
+/// the latest value at the same time, and how much of the stream the
+/// readers manage to see.
+///
+/// The readers poll continuously without pausing, which is the worst
+/// case for cache line contention with the writer.
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "base/telemetry_shm.h"
+
+namespace {
+constexpr int kIterations = 200000;
+
+using mjmech::base::TelemetryShmReader;
+using mjmech::base::TelemetryShmWriter;
+
+struct Result {
+  double write_ns = 0.0;
+  uint64_t streamed = 0;
+  uint64_t overruns = 0;
+  uint64_t latest = 0;
+};
+
+Result Run(std::size_t record_size, bool with_readers) {
+  const std::string name =
+      "/mjmech_shm_benchmark_" + std::to_string(::getpid());
+  TelemetryShmWriter writer(name);
+  const int record = writer.AddRecord("record", "");
+
+  std::atomic<bool> done{false};
+  Result result;
+
+  std::vector<std::thread> readers;
+  if (with_readers) {
+    readers.emplace_back([&]() {
+        TelemetryShmReader reader(name);
+        uint64_t bytes = 0;
+        while (!done.load()) {
+          result.streamed += reader.ReadNew([&](const auto& sample) {
+              bytes += sample.data.size();
+            });
+        }
+        result.streamed += reader.ReadNew([](const auto&) {});
+        result.overruns = reader.overruns();
+      });
+    readers.emplace_back([&]() {
+        TelemetryShmReader reader(name);
+        while (!done.load()) {
+          if (reader.ReadLatest(record, [](const auto&) {})) {
+            result.latest++;
+          }
+        }
+      });
+    // Give the readers a chance to map the region.
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+
+  const std::string data(record_size, 'x');
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; i++) {
+    writer.Write(record, i, data);
+  }
+  const auto end = std::chrono::steady_clock::now();
+
+  done.store(true);
+  for (auto& thread : readers) { thread.join(); }
+
+  result.write_ns =
+      std::chrono::duration<double, std::nano>(end - start).count() /
+      kIterations;
+  return result;
+}
+}
+
+extern "C" {
+int main(int argc, char** argv) {
+  fmt::print("{:>8} {:>10} {:>12} {:>12} {:>10} {:>12}\n",
+             "size", "readers", "write ns", "streamed", "overruns",
+             "latest");
+  for (const std::size_t size : {64, 512, 4096}) {
+    for (const bool with_readers : {false, true}) {
+      const auto result = Run(size, with_readers);
+      fmt::print("{:>8} {:>10} {:>12.1f} {:>12} {:>10} {:>12}\n",
+                 size, with_readers ? "2" : "0", result.write_ns,
+                 result.streamed, result.overruns, result.latest);
+    }
+  }
+  return 0;
+}
+}
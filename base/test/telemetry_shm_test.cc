@@ -0,0 +1,129 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/telemetry_shm.h"
+
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjmech::base;
+
+namespace {
+std::string MakeName() {
+  return "/mjmech_shm_test_" + std::to_string(::getpid());
+}
+}
+
+BOOST_AUTO_TEST_CASE(TelemetryShmRecordsAndLatest) {
+  const auto name = MakeName();
+  TelemetryShmWriter writer(name);
+  const int foo = writer.AddRecord("foo", "foo_schema");
+
+  TelemetryShmReader reader(name);
+  BOOST_TEST(reader.records().size() == 1);
+  BOOST_TEST(reader.records()[0].name == "foo");
+  BOOST_TEST(reader.records()[0].schema == "foo_schema");
+
+  // Records added after the reader opened are still found.
+  const int bar = writer.AddRecord("bar", "bar_schema");
+  BOOST_TEST(reader.Find("bar") == bar);
+  BOOST_TEST(reader.Find("baz") == -1);
+
+  // Nothing has been written yet.
+  BOOST_TEST(!reader.ReadLatest(foo, [](const auto&) {}));
+
+  writer.Write(foo, 10, "first");
+  writer.Write(bar, 11, "other");
+  writer.Write(foo, 12, "second");
+
+  std::string data;
+  int64_t timestamp_us = 0;
+  uint64_t count = 0;
+  BOOST_TEST(reader.ReadLatest(foo, [&](const auto& sample) {
+        data = std::string(sample.data);
+        timestamp_us = sample.timestamp_us;
+        count = sample.count;
+      }));
+  BOOST_TEST(data == "second");
+  BOOST_TEST(timestamp_us == 12);
+  BOOST_TEST(count == 2);
+}
+
+BOOST_AUTO_TEST_CASE(TelemetryShmStream) {
+  const auto name = MakeName();
+  TelemetryShmWriter::Options options;
+  options.data_size = 4096;
+  TelemetryShmWriter writer(name, options);
+  const int record = writer.AddRecord("foo", "");
+
+  TelemetryShmReader reader(name);
+
+  // Write enough to wrap the ring several times, reading as we go.
+  std::vector<std::string> received;
+  int expected = 0;
+  for (int i = 0; i < 500; i++) {
+    writer.Write(record, i, std::string(1 + (i % 37), 'a' + (i % 26)));
+    if ((i % 7) == 6) {
+      reader.ReadNew([&](const auto& sample) {
+          received.push_back(std::string(sample.data));
+        });
+    }
+  }
+  reader.ReadNew([&](const auto& sample) {
+      received.push_back(std::string(sample.data));
+    });
+
+  BOOST_TEST(reader.overruns() == 0);
+  BOOST_TEST_REQUIRE(received.size() == 500);
+  for (const auto& item : received) {
+    BOOST_TEST(item == std::string(1 + (expected % 37),
+                                   'a' + (expected % 26)));
+    expected++;
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TelemetryShmOverrun) {
+  const auto name = MakeName();
+  TelemetryShmWriter::Options options;
+  options.data_size = 4096;
+  TelemetryShmWriter writer(name, options);
+  const int record = writer.AddRecord("foo", "");
+
+  TelemetryShmReader reader(name);
+
+  // Lap the reader.
+  for (int i = 0; i < 100; i++) {
+    writer.Write(record, i, std::string(100, 'x'));
+  }
+  int count = 0;
+  reader.ReadNew([&](const auto&) { count++; });
+  BOOST_TEST(reader.overruns() == 1);
+  BOOST_TEST(count == 0);
+
+  // After resynchronizing, new data comes through.
+  writer.Write(record, 100, "fresh");
+  std::string data;
+  BOOST_TEST(reader.ReadNew([&](const auto& sample) {
+        data = std::string(sample.data);
+      }) == 1);
+  BOOST_TEST(data == "fresh");
+
+  // Oversize writes are dropped.
+  writer.Write(record, 101, std::string(3000, 'y'));
+  BOOST_TEST(writer.oversize() == 1);
+}
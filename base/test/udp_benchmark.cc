@@ -0,0 +1,116 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// @file
+///
+/// Measure UdpSocket throughput over loopback, with and without
+/// batched sendmmsg/recvmmsg I/O.
+///
+/// The sender keeps a fixed window of packets outstanding, refilling
+/// it from the receive handler, so the result is the rate at which
+/// packets can be moved end to end rather than how fast the kernel
+/// can drop them.
+
+#include <chrono>
+#include <string>
+
+#include <boost/asio/io_context.hpp>
+
+#include <fmt/format.h>
+
+#include "base/logging.h"
+#include "base/udp_socket.h"
+
+namespace {
+constexpr int kWindow = 128;
+constexpr auto kDuration = std::chrono::seconds(2);
+
+struct Result {
+  double packets_per_s = 0.0;
+  double mbit_per_s = 0.0;
+};
+
+Result Run(bool batch_io, std::size_t packet_size) {
+  using mjmech::base::UdpSocket;
+
+  boost::asio::io_context context;
+  auto log = mjmech::base::GetLogInstance("udp_benchmark");
+
+  UdpSocket::Parameters parameters;
+  parameters.batch_io = batch_io;
+  parameters.max_tx_pending = 4 * kWindow;
+
+  UdpSocket rx(context.get_executor(), log, "127.0.0.1:0", false, parameters);
+  UdpSocket tx(context.get_executor(), log, "127.0.0.1:0", false, parameters);
+  const auto destination = rx.local_endpoint();
+
+  const std::string payload(packet_size, 'x');
+  int64_t sent = 0;
+  int64_t received = 0;
+  int64_t bytes = 0;
+
+  auto pump = [&]() {
+    while (sent - received < kWindow) {
+      tx.SendTo(payload, destination);
+      sent++;
+    }
+  };
+
+  rx.StartRead();
+  rx.data_signal()->connect(
+      [&](std::string_view data, const UdpSocket::endpoint&) {
+        received++;
+        bytes += data.size();
+        if (sent - received < kWindow / 2) { pump(); }
+      });
+
+  pump();
+
+  const auto start = std::chrono::steady_clock::now();
+  auto last_received = received;
+  while (std::chrono::steady_clock::now() - start < kDuration) {
+    context.run_for(std::chrono::milliseconds(20));
+    if (received == last_received) {
+      // Something was dropped.  Start a new window.
+      sent = received;
+      pump();
+    }
+    last_received = received;
+  }
+  const double elapsed_s = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+
+  Result result;
+  result.packets_per_s = received / elapsed_s;
+  result.mbit_per_s = bytes * 8.0 / elapsed_s / 1e6;
+  return result;
+}
+}
+
+extern "C" {
+int main(int argc, char** argv) {
+  for (const std::size_t size : {64, 512, 1400}) {
+    const auto single = Run(false, size);
+    const auto batch = Run(true, size);
+
+    fmt::print("{:5} bytes  single {:9.0f} pkt/s {:8.1f} Mbit/s  "
+               "batch {:9.0f} pkt/s {:8.1f} Mbit/s  ratio {:.2f}x\n",
+               size,
+               single.packets_per_s, single.mbit_per_s,
+               batch.packets_per_s, batch.mbit_per_s,
+               batch.packets_per_s / single.packets_per_s);
+  }
+  return 0;
+}
+}
@@ -95,7 +95,7 @@ class SocketTesterBase : boost::noncopyable {
 
 
  protected:
-  void HandleIncomingPacket(const std::string& data,
+  void HandleIncomingPacket(std::string_view data,
                             const std::string& sender) {
     stats_["rx_count"]++;
     stats_["rx_size"] += data.size();
@@ -105,7 +105,7 @@ class SocketTesterBase : boost::noncopyable {
       return;
     }
 
-    std::string preview = data.substr(0, 16);
+    std::string preview(data.substr(0, 16));
     for (size_t i=0; i<preview.length(); i++) {
       if (preview[i] < 32 || preview[i] > 127) {
         preview[i] = '?';
@@ -223,7 +223,7 @@ class SocketTester: public SocketTesterBase {
     if (parameters_.do_recv) {
       socket_->StartRead();
       socket_->data_signal()->connect(
-          [=](const std::string& data, const UdpSocket::endpoint& addr) {
+          [=](std::string_view data, const UdpSocket::endpoint& addr) {
             std::string sender = boost::lexical_cast<std::string>(addr);
             HandleIncomingPacket(data, sender);
           });
@@ -295,7 +295,7 @@ class LinkTester: public SocketTesterBase {
                         parameters_.opts));
 
     link_->data_signal()->connect(
-        [=](const std::string& data, const UdpDataLink::PeerInfo& cli) {
+        [=](std::string_view data, const UdpDataLink::PeerInfo& cli) {
           HandleIncomingPacket(data, boost::lexical_cast<std::string>(cli.id));
         });
 
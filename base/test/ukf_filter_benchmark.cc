@@ -0,0 +1,191 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// @file
+///
+/// Compare the cost and numerical robustness of UkfFilter and
+/// SrUkfFilter for state sizes from 3 through 15.
+///
+/// The process is a lightly damped chain of integrators with a mild
+/// nonlinearity, observed through its first and last states.  For
+/// each size we report the time per predict+update step, and for a
+/// deliberately ill-conditioned run (large spread of initial
+/// variances and nearly noise-free measurements), how many steps left
+/// the covariance not positive definite.
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <utility>
+
+#include <fmt/format.h>
+
+#include "base/sr_ukf_filter.h"
+#include "base/ukf_filter.h"
+
+namespace {
+constexpr int kIterations = 2000;
+constexpr double kDt = 0.01;
+
+template <int N>
+struct Model {
+  typedef Eigen::Matrix<double, N, 1> State;
+  typedef Eigen::Matrix<double, N, N> Covariance;
+  typedef Eigen::Matrix<double, 2, 1> Measurement;
+
+  static State Process(const State& s, double dt_s) {
+    State result = s;
+    result(0) += dt_s * (-0.1 * s(0) + 0.05 * std::sin(s(N - 1)));
+    for (int i = 1; i < N; i++) {
+      result(i) += dt_s * (s(i - 1) - 0.1 * s(i));
+    }
+    return result;
+  }
+
+  template <typename Sigma>
+  static Sigma ProcessBatch(const Sigma& s, double dt_s) {
+    Sigma result = s;
+    result.row(0) += dt_s * (-0.1 * s.row(0) +
+                             0.05 * s.row(N - 1).array().sin().matrix());
+    result.template bottomRows<N - 1>() +=
+        dt_s * (s.template topRows<N - 1>() -
+                0.1 * s.template bottomRows<N - 1>());
+    return result;
+  }
+
+  static Measurement Measure(const State& s) {
+    return Measurement(s(0), s(N - 1));
+  }
+
+  template <typename Sigma>
+  static Eigen::Matrix<double, 2, Sigma::ColsAtCompileTime>
+  MeasureBatch(const Sigma& s) {
+    Eigen::Matrix<double, 2, Sigma::ColsAtCompileTime> result;
+    result.row(0) = s.row(0);
+    result.row(1) = s.row(N - 1);
+    return result;
+  }
+};
+
+struct Result {
+  double us_per_step = 0.0;
+  int indefinite_steps = 0;
+  double final_error = 0.0;
+};
+
+bool IsPositiveDefinite(const Eigen::MatrixXd& P) {
+  if (!P.allFinite()) { return false; }
+  Eigen::LLT<Eigen::MatrixXd> llt(0.5 * (P + P.transpose()));
+  return llt.info() == Eigen::Success;
+}
+
+template <typename Filter, typename Step>
+Result Run(Filter& filter, Step step, bool stress) {
+  typedef typename Filter::State State;
+  constexpr int N = State::RowsAtCompileTime;
+
+  Result result;
+
+  State truth = State::Constant(0.5);
+  Eigen::Matrix<double, 2, 1> noise;
+  noise(0) = stress ? 1e-10 : 1e-2;
+  noise(1) = stress ? 1e-10 : 1e-2;
+  const Eigen::Matrix2d meas_noise = noise.asDiagonal();
+
+  std::chrono::steady_clock::duration elapsed{};
+  for (int i = 0; i < kIterations; i++) {
+    truth = Model<N>::Process(truth, kDt);
+    const auto measurement = Model<N>::Measure(truth);
+    const auto start = std::chrono::steady_clock::now();
+    step(filter, measurement, meas_noise);
+    elapsed += std::chrono::steady_clock::now() - start;
+    // Neither filter checks this in use, so it is not timed.
+    if (stress && !IsPositiveDefinite(filter.covariance())) {
+      result.indefinite_steps++;
+    }
+  }
+
+  result.us_per_step =
+      std::chrono::duration<double, std::micro>(elapsed).count() /
+      kIterations;
+  result.final_error = (filter.state() - truth).norm();
+  return result;
+}
+
+template <int N>
+typename Model<N>::Covariance InitialCovariance(bool stress) {
+  typename Model<N>::Covariance result = Model<N>::Covariance::Zero();
+  for (int i = 0; i < N; i++) {
+    result(i, i) = stress ? std::pow(10.0, 4.0 - 12.0 * i / (N - 1)) : 1.0;
+  }
+  return result;
+}
+
+template <int N>
+void RunSize() {
+  typedef Model<N> M;
+  typedef typename M::State State;
+  typedef typename M::Covariance Covariance;
+  typedef mjmech::base::UkfFilter<double, N> Ukf;
+  typedef mjmech::base::SrUkfFilter<double, N> SrUkf;
+
+  const State initial = State::Zero();
+  const Covariance process_noise = Covariance::Identity() * 1e-6;
+
+  auto ukf_step = [](auto& f, const auto& meas, const auto& noise) {
+    f.UpdateState(kDt, M::Process);
+    f.UpdateMeasurement(M::Measure, meas, noise);
+  };
+  auto sr_batch_step = [](auto& f, const auto& meas, const auto& noise) {
+    typedef typename SrUkf::SigmaPoints Sigma;
+    f.UpdateStateBatch(kDt, M::template ProcessBatch<Sigma>);
+    f.UpdateMeasurementBatch(M::template MeasureBatch<Sigma>, meas, noise);
+  };
+
+  for (bool stress : { false, true }) {
+    const Covariance P0 = InitialCovariance<N>(stress);
+
+    Ukf ukf(initial, P0, process_noise);
+    SrUkf sr(initial, P0, process_noise);
+    SrUkf sr_batch(initial, P0, process_noise);
+
+    const auto ukf_result = Run(ukf, ukf_step, stress);
+    const auto sr_result = Run(sr, ukf_step, stress);
+    const auto batch_result = Run(sr_batch, sr_batch_step, stress);
+
+    std::cout << fmt::format(
+        "N={:2d} {:6s} | ukf {:7.2f}us err={:9.3g} bad={:4d} | "
+        "srukf {:7.2f}us err={:9.3g} bad={:4d} skip={:4d} | "
+        "srukf-batch {:7.2f}us\n",
+        N, stress ? "stress" : "normal",
+        ukf_result.us_per_step, ukf_result.final_error,
+        ukf_result.indefinite_steps,
+        sr_result.us_per_step, sr_result.final_error,
+        sr_result.indefinite_steps, sr.downdate_failures(),
+        batch_result.us_per_step);
+  }
+}
+
+template <int... Sizes>
+void RunSizes(std::integer_sequence<int, Sizes...>) {
+  (RunSize<Sizes + 3>(), ...);
+}
+}
+
+extern "C" {
+int main(int argc, char** argv) {
+  RunSizes(std::make_integer_sequence<int, 13>());
+  return 0;
+}
+}
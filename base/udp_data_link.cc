@@ -15,6 +15,8 @@
 
 #include "udp_data_link.h"
 
+#include <algorithm>
+
 #include "mjlib/base/fail.h"
 #include "mjlib/io/now.h"
 
@@ -119,17 +121,25 @@ UdpDataLink::UdpDataLink(const boost::asio::any_io_executor& executor,
   HandlePeriodicTimer();
 }
 
-void UdpDataLink::Send(const std::string& data) {
+void UdpDataLink::Send(std::string_view data) {
+  if (!tx_addr_ && peers_.empty()) { return; }
+
+  PacketBuffer buffer = tx_socket_->AllocateBuffer(data.size());
+  std::copy(data.begin(), data.end(), buffer.data());
+  Send(buffer);
+}
+
+void UdpDataLink::Send(const PacketBuffer& buffer) {
   if (tx_addr_) {
-    tx_socket_->SendTo(data, *tx_addr_);
+    tx_socket_->SendTo(buffer, *tx_addr_);
   } else {
     for (const auto& val: peers_) {
-      tx_socket_->SendTo(data, val.second.endpoint);
+      tx_socket_->SendTo(buffer, val.second.endpoint);
     }
   }
 }
 
-void UdpDataLink::SendTo(const std::string& data, const PeerInfo& peer) {
+void UdpDataLink::SendTo(std::string_view data, const PeerInfo& peer) {
   tx_socket_->SendTo(data, peer.endpoint);
 }
 
@@ -153,7 +163,7 @@ int UdpDataLink::GetLastBitOfAddress(const boost::asio::ip::address& addr) {
 }
 
 void UdpDataLink::HandleUdpPacket(
-    const std::string& data, const UdpSocket::endpoint& sender) {
+    std::string_view data, const UdpSocket::endpoint& sender) {
 
   auto iter = peers_.find(sender);
   if (iter == peers_.end()) {
@@ -91,8 +91,9 @@ class UdpDataLink : boost::noncopyable {
     boost::posix_time::ptime last_rx_time;
   };
 
+  // The data is only valid for the duration of the call.
   typedef boost::signals2::signal<
-    void(const std::string&, const PeerInfo&)> DataSignal;
+    void(std::string_view, const PeerInfo&)> DataSignal;
   DataSignal* data_signal() { return &data_signal_; }
 
   typedef boost::signals2::signal<void(const PeerInfo&)> PeerSignal;
@@ -102,13 +103,20 @@ class UdpDataLink : boost::noncopyable {
   // Return maximum payload size.
   int get_max_data_size() const { return params_.link_mtu - kUdpV4HeaderSize; }
 
-  // Send to all clients (see description of 'dest')
-  void Send(const std::string& data);
+  // Send to all clients (see description of 'dest').  The data is
+  // copied once, no matter how many clients there are.
+  void Send(std::string_view data);
+  void Send(const PacketBuffer&);
+
+  // Return a buffer of @p size bytes to fill in and pass to Send.
+  PacketBuffer AllocateBuffer(std::size_t size) {
+    return tx_socket_->AllocateBuffer(size);
+  }
 
   // This method always sends via unicast, to client address from the original
   // packet. There is currently no way for client to tell that it wants to
   // receive responses over multicast.
-  void SendTo(const std::string& data, const PeerInfo&);
+  void SendTo(std::string_view data, const PeerInfo&);
 
   // Flip last bit in the IP address
   static boost::asio::ip::address FlipBitInAddress(
@@ -117,7 +125,7 @@ class UdpDataLink : boost::noncopyable {
   static int GetLastBitOfAddress(const boost::asio::ip::address&);
 
  private:
-  void HandleUdpPacket(const std::string&, const UdpSocket::endpoint&);
+  void HandleUdpPacket(std::string_view, const UdpSocket::endpoint&);
   void HandlePeriodicTimer();
 
   const int kUdpV4HeaderSize = 28; // 20 byte IPv4 + 8 bytes UDP
@@ -15,7 +15,13 @@
 
 #include "udp_socket.h"
 
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <cerrno>
+
 #include <boost/asio/ip/multicast.hpp>
+#include <boost/asio/post.hpp>
 #include <boost/lexical_cast.hpp>
 
 #include "mjlib/base/fail.h"
@@ -36,6 +42,14 @@ Cool UDP features:
 
 namespace ip = boost::asio::ip;
 
+namespace {
+#ifdef __linux__
+constexpr bool kHaveBatchIo = true;
+#else
+constexpr bool kHaveBatchIo = false;
+#endif
+}
+
 UdpSocket::UdpSocket(const boost::asio::any_io_executor& executor,
                      LogRef& log,
                      const std::string& listen_addr,
@@ -53,7 +67,9 @@ UdpSocket::UdpSocket(const boost::asio::any_io_executor& executor,
                      const Parameters& parameters)
     : log_(log),
       parameters_(parameters),
-      socket_(executor) {
+      socket_(executor),
+      batch_io_(kHaveBatchIo && parameters.batch_io),
+      receive_buffer_((batch_io_ ? kRxBatch : 1) * kMaxPacketSize) {
 
   PrepareSocket();
 
@@ -186,9 +202,17 @@ void UdpSocket::PrepareToSendTo(const endpoint& endpoint) {
   mjlib::base::Fail("Unknown multicast / broadcast type");
 }
 
-void UdpSocket::SendTo(const std::string& data, const endpoint& endpoint) {
+PacketBuffer UdpSocket::AllocateBuffer(std::size_t size) {
+  return pool_.Allocate(size);
+}
+
+void UdpSocket::SendTo(std::string_view data, const endpoint& endpoint) {
+  SendTo(pool_.Copy(data), endpoint);
+}
+
+void UdpSocket::SendTo(const PacketBuffer& buffer, const endpoint& endpoint) {
   if (tx_pending_ > parameters_.max_tx_pending) {
-    log_.warnStream() << "Cannot send " << data.size() << " bytes to "
+    log_.warnStream() << "Cannot send " << buffer.size() << " bytes to "
                       << endpoint << ": too many pending packets("
                       << tx_pending_ << ")";
     return;
@@ -196,16 +220,73 @@ void UdpSocket::SendTo(const std::string& data, const endpoint& endpoint) {
 
   PrepareToSendTo(endpoint);
   tx_pending_++;
-  std::shared_ptr<std::string> shared_data(new std::string(data));
-  socket_.async_send_to(
-      boost::asio::buffer(*shared_data),
-      endpoint,
-      std::bind(&UdpSocket::HandleWrite, this, shared_data,
-                std::placeholders::_1));
+  tx_queue_.push_back({buffer, endpoint});
+
+  if (!tx_flush_scheduled_) {
+    // Wait until the current handler is done, so that everything it
+    // sends can go out together.
+    tx_flush_scheduled_ = true;
+    boost::asio::post(socket_.get_executor(),
+                      std::bind(&UdpSocket::FlushTx, this));
+  }
 }
 
-void UdpSocket::HandleWrite(std::shared_ptr<std::string>,
-                            mjlib::base::error_code ec) {
+void UdpSocket::FlushTx() {
+#ifdef __linux__
+  if (batch_io_) {
+    while (!tx_queue_.empty()) {
+      const std::size_t count =
+          std::min<std::size_t>(tx_queue_.size(), kTxBatch);
+      struct mmsghdr messages[kTxBatch] = {};
+      struct iovec iovecs[kTxBatch] = {};
+      for (std::size_t i = 0; i < count; i++) {
+        auto& item = tx_queue_[i];
+        iovecs[i].iov_base = item.buffer.data();
+        iovecs[i].iov_len = item.buffer.size();
+        auto& header = messages[i].msg_hdr;
+        header.msg_name = item.destination.data();
+        header.msg_namelen = item.destination.size();
+        header.msg_iov = &iovecs[i];
+        header.msg_iovlen = 1;
+      }
+
+      const int result = ::sendmmsg(
+          socket_.native_handle(), messages, count, MSG_DONTWAIT);
+      if (result < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          // The socket's buffer is full.  Try again once there is
+          // room.
+          socket_.async_wait(
+              udp::socket::wait_write,
+              [this](mjlib::base::error_code ec) {
+                mjlib::base::FailIf(ec);
+                FlushTx();
+              });
+          return;
+        }
+        mjlib::base::system_error::throw_if(true, "sendmmsg");
+      }
+
+      tx_queue_.erase(tx_queue_.begin(), tx_queue_.begin() + result);
+      tx_pending_ -= result;
+    }
+    tx_flush_scheduled_ = false;
+    return;
+  }
+#endif
+
+  for (const auto& item : tx_queue_) {
+    socket_.async_send_to(
+        boost::asio::buffer(item.buffer.data(), item.buffer.size()),
+        item.destination,
+        std::bind(&UdpSocket::HandleWrite, this, item.buffer,
+                  std::placeholders::_1));
+  }
+  tx_queue_.clear();
+  tx_flush_scheduled_ = false;
+}
+
+void UdpSocket::HandleWrite(PacketBuffer, mjlib::base::error_code ec) {
   mjlib::base::FailIf(ec);
   tx_pending_--;
 }
@@ -223,9 +304,16 @@ void UdpSocket::StartRead() {
 }
 
 void UdpSocket::StartNextRead() {
+  if (batch_io_) {
+    socket_.async_wait(
+        udp::socket::wait_read,
+        std::bind(&UdpSocket::HandleReadable, this, std::placeholders::_1));
+    return;
+  }
+
   socket_.async_receive_from(
       boost::asio::buffer(receive_buffer_),
-      receive_endpoint_,
+      receive_endpoint_[0],
       std::bind(&UdpSocket::HandleRead, this,
                 std::placeholders::_1,
                 std::placeholders::_2));
@@ -245,12 +333,52 @@ UdpSocket::endpoint UdpSocket::local_endpoint() const {
 void UdpSocket::HandleRead(mjlib::base::error_code ec, std::size_t size) {
   mjlib::base::FailIf(ec);
 
-  std::string data(receive_buffer_, size);
-  udp::endpoint from = receive_endpoint_;
+  // The next read can complete immediately into the same buffer, so
+  // it is only started once every subscriber has seen this one.
+  data_signal_(std::string_view(receive_buffer_.data(), size),
+               receive_endpoint_[0]);
 
   StartNextRead();
+}
+
+void UdpSocket::HandleReadable(mjlib::base::error_code ec) {
+  mjlib::base::FailIf(ec);
+
+#ifdef __linux__
+  struct mmsghdr messages[kRxBatch] = {};
+  struct iovec iovecs[kRxBatch] = {};
+  for (int i = 0; i < kRxBatch; i++) {
+    iovecs[i].iov_base = &receive_buffer_[i * kMaxPacketSize];
+    iovecs[i].iov_len = kMaxPacketSize;
+    auto& header = messages[i].msg_hdr;
+    header.msg_name = receive_endpoint_[i].data();
+    header.msg_namelen = receive_endpoint_[i].capacity();
+    header.msg_iov = &iovecs[i];
+    header.msg_iovlen = 1;
+  }
 
-  data_signal_(data, from);
+  const int result = ::recvmmsg(
+      socket_.native_handle(), messages, kRxBatch, MSG_DONTWAIT, nullptr);
+  if (result < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      StartNextRead();
+      return;
+    }
+    mjlib::base::system_error::throw_if(true, "recvmmsg");
+  }
+
+  for (int i = 0; i < result; i++) {
+    receive_endpoint_[i].resize(messages[i].msg_hdr.msg_namelen);
+  }
+
+  for (int i = 0; i < result; i++) {
+    data_signal_(std::string_view(&receive_buffer_[i * kMaxPacketSize],
+                                  messages[i].msg_len),
+                 receive_endpoint_[i]);
+  }
+
+  StartNextRead();
+#endif
 }
 
 
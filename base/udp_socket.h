@@ -17,6 +17,8 @@
 
 #include <optional>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include <boost/asio/any_io_executor.hpp>
 #include <boost/asio/ip/udp.hpp>
@@ -24,6 +26,8 @@
 
 #include "mjlib/base/error_code.h"
 
+#include "base/packet_buffer.h"
+
 #include "logging.h"
 
 namespace mjmech {
@@ -65,14 +69,28 @@ class UdpSocket {
   // Parse address into endpoint. Uses parameters.default_port if no
   // port is given.
   endpoint ParseSendEndpoint(const std::string& addr);
-  // Send to a given address -- based on endpoint struct
-  void SendTo(const std::string& data, const endpoint&);
+  // Send to a given address -- based on endpoint struct.  The data
+  // is copied once, into a pooled buffer.
+  void SendTo(std::string_view data, const endpoint&);
+  // Send a buffer without copying it.  The same buffer may be passed
+  // to any number of SendTo calls.
+  void SendTo(const PacketBuffer&, const endpoint&);
+
+  // Return a buffer of @p size bytes to fill in and pass to SendTo.
+  PacketBuffer AllocateBuffer(std::size_t size);
+
+  // All packets passed to SendTo from within one handler are queued,
+  // and then handed to the kernel together.  On Linux, that is done
+  // with a single sendmmsg call, and reads use recvmmsg.
 
   // asio's socket interface is designed to throttle down TCP connections
   // when the host is not keeping up. We have no such concerns, so we
   // expose more convinient API.
+  //
+  // The data passed to the signal is only valid for the duration of
+  // the call.
   typedef boost::signals2::signal<
-    void(const std::string&, const endpoint&)> DataSignal;
+    void(std::string_view, const endpoint&)> DataSignal;
   // Start reading loop.
   void StartRead();
   // Get the data signal. Reading loop must be started first.
@@ -116,6 +134,9 @@ class UdpSocket {
     // Warn and drop packets if more than that many are in flight.
     int max_tx_pending = 16;
 
+    // Use sendmmsg and recvmmsg where they are available.
+    bool batch_io = true;
+
     template <typename Archive>
     void Serialize(Archive* a) {
       a->Visit(MJ_NVP(default_port));
@@ -125,6 +146,7 @@ class UdpSocket {
       a->Visit(MJ_NVP(dont_fragment));
       a->Visit(MJ_NVP(dont_route));
       a->Visit(MJ_NVP(max_tx_pending));
+      a->Visit(MJ_NVP(batch_io));
     };
   };
 
@@ -141,15 +163,34 @@ class UdpSocket {
   typedef boost::asio::ip::udp udp;
   void StartNextRead();
   void HandleRead(mjlib::base::error_code, std::size_t size);
-  void HandleWrite(std::shared_ptr<std::string>, mjlib::base::error_code);
+  void HandleReadable(mjlib::base::error_code);
+  void HandleWrite(PacketBuffer, mjlib::base::error_code);
+  void FlushTx();
   void PrepareSocket();
   void PrepareToSendTo(const endpoint&);
 
+  static constexpr std::size_t kMaxPacketSize = 0x10000;
+  static constexpr int kRxBatch = 8;
+  static constexpr int kTxBatch = 32;
+
+  struct PendingSend {
+    PacketBuffer buffer;
+    endpoint destination;
+  };
+
   LogRef log_;
   Parameters parameters_;
   udp::socket socket_;
-  char receive_buffer_[0x10000] = {};
-  endpoint receive_endpoint_;
+  const bool batch_io_;
+  PacketBufferPool pool_;
+
+  // kRxBatch buffers of kMaxPacketSize bytes, when batch_io_ is set,
+  // otherwise just one.
+  std::vector<char> receive_buffer_;
+  endpoint receive_endpoint_[kRxBatch];
+
+  std::vector<PendingSend> tx_queue_;
+  bool tx_flush_scheduled_ = false;
   std::optional<endpoint> rx_multicast_addr_;
 
   bool reading_loop_running_ = false;
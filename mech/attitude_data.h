@@ -14,6 +14,8 @@
 
 #pragma once
 
+#include <array>
+
 #include "mjlib/base/visitor.h"
 
 #include "base/euler.h"
@@ -48,5 +50,27 @@ struct AttitudeData {
   }
 };
 
+/// Every IMU sample received since the previous batch was read,
+/// oldest first.  This lets consumers integrate at the full IMU rate
+/// even when they run at a lower rate themselves.
+struct AttitudeBatch {
+  static constexpr int kMaxSamples = 32;
+
+  int count = 0;
+
+  // Samples which were received, but discarded because more than
+  // kMaxSamples accumulated between reads.
+  int dropped = 0;
+
+  std::array<AttitudeData, kMaxSamples> samples = {};
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(count));
+    a->Visit(MJ_NVP(dropped));
+    a->Visit(MJ_NVP(samples));
+  }
+};
+
 }
 }
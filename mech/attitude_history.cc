@@ -0,0 +1,61 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/attitude_history.h"
+
+#include "base/common.h"
+
+namespace mjmech {
+namespace mech {
+
+void AttitudeHistory::Add(const Sample& sample) {
+  if (count_ > 0 && sample.time <= at(0).time) { return; }
+
+  samples_[next_] = sample;
+  next_ = (next_ + 1) % kSize;
+  if (count_ < kSize) { count_++; }
+}
+
+std::optional<AttitudeHistory::Sample> AttitudeHistory::Get(
+    base::MonoTime time) const {
+  if (count_ == 0) { return {}; }
+
+  const auto& newest = at(0);
+  if (time >= newest.time) { return newest; }
+
+  // Search back from the newest, as recent times are the usual case.
+  for (int age = 1; age < count_; age++) {
+    const auto& before = at(age);
+    if (before.time > time) { continue; }
+
+    const auto& after = at(age - 1);
+    const double fraction =
+        base::MonoSeconds(time, before.time) /
+        base::MonoSeconds(after.time, before.time);
+
+    Sample result;
+    result.time = time;
+    result.pitch_deg =
+        before.pitch_deg + fraction * (after.pitch_deg - before.pitch_deg);
+    result.yaw_deg = base::WrapNeg180To180(
+        before.yaw_deg +
+        fraction * base::WrapNeg180To180(after.yaw_deg - before.yaw_deg));
+    return result;
+  }
+
+  return at(count_ - 1);
+}
+
+}
+}
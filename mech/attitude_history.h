@@ -0,0 +1,61 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <optional>
+
+#include "base/mono_time.h"
+
+namespace mjmech {
+namespace mech {
+
+/// Remembers recent gimbal attitudes, so that something measured in
+/// the past, like a target seen in a camera frame, can be related to
+/// where the gimbal points now.
+class AttitudeHistory {
+ public:
+  struct Sample {
+    base::MonoTime time;
+    double pitch_deg = 0.0;
+    double yaw_deg = 0.0;
+  };
+
+  /// With every sample from a 400Hz IMU, this covers over a second.
+  static constexpr int kSize = 512;
+
+  /// Samples which are not newer than the last are ignored.
+  void Add(const Sample&);
+
+  /// @return the attitude at @p time, interpolated between the
+  /// samples around it, or the oldest or newest sample if it is
+  /// outside of those held.  Yaw is interpolated the short way
+  /// around.
+  std::optional<Sample> Get(base::MonoTime time) const;
+
+  int size() const { return count_; }
+
+ private:
+  const Sample& at(int age) const {
+    return samples_[(next_ + kSize - 1 - age) % kSize];
+  }
+
+  std::array<Sample, kSize> samples_ = {};
+  int next_ = 0;
+  int count_ = 0;
+};
+
+}
+}
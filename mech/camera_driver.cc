@@ -14,77 +14,183 @@
 
 #include "mech/camera_driver.h"
 
+#include <pthread.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <thread>
 
-#include <boost/date_time/posix_time/posix_time.hpp>
+#include <fmt/format.h>
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/videoio/videoio.hpp>
-#include <opencv2/imgcodecs/imgcodecs.hpp>
 
 #ifdef COM_GITHUB_MJBOTS_RASPBERRYPI
 #include <raspicam_cv.h>
 #endif
 
+#include "mech/camera_replay.h"
+
 namespace mjmech {
 namespace mech {
 
-#ifdef COM_GITHUB_MJBOTS_RASPBERRYPI
 class CameraDriver::Impl {
  public:
   Impl(const Options& options)
-      : thread_(std::bind(&Impl::Run, this, options)) {
+      : options_(options),
+        mailbox_(std::max(1, options.workers) + 2) {
+    if (options_.record_every >= 1) {
+      const bool rotated = options_.rotation == 90 || options_.rotation == 270;
+      recorder_ = std::make_unique<FrameRecorder>(
+          options_.record_path, options_.record,
+          rotated ?
+          cv::Size(options_.height, options_.width) :
+          cv::Size(options_.width, options_.height));
+    }
+
+    if (!options_.source.empty()) {
+      StartWorkers();
+      capture_thread_ = std::thread(std::bind(&Impl::RunReplay, this));
+      return;
+    }
+#ifdef COM_GITHUB_MJBOTS_RASPBERRYPI
+    StartWorkers();
+    capture_thread_ = std::thread(std::bind(&Impl::RunCapture, this));
+#endif
   }
 
   ~Impl() {
     done_.store(true);
-    thread_.join();
+    if (capture_thread_.joinable()) { capture_thread_.join(); }
+    mailbox_.Close();
+    for (auto& worker : workers_) { worker.join(); }
+  }
+
+  Stats stats() const {
+    Stats result;
+    result.captured = captured_.load();
+    result.mailbox = mailbox_.stats();
+    if (recorder_) { result.recorder = recorder_->stats(); }
+    return result;
   }
 
-  void Run(Options options) {
+  void StartWorkers() {
+    for (int i = 0; i < std::max(1, options_.workers); i++) {
+      workers_.emplace_back(std::bind(&Impl::RunWorker, this, i));
+    }
+  }
+
+#ifdef COM_GITHUB_MJBOTS_RASPBERRYPI
+  void RunCapture() {
+    ::pthread_setname_np(::pthread_self(), "camera");
+
     raspicam::RaspiCam_Cv camera;
-    camera.set(cv::CAP_PROP_FRAME_WIDTH, options.width);
-    camera.set(cv::CAP_PROP_FRAME_HEIGHT, options.height);
-    camera.set(cv::CAP_PROP_MODE, options.mode);
-    camera.set(cv::CAP_PROP_FPS, options.fps);
-    camera.setRotation(options.rotation);
+    camera.set(cv::CAP_PROP_FRAME_WIDTH, options_.width);
+    camera.set(cv::CAP_PROP_FRAME_HEIGHT, options_.height);
+    camera.set(cv::CAP_PROP_MODE, options_.mode);
+    camera.set(cv::CAP_PROP_FPS, options_.fps);
+    camera.setRotation(options_.rotation);
     camera.set(cv::CAP_PROP_FORMAT, CV_8UC3);
     camera.open();
 
-    cv::Mat image;
-    uint16_t count = 0;
+    uint64_t sequence = 0;
     while (!done_.load()) {
       camera.grab();
-      camera.retrieve(image);
-      if (options.record_every >= 1) {
-        if (count == 0) {
-          cv::imwrite(MakePath(options), image);
-          count = options.record_every - 1;
-        } else {
-          count--;
+
+      auto frame = mailbox_.Acquire();
+      frame->capture_time =
+          base::MonoClock::ReadMonotonic() +
+          -base::MonoNanoseconds(options_.capture_latency_s);
+      frame->sequence = sequence++;
+      // This reuses the frame's existing image if it is the right
+      // size.
+      camera.retrieve(frame->image);
+      captured_++;
+
+      MaybeRecord(*frame);
+      mailbox_.Publish(std::move(frame));
+    }
+  }
+#endif
+
+  void RunReplay() {
+    ::pthread_setname_np(::pthread_self(), "camera");
+
+    CameraReplay replay(options_.source, options_.fps);
+
+    const auto start = base::MonoClock::ReadMonotonic();
+    uint64_t sequence = 0;
+    // Each time through the source is shifted to follow the last.
+    double loop_offset_s = 0.0;
+    double last_time_s = 0.0;
+
+    while (!done_.load()) {
+      auto frame = mailbox_.Acquire();
+      double time_s = 0.0;
+      if (!replay.Read(&frame->image, &time_s)) {
+        if (!options_.replay_loop || sequence == 0) { return; }
+        replay.Rewind();
+        loop_offset_s = last_time_s + 1.0 / std::max(1, options_.fps);
+        continue;
+      }
+      last_time_s = loop_offset_s + time_s;
+
+      if (options_.replay_realtime) {
+        const auto due = start + base::MonoNanoseconds(last_time_s);
+        // Sleep in pieces, so that shutdown is never held up by a long
+        // gap in the recording.
+        while (!done_.load()) {
+          const double remaining_s =
+              base::MonoSeconds(due, base::MonoClock::ReadMonotonic());
+          if (remaining_s <= 0.0) { break; }
+          std::this_thread::sleep_for(std::chrono::duration<double>(
+              std::min(remaining_s, 0.1)));
         }
       }
-      image_signal_(image);
+
+      frame->capture_time = base::MonoClock::ReadMonotonic();
+      frame->source_time_s = time_s;
+      frame->sequence = sequence++;
+      captured_++;
+
+      MaybeRecord(*frame);
+      mailbox_.Publish(std::move(frame));
     }
   }
 
-  std::string MakePath(const Options& options) const {
-    const auto now = boost::posix_time::microsec_clock::universal_time();
-    return options.record_path + to_iso_string(now) + ".png";
+  void RunWorker(int index) {
+    const auto name = fmt::format("camera_work{}", index);
+    ::pthread_setname_np(::pthread_self(), name.c_str());
+
+    while (auto frame = mailbox_.Take()) {
+      image_signal_(*frame, index);
+    }
   }
 
-  std::thread thread_;
-  std::atomic<bool> done_{false};
-  ImageSignal image_signal_;
-};
-#else
-class CameraDriver::Impl {
- public:
-  Impl(const Options&) {}
+  void MaybeRecord(const CameraFrame& frame) {
+    if (!recorder_) { return; }
+    if (record_count_ == 0) {
+      // This only copies the image, the encoding happens in the
+      // recorder's own thread.
+      recorder_->Record(frame);
+      record_count_ = options_.record_every - 1;
+    } else {
+      record_count_--;
+    }
+  }
 
+  const Options options_;
+  FrameMailbox mailbox_;
   ImageSignal image_signal_;
+  std::unique_ptr<FrameRecorder> recorder_;
+  int record_count_ = 0;
+
+  std::atomic<bool> done_{false};
+  std::atomic<uint64_t> captured_{0};
+  std::thread capture_thread_;
+  std::vector<std::thread> workers_;
 };
-#endif
 
 CameraDriver::CameraDriver(const Options& options)
     : impl_(std::make_unique<Impl>(options)) {}
@@ -95,5 +201,17 @@ CameraDriver::ImageSignal* CameraDriver::image_signal() {
   return &impl_->image_signal_;
 }
 
+CameraDriver::Stats CameraDriver::stats() const {
+  return impl_->stats();
+}
+
+void CameraDriver::SetRecordState(const std::string& state) {
+  if (impl_->recorder_) { impl_->recorder_->SetState(state); }
+}
+
+bool CameraDriver::recording() const {
+  return !!impl_->recorder_;
+}
+
 }
 }
@@ -21,10 +21,21 @@
 #include "mjlib/base/visitor.h"
 #include "mjlib/io/async_types.h"
 
+#include "mech/frame_mailbox.h"
+#include "mech/frame_recorder.h"
+
 namespace mjmech {
 namespace mech {
 
 /// Read frames from a camera.
+///
+/// A capture thread does nothing but read frames into a pool and
+/// publish them to a FrameMailbox.  Separate worker threads take the
+/// newest frame and emit it, so slow processing drops frames rather
+/// than delaying capture.
+///
+/// If Options::source is set, frames are replayed from it instead of
+/// read from the camera, which works on any machine.
 class CameraDriver {
  public:
   struct Options {
@@ -34,8 +45,27 @@ class CameraDriver {
     int fps = 60;
     int rotation = 270;
 
+    /// If record_every is 1 or more, every Nth frame is written by a
+    /// FrameRecorder, with names starting with record_path.
     std::string record_path = "/tmp/mjbots-camera";
     int record_every = -1;
+    FrameRecorder::Options record;
+
+    /// The number of threads which process frames in parallel.
+    int workers = 1;
+
+    /// The time from exposure until a frame is returned by the
+    /// camera, which is subtracted from each CameraFrame::capture_time.
+    double capture_latency_s = 0.0;
+
+    /// A video file or directory of images to replay, as read by
+    /// CameraReplay.  If empty, the camera is used.
+    std::string source;
+    /// Deliver replayed frames with their original spacing, rather
+    /// than as fast as they can be read.
+    bool replay_realtime = true;
+    /// Start over at the end of the source.
+    bool replay_loop = true;
 
     template <typename Archive>
     void Serialize(Archive* a) {
@@ -46,16 +76,50 @@ class CameraDriver {
       a->Visit(MJ_NVP(rotation));
       a->Visit(MJ_NVP(record_path));
       a->Visit(MJ_NVP(record_every));
+      a->Visit(MJ_NVP(record));
+      a->Visit(MJ_NVP(workers));
+      a->Visit(MJ_NVP(capture_latency_s));
+      a->Visit(MJ_NVP(source));
+      a->Visit(MJ_NVP(replay_realtime));
+      a->Visit(MJ_NVP(replay_loop));
     }
   };
 
   CameraDriver(const Options& options);
   ~CameraDriver();
 
-  using ImageSignal = boost::signals2::signal<void (const cv::Mat&)>;
-  // This will be emitted from a background thread.
+  /// The second argument is the index of the worker, from 0 to
+  /// Options::workers - 1.
+  using ImageSignal =
+      boost::signals2::signal<void (const CameraFrame&, int worker)>;
+  // This will be emitted from the worker threads, concurrently if
+  // there is more than one.
   ImageSignal* image_signal();
 
+  struct Stats {
+    uint64_t captured = 0;
+    FrameMailbox::Stats mailbox;
+    FrameRecorder::Stats recorder;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(captured));
+      a->Visit(MJ_NVP(mailbox));
+      a->Visit(MJ_NVP(recorder));
+    }
+  };
+
+  /// This may be called from any thread.
+  Stats stats() const;
+
+  /// Set the state written alongside each recorded frame, for
+  /// instance where the turret was pointing.  This does nothing if
+  /// recording is disabled, and may be called from any thread.
+  void SetRecordState(const std::string&);
+
+  /// @return true if frames are being recorded.
+  bool recording() const;
+
  private:
   class Impl;
   std::unique_ptr<Impl> impl_;
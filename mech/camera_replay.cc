@@ -0,0 +1,174 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "mech/camera_replay.h"
+
+#include <algorithm>
+#include <cctype>
+#include <optional>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
+
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+#include <opencv2/videoio/videoio.hpp>
+
+#include "mjlib/base/system_error.h"
+
+namespace fs = boost::filesystem;
+namespace pt = boost::posix_time;
+
+namespace mjmech {
+namespace mech {
+
+namespace {
+bool IsImage(const fs::path& path) {
+  const auto extension = boost::to_lower_copy(path.extension().string());
+  for (const char* candidate : {
+           ".png", ".jpg", ".jpeg", ".bmp", ".pgm", ".ppm", ".tif", ".tiff"}) {
+    if (extension == candidate) { return true; }
+  }
+  return false;
+}
+
+bool AllDigits(const std::string& value, std::size_t start, std::size_t size) {
+  if (start + size > value.size()) { return false; }
+  return std::all_of(value.begin() + start, value.begin() + start + size,
+                     [](char c) { return std::isdigit(c) != 0; });
+}
+
+/// Find a timestamp like 20200314T152301.123456 anywhere in @p name.
+std::optional<pt::ptime> ParseTimestamp(const std::string& name) {
+  for (std::size_t t = name.find('T', 8); t != std::string::npos;
+       t = name.find('T', t + 1)) {
+    if (!AllDigits(name, t - 8, 8) || !AllDigits(name, t + 1, 6)) {
+      continue;
+    }
+    std::size_t end = t + 7;
+    if (end < name.size() && name[end] == '.') {
+      end++;
+      while (end < name.size() && std::isdigit(name[end])) { end++; }
+    }
+    try {
+      return pt::from_iso_string(name.substr(t - 8, end - (t - 8)));
+    } catch (std::exception&) {
+      continue;
+    }
+  }
+  return {};
+}
+}
+
+class CameraReplay::Impl {
+ public:
+  Impl(const std::string& source, double default_fps)
+      : source_(source),
+        default_fps_(default_fps > 0.0 ? default_fps : 30.0) {
+    boost::system::error_code ec;
+    if (fs::is_directory(source, ec)) {
+      for (fs::directory_iterator it(source, ec), end;
+           !ec && it != end; it.increment(ec)) {
+        if (fs::is_regular_file(it->path(), ec) && IsImage(it->path())) {
+          files_.push_back(it->path().string());
+        }
+      }
+      std::sort(files_.begin(), files_.end());
+      if (files_.empty()) {
+        throw mjlib::base::system_error::einval(
+            "No images found in: " + source);
+      }
+    } else {
+      video_.open(source);
+      if (!video_.isOpened()) {
+        throw mjlib::base::system_error::einval(
+            "Could not open video: " + source);
+      }
+      const double fps = video_.get(cv::CAP_PROP_FPS);
+      if (fps > 0.0) { default_fps_ = fps; }
+    }
+  }
+
+  bool Read(cv::Mat* image, double* time_s) {
+    const double index_s = index_ / default_fps_;
+
+    if (files_.empty()) {
+      if (!video_.read(*image)) { return false; }
+      // Backends which do not know the timestamps report zero.
+      const double position_s = video_.get(cv::CAP_PROP_POS_MSEC) * 1e-3;
+      *time_s = (index_ == 0 || position_s > 0.0) ? position_s : index_s;
+      name_ = source_;
+    } else {
+      if (index_ >= static_cast<int64_t>(files_.size())) { return false; }
+      name_ = files_[index_];
+      // imread always allocates, so this cannot reuse the storage.
+      *image = cv::imread(name_);
+      if (image->empty()) {
+        throw mjlib::base::system_error::einval(
+            "Could not read image: " + name_);
+      }
+
+      const auto stamp = ParseTimestamp(fs::path(name_).filename().string());
+      if (index_ == 0) { first_stamp_ = stamp; }
+      if (stamp && first_stamp_) {
+        *time_s = (*stamp - *first_stamp_).total_microseconds() * 1e-6;
+      } else {
+        *time_s = index_s;
+      }
+    }
+
+    index_++;
+    return true;
+  }
+
+  void Rewind() {
+    index_ = 0;
+    if (files_.empty()) {
+      video_.release();
+      video_.open(source_);
+    }
+  }
+
+  const std::string source_;
+  double default_fps_;
+
+  std::vector<std::string> files_;
+  cv::VideoCapture video_;
+
+  int64_t index_ = 0;
+  std::optional<pt::ptime> first_stamp_;
+  std::string name_;
+};
+
+CameraReplay::CameraReplay(const std::string& source, double default_fps)
+    : impl_(std::make_unique<Impl>(source, default_fps)) {}
+
+CameraReplay::~CameraReplay() {}
+
+bool CameraReplay::Read(cv::Mat* image, double* time_s) {
+  return impl_->Read(image, time_s);
+}
+
+void CameraReplay::Rewind() {
+  impl_->Rewind();
+}
+
+std::string CameraReplay::name() const {
+  return impl_->name_;
+}
+
+}
+}
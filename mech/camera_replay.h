@@ -0,0 +1,62 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <opencv2/core/core.hpp>
+
+namespace mjmech {
+namespace mech {
+
+/// Reads recorded frames, from either a video file or a directory of
+/// images, so that the camera pipeline can be run without a camera.
+///
+/// Images in a directory are read in name order.  If their names
+/// contain an ISO timestamp, as those written by
+/// CameraDriver::Options::record_path do, that is used as their time.
+/// Otherwise, and for videos without timestamps, frames are spaced by
+/// the frame rate.
+class CameraReplay {
+ public:
+  /// @param default_fps is used when the source has no frame rate or
+  /// timestamps of its own.
+  CameraReplay(const std::string& source, double default_fps);
+  ~CameraReplay();
+
+  /// Read the next frame, reusing the storage of @p image if it is
+  /// the right size.
+  ///
+  /// @param time_s is set to the time of the frame, relative to the
+  /// first frame of the source.
+  ///
+  /// @return false at the end of the source.
+  bool Read(cv::Mat* image, double* time_s);
+
+  /// Start again from the first frame.
+  void Rewind();
+
+  /// @return the file the last frame was read from.
+  std::string name() const;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}
+}
@@ -14,25 +14,22 @@
 
 #pragma once
 
-#include <boost/asio/any_io_executor.hpp>
-#include <boost/date_time/posix_time/posix_time_types.hpp>
-
-#include "mjlib/base/time_conversions.h"
 #include "mjlib/base/visitor.h"
-#include "mjlib/io/now.h"
+
+#include "base/mono_time.h"
 
 namespace mjmech {
 namespace mech {
 
 class ControlTiming {
  public:
-  ControlTiming(const boost::asio::any_io_executor& executor,
-                boost::posix_time::ptime last_cycle_start)
-      : executor_(executor) {
+  ControlTiming(const base::MonoClock* clock,
+                base::MonoTime last_cycle_start)
+      : clock_(clock) {
     timestamps_.last_cycle_start = last_cycle_start;
     timestamps_.cycle_start = Now();
-    timestamps_.delta_s = mjlib::base::ConvertDurationToSeconds(
-        timestamps_.cycle_start - timestamps_.last_cycle_start);
+    timestamps_.delta_s = base::MonoSeconds(
+        timestamps_.cycle_start, timestamps_.last_cycle_start);
   }
 
   struct Status {
@@ -57,22 +54,22 @@ class ControlTiming {
   Status status() const {
     Status result;
 
-    result.query_s = mjlib::base::ConvertDurationToSeconds(
-        timestamps_.query_done - timestamps_.cycle_start);
-    result.status_s = mjlib::base::ConvertDurationToSeconds(
-        timestamps_.status_done - timestamps_.query_done);
-    result.control_s = mjlib::base::ConvertDurationToSeconds(
-        timestamps_.control_done - timestamps_.status_done);
-    result.command_s = mjlib::base::ConvertDurationToSeconds(
-        timestamps_.command_done - timestamps_.control_done);
-    result.cycle_s = mjlib::base::ConvertDurationToSeconds(
-        timestamps_.command_done - timestamps_.cycle_start);
+    result.query_s = base::MonoSeconds(
+        timestamps_.query_done, timestamps_.cycle_start);
+    result.status_s = base::MonoSeconds(
+        timestamps_.status_done, timestamps_.query_done);
+    result.control_s = base::MonoSeconds(
+        timestamps_.control_done, timestamps_.status_done);
+    result.command_s = base::MonoSeconds(
+        timestamps_.command_done, timestamps_.control_done);
+    result.cycle_s = base::MonoSeconds(
+        timestamps_.command_done, timestamps_.cycle_start);
     result.delta_s = timestamps_.delta_s;
 
     return result;
   }
 
-  boost::posix_time::ptime cycle_start() const { return timestamps_.cycle_start; }
+  base::MonoTime cycle_start() const { return timestamps_.cycle_start; }
 
   void finish_query() { timestamps_.query_done = Now(); }
   void finish_status() { timestamps_.status_done = Now(); }
@@ -81,21 +78,19 @@ class ControlTiming {
 
  private:
   struct Timestamps {
-    boost::posix_time::ptime last_cycle_start;
+    base::MonoTime last_cycle_start;
     double delta_s = 0.0;
 
-    boost::posix_time::ptime cycle_start;
-    boost::posix_time::ptime query_done;
-    boost::posix_time::ptime status_done;
-    boost::posix_time::ptime control_done;
-    boost::posix_time::ptime command_done;
+    base::MonoTime cycle_start;
+    base::MonoTime query_done;
+    base::MonoTime status_done;
+    base::MonoTime control_done;
+    base::MonoTime command_done;
   };
 
-  boost::posix_time::ptime Now() const {
-    return mjlib::io::Now(executor_.context());
-  }
+  base::MonoTime Now() const { return clock_->Now(); }
 
-  boost::asio::any_io_executor executor_;
+  const base::MonoClock* clock_;
   Timestamps timestamps_;
 };
 
@@ -0,0 +1,92 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/frame_mailbox.h"
+
+namespace mjmech {
+namespace mech {
+
+FrameMailbox::FrameMailbox(int pool_size) {
+  for (int i = 0; i < pool_size; i++) {
+    pool_.push_back(std::make_unique<CameraFrame>());
+    free_.push_back(pool_.back().get());
+  }
+}
+
+FrameMailbox::~FrameMailbox() {
+  // This returns the pending frame to the pool while it still exists.
+  // Any other frame must be released before the mailbox is
+  // destroyed.
+  newest_.reset();
+}
+
+FrameMailbox::FramePtr FrameMailbox::Acquire() {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (free_.empty()) {
+    stats_.allocated++;
+    pool_.push_back(std::make_unique<CameraFrame>());
+    free_.push_back(pool_.back().get());
+  }
+
+  CameraFrame* const frame = free_.back();
+  free_.pop_back();
+  return FramePtr(frame, [this](CameraFrame* released) {
+      this->Release(released);
+    });
+}
+
+void FrameMailbox::Release(CameraFrame* frame) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  free_.push_back(frame);
+}
+
+void FrameMailbox::Publish(FramePtr frame) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.published++;
+    if (newest_) { stats_.dropped++; }
+    // The replaced frame, now in frame, is released after the lock,
+    // since that takes the lock again.
+    std::swap(newest_, frame);
+  }
+  condition_.notify_one();
+}
+
+FrameMailbox::FramePtr FrameMailbox::Take() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  condition_.wait(lock, [&]() { return closed_ || !!newest_; });
+  if (closed_) { return {}; }
+
+  stats_.taken++;
+  return std::move(newest_);
+}
+
+void FrameMailbox::Close() {
+  FramePtr pending;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    std::swap(newest_, pending);
+  }
+  condition_.notify_all();
+}
+
+FrameMailbox::Stats FrameMailbox::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+}
+}
@@ -0,0 +1,113 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "mjlib/base/visitor.h"
+
+#include "base/mono_time.h"
+
+namespace mjmech {
+namespace mech {
+
+struct CameraFrame {
+  cv::Mat image;
+  /// Incremented for each frame captured.
+  uint64_t sequence = 0;
+  /// When the frame was captured, from base::MonoClock::ReadMonotonic.
+  base::MonoTime capture_time;
+  /// For replayed frames, the time the frame was originally captured,
+  /// in seconds since the start of the recording.
+  double source_time_s = 0.0;
+};
+
+/// Hands frames from a capture thread to one or more worker threads.
+///
+/// Only the newest frame is kept.  A worker which asks for a frame
+/// gets the newest one which no worker has yet taken, and any frame
+/// replaced before a worker took it is dropped.  With several
+/// workers, each naturally takes alternate frames.
+///
+/// Frames come from a pool, and one is only reused once nobody holds
+/// it, so in steady state capture writes into already allocated
+/// images.  The last reference to a frame returns it to the pool
+/// under the mutex, which orders a worker's last use of the image
+/// before the producer overwrites it.
+class FrameMailbox {
+ public:
+  using FramePtr = std::shared_ptr<CameraFrame>;
+
+  /// @param pool_size the number of frames to preallocate, which is
+  /// enough if it is the number of workers plus 2.
+  explicit FrameMailbox(int pool_size);
+  ~FrameMailbox();
+
+  /// @return a frame which nobody else holds, for the producer to
+  /// fill.
+  FramePtr Acquire();
+
+  /// Make @p frame the newest.  If the previous newest frame was
+  /// never taken, it is dropped.
+  void Publish(FramePtr frame);
+
+  /// Block until a frame is available.
+  ///
+  /// @return nullptr once Close has been called.
+  FramePtr Take();
+
+  /// Wake all waiting workers, and make Take return nullptr from now
+  /// on.
+  void Close();
+
+  struct Stats {
+    uint64_t published = 0;
+    uint64_t taken = 0;
+    uint64_t dropped = 0;
+    /// Frames allocated beyond the initial pool.
+    uint64_t allocated = 0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(published));
+      a->Visit(MJ_NVP(taken));
+      a->Visit(MJ_NVP(dropped));
+      a->Visit(MJ_NVP(allocated));
+    }
+  };
+
+  Stats stats() const;
+
+ private:
+  void Release(CameraFrame*);
+
+  mutable std::mutex mutex_;
+  std::condition_variable condition_;
+
+  std::vector<std::unique_ptr<CameraFrame>> pool_;
+  std::vector<CameraFrame*> free_;
+  FramePtr newest_;
+  bool closed_ = false;
+  Stats stats_;
+};
+
+}
+}
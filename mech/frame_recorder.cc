@@ -0,0 +1,249 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/frame_recorder.h"
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <fmt/format.h>
+
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+
+#include "base/mono_time.h"
+
+namespace mjmech {
+namespace mech {
+
+namespace {
+namespace pt = boost::posix_time;
+}
+
+class FrameRecorder::Impl {
+ public:
+  Impl(const std::string& prefix, const Options& options,
+       cv::Size size, int type)
+      : prefix_(prefix),
+        options_(options),
+        slots_(std::max(1, options.depth)) {
+    if (size.area() > 0) {
+      for (auto& slot : slots_) { slot.image.create(size, type); }
+    }
+
+    switch (options_.format) {
+      case Format::kRaw: {
+        break;
+      }
+      case Format::kJpeg: {
+        params_ = {cv::IMWRITE_JPEG_QUALITY, options_.jpeg_quality};
+        break;
+      }
+      case Format::kPng: {
+        params_ = {cv::IMWRITE_PNG_COMPRESSION, options_.png_compression};
+        break;
+      }
+    }
+
+    if (options_.sidecar) {
+      sidecar_.open(prefix_ + pt::to_iso_string(
+                        pt::microsec_clock::universal_time()) + ".csv");
+      sidecar_ << "file,sequence,timestamp,width,height,state\n";
+    }
+
+    thread_ = std::thread(std::bind(&Impl::Run, this));
+  }
+
+  ~Impl() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_ = true;
+    }
+    condition_.notify_all();
+    thread_.join();
+  }
+
+  bool Record(const CameraFrame& frame) {
+    // Convert the capture time to wall time here, while the two
+    // clocks are read close together.
+    const double age_s = base::MonoSeconds(
+        base::MonoClock::ReadMonotonic(), frame.capture_time);
+    const auto timestamp =
+        pt::microsec_clock::universal_time() -
+        pt::microseconds(static_cast<int64_t>(age_s * 1e6));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.offered++;
+    if (queued_ == static_cast<int>(slots_.size())) {
+      stats_.dropped++;
+      return false;
+    }
+
+    // The writer only ever touches the slot at head_, and this one is
+    // not it, so the copy into storage from the last time around the
+    // ring needs no allocation.
+    auto& slot = slots_[(head_ + queued_) % slots_.size()];
+    frame.image.copyTo(slot.image);
+    slot.sequence = frame.sequence;
+    slot.timestamp = timestamp;
+    slot.state = state_;
+    queued_++;
+    stats_.queued = queued_;
+
+    condition_.notify_all();
+    return true;
+  }
+
+  void SetState(const std::string& state) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    state_ = state;
+  }
+
+  Stats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+  void Flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [&]() { return queued_ == 0; });
+  }
+
+ private:
+  struct Slot {
+    cv::Mat image;
+    uint64_t sequence = 0;
+    pt::ptime timestamp;
+    std::string state;
+  };
+
+  void Run() {
+    ::pthread_setname_np(::pthread_self(), "recorder");
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      condition_.wait(lock, [&]() { return done_ || queued_ > 0; });
+      // Anything still queued is written before exiting.
+      if (queued_ == 0) { return; }
+
+      auto& slot = slots_[head_];
+      lock.unlock();
+
+      const auto start = base::MonoClock::ReadMonotonic();
+      const bool success = Write(slot);
+      const double write_s =
+          base::MonoSeconds(base::MonoClock::ReadMonotonic(), start);
+
+      lock.lock();
+      head_ = (head_ + 1) % slots_.size();
+      queued_--;
+      stats_.queued = queued_;
+      if (success) {
+        stats_.written++;
+      } else {
+        stats_.errors++;
+      }
+      stats_.write_s = write_s;
+      stats_.max_write_s = std::max(stats_.max_write_s, write_s);
+      condition_.notify_all();
+    }
+  }
+
+  bool Write(const Slot& slot) {
+    const auto path =
+        prefix_ + pt::to_iso_string(slot.timestamp) + Extension(slot.image);
+    bool success = false;
+    try {
+      success = cv::imwrite(path, slot.image, params_);
+    } catch (cv::Exception&) {
+      success = false;
+    }
+    if (!success) { return false; }
+
+    if (sidecar_.is_open()) {
+      sidecar_ << fmt::format(
+          "{},{},{},{},{},{}\n",
+          path, slot.sequence, pt::to_iso_extended_string(slot.timestamp),
+          slot.image.cols, slot.image.rows, slot.state);
+      // Keep the file usable if the process is killed.
+      sidecar_.flush();
+    }
+    return true;
+  }
+
+  std::string Extension(const cv::Mat& image) const {
+    switch (options_.format) {
+      case Format::kRaw: {
+        return image.channels() == 1 ? ".pgm" : ".ppm";
+      }
+      case Format::kJpeg: {
+        return ".jpg";
+      }
+      case Format::kPng: {
+        return ".png";
+      }
+    }
+    return ".png";
+  }
+
+  const std::string prefix_;
+  const Options options_;
+  std::vector<int> params_;
+  std::ofstream sidecar_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable condition_;
+
+  std::vector<Slot> slots_;
+  std::size_t head_ = 0;
+  int queued_ = 0;
+  bool done_ = false;
+  std::string state_;
+  Stats stats_;
+
+  std::thread thread_;
+};
+
+FrameRecorder::FrameRecorder(const std::string& prefix,
+                             const Options& options,
+                             cv::Size size, int type)
+    : impl_(std::make_unique<Impl>(prefix, options, size, type)) {}
+
+FrameRecorder::~FrameRecorder() {}
+
+bool FrameRecorder::Record(const CameraFrame& frame) {
+  return impl_->Record(frame);
+}
+
+void FrameRecorder::SetState(const std::string& state) {
+  impl_->SetState(state);
+}
+
+FrameRecorder::Stats FrameRecorder::stats() const {
+  return impl_->stats();
+}
+
+void FrameRecorder::Flush() {
+  impl_->Flush();
+}
+
+}
+}
@@ -0,0 +1,148 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <opencv2/core/core.hpp>
+
+#include "mjlib/base/visitor.h"
+
+#include "mech/frame_mailbox.h"
+
+namespace mjmech {
+namespace mech {
+
+/// Writes camera frames to disk from a background thread.
+///
+/// Frames are copied into a fixed ring of images and encoded by a
+/// single writer thread.  If the writer falls behind and the ring is
+/// full, new frames are dropped and counted, so that Record never
+/// waits on the disk or the encoder.
+///
+/// Each frame is named with the prefix and the ISO time it was
+/// captured, which CameraReplay understands.  Optionally, a sidecar
+/// CSV file lists every frame written, with the state most recently
+/// given to SetState.
+class FrameRecorder {
+ public:
+  enum class Format {
+    /// Uncompressed PPM, or PGM for single channel images.
+    kRaw,
+    kJpeg,
+    kPng,
+  };
+
+  struct Options {
+    /// Lossless, as recordings always were.  JPEG is much cheaper to
+    /// encode, but loses detail.
+    Format format = Format::kPng;
+    /// The number of frames which can wait to be written.
+    int depth = 4;
+    int jpeg_quality = 90;
+    /// From 0 to 9, where higher is smaller and slower.
+    int png_compression = 1;
+    /// Write "<prefix><time>.csv" with one line per frame.
+    bool sidecar = true;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(format));
+      a->Visit(MJ_NVP(depth));
+      a->Visit(MJ_NVP(jpeg_quality));
+      a->Visit(MJ_NVP(png_compression));
+      a->Visit(MJ_NVP(sidecar));
+    }
+  };
+
+  /// @param prefix is prepended to each file name, and may include a
+  /// directory.
+  ///
+  /// @param size if not empty, the ring is allocated for images of
+  /// this size and @p type up front.
+  FrameRecorder(const std::string& prefix, const Options& options,
+                cv::Size size = cv::Size(), int type = CV_8UC3);
+  ~FrameRecorder();
+
+  /// Queue @p frame to be written.  This copies the image and
+  /// returns without waiting.
+  ///
+  /// @return false if the frame was dropped because the ring was
+  /// full.
+  bool Record(const CameraFrame& frame);
+
+  /// Set the state recorded in the sidecar for subsequent frames.
+  /// This may be called from any thread.
+  void SetState(const std::string& state);
+
+  struct Stats {
+    uint64_t offered = 0;
+    uint64_t written = 0;
+    uint64_t dropped = 0;
+    uint64_t errors = 0;
+    /// Frames waiting to be written.
+    int queued = 0;
+    /// The time taken to encode and write the last frame.
+    double write_s = 0.0;
+    double max_write_s = 0.0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(offered));
+      a->Visit(MJ_NVP(written));
+      a->Visit(MJ_NVP(dropped));
+      a->Visit(MJ_NVP(errors));
+      a->Visit(MJ_NVP(queued));
+      a->Visit(MJ_NVP(write_s));
+      a->Visit(MJ_NVP(max_write_s));
+    }
+  };
+
+  /// This may be called from any thread.
+  Stats stats() const;
+
+  /// Block until every queued frame has been written.
+  void Flush();
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}
+}
+
+namespace mjlib {
+namespace base {
+
+template <>
+struct IsEnum<mjmech::mech::FrameRecorder::Format> {
+  static constexpr bool value = true;
+
+  using F = mjmech::mech::FrameRecorder::Format;
+  static std::map<F, const char*> map() {
+    return {
+      { F::kRaw, "raw" },
+      { F::kJpeg, "jpeg" },
+      { F::kPng, "png" },
+    };
+  }
+};
+
+}
+}
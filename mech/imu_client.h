@@ -26,6 +26,15 @@ class ImuClient {
   virtual ~ImuClient() {}
 
   virtual void ReadImu(AttitudeData*, mjlib::io::ErrorCallback) = 0;
+
+  /// Store every sample received since the last call into @p batch.
+  /// This never blocks, and may be called from the same thread as
+  /// any other method.  Clients which do not buffer samples report an
+  /// empty batch.
+  virtual void ReadImuBatch(AttitudeBatch* batch) {
+    batch->count = 0;
+    batch->dropped = 0;
+  }
 };
 
 }
@@ -0,0 +1,471 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/mcast_telemetry.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <random>
+
+#include <boost/asio/post.hpp>
+
+#include "mjlib/base/fail.h"
+#include "mjlib/base/system_error.h"
+#include "mjlib/base/time_conversions.h"
+#include "mjlib/io/now.h"
+#include "mjlib/io/repeating_timer.h"
+
+namespace pl = std::placeholders;
+
+namespace mjmech {
+namespace mech {
+
+namespace {
+void Write8(std::string* out, uint8_t value) {
+  out->push_back(static_cast<char>(value));
+}
+
+void Write16(std::string* out, uint16_t value) {
+  Write8(out, value & 0xff);
+  Write8(out, value >> 8);
+}
+
+void Write32(std::string* out, uint32_t value) {
+  Write16(out, value & 0xffff);
+  Write16(out, value >> 16);
+}
+
+void Patch16(std::string* out, std::size_t position, uint16_t value) {
+  (*out)[position] = static_cast<char>(value & 0xff);
+  (*out)[position + 1] = static_cast<char>(value >> 8);
+}
+
+class Reader {
+ public:
+  explicit Reader(std::string_view data) : data_(data) {}
+
+  bool ok() const { return ok_; }
+
+  uint8_t Read8() {
+    if (data_.empty()) {
+      ok_ = false;
+      return 0;
+    }
+    const uint8_t result = static_cast<uint8_t>(data_[0]);
+    data_.remove_prefix(1);
+    return result;
+  }
+
+  uint16_t Read16() {
+    const uint16_t lo = Read8();
+    return lo | (static_cast<uint16_t>(Read8()) << 8);
+  }
+
+  uint32_t Read32() {
+    const uint32_t lo = Read16();
+    return lo | (static_cast<uint32_t>(Read16()) << 16);
+  }
+
+  std::string_view ReadBytes(std::size_t size) {
+    if (size > data_.size()) {
+      ok_ = false;
+      return {};
+    }
+    const auto result = data_.substr(0, size);
+    data_.remove_prefix(size);
+    return result;
+  }
+
+ private:
+  std::string_view data_;
+  bool ok_ = true;
+};
+
+/// Sequence numbers wrap, so compare them as in RFC 1982.
+int32_t SequenceDelta(uint32_t later, uint32_t earlier) {
+  return static_cast<int32_t>(later - earlier);
+}
+}
+
+McastTelemetryEncoder::McastTelemetryEncoder()
+    : McastTelemetryEncoder(std::random_device()()) {}
+
+McastTelemetryEncoder::McastTelemetryEncoder(uint32_t session)
+    : session_(session) {}
+
+void McastTelemetryEncoder::Set(const std::string& name,
+                                std::string_view data,
+                                boost::posix_time::ptime now,
+                                boost::posix_time::ptime expiration) {
+  if (name.size() > std::numeric_limits<uint8_t>::max()) {
+    throw mjlib::base::system_error::einval(
+        "telemetry name too long: " + name);
+  }
+
+  auto& item = items_[name];
+  item.data.assign(data.data(), data.size());
+  item.sequence++;
+  item.set_time = now;
+  item.expiration = expiration;
+}
+
+void McastTelemetryEncoder::Encode(boost::posix_time::ptime now,
+                                   std::size_t max_datagram_size,
+                                   int64_t byte_budget,
+                                   const EmitCallback& emit) {
+  for (auto it = items_.begin(); it != items_.end();) {
+    const auto& expiration = it->second.expiration;
+    if (!expiration.is_not_a_date_time() && expiration <= now) {
+      stats_.expired++;
+      it = items_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  using ItemRef = std::pair<const std::string*, Item*>;
+  std::vector<ItemRef> order;
+  order.reserve(items_.size());
+  for (auto& pair : items_) { order.emplace_back(&pair.first, &pair.second); }
+  std::sort(order.begin(), order.end(),
+            [](const ItemRef& lhs, const ItemRef& rhs) {
+              const bool lhs_new =
+                  lhs.second->sent_sequence != lhs.second->sequence;
+              const bool rhs_new =
+                  rhs.second->sent_sequence != rhs.second->sequence;
+              if (lhs_new != rhs_new) { return lhs_new; }
+              return lhs.second->set_time > rhs.second->set_time;
+            });
+
+  const std::size_t max_size = std::min<std::size_t>(
+      max_datagram_size, std::numeric_limits<uint16_t>::max());
+
+  std::size_t used = 0;
+  auto open_datagram = [&]() {
+    if (used == datagrams_.size()) { datagrams_.emplace_back(); }
+    auto& datagram = datagrams_[used++];
+    datagram.clear();
+    Write8(&datagram, kVersion);
+    Write8(&datagram, 0);
+    Write16(&datagram, 0);
+    Write32(&datagram, ++datagram_sequence_);
+    Write32(&datagram, session_);
+    return &datagram;
+  };
+
+  int64_t spent = 0;
+  for (const auto& ref : order) {
+    const std::string& name = *ref.first;
+    Item& item = *ref.second;
+
+    const std::size_t header_size = kChunkHeaderSize + name.size();
+    if (max_size <= kDatagramHeaderSize + header_size) {
+      throw mjlib::base::system_error::einval(
+          "datagram too small for telemetry: " + name);
+    }
+    const std::size_t max_chunk =
+        max_size - kDatagramHeaderSize - header_size;
+    const std::size_t num_chunks =
+        std::max<std::size_t>(
+            1, (item.data.size() + max_chunk - 1) / max_chunk);
+    const int64_t cost = item.data.size() + num_chunks * header_size;
+
+    if (byte_budget >= 0 && spent + cost > byte_budget) {
+      stats_.deferred++;
+      continue;
+    }
+    spent += cost;
+
+    const uint32_t age_us = static_cast<uint32_t>(
+        std::clamp<int64_t>(
+            (now - item.set_time).total_microseconds(),
+            0, std::numeric_limits<uint32_t>::max()));
+
+    std::size_t offset = 0;
+    do {
+      const std::size_t remaining = item.data.size() - offset;
+
+      // Place the chunk in the first datagram which can hold it
+      // whole, or else start a new one.
+      std::string* datagram = nullptr;
+      for (std::size_t i = 0; i < used; i++) {
+        if (datagrams_[i].size() + header_size + remaining <= max_size) {
+          datagram = &datagrams_[i];
+          break;
+        }
+      }
+      if (datagram == nullptr) { datagram = open_datagram(); }
+
+      const std::size_t chunk = std::min(
+          remaining, max_size - datagram->size() - header_size);
+
+      Write8(datagram, name.size());
+      datagram->append(name);
+      Write32(datagram, item.sequence);
+      Write32(datagram, item.data.size());
+      Write32(datagram, offset);
+      Write16(datagram, chunk);
+      Write32(datagram, age_us);
+      datagram->append(item.data, offset, chunk);
+
+      const uint16_t count =
+          static_cast<uint8_t>((*datagram)[2]) |
+          (static_cast<uint8_t>((*datagram)[3]) << 8);
+      Patch16(datagram, 2, count + 1);
+
+      offset += chunk;
+    } while (offset < item.data.size());
+
+    item.sent_sequence = item.sequence;
+    stats_.items++;
+  }
+
+  for (std::size_t i = 0; i < used; i++) {
+    stats_.datagrams++;
+    stats_.bytes += datagrams_[i].size();
+    emit(datagrams_[i]);
+  }
+}
+
+bool McastTelemetryDecoder::Decode(std::string_view datagram) {
+  stats_.datagrams++;
+
+  Reader reader(datagram);
+  const uint8_t version = reader.Read8();
+  reader.Read8();  // reserved
+  const uint16_t num_chunks = reader.Read16();
+  const uint32_t sequence = reader.Read32();
+  const uint32_t session = reader.Read32();
+
+  if (!reader.ok() || version != McastTelemetryEncoder::kVersion) {
+    stats_.malformed++;
+    return false;
+  }
+
+  if (session_ != session) {
+    if (session_) { stats_.restarts++; }
+    session_ = session;
+    last_datagram_sequence_.reset();
+    partials_.clear();
+    delivered_.clear();
+  }
+
+  if (last_datagram_sequence_) {
+    const int32_t delta = SequenceDelta(sequence, *last_datagram_sequence_);
+    if (delta > 1) { stats_.lost += delta - 1; }
+    if (delta > 0) { last_datagram_sequence_ = sequence; }
+  } else {
+    last_datagram_sequence_ = sequence;
+  }
+
+  for (uint16_t i = 0; i < num_chunks; i++) {
+    const auto name = reader.ReadBytes(reader.Read8());
+    const uint32_t item_sequence = reader.Read32();
+    const uint32_t total_size = reader.Read32();
+    const uint32_t offset = reader.Read32();
+    const uint16_t size = reader.Read16();
+    const uint32_t age_us = reader.Read32();
+    const auto data = reader.ReadBytes(size);
+
+    if (!reader.ok() ||
+        offset > total_size ||
+        size > total_size - offset) {
+      stats_.malformed++;
+      return false;
+    }
+
+    HandleChunk(name, item_sequence, total_size, offset, data,
+                age_us * 1e-6);
+  }
+
+  return true;
+}
+
+void McastTelemetryDecoder::HandleChunk(
+    std::string_view name, uint32_t sequence, uint32_t total_size,
+    uint32_t offset, std::string_view data, double age_s) {
+  const auto delivered = delivered_.find(name);
+  if (delivered != delivered_.end() &&
+      SequenceDelta(sequence, delivered->second) <= 0) {
+    // We have already seen this version, or a newer one.
+    stats_.duplicates++;
+    return;
+  }
+
+  if (offset == 0 && data.size() == total_size) {
+    // The common case, where the item fits in one chunk, is
+    // delivered straight from the datagram.
+    Deliver(name, data, sequence, age_s);
+    return;
+  }
+
+  auto it = partials_.find(name);
+  bool reset = false;
+  if (it == partials_.end()) {
+    it = partials_.emplace(std::string(name), Partial()).first;
+    reset = true;
+  } else if (it->second.sequence != sequence) {
+    if (SequenceDelta(sequence, it->second.sequence) < 0) {
+      stats_.duplicates++;
+      return;
+    }
+    if (!it->second.offsets.empty()) { stats_.incomplete++; }
+    reset = true;
+  }
+
+  Partial& partial = it->second;
+  if (reset) {
+    partial.sequence = sequence;
+    partial.data.resize(total_size);
+    partial.offsets.clear();
+    partial.received = 0;
+  }
+
+  if (std::find(partial.offsets.begin(), partial.offsets.end(), offset) !=
+      partial.offsets.end()) {
+    // A retransmission of a fragment we already have.
+    return;
+  }
+
+  if (!data.empty()) {
+    std::memcpy(&partial.data[offset], data.data(), data.size());
+  }
+  partial.offsets.push_back(offset);
+  partial.received += data.size();
+
+  if (partial.received >= total_size) {
+    partial.offsets.clear();
+    partial.received = 0;
+    Deliver(name, partial.data, sequence, age_s);
+  }
+}
+
+void McastTelemetryDecoder::Deliver(
+    std::string_view name, std::string_view data,
+    uint32_t sequence, double age_s) {
+  auto it = delivered_.find(name);
+  if (it == delivered_.end()) {
+    it = delivered_.emplace(std::string(name), sequence).first;
+  } else {
+    it->second = sequence;
+  }
+
+  stats_.items++;
+
+  Item item;
+  item.name = name;
+  item.data = data;
+  item.sequence = sequence;
+  item.age_s = age_s;
+  callback_(item);
+}
+
+class McastTelemetryPublisher::Impl {
+ public:
+  Impl(const boost::asio::any_io_executor& executor,
+       base::UdpDataLink* link,
+       const Options& options)
+      : executor_(executor),
+        link_(link),
+        options_(options) {}
+
+  void AsyncStart(mjlib::io::ErrorCallback callback) {
+    timer_.start(mjlib::base::ConvertSecondsToDuration(options_.period_s),
+                 std::bind(&Impl::HandleTimer, this, pl::_1));
+
+    boost::asio::post(
+        executor_,
+        std::bind(std::move(callback), mjlib::base::error_code()));
+  }
+
+  void SetTelemetry(const std::string& name,
+                    const std::string& data,
+                    boost::posix_time::ptime expiration) {
+    encoder_.Set(name, data, Now(), expiration);
+  }
+
+  void Poll() {
+    const int64_t budget =
+        options_.max_bytes_per_s > 0.0 ?
+        static_cast<int64_t>(options_.max_bytes_per_s * options_.period_s) :
+        -1;
+    encoder_.Encode(
+        Now(), link_->get_max_data_size(), budget,
+        [&](std::string_view datagram) { link_->Send(datagram); });
+  }
+
+  const McastTelemetryEncoder::Stats& stats() const {
+    return encoder_.stats();
+  }
+
+ private:
+  void HandleTimer(const mjlib::base::error_code& ec) {
+    if (ec == boost::asio::error::operation_aborted) { return; }
+    mjlib::base::FailIf(ec);
+
+    Poll();
+  }
+
+  boost::posix_time::ptime Now() const {
+    return mjlib::io::Now(executor_.context());
+  }
+
+  boost::asio::any_io_executor executor_;
+  base::UdpDataLink* const link_;
+  const Options options_;
+  mjlib::io::RepeatingTimer timer_{executor_};
+
+  McastTelemetryEncoder encoder_;
+};
+
+McastTelemetryPublisher::McastTelemetryPublisher(
+    const boost::asio::any_io_executor& executor,
+    base::UdpDataLink* link,
+    const Options& options)
+    : impl_(std::make_unique<Impl>(executor, link, options)) {}
+
+McastTelemetryPublisher::~McastTelemetryPublisher() {}
+
+void McastTelemetryPublisher::AsyncStart(mjlib::io::ErrorCallback callback) {
+  impl_->AsyncStart(std::move(callback));
+}
+
+void McastTelemetryPublisher::SetTelemetry(
+    const std::string& name,
+    const std::string& data,
+    boost::posix_time::ptime expiration) {
+  impl_->SetTelemetry(name, data, expiration);
+}
+
+void McastTelemetryPublisher::Poll() {
+  impl_->Poll();
+}
+
+const McastTelemetryEncoder::Stats& McastTelemetryPublisher::stats() const {
+  return impl_->stats();
+}
+
+McastTelemetryReceiver::McastTelemetryReceiver(
+    base::UdpDataLink* link,
+    McastTelemetryDecoder::Callback callback)
+    : decoder_(std::move(callback)) {
+  connection_ = link->data_signal()->connect(
+      [this](std::string_view data, const base::UdpDataLink::PeerInfo&) {
+        decoder_.Decode(data);
+      });
+}
+
+}
+}
@@ -0,0 +1,266 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "mjlib/base/visitor.h"
+#include "mjlib/io/async_types.h"
+
+#include "base/udp_data_link.h"
+
+#include "mech/mcast_telemetry_interface.h"
+
+namespace mjmech {
+namespace mech {
+
+/// Packs named telemetry items into as few datagrams as possible.
+///
+/// Each datagram is:
+///
+///   uint8 version
+///   uint8 reserved
+///   uint16 chunk count
+///   uint32 datagram sequence
+///   uint32 session, chosen at random by each encoder
+///   chunks...
+///
+/// and each chunk is:
+///
+///   uint8 name size
+///   name
+///   uint32 item sequence, incremented each time the item is set
+///   uint32 item total size
+///   uint32 offset of this chunk within the item
+///   uint16 chunk size
+///   uint32 age of the item in microseconds when sent
+///   data
+///
+/// All integers are little endian.  An item which does not fit in
+/// one datagram is split into several chunks.
+///
+/// Sequence numbers start again from 1 when the publisher restarts,
+/// so the session tells receivers to forget the old ones.
+class McastTelemetryEncoder {
+ public:
+  static constexpr uint8_t kVersion = 2;
+  static constexpr std::size_t kDatagramHeaderSize = 12;
+  static constexpr std::size_t kChunkHeaderSize = 19;
+
+  /// Use a random session.
+  McastTelemetryEncoder();
+  explicit McastTelemetryEncoder(uint32_t session);
+
+  /// Replace any existing item called @p name.  It will be included
+  /// in every Encode until @p expiration.
+  void Set(const std::string& name, std::string_view data,
+           boost::posix_time::ptime now,
+           boost::posix_time::ptime expiration);
+
+  struct Stats {
+    uint64_t datagrams = 0;
+    uint64_t bytes = 0;
+    uint64_t items = 0;
+    // Items dropped because they expired.
+    uint64_t expired = 0;
+    // Items left out of an Encode because of the byte budget.
+    uint64_t deferred = 0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(datagrams));
+      a->Visit(MJ_NVP(bytes));
+      a->Visit(MJ_NVP(items));
+      a->Visit(MJ_NVP(expired));
+      a->Visit(MJ_NVP(deferred));
+    }
+  };
+
+  using EmitCallback = std::function<void (std::string_view)>;
+
+  /// Drop expired items, then pack the rest into datagrams of at
+  /// most @p max_datagram_size bytes and pass each to @p emit.
+  ///
+  /// If @p byte_budget is non-negative, items are left out once it
+  /// would be exceeded.  Items which have changed since they were
+  /// last sent are preferred, and then the most recently set.
+  void Encode(boost::posix_time::ptime now,
+              std::size_t max_datagram_size,
+              int64_t byte_budget,
+              const EmitCallback& emit);
+
+  /// @return the number of unexpired items as of the last Encode.
+  std::size_t size() const { return items_.size(); }
+
+  const Stats& stats() const { return stats_; }
+
+ private:
+  struct Item {
+    std::string data;
+    uint32_t sequence = 0;
+    uint32_t sent_sequence = 0;
+    boost::posix_time::ptime set_time;
+    boost::posix_time::ptime expiration;
+  };
+
+  std::map<std::string, Item> items_;
+  const uint32_t session_;
+  uint32_t datagram_sequence_ = 0;
+  Stats stats_;
+
+  std::vector<std::string> datagrams_;
+};
+
+/// Reassembles the items packed by McastTelemetryEncoder.
+class McastTelemetryDecoder {
+ public:
+  struct Item {
+    std::string_view name;
+    std::string_view data;
+    uint32_t sequence = 0;
+    // How old the item was when it was sent.
+    double age_s = 0.0;
+  };
+
+  /// The item is only valid for the duration of the call.
+  using Callback = std::function<void (const Item&)>;
+
+  explicit McastTelemetryDecoder(Callback callback)
+      : callback_(std::move(callback)) {}
+
+  /// Each item is delivered once per sequence number, no matter how
+  /// many times it is received.  When the session changes, as when
+  /// the publisher restarts, everything received before is forgotten.
+  ///
+  /// @return false if @p datagram was malformed.
+  bool Decode(std::string_view datagram);
+
+  struct Stats {
+    uint64_t datagrams = 0;
+    uint64_t items = 0;
+    uint64_t duplicates = 0;
+    uint64_t malformed = 0;
+    // Datagrams which never arrived, judging from the sequence
+    // numbers.
+    uint64_t lost = 0;
+    // Partially received items which were abandoned because a newer
+    // version arrived.
+    uint64_t incomplete = 0;
+    // Times the session changed after the first.
+    uint64_t restarts = 0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(datagrams));
+      a->Visit(MJ_NVP(items));
+      a->Visit(MJ_NVP(duplicates));
+      a->Visit(MJ_NVP(malformed));
+      a->Visit(MJ_NVP(lost));
+      a->Visit(MJ_NVP(incomplete));
+      a->Visit(MJ_NVP(restarts));
+    }
+  };
+
+  const Stats& stats() const { return stats_; }
+
+ private:
+  struct Partial {
+    uint32_t sequence = 0;
+    std::string data;
+    std::vector<uint32_t> offsets;
+    std::size_t received = 0;
+  };
+
+  void HandleChunk(std::string_view name, uint32_t sequence,
+                   uint32_t total_size, uint32_t offset,
+                   std::string_view data, double age_s);
+  void Deliver(std::string_view name, std::string_view data,
+               uint32_t sequence, double age_s);
+
+  Callback callback_;
+  Stats stats_;
+  std::optional<uint32_t> session_;
+  std::optional<uint32_t> last_datagram_sequence_;
+  std::map<std::string, Partial, std::less<>> partials_;
+  std::map<std::string, uint32_t, std::less<>> delivered_;
+};
+
+/// Periodically sends all current telemetry items over a UdpDataLink,
+/// normally to a multicast group, so that any number of ground
+/// stations can receive them.
+class McastTelemetryPublisher : public McastTelemetryInterface,
+                                boost::noncopyable {
+ public:
+  struct Options {
+    double period_s = 0.05;
+    // If non-zero, limit the average data rate.
+    double max_bytes_per_s = 0.0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(period_s));
+      a->Visit(MJ_NVP(max_bytes_per_s));
+    }
+  };
+
+  McastTelemetryPublisher(const boost::asio::any_io_executor&,
+                          base::UdpDataLink*,
+                          const Options&);
+  ~McastTelemetryPublisher() override;
+
+  void AsyncStart(mjlib::io::ErrorCallback);
+
+  void SetTelemetry(const std::string& name,
+                    const std::string& data,
+                    boost::posix_time::ptime expiration) override;
+
+  /// Send everything now, rather than waiting for the next period.
+  void Poll();
+
+  const McastTelemetryEncoder::Stats& stats() const;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+/// Delivers the items sent by a McastTelemetryPublisher.
+class McastTelemetryReceiver : boost::noncopyable {
+ public:
+  McastTelemetryReceiver(base::UdpDataLink*,
+                         McastTelemetryDecoder::Callback);
+
+  const McastTelemetryDecoder::Stats& stats() const {
+    return decoder_.stats();
+  }
+
+ private:
+  McastTelemetryDecoder decoder_;
+  boost::signals2::scoped_connection connection_;
+};
+
+}
+}
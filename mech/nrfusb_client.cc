@@ -15,11 +15,9 @@
 #include "mech/nrfusb_client.h"
 
 #include <array>
+#include <cstring>
 #include <functional>
-#include <iostream>
-#include <sstream>
 
-#include <boost/algorithm/string.hpp>
 #include <boost/asio/post.hpp>
 #include <boost/asio/read_until.hpp>
 #include <boost/asio/streambuf.hpp>
@@ -29,34 +27,15 @@
 
 #include "mjlib/base/assert.h"
 #include "mjlib/base/fail.h"
-#include "mjlib/base/tokenizer.h"
 #include "mjlib/io/now.h"
 
+#include "mech/nrfusb_protocol.h"
+
 namespace pl = std::placeholders;
 
 namespace mjmech {
 namespace mech {
 
-namespace {
-std::optional<std::string> ParseHexData(const std::string& data) {
-  if (data.size() % 2 != 0) { return {}; }
-  std::string result;
-  for (size_t i = 0; i < data.size(); i += 2) {
-    const int element = std::stoi(data.substr(i, 2), nullptr, 16);
-    result.push_back(static_cast<char>(element));
-  }
-  return result;
-}
-
-std::string FormatHexData(const std::string& data) {
-  std::ostringstream ostr;
-  for (char c : data) {
-    ostr << fmt::format("{:02x}", static_cast<int>(static_cast<uint8_t>(c)));
-  }
-  return ostr.str();
-}
-}
-
 class NrfusbClient::Impl {
  public:
   Impl(mjlib::io::AsyncStream* stream, const Options& options)
@@ -84,9 +63,10 @@ class NrfusbClient::Impl {
     MJ_ASSERT(slot_idx >= 0 && slot_idx < 15);
     tx_slots_[remote][slot_idx] = slot;
 
-    Write(fmt::format("slot pri2 {} {} {:08x}\nslot tx2 {} {} {}\n",
-                      remote, slot_idx, slot.priority,
-                      remote, slot_idx, FormatHexData({slot.data, slot.size})));
+    std::array<char, kNrfusbMaxTransmitSize> buffer;
+    const auto size = FormatNrfusbTransmit(
+        remote, slot_idx, slot.priority, slot.data, slot.size, &buffer);
+    Write({buffer.data(), size});
   }
 
   Slot tx_slot(int remote, int slot_idx) {
@@ -116,102 +96,66 @@ class NrfusbClient::Impl {
         *stream_,
         read_streambuf_,
         '\n',
-        std::bind(&Impl::HandleRead, this, pl::_1));
+        std::bind(&Impl::HandleRead, this, pl::_1, pl::_2));
   }
 
-  void HandleRead(const mjlib::base::error_code& ec) {
+  void HandleRead(const mjlib::base::error_code& ec, std::size_t size) {
     mjlib::base::FailIf(ec);
 
-    std::istream in(&read_streambuf_);
-    std::string line;
-    std::getline(in, line);
-
+    // The streambuf's input sequence is contiguous, so the line can
+    // be parsed where it lies.
+    const std::string_view line(
+        static_cast<const char*>(read_streambuf_.data().data()), size);
     HandleLine(line);
+    read_streambuf_.consume(size);
 
     StartRead();
   }
 
-  void HandleLine(const std::string& line_in) {
-    std::string line = boost::trim_copy(line_in);
-    if (line.empty()) { return; }
-    if (line == "OK") { return; }
-
-    if (line.substr(0, 5) == "rcv2 ") {
-      HandleReceive2(line.substr(5));
-    } else if (line.substr(0, 4) == "rcv ")  {
-      HandleReceive(0, line.substr(4));
-    }
-
-    // Some unknown line.  We'll ignore for now.
-  }
-
-  void HandleReceive2(const std::string& line) {
-    mjlib::base::Tokenizer tokenizer(line, " ");
-    const int remote = std::strtol(tokenizer.next().data(), nullptr, 0);
-    HandleReceive(remote, std::string(tokenizer.remaining()));
-  }
+  void HandleLine(std::string_view line) {
+    // Anything other than a receive, like "OK", is ignored.
+    if (!ParseNrfusbLine(line, &receive_)) { return; }
 
-  void HandleReceive(int remote, const std::string& line) {
     const auto now = mjlib::io::Now(stream_->get_executor().context());
+    auto& rx_slots = rx_slots_[receive_.remote];
 
-    std::vector<std::string> fields;
-    boost::split(fields, line, boost::is_any_of(" "));
-    for (const auto& field : fields) {
-      HandleField(now, remote, field);
+    for (int i = 0; i < kNrfusbNumSlots; i++) {
+      if ((receive_.bitfield & (1 << i)) == 0) { continue; }
+
+      const auto& received = receive_.slots[i];
+      auto& slot = rx_slots[i];
+      std::memcpy(&slot.data[0], received.data.data(), received.size);
+      slot.size = received.size;
+      slot.timestamp = now;
     }
+    pending_bitfield_ |= receive_.bitfield;
 
     if (remote_) {
-      *remote_ = remote;
+      *remote_ = receive_.remote;
     }
 
     MaybeProcessCallback();
   }
 
-  void HandleField(boost::posix_time::ptime now,
-                   int remote,
-                   const std::string& field) {
-    const size_t pos = field.find(':');
-    if (pos == std::string::npos) {
-      return;
-    }
-
-    const int slot_num = std::stoi(field.substr(0, pos));
-
-    if (slot_num < 0 || slot_num > 14) {
-      return;
-    }
-
-    const auto maybe_data = ParseHexData(field.substr(pos + 1));
-    if (!maybe_data) {
-      return;
-    }
-
-    const auto data = *maybe_data;
-
-    auto& slot = rx_slots_[remote][slot_num];
-    const auto to_copy =
-        std::min<std::size_t>(sizeof(slot.data), data.size());
-    std::memcpy(&slot.data[0], data.data(), to_copy);
-    slot.size = to_copy;
-    slot.timestamp = now;
-
-    pending_bitfield_ |= (1 << slot_num);
-  }
-
-  void Write(const std::string& data) {
-    std::ostream os(&write_streambuf_);
-    os.write(data.data(), data.size());
+  void Write(std::string_view data) {
+    queued_.append(data.data(), data.size());
     MaybeStartWrite();
   }
 
   void MaybeStartWrite() {
     if (write_outstanding_) { return; }
-    if (write_streambuf_.size() == 0) { return; }
+    if (queued_.empty()) { return; }
+
+    // Writes issued while this one is outstanding accumulate in
+    // queued_, so the buffer being written is never touched.  Both
+    // keep their capacity, so steady state writes do not allocate.
+    std::swap(queued_, writing_);
+    queued_.clear();
 
     write_outstanding_ = true;
     boost::asio::async_write(
         *stream_,
-        write_streambuf_,
+        boost::asio::buffer(writing_),
         std::bind(&Impl::HandleWrite, this, pl::_1));
   }
 
@@ -228,7 +172,10 @@ class NrfusbClient::Impl {
   std::map<int, std::array<Slot, 15>> tx_slots_ = {};
 
   boost::asio::streambuf read_streambuf_;
-  boost::asio::streambuf write_streambuf_;
+  NrfusbReceive receive_;
+
+  std::string queued_;
+  std::string writing_;
   bool write_outstanding_ = false;
 
   uint16_t pending_bitfield_ = 0;
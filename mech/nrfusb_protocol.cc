@@ -0,0 +1,165 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/nrfusb_protocol.h"
+
+#include <algorithm>
+
+namespace mjmech {
+namespace mech {
+
+namespace {
+bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+std::string_view Trim(std::string_view value) {
+  while (!value.empty() && IsSpace(value.front())) { value.remove_prefix(1); }
+  while (!value.empty() && IsSpace(value.back())) { value.remove_suffix(1); }
+  return value;
+}
+
+/// Remove and return everything up to the next space.
+std::string_view NextToken(std::string_view* line) {
+  const auto end = line->find(' ');
+  const auto result = line->substr(0, end);
+  line->remove_prefix(end == std::string_view::npos ? line->size() : end + 1);
+  return result;
+}
+
+int HexValue(char c) {
+  if (c >= '0' && c <= '9') { return c - '0'; }
+  if (c >= 'a' && c <= 'f') { return c - 'a' + 10; }
+  if (c >= 'A' && c <= 'F') { return c - 'A' + 10; }
+  return -1;
+}
+
+/// Parse a small non-negative integer, in decimal, or in hex with a
+/// 0x prefix.  @return -1 on error.
+int ParseInteger(std::string_view value) {
+  int base = 10;
+  if (value.size() > 2 && value[0] == '0' &&
+      (value[1] == 'x' || value[1] == 'X')) {
+    base = 16;
+    value.remove_prefix(2);
+  }
+  if (value.empty() || value.size() > 6) { return -1; }
+
+  int result = 0;
+  for (const char c : value) {
+    const int digit = HexValue(c);
+    if (digit < 0 || digit >= base) { return -1; }
+    result = result * base + digit;
+  }
+  return result;
+}
+
+constexpr char kHexDigits[] = "0123456789abcdef";
+
+char* WriteInteger(char* out, uint32_t value) {
+  char digits[10] = {};
+  int count = 0;
+  do {
+    digits[count++] = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while (value);
+  while (count) { *out++ = digits[--count]; }
+  return out;
+}
+
+char* WriteString(char* out, std::string_view value) {
+  return std::copy(value.begin(), value.end(), out);
+}
+
+void ParseField(std::string_view field, NrfusbReceive* result) {
+  const auto colon = field.find(':');
+  if (colon == std::string_view::npos) { return; }
+
+  const int slot_num = ParseInteger(field.substr(0, colon));
+  if (slot_num < 0 || slot_num >= kNrfusbNumSlots) { return; }
+
+  const auto hex = field.substr(colon + 1);
+  if (hex.size() % 2 != 0) { return; }
+
+  auto& slot = result->slots[slot_num];
+  uint8_t size = 0;
+  for (std::size_t i = 0; i < hex.size(); i += 2) {
+    const int high = HexValue(hex[i]);
+    const int low = HexValue(hex[i + 1]);
+    if (high < 0 || low < 0) { return; }
+    // Anything longer than a slot is validated, but dropped.
+    if (size < kNrfusbMaxSlotSize) {
+      slot.data[size++] = static_cast<uint8_t>(high * 16 + low);
+    }
+  }
+  slot.size = size;
+
+  result->bitfield |= (1 << slot_num);
+}
+}
+
+bool ParseNrfusbLine(std::string_view line, NrfusbReceive* result) {
+  line = Trim(line);
+  result->bitfield = 0;
+  result->remote = 0;
+
+  const auto command = NextToken(&line);
+  if (command == "rcv2") {
+    result->remote = ParseInteger(NextToken(&line));
+    if (result->remote < 0) { return false; }
+  } else if (command != "rcv") {
+    return false;
+  }
+
+  while (!line.empty()) {
+    ParseField(NextToken(&line), result);
+  }
+
+  return true;
+}
+
+std::size_t FormatNrfusbTransmit(
+    int remote, int slot_idx, uint32_t priority,
+    const char* data, std::size_t size,
+    std::array<char, kNrfusbMaxTransmitSize>* out) {
+  char* const start = out->data();
+  char* ptr = start;
+
+  ptr = WriteString(ptr, "slot pri2 ");
+  ptr = WriteInteger(ptr, remote);
+  *ptr++ = ' ';
+  ptr = WriteInteger(ptr, slot_idx);
+  *ptr++ = ' ';
+  for (int shift = 28; shift >= 0; shift -= 4) {
+    *ptr++ = kHexDigits[(priority >> shift) & 0x0f];
+  }
+  ptr = WriteString(ptr, "\nslot tx2 ");
+  ptr = WriteInteger(ptr, remote);
+  *ptr++ = ' ';
+  ptr = WriteInteger(ptr, slot_idx);
+  *ptr++ = ' ';
+  const std::size_t to_write =
+      std::min<std::size_t>(size, kNrfusbMaxSlotSize);
+  for (std::size_t i = 0; i < to_write; i++) {
+    const auto byte = static_cast<uint8_t>(data[i]);
+    *ptr++ = kHexDigits[byte >> 4];
+    *ptr++ = kHexDigits[byte & 0x0f];
+  }
+  *ptr++ = '\n';
+
+  return ptr - start;
+}
+
+}
+}
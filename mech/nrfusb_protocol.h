@@ -0,0 +1,76 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+/// @file
+///
+/// The text protocol spoken by the nrfusb dongle.  Slots are received
+/// as lines of the form:
+///
+///   rcv <slot>:<hex> <slot>:<hex> ...
+///   rcv2 <remote> <slot>:<hex> <slot>:<hex> ...
+///
+/// and transmitted with:
+///
+///   slot pri2 <remote> <slot> <priority as 8 hex digits>
+///   slot tx2 <remote> <slot> <hex>
+///
+/// Neither parsing nor formatting allocates.
+
+namespace mjmech {
+namespace mech {
+
+constexpr int kNrfusbNumSlots = 15;
+constexpr int kNrfusbMaxSlotSize = 16;
+
+struct NrfusbReceive {
+  int remote = 0;
+
+  /// A 1 for each slot which was present in the line.
+  uint16_t bitfield = 0;
+
+  struct Slot {
+    uint8_t size = 0;
+    std::array<uint8_t, kNrfusbMaxSlotSize> data = {};
+  };
+
+  /// Only those slots named in bitfield are valid.
+  std::array<Slot, kNrfusbNumSlots> slots;
+};
+
+/// Parse one line from the dongle, with or without its terminator.
+///
+/// @return false if the line is not a receive, or is malformed.
+/// Individual malformed slots are skipped.
+bool ParseNrfusbLine(std::string_view line, NrfusbReceive* result);
+
+/// The longest output of FormatNrfusbTransmit.
+constexpr std::size_t kNrfusbMaxTransmitSize = 128;
+
+/// Format the commands which transmit one slot into @p out.  At most
+/// kNrfusbMaxSlotSize bytes of @p data are sent.
+///
+/// @return the number of characters written.
+std::size_t FormatNrfusbTransmit(
+    int remote, int slot_idx, uint32_t priority,
+    const char* data, std::size_t size,
+    std::array<char, kNrfusbMaxTransmitSize>* out);
+
+}
+}
@@ -14,6 +14,12 @@
 
 #pragma once
 
+#include <array>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "mjlib/base/visitor.h"
 #include "mjlib/multiplex/asio_client.h"
 
 #include "mech/imu_client.h"
@@ -30,10 +36,83 @@ class Pi3hatInterface : public ImuClient,
  public:
   ~Pi3hatInterface() override {}
 
+  struct Stats {
+    boost::posix_time::ptime timestamp;
+
+    struct Bus {
+      int tx_frames = 0;
+      int tx_bytes = 0;
+      int rx_frames = 0;
+      int rx_bytes = 0;
+
+      template <typename Archive>
+      void Serialize(Archive* a) {
+        a->Visit(MJ_NVP(tx_frames));
+        a->Visit(MJ_NVP(tx_bytes));
+        a->Visit(MJ_NVP(rx_frames));
+        a->Visit(MJ_NVP(rx_bytes));
+      }
+    };
+
+    /// The traffic and duration of a single exchange with the hat.
+    struct Transfer {
+      double duration_s = 0.0;
+      // Indexed by bus number.  Bus 5 is the auxiliary bus.
+      std::array<Bus, 6> buses = {};
+
+      template <typename Archive>
+      void Serialize(Archive* a) {
+        a->Visit(MJ_NVP(duration_s));
+        a->Visit(MJ_NVP(buses));
+      }
+    };
+
+    // The most recent Cycle and AsyncTransmit respectively.
+    Transfer cycle;
+    Transfer transmit;
+
+    struct Servo {
+      int id = 0;
+      int bus = 0;
+      // Whether the most recent request expecting a reply went
+      // unanswered, and how many have in total.
+      bool missing = false;
+      int total_missing = 0;
+
+      template <typename Archive>
+      void Serialize(Archive* a) {
+        a->Visit(MJ_NVP(id));
+        a->Visit(MJ_NVP(bus));
+        a->Visit(MJ_NVP(missing));
+        a->Visit(MJ_NVP(total_missing));
+      }
+    };
+
+    std::vector<Servo> servos;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(timestamp));
+      a->Visit(MJ_NVP(cycle));
+      a->Visit(MJ_NVP(transmit));
+      a->Visit(MJ_NVP(servos));
+    }
+  };
+
   virtual void Cycle(
       AttitudeData*,
       const Request*, Reply*,
       mjlib::io::ErrorCallback callback) = 0;
+
+  /// Return the CAN bus which the given servo id is attached to.
+  virtual int SelectBus(int id) const { return 1; }
+
+  /// Statistics about the most recent bus exchanges.  Only valid from
+  /// the thread which owns this object.
+  virtual const Stats& stats() const {
+    static Stats empty;
+    return empty;
+  }
 };
 
 }
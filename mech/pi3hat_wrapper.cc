@@ -14,13 +14,19 @@
 
 #include "mech/pi3hat_wrapper.h"
 
+#include <pthread.h>
+
+#include <algorithm>
+#include <chrono>
 #include <functional>
 #include <thread>
 
 #include <fmt/format.h>
 
+#include <boost/algorithm/string.hpp>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
 
 #include "mjlib/base/fail.h"
 #include "mjlib/base/system_error.h"
@@ -34,6 +40,7 @@
 
 #include "base/logging.h"
 #include "base/saturate.h"
+#include "base/spsc_ring.h"
 
 namespace mjmech {
 namespace mech {
@@ -43,6 +50,11 @@ template <typename T>
 uint32_t u32(T value) {
   return static_cast<uint32_t>(value);
 }
+
+int64_t SteadyNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 }
 
 #ifdef COM_GITHUB_MJBOTS_RASPBERRYPI
@@ -52,6 +64,7 @@ class Pi3hatWrapper::Impl {
       : executor_(executor),
         options_(options),
         power_poll_timer_(executor) {
+    ParseBusMap();
     thread_ = std::thread(std::bind(&Impl::CHILD_Run, this));
   }
 
@@ -61,6 +74,8 @@ class Pi3hatWrapper::Impl {
   }
 
   void AsyncStart(mjlib::io::ErrorCallback callback) {
+    CheckBusBalance();
+
     power_poll_timer_.start(base::ConvertSecondsToDuration(
                                 options_.power_poll_period_s),
                             std::bind(&Impl::HandlePowerPoll, this,
@@ -76,6 +91,30 @@ class Pi3hatWrapper::Impl {
     attitude_callback_ = std::move(callback);
   }
 
+  void ReadImuBatch(AttitudeBatch* batch) {
+    // The samples were timestamped with the monotonic clock in the
+    // child, map them back onto our (possibly simulated) time base.
+    const auto now = mjlib::io::Now(executor_.context());
+    const auto steady_now = SteadyNs();
+
+    batch->count = 0;
+    batch->dropped = imu_dropped_.exchange(0);
+
+    ImuSample sample;
+    while (imu_ring_.size() > AttitudeBatch::kMaxSamples) {
+      imu_ring_.Pop(&sample);
+      batch->dropped++;
+    }
+    while (batch->count < AttitudeBatch::kMaxSamples &&
+           imu_ring_.Pop(&sample)) {
+      const auto age = boost::posix_time::microseconds(
+          (steady_now - sample.steady_ns) / 1000);
+      FillAttitude(now - age, sample.attitude,
+                   &batch->samples[batch->count]);
+      batch->count++;
+    }
+  }
+
   void AsyncWaitForSlot(
       int* remote,
       uint16_t* bitfield,
@@ -150,7 +189,64 @@ class Pi3hatWrapper::Impl {
     return std::make_shared<Tunnel>(this, id, channel, options);
   }
 
+  int SelectBus(int id) const {
+    if (options_.force_bus >= 0) { return options_.force_bus; }
+    if (id < 0 || id >= static_cast<int>(bus_map_.size())) { return 1; }
+
+    return bus_map_[id];
+  }
+
+  const Stats& stats() const { return stats_; }
+
  private:
+  void ParseBusMap() {
+    bus_map_.fill(1);
+
+    std::vector<std::string> items;
+    boost::split(items, options_.bus_map, boost::is_any_of(", "),
+                 boost::token_compress_on);
+    for (const auto& item : items) {
+      if (item.empty()) { continue; }
+
+      std::vector<std::string> fields;
+      boost::split(fields, item, boost::is_any_of(":"));
+      const auto maybe_pair = [&]() -> std::optional<std::pair<int, int>> {
+        if (fields.size() != 2) { return {}; }
+        try {
+          return std::make_pair(std::stoi(fields[0]), std::stoi(fields[1]));
+        } catch (std::exception&) {
+          return {};
+        }
+      }();
+      if (!maybe_pair ||
+          maybe_pair->first < 0 ||
+          maybe_pair->first >= static_cast<int>(bus_map_.size()) ||
+          maybe_pair->second < 1 || maybe_pair->second > 5) {
+        mjlib::base::Fail(fmt::format("Invalid bus_map entry '{}'", item));
+      }
+
+      bus_map_[maybe_pair->first] = maybe_pair->second;
+      mapped_ids_.push_back(maybe_pair->first);
+    }
+  }
+
+  void CheckBusBalance() {
+    // Only the 4 high speed buses carry servos.
+    std::array<int, 5> servos_per_bus = {};
+    for (const int id : mapped_ids_) {
+      const int bus = SelectBus(id);
+      if (bus >= 1 && bus <= 4) { servos_per_bus[bus]++; }
+    }
+    const auto minmax = std::minmax_element(
+        servos_per_bus.begin() + 1, servos_per_bus.end());
+    if (*minmax.second - *minmax.first > 1) {
+      log_.warn(fmt::format(
+                    "CAN buses are unbalanced, servos per bus 1-4: {} {} {} {}",
+                    servos_per_bus[1], servos_per_bus[2],
+                    servos_per_bus[3], servos_per_bus[4]));
+    }
+  }
+
   void HandlePowerPoll(const mjlib::base::error_code& ec) {
     if (ec == boost::asio::error::operation_aborted) {
       return;
@@ -236,6 +332,8 @@ class Pi3hatWrapper::Impl {
   };
 
   void CHILD_Run() {
+    ::pthread_setname_np(::pthread_self(), "pi3hat");
+
     if (options_.cpu_affinity >= 0) {
       cpu_set_t cpuset = {};
       CPU_ZERO(&cpuset);
@@ -260,6 +358,10 @@ class Pi3hatWrapper::Impl {
         return c;
       }());
 
+    if (options_.imu_buffer) {
+      CHILD_PollImu();
+    }
+
     boost::asio::io_context::work work{child_context_};
     child_context_.run();
 
@@ -341,13 +443,18 @@ class Pi3hatWrapper::Impl {
 
     input.attitude = &pi3data_.attitude;
     input.request_attitude = true;
-    input.wait_for_attitude = true;
+    // When buffering, the poller has likely already consumed the most
+    // recent sample, and waiting for another would only add latency.
+    input.wait_for_attitude = !options_.imu_buffer;
     input.request_attitude_detail = options_.attitude_detail;
     input.request_rf = request_rf;
     input.timeout_ns = options_.query_timeout_s * 1e9;
     input.rx_extra_wait_ns = 0;
 
+    const auto start_ns = SteadyNs();
     pi3data_.result = pi3hat_->Cycle(input);
+    pi3data_.duration_ns = SteadyNs() - start_ns;
+    CHILD_HandleAttitude();
 
     // Now come back to the main thread.
     boost::asio::post(
@@ -374,7 +481,12 @@ class Pi3hatWrapper::Impl {
     input.request_rf = request_rf;
     input.timeout_ns = options_.query_timeout_s * 1e9;
 
+    const auto start_ns = SteadyNs();
     pi3data_.result = pi3hat_->Cycle(input);
+    pi3data_.duration_ns = SteadyNs() - start_ns;
+    if (request_attitude) {
+      CHILD_HandleAttitude();
+    }
 
     // Now come back to the main thread.
     boost::asio::post(
@@ -384,6 +496,49 @@ class Pi3hatWrapper::Impl {
         });
   }
 
+  void CHILD_HandleAttitude() {
+    if (!options_.imu_buffer) { return; }
+
+    if (pi3data_.result.attitude_present) {
+      CHILD_PushImu(pi3data_.attitude);
+    } else {
+      // The poller got to it first, so report the latest it saw.
+      pi3data_.attitude = imu_poll_attitude_;
+    }
+  }
+
+  void CHILD_PushImu(const mjbots::pi3hat::Attitude& attitude) {
+    imu_poll_attitude_ = attitude;
+    if (!imu_ring_.Push({SteadyNs(), attitude})) {
+      imu_dropped_++;
+    }
+  }
+
+  void CHILD_PollImu() {
+    // Only the attitude is requested, and we never block waiting for
+    // it, so that CAN cycles queued behind us are not delayed.
+    mjbots::pi3hat::Pi3Hat::Input input;
+    mjbots::pi3hat::Attitude attitude;
+    input.attitude = &attitude;
+    input.request_attitude = true;
+    input.wait_for_attitude = false;
+    input.request_attitude_detail = options_.attitude_detail;
+
+    const auto result = pi3hat_->Cycle(input);
+    if (result.attitude_present) {
+      CHILD_PushImu(attitude);
+    }
+
+    // Poll at twice the IMU rate so no sample is missed.
+    imu_poll_timer_.expires_after(std::chrono::nanoseconds(
+        static_cast<int64_t>(0.5e9 / std::max<uint32_t>(
+                                 1, options_.imu_rate_hz))));
+    imu_poll_timer_.async_wait([this](const auto& ec) {
+        if (ec) { return; }
+        this->CHILD_PollImu();
+      });
+  }
+
   size_t CHILD_TunnelPoll(uint8_t id, uint32_t channel,
                           mjlib::io::MutableBufferSequence buffers) {
     mjbots::pi3hat::Pi3Hat::Input input;
@@ -557,7 +712,67 @@ class Pi3hatWrapper::Impl {
     }
   }
 
+  void FinishStats(boost::posix_time::ptime now, Stats::Transfer* transfer) {
+    const auto& d = pi3data_;
+
+    stats_.timestamp = now;
+    transfer->duration_s = d.duration_ns * 1e-9;
+    transfer->buses = {};
+
+    auto get_bus = [&](int bus) -> Stats::Bus* {
+      if (bus < 0 || bus >= static_cast<int>(transfer->buses.size())) {
+        return nullptr;
+      }
+      return &transfer->buses[bus];
+    };
+
+    for (const auto& frame : d.tx_can) {
+      if (auto* const bus = get_bus(frame.bus)) {
+        bus->tx_frames++;
+        bus->tx_bytes += frame.size;
+      }
+    }
+    for (size_t i = 0; i < d.result.rx_can_size; i++) {
+      const auto& frame = d.rx_can[i];
+      if (auto* const bus = get_bus(frame.bus)) {
+        bus->rx_frames++;
+        bus->rx_bytes += frame.size;
+      }
+    }
+
+    for (const auto& frame : d.tx_can) {
+      if (!frame.expect_reply) { continue; }
+
+      const int id = frame.id & 0x7f;
+      bool found = false;
+      for (size_t i = 0; i < d.result.rx_can_size; i++) {
+        if (((d.rx_can[i].id >> 8) & 0xff) == static_cast<uint32_t>(id)) {
+          found = true;
+          break;
+        }
+      }
+
+      auto& servo = [&]() -> Stats::Servo& {
+        for (auto& servo : stats_.servos) {
+          if (servo.id == id) { return servo; }
+        }
+        stats_.servos.push_back({});
+        stats_.servos.back().id = id;
+        return stats_.servos.back();
+      }();
+      servo.bus = frame.bus;
+      servo.missing = !found;
+      if (!found) { servo.total_missing++; }
+    }
+  }
+
   void FinishAttitude(boost::posix_time::ptime now, AttitudeData* attitude) {
+    FillAttitude(now, pi3data_.attitude, attitude);
+  }
+
+  static void FillAttitude(boost::posix_time::ptime now,
+                           const mjbots::pi3hat::Attitude& src,
+                           AttitudeData* attitude) {
     auto make_point = [](const auto& p) {
       return base::Point3D(p.x, p.y, p.z);
     };
@@ -565,15 +780,13 @@ class Pi3hatWrapper::Impl {
       return base::Quaternion(q.w, q.x, q.y, q.z);
     };
     attitude->timestamp = now;
-    attitude->attitude = make_quat(pi3data_.attitude.attitude);
-    attitude->rate_dps = make_point(pi3data_.attitude.rate_dps);
+    attitude->attitude = make_quat(src.attitude);
+    attitude->rate_dps = make_point(src.rate_dps);
     attitude->euler_deg = (180.0 / M_PI) * attitude->attitude.euler_rad();
-    attitude->accel_mps2 = make_point(pi3data_.attitude.accel_mps2);
-    attitude->bias_dps = make_point(pi3data_.attitude.bias_dps);
-    attitude->attitude_uncertainty =
-        make_quat(pi3data_.attitude.attitude_uncertainty);
-    attitude->bias_uncertainty_dps =
-        make_point(pi3data_.attitude.bias_uncertainty_dps);
+    attitude->accel_mps2 = make_point(src.accel_mps2);
+    attitude->bias_dps = make_point(src.bias_dps);
+    attitude->attitude_uncertainty = make_quat(src.attitude_uncertainty);
+    attitude->bias_uncertainty_dps = make_point(src.bias_uncertainty_dps);
   }
 
   void FinishRF(boost::posix_time::ptime now) {
@@ -610,6 +823,7 @@ class Pi3hatWrapper::Impl {
     const auto now = mjlib::io::Now(executor_.context());
 
     FinishCAN(reply);
+    FinishStats(now, &stats_.cycle);
     FinishAttitude(now, attitude);
     FinishRF(now);
 
@@ -622,6 +836,7 @@ class Pi3hatWrapper::Impl {
     const auto now = mjlib::io::Now(executor_.context());
 
     FinishCAN(reply);
+    FinishStats(now, &stats_.transmit);
 
     if (attitude_) {
       FinishAttitude(now, attitude_);
@@ -640,16 +855,6 @@ class Pi3hatWrapper::Impl {
         std::bind(std::move(callback), mjlib::base::error_code()));
   }
 
-  int SelectBus(int id) const {
-    if (options_.force_bus >= 0) { return options_.force_bus; }
-
-    return (id >= 1 && id <= 3) ? 1 :
-        (id >= 4 && id <= 6) ? 2 :
-        (id >= 7 && id <= 9) ? 3 :
-        (id >= 10 && id <= 12) ? 4 :
-        1; // just send everything else out to 1 by default
-  }
-
   base::LogRef log_ = base::GetLogInstance("Pi3hatWrapper");
 
   boost::asio::any_io_executor executor_;
@@ -669,6 +874,12 @@ class Pi3hatWrapper::Impl {
   uint16_t* rf_bitfield_ = nullptr;
   mjlib::io::ErrorCallback rf_callback_;
 
+  // Indexed by servo id.
+  std::array<int, 128> bus_map_ = {};
+  std::vector<int> mapped_ids_;
+
+  Stats stats_;
+
   std::array<Slot, 16> rf_rx_slots_ = {};
   std::array<Slot, 16> rf_tx_slots_ = {};
   uint16_t rf_to_send_ = 0;
@@ -679,6 +890,17 @@ class Pi3hatWrapper::Impl {
   // Only accessed from the thread.
   std::optional<mjbots::pi3hat::Pi3Hat> pi3hat_;
   boost::asio::io_context child_context_;
+  boost::asio::steady_timer imu_poll_timer_{child_context_};
+  mjbots::pi3hat::Attitude imu_poll_attitude_;
+
+  // IMU samples flow from the child to the parent through this ring
+  // without any locking.
+  struct ImuSample {
+    int64_t steady_ns = 0;
+    mjbots::pi3hat::Attitude attitude;
+  };
+  base::SpscRing<ImuSample, 64> imu_ring_;
+  std::atomic<int> imu_dropped_{0};
 
   // The following are accessed by both threads, but never at the same
   // time.  They can either be accessed inside CHILD_Register, or in
@@ -693,6 +915,7 @@ class Pi3hatWrapper::Impl {
     uint16_t rf_to_send = 0;
 
     mjbots::pi3hat::Pi3Hat::Output result;
+    int64_t duration_ns = 0;
   };
   Pi3Data pi3data_;
 
@@ -705,6 +928,10 @@ class Pi3hatWrapper::Impl {
   Impl(const boost::asio::any_io_executor&, const Options&) {}
   void AsyncStart(mjlib::io::ErrorCallback) {}
   void ReadImu(AttitudeData*, mjlib::io::ErrorCallback) {}
+  void ReadImuBatch(AttitudeBatch* batch) {
+    batch->count = 0;
+    batch->dropped = 0;
+  }
   void AsyncWaitForSlot(int*, uint16_t*, mjlib::io::ErrorCallback) {}
   Slot rx_slot(int, int) { return {}; }
   void tx_slot(int, int, const Slot&) {}
@@ -715,6 +942,10 @@ class Pi3hatWrapper::Impl {
   mjlib::io::SharedStream MakeTunnel(uint8_t, uint32_t, const TunnelOptions&) {
     return {};
   }
+  int SelectBus(int) const { return 1; }
+  const Stats& stats() const { return stats_; }
+
+  Stats stats_;
 };
 #endif
 
@@ -733,6 +964,10 @@ void Pi3hatWrapper::ReadImu(AttitudeData* data,
   impl_->ReadImu(data, std::move(callback));
 }
 
+void Pi3hatWrapper::ReadImuBatch(AttitudeBatch* batch) {
+  impl_->ReadImuBatch(batch);
+}
+
 void Pi3hatWrapper::AsyncWaitForSlot(
     int* remote,
     uint16_t* bitfield,
@@ -765,8 +1000,8 @@ mjlib::io::SharedStream Pi3hatWrapper::MakeTunnel(
   return impl_->MakeTunnel(id, channel, options);
 }
 
-Pi3hatWrapper::Stats Pi3hatWrapper::stats() const {
-  return Stats();
+const Pi3hatWrapper::Stats& Pi3hatWrapper::stats() const {
+  return impl_->stats();
 }
 
 void Pi3hatWrapper::Cycle(AttitudeData* attitude,
@@ -776,5 +1011,9 @@ void Pi3hatWrapper::Cycle(AttitudeData* attitude,
   impl_->Cycle(attitude, request, reply, std::move(callback));
 }
 
+int Pi3hatWrapper::SelectBus(int id) const {
+  return impl_->SelectBus(id);
+}
+
 }
 }
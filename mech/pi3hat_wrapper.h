@@ -66,10 +66,22 @@ class Pi3hatWrapper : public Pi3hatInterface {
     double min_wait_s = 0.00005;
 
     Mounting mounting;
+    // The CAN bus each servo is attached to, as a comma separated
+    // list of id:bus pairs.  Unlisted ids are sent to bus 1.
+    std::string bus_map = "1:1,2:1,3:1,4:2,5:2,6:2,7:3,8:3,9:3,10:4,11:4,12:4";
+
     uint32_t rf_id = 5678;
     double power_poll_period_s = 0.1;
     double shutdown_timeout_s = 15.0;
     uint32_t imu_rate_hz = 400;
+
+    // When set, the pi3hat thread samples the IMU between cycles so
+    // that every sample can be retrieved with ReadImuBatch.  This
+    // polls the SPI bus more often, and cycles no longer wait for a
+    // fresh attitude, so it is only worth it for consumers which use
+    // the batch.
+    bool imu_buffer = false;
+
     bool attitude_detail = false;
     int force_bus = -1;
 
@@ -79,10 +91,12 @@ class Pi3hatWrapper : public Pi3hatInterface {
       a->Visit(MJ_NVP(spi_speed_hz));
       a->Visit(MJ_NVP(query_timeout_s));
       a->Visit(MJ_NVP(mounting));
+      a->Visit(MJ_NVP(bus_map));
       a->Visit(MJ_NVP(rf_id));
       a->Visit(MJ_NVP(power_poll_period_s));
       a->Visit(MJ_NVP(shutdown_timeout_s));
       a->Visit(MJ_NVP(imu_rate_hz));
+      a->Visit(MJ_NVP(imu_buffer));
       a->Visit(MJ_NVP(attitude_detail));
       a->Visit(MJ_NVP(force_bus));
     }
@@ -107,12 +121,7 @@ class Pi3hatWrapper : public Pi3hatInterface {
       uint32_t channel,
       const TunnelOptions& options) override;
 
-  struct Stats {
-    template <typename Archive>
-    void Serialize(Archive* a) {
-    }
-  };
-  Stats stats() const;
+  const Stats& stats() const override;
 
   // ************************
   // ImuClient
@@ -123,6 +132,10 @@ class Pi3hatWrapper : public Pi3hatInterface {
   /// fails.
   void ReadImu(AttitudeData* data, mjlib::io::ErrorCallback callback) override;
 
+  /// Retrieve every IMU sample the pi3hat thread has received since
+  /// the last call.  Requires Options::imu_buffer.
+  void ReadImuBatch(AttitudeBatch* batch) override;
+
   // ***********************
   // RfClient
 
@@ -140,6 +153,8 @@ class Pi3hatWrapper : public Pi3hatInterface {
              Reply* reply,
              mjlib::io::ErrorCallback callback) override;
 
+  int SelectBus(int id) const override;
+
  private:
   class Impl;
   std::unique_ptr<Impl> impl_;
@@ -33,6 +33,7 @@
 #include "mjlib/multiplex/stream_asio_client_builder.h"
 #include "mjlib/telemetry/file_writer.h"
 
+#include "base/fast_signal.h"
 #include "base/linux_input.h"
 #include "base/telemetry_log_registrar.h"
 #include "mech/moteus.h"
@@ -678,7 +679,7 @@ class Application {
   double measured_torque_Nm_ = 0.0;
   PowerSupply::Data power_supply_data_;
 
-  boost::signals2::signal<void (const Data*)> signal_;
+  base::FastSignal<void (const Data*)> signal_;
 
   const std::map<int, std::string> mode_text_ = {
     { 0, "stop" },
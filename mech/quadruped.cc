@@ -18,6 +18,7 @@
 
 #include "base/logging.h"
 #include "mech/pi3hat_wrapper.h"
+#include "mech/quadruped_web_command.h"
 
 namespace pl = std::placeholders;
 
@@ -48,6 +49,7 @@ class Quadruped::Impl {
         []() {
           QuadrupedWebControl::Options options;
           options.asset_path = "web_control_assets";
+          options.decode_binary_command = DecodeQuadrupedWebCommand;
           return options;
         }());
     m_.rf_control = std::make_unique<RfControl>(
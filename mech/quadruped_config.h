@@ -28,7 +28,11 @@ namespace mech {
 // This represents the JSON used to configure the geometry of the
 // robot.
 struct QuadrupedConfig {
+  // The period of the planner: gait, terrain, and mode logic.
   double period_s = 0.0025;
+  // The Cartesian PD, IK, and servo commands run this many times per
+  // planner period, extrapolating the most recent plan in between.
+  int inner_loop_multiple = 1;
   double min_voltage = 16.0;
 
   struct Joint {
@@ -296,6 +300,7 @@ struct QuadrupedConfig {
   template <typename Archive>
   void Serialize(Archive* a) {
     a->Visit(MJ_NVP(period_s));
+    a->Visit(MJ_NVP(inner_loop_multiple));
     a->Visit(MJ_NVP(min_voltage));
     a->Visit(MJ_NVP(joints));
     a->Visit(MJ_NVP(rezero_threshold_deg));
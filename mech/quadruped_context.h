@@ -110,7 +110,8 @@ struct QuadrupedContext : boost::noncopyable {
                    QuadrupedState* state_in)
       : config(config_in),
         command(command_in),
-        state(state_in) {
+        state(state_in),
+        period_s(config_in.period_s) {
     for (const auto& leg : config.legs) {
       legs.emplace_back(leg, config.stand_up, config.stand_height,
                         config.idle_x, config.idle_y);
@@ -187,7 +188,7 @@ struct QuadrupedContext : boost::noncopyable {
         {command->v_R, command->w_R},
         max_rate * config.lr_acceleration,
         max_rate * config.lr_alpha_rad_s2,
-        config.period_s);
+        period_s);
     state->robot.desired_R.v = result_R.v;
     state->robot.desired_R.w = result_R.w;
   }
@@ -195,7 +196,7 @@ struct QuadrupedContext : boost::noncopyable {
   void MoveLegsForR(std::vector<QC::Leg>* legs_R) {
     PropagateLeg propagator(state->robot.desired_R.v,
                             state->robot.desired_R.w,
-                            config.period_s);
+                            period_s);
 
     for (auto& leg_R : *legs_R) {
       if (leg_R.stance == 0.0 && !leg_R.landing) { continue; }
@@ -261,7 +262,7 @@ struct QuadrupedContext : boost::noncopyable {
       const auto result = CalculateAccelerationLimitedTrajectory(
           initial, pair.second,
           desired_velocity, acceleration,
-          config.period_s);
+          period_s);
 
       leg_R.position = result.pose_l;
       leg_R.acceleration =
@@ -292,7 +293,7 @@ struct QuadrupedContext : boost::noncopyable {
       const base::Point3D error = pair.second - leg_R.position;
       const double error_norm = error.norm();
       const double velocity = error_norm /
-          std::max(config.period_s, remaining_s);
+          std::max(period_s, remaining_s);
 
       // For now, we'll do this as just an infinite acceleration
       // profile.
@@ -300,7 +301,7 @@ struct QuadrupedContext : boost::noncopyable {
       const double delta =
           std::min(
               error_norm,
-              velocity * config.period_s);
+              velocity * period_s);
       leg_R.position += error.normalized() * delta;
       leg_R.velocity = error.normalized() * velocity;
       // Since we are not in stance.
@@ -311,6 +312,12 @@ struct QuadrupedContext : boost::noncopyable {
   const QuadrupedConfig& config;
   const QuadrupedCommand* const command;
   QuadrupedState* const state;
+
+  /// The time since the last plan, which everything here integrates
+  /// over.  This is config.period_s, except when the planner runs
+  /// early.
+  double period_s = 0.0;
+
   std::deque<Leg> legs;
 
   std::array<SwingTrajectory, 4> swing_trajectory = {};
@@ -15,6 +15,7 @@
 #include "mech/quadruped_control.h"
 
 #include <fstream>
+#include <numeric>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/asio/post.hpp>
@@ -24,13 +25,15 @@
 #include "mjlib/base/clipp_archive.h"
 #include "mjlib/base/json5_read_archive.h"
 
-#include "mjlib/io/now.h"
 #include "mjlib/io/repeating_timer.h"
 
 #include "base/common.h"
+#include "base/fast_log.h"
+#include "base/fast_signal.h"
 #include "base/fit_plane.h"
 #include "base/interpolate.h"
 #include "base/logging.h"
+#include "base/mono_time.h"
 #include "base/sophus.h"
 #include "base/telemetry_registry.h"
 #include "base/timestamped_log.h"
@@ -101,6 +104,32 @@ auto Min(Iter begin, Iter end, Functor f) -> decltype(f(*begin)) {
   return current;
 }
 
+/// A contiguous block of servo registers to read, and how often.
+struct RegisterPoll {
+  moteus::Register start;
+  int count;
+  moteus::RegisterTypes type;
+
+  // The block is read every Nth cycle, where 1 means every cycle.
+  int divider;
+};
+
+int RegisterSize(moteus::RegisterTypes type) {
+  switch (type) {
+    case moteus::kInt8: return 1;
+    case moteus::kInt16: return 2;
+    case moteus::kInt32: return 4;
+    case moteus::kFloat: return 4;
+  }
+  return 4;
+}
+
+/// The reply to a block read has a subframe header and starting
+/// register ahead of the values themselves.
+int EstimateReplyBytes(const RegisterPoll& poll) {
+  return 3 + poll.count * RegisterSize(poll.type);
+}
+
 struct ReportedServoConfig {
   boost::posix_time::ptime timestamp;
 
@@ -160,6 +189,7 @@ class QuadrupedControl::Impl {
     context.telemetry_registry->Register("qc_control", &control_signal_);
     context.telemetry_registry->Register("imu", &imu_signal_);
     context.telemetry_registry->Register("servo_config", &servo_config_signal_);
+    context.telemetry_registry->Register("pi3hat_stats", &pi3hat_stats_signal_);
   }
 
   void AsyncStart(mjlib::io::ErrorCallback callback) {
@@ -191,8 +221,15 @@ class QuadrupedControl::Impl {
 
     PopulateStatusRequest();
 
+    if (config_.inner_loop_multiple < 1) {
+      mjlib::base::Fail(
+          fmt::format("inner_loop_multiple must be positive: {}",
+                      config_.inner_loop_multiple));
+    }
+
     period_s_ = config_.period_s;
-    timer_.start(mjlib::base::ConvertSecondsToDuration(period_s_),
+    control_period_s_ = config_.period_s / config_.inner_loop_multiple;
+    timer_.start(mjlib::base::ConvertSecondsToDuration(control_period_s_),
                  std::bind(&Impl::HandleTimer, this, pl::_1));
 
     boost::asio::post(
@@ -201,18 +238,18 @@ class QuadrupedControl::Impl {
   }
 
   void Command(const QC& command) {
-    const auto now = Now();
+    const auto now = clock_.Now();
     const bool higher_priority = command.priority >= current_command_.priority;
     const bool stale =
-        !current_command_timestamp_.is_not_a_date_time() &&
-        (mjlib::base::ConvertDurationToSeconds(
-            now - current_command_timestamp_) > parameters_.command_timeout_s);
+        current_command_timestamp_.is_set() &&
+        (base::MonoSeconds(now, current_command_timestamp_) >
+         parameters_.command_timeout_s);
     if (!higher_priority && !stale) {
       return;
     }
 
     CommandLog command_log;
-    command_log.timestamp = now;
+    command_log.timestamp = clock_.ToPtime(now);
     command_log.command = &command;
 
     current_command_ = command;
@@ -235,34 +272,113 @@ class QuadrupedControl::Impl {
     command_signal_(&command_log);
   }
 
-  void PopulateStatusRequest() {
-    status_request_ = {};
+  /// One step of the polling schedule, with everything precomputed
+  /// so that nothing needs to be built in the control cycle.
+  struct PollPhase {
+    mjlib::multiplex::AsioClient::Request request;
+    std::vector<QuadrupedControl::Poll::Bus> buses;
+  };
+
+  PollPhase MakePollPhase(const std::vector<RegisterPoll>& polls, int phase) {
+    PollPhase result;
+    int servo_index = 0;
     for (const auto& joint : config_.joints) {
-      status_request_.push_back({});
-      auto& current = status_request_.back();
+      result.request.push_back({});
+      auto& current = result.request.back();
       current.id = joint.id;
 
-      // Read mode, position, velocity, and torque.
-      current.request.ReadMultiple(moteus::Register::kMode, 4, 1);
-      current.request.ReadMultiple(moteus::Register::kVoltage, 3, 0);
+      int rx_bytes = 0;
+      for (const auto& poll : polls) {
+        // Offsetting by the servo index staggers the slower blocks
+        // across cycles, so that each cycle carries a similar load.
+        if (((phase + servo_index) % poll.divider) != 0) { continue; }
+        current.request.ReadMultiple(poll.start, poll.count, poll.type);
+        rx_bytes += EstimateReplyBytes(poll);
+      }
+      servo_index++;
+
+      const int bus = pi3hat_->SelectBus(joint.id);
+      auto it = std::find_if(
+          result.buses.begin(), result.buses.end(),
+          [&](const auto& item) { return item.bus == bus; });
+      if (it == result.buses.end()) {
+        result.buses.push_back({});
+        it = result.buses.end() - 1;
+        it->bus = bus;
+      }
+      it->tx_bytes += current.request.buffer().size();
+      it->rx_bytes += rx_bytes;
+    }
 
-      if (parameters_.servo_debug) {
-        current.request.ReadMultiple(moteus::Register::kPositionKp, 5, 1);
+    std::sort(result.buses.begin(), result.buses.end(),
+              [](const auto& lhs, const auto& rhs) {
+                return lhs.bus < rhs.bus;
+              });
+    return result;
+  }
+
+  void PopulateStatusRequest() {
+    // Mode, position, velocity, and torque are needed every cycle.
+    // Everything else changes slowly enough to be polled less often.
+    const int slow = std::max(1, parameters_.slow_poll_divider);
+    const int debug = std::max(1, parameters_.debug_poll_divider);
+    std::vector<RegisterPoll> polls = {
+      { moteus::kMode, 4, moteus::kInt16, 1 },
+      { moteus::kVoltage, 3, moteus::kInt8, slow },
+    };
+    if (parameters_.servo_debug) {
+      polls.push_back({ moteus::kPositionKp, 5, moteus::kInt16, debug });
+    }
+
+    int num_phases = 1;
+    for (const auto& poll : polls) {
+      num_phases = std::lcm(num_phases, poll.divider);
+    }
+
+    status_phases_.clear();
+    for (int phase = 0; phase < num_phases; phase++) {
+      status_phases_.push_back(MakePollPhase(polls, phase));
+    }
+
+    // Record the peak load of the schedule for each bus.
+    for (auto& phase : status_phases_) {
+      for (auto& bus : phase.buses) {
+        for (const auto& other_phase : status_phases_) {
+          for (const auto& other_bus : other_phase.buses) {
+            if (other_bus.bus != bus.bus) { continue; }
+            bus.peak_tx_bytes = std::max(bus.peak_tx_bytes, other_bus.tx_bytes);
+            bus.peak_rx_bytes = std::max(bus.peak_rx_bytes, other_bus.rx_bytes);
+          }
+        }
       }
     }
 
-    config_status_request_ = {};
-    for (const auto& joint : config_.joints) {
-      config_status_request_.push_back({});
-      auto& current = config_status_request_.back();
-      current.id = joint.id;
+    // Until every servo has reported every register once, we poll
+    // everything each cycle.
+    std::vector<RegisterPoll> full_polls = polls;
+    for (auto& poll : full_polls) { poll.divider = 1; }
+    full_status_phase_ = MakePollPhase(full_polls, 0);
+
+    // While configuring, we request a few more things.
+    config_status_phase_ = MakePollPhase({
+        { moteus::kMode, 4, moteus::kInt16, 1 },
+        { moteus::kRezeroState, 4, moteus::kInt8, 1 },
+        { moteus::kRegisterMapVersion, 1, moteus::kInt32, 1 },
+        { moteus::kSerialNumber, 3, moteus::kInt32, 1 },
+      }, 0);
+  }
 
-      // While configuring, we request a few more things.
-      current.request.ReadMultiple(moteus::Register::kMode, 4, 1);
-      current.request.ReadMultiple(moteus::Register::kRezeroState, 4, 0);
-      current.request.ReadMultiple(moteus::Register::kRegisterMapVersion, 1, 2);
-      current.request.ReadMultiple(moteus::Register::kSerialNumber, 3, 2);
+  const PollPhase& SelectPollPhase() {
+    if (status_.mode == QM::kConfiguring) {
+      return config_status_phase_;
+    }
+    if (!have_full_status_) {
+      return full_status_phase_;
     }
+    const auto& result = status_phases_[poll_phase_];
+    status_.poll.phase = poll_phase_;
+    poll_phase_ = (poll_phase_ + 1) % status_phases_.size();
+    return result;
   }
 
   void HandleTimer(const mjlib::base::error_code& ec) {
@@ -272,12 +388,12 @@ class QuadrupedControl::Impl {
     if (!pi3hat_) { return; }
     if (outstanding_) { return; }
 
-    timing_ = ControlTiming(executor_, timing_.cycle_start());
+    timing_ = ControlTiming(&clock_, timing_.cycle_start());
 
-    if (timing_.status().delta_s > 1.5 * period_s_) {
+    if (timing_.status().delta_s > 1.5 * control_period_s_) {
       // We likely skipped a cycle.  Warn.
-      WarnRateLimited(fmt::format("Skipped cycle: delta_s={}",
-                                  timing_.status().delta_s));
+      MJMECH_LOG_RATE_LIMITED(log_, WARN, 1.0, "Skipped cycle: delta_s={}",
+                              timing_.status().delta_s);
     }
 
     outstanding_ = true;
@@ -287,13 +403,11 @@ class QuadrupedControl::Impl {
     // Ask for the IMU and the servo data simultaneously.
     outstanding_status_requests_ = 0;
 
-    auto* request = [&]() {
-      if (status_.mode == QM::kConfiguring) {
-        return &config_status_request_;
-      }
-      return &status_request_;
-    }();
-    pi3hat_->Cycle(&imu_data_, request, &status_reply_,
+    const auto& poll_phase = SelectPollPhase();
+    status_.poll.buses = poll_phase.buses;
+    current_poll_is_full_ = (&poll_phase == &full_status_phase_);
+
+    pi3hat_->Cycle(&imu_data_, &poll_phase.request, &status_reply_,
                    std::bind(&Impl::HandleStatus, this, pl::_1));
   }
 
@@ -304,6 +418,10 @@ class QuadrupedControl::Impl {
 
     imu_signal_(&imu_data_);
 
+    pi3hat_->ReadImuBatch(&imu_batch_);
+    status_.imu_samples = imu_batch_.count;
+    status_.imu_dropped = imu_batch_.dropped;
+
     // If we don't have all 12 servos, then skip this cycle.
     const uint16_t servo_bitmask = [&]() {
       uint16_t result = 0;
@@ -330,8 +448,15 @@ class QuadrupedControl::Impl {
         outstanding_ = false;
         return;
       }
+    } else if (current_poll_is_full_) {
+      // Now that every register has been seen once, the scheduled
+      // partial polls will only refresh some of them each cycle.
+      // UpdateStatus retains the last value for the rest.
+      have_full_status_ = true;
     }
 
+    planner_tick_ = IsPlannerTick();
+
     // Fill in the status structure.
     if (!UpdateStatus()) {
       // Guess we didn't have enough to actually do anything.
@@ -342,9 +467,15 @@ class QuadrupedControl::Impl {
     timing_.finish_status();
 
     // Now run our control loop and generate our command.
-    std::swap(control_log_, old_control_log_);
-    *control_log_ = {};
-    RunControl();
+    if (planner_tick_) {
+      std::swap(control_log_, old_control_log_);
+      *control_log_ = {};
+      RunControl();
+      PublishPlan();
+    } else {
+      RunInnerControl();
+    }
+    status_.cycles_since_plan = cycles_since_plan_;
 
     timing_.finish_control();
 
@@ -367,6 +498,7 @@ class QuadrupedControl::Impl {
     status_.timing = timing_.status();
 
     status_signal_(&status_);
+    pi3hat_stats_signal_(&pi3hat_->stats());
   }
 
   std::optional<double> MaybeGetSign(int id) const {
@@ -395,7 +527,7 @@ class QuadrupedControl::Impl {
     for (const auto& reply : status_reply_) {
       const auto maybe_sign = MaybeGetSign(reply.id);
       if (!maybe_sign) {
-        log_.warn(fmt::format("Reply from unknown servo {}", reply.id));
+        MJMECH_LOG(log_, WARN, "Reply from unknown servo {}", reply.id);
         return false;
       }
 
@@ -568,8 +700,11 @@ class QuadrupedControl::Impl {
     };
     frame_MB.pose = MC * CB;
 
-    // Do terrain.
-    UpdateTerrain();
+    // Do terrain.  This is only consumed by the planner, so it need
+    // not be updated any faster than it runs.
+    if (planner_tick_) {
+      UpdateTerrain();
+    }
 
     {
       const double min_voltage =
@@ -581,7 +716,7 @@ class QuadrupedControl::Impl {
         out_voltage = min_voltage;
       } else {
         const double alpha =
-            std::pow(0.5, config_.period_s / config_.voltage_filter_s);
+            std::pow(0.5, control_period_s_ / config_.voltage_filter_s);
         out_voltage = alpha * out_voltage + (1.0 - alpha) * min_voltage;
       }
 
@@ -636,7 +771,7 @@ class QuadrupedControl::Impl {
 
     // We filter our X and Y slopes.
     const double alpha = (
-        std::pow(0.5, config_.period_s / config_.terrain_filter_s));
+        std::pow(0.5, period_s_ / config_.terrain_filter_s));
     robot.terrain_rad[0] = (
         alpha * robot.terrain_rad[0] + (1.0 - alpha) * std::atan(plane.a));
     robot.terrain_rad[1] = (
@@ -703,6 +838,53 @@ class QuadrupedControl::Impl {
     servo_config_signal_(&reported);
   }
 
+  bool IsPlannerTick() {
+    cycles_since_plan_++;
+
+    // Anything other than a plain Cartesian plan, like rezeroing or
+    // direct joint commands, is cheap enough to just run every cycle.
+    const bool force =
+        !last_plan_cartesian_ ||
+        current_command_.mode != status_.mode ||
+        status_.mode == QM::kConfiguring ||
+        status_.mode == QM::kFault;
+
+    if (force || cycles_since_plan_ >= config_.inner_loop_multiple) {
+      // A forced plan can come early, so everything the planner
+      // integrates uses the time since the last one.
+      period_s_ = cycles_since_plan_ * control_period_s_;
+      context_->period_s = period_s_;
+      cycles_since_plan_ = 0;
+      return true;
+    }
+    return false;
+  }
+
+  void PublishPlan() {
+    // Only a plan which went through ControlLegs_R can be
+    // extrapolated by the inner loop.
+    last_plan_cartesian_ = !control_log_->legs_R.empty();
+  }
+
+  void RunInnerControl() {
+    // The planner's log is what it integrates from on its next cycle,
+    // so the inner loop writes to one of its own.
+    ControlLog* const planner_log = control_log_;
+    control_log_ = &inner_control_log_;
+    *control_log_ = {};
+
+    const double elapsed_s = cycles_since_plan_ * control_period_s_;
+    control_log_->desired_RB = planner_log->desired_RB;
+    control_log_->legs_R = planner_log->legs_R;
+    for (auto& leg_R : control_log_->legs_R) {
+      leg_R.position += leg_R.velocity * elapsed_s;
+    }
+
+    ControlLegsFromR();
+
+    control_log_ = planner_log;
+  }
+
   void RunControl() {
     if (current_command_.mode != status_.mode) {
       MaybeChangeMode();
@@ -894,6 +1076,7 @@ class QuadrupedControl::Impl {
         }
       }
       status_.mode_start = Now();
+      mode_start_mono_ = clock_.Now();
     }
   }
 
@@ -991,6 +1174,7 @@ class QuadrupedControl::Impl {
     status_.mode = QM::kFault;
     status_.fault = message;
     status_.mode_start = Now();
+    mode_start_mono_ = clock_.Now();
 
     log_.warn("Fault: " + std::string(message));
 
@@ -1031,7 +1215,7 @@ class QuadrupedControl::Impl {
     // See if we can advance to the next state.
 
     const double elapsed_s =
-        base::ConvertDurationToSeconds(Now() - status_.mode_start);
+        base::MonoSeconds(clock_.Now(), mode_start_mono_);
     if (status_.state.stand_up.mode != M::kDone &&
         elapsed_s > config_.stand_up.timeout_s) {
       Fault("timeout");
@@ -1548,9 +1732,9 @@ class QuadrupedControl::Impl {
       // Blend in the ramped rate and the observed rate with an
       // exponential filter.
       const double propagated =
-          js.velocity + config_.period_s * js.acceleration;
+          js.velocity + period_s_ * js.acceleration;
       const double filter_s = 0.1;
-      const double alpha = std::pow(0.5, config_.period_s / filter_s);
+      const double alpha = std::pow(0.5, period_s_ / filter_s);
       js.velocity =
           alpha * propagated + (1.0 - alpha) * average_velocity;
     }
@@ -1853,16 +2037,22 @@ class QuadrupedControl::Impl {
       const base::Point3D delta =
           desired_RB.pose.translation() - frame_RB.pose.translation();
       frame_RB.pose.translation() +=
-          config_.rb_filter_constant_Hz * config_.period_s * delta;
+          config_.rb_filter_constant_Hz * period_s_ * delta;
       frame_RB.pose.so3() =
           Sophus::SO3d(
               frame_RB.pose.so3().unit_quaternion().slerp(
-                  config_.rb_filter_constant_Hz * config_.period_s,
+                  config_.rb_filter_constant_Hz * period_s_,
                   desired_RB.pose.so3().unit_quaternion()));
       frame_RB.v = desired_RB.v;
       frame_RB.w = desired_RB.w;
     }
 
+    ControlLegsFromR();
+  }
+
+  /// Transform the R frame leg commands in the control log into the B
+  /// frame using the current, already filtered, RB frame.
+  void ControlLegsFromR() {
     const Sophus::SE3d pose_BR = status_.state.robot.frame_RB.pose.inverse();
 
     std::vector<QC::Leg> legs_B;
@@ -2072,7 +2262,7 @@ class QuadrupedControl::Impl {
       if (mode == moteus::Mode::kPosition) {
         const auto maybe_sign = MaybeGetSign(joint.id);
         if (!maybe_sign) {
-          log_.warn(fmt::format("Unknown servo {}", joint.id));
+          MJMECH_LOG(log_, WARN, "Unknown servo {}", joint.id);
           continue;
         }
         const double sign = *maybe_sign;
@@ -2136,7 +2326,7 @@ class QuadrupedControl::Impl {
               double kp = joint.kp_scale.value_or(1.0);
               if (kp < 0.0) {
                 kp = 0.0;
-                log_.warn("negative joint kp!");
+                MJMECH_LOG(log_, WARN, "negative joint kp!");
               }
               values[i] = moteus::WritePwm(kp, moteus::kFloat);
               break;
@@ -2145,7 +2335,7 @@ class QuadrupedControl::Impl {
               double kd = joint.kd_scale.value_or(1.0);
               if (kd < 0.0) {
                 kd = 0.0;
-                log_.warn("negative joint kd!");
+                MJMECH_LOG(log_, WARN, "negative joint kd!");
               }
               values[i] = moteus::WritePwm(kd, moteus::kFloat);
               break;
@@ -2181,7 +2371,7 @@ class QuadrupedControl::Impl {
   }
 
   boost::posix_time::ptime Now() {
-    return mjlib::io::Now(executor_.context());
+    return clock_.PtimeNow();
   }
 
   const QuadrupedContext::Leg& GetLeg(int id) const {
@@ -2199,19 +2389,8 @@ class QuadrupedControl::Impl {
     return true;
   }
 
-  void WarnRateLimited(const std::string& message) {
-    const boost::posix_time::time_duration kRateLimitTime =
-        boost::posix_time::seconds(1);
-
-    const auto now = Now();
-    if (last_warn_timestamp_.is_not_a_date_time() ||
-        (now - last_warn_timestamp_) > kRateLimitTime) {
-      last_warn_timestamp_ = now;
-      log_.warn(message);
-    }
-  }
-
   boost::asio::any_io_executor executor_;
+  base::MonoClock clock_{executor_.context()};
   mjlib::telemetry::FileWriter* const telemetry_log_;
   Parameters parameters_;
 
@@ -2221,15 +2400,20 @@ class QuadrupedControl::Impl {
   std::optional<QuadrupedContext> context_;
 
   QuadrupedControl::Status status_;
+  base::MonoTime mode_start_mono_;
   QC current_command_;
-  boost::posix_time::ptime current_command_timestamp_;
+  base::MonoTime current_command_timestamp_;
   ReportedServoConfig reported_servo_config_;
 
   std::array<ControlLog, 2> control_logs_;
   ControlLog* control_log_ = &control_logs_[0];
   ControlLog* old_control_log_ = &control_logs_[1];
 
+  // The inner Cartesian loop runs at control_period_s_.  period_s_ is
+  // the time since the previous plan, which is normally
+  // config_.period_s, but less when a plan is forced early.
   double period_s_ = 0.0;
+  double control_period_s_ = 0.0;
   mjlib::io::RepeatingTimer timer_;
   using Client = mjlib::multiplex::AsioClient;
 
@@ -2238,31 +2422,42 @@ class QuadrupedControl::Impl {
   Pi3hatInterface* pi3hat_ = nullptr;
 
   using Request = Client::Request;
-  Request status_request_;
-  Request config_status_request_;
+  using Poll = QuadrupedControl::Poll;
+  std::vector<PollPhase> status_phases_;
+  PollPhase full_status_phase_;
+  PollPhase config_status_phase_;
+  size_t poll_phase_ = 0;
+  bool have_full_status_ = false;
+  bool current_poll_is_full_ = false;
   Client::Reply status_reply_;
 
   Request client_command_;
   Client::Reply client_command_reply_;
 
   bool outstanding_ = false;
-  ControlTiming timing_{executor_, {}};
+  ControlTiming timing_{&clock_, {}};
 
   int outstanding_status_requests_ = 0;
   AttitudeData imu_data_;
-
-  boost::signals2::signal<void (const Status*)> status_signal_;
-  boost::signals2::signal<void (const CommandLog*)> command_signal_;
-  boost::signals2::signal<void (const ControlLog*)> control_signal_;
-  boost::signals2::signal<void (const AttitudeData*)> imu_signal_;
-  boost::signals2::signal<
+  AttitudeBatch imu_batch_;
+
+  ControlLog inner_control_log_;
+  bool planner_tick_ = true;
+  bool last_plan_cartesian_ = false;
+  int cycles_since_plan_ = 0;
+
+  base::FastSignal<void (const Status*)> status_signal_;
+  base::FastSignal<void (const CommandLog*)> command_signal_;
+  base::FastSignal<void (const ControlLog*)> control_signal_;
+  base::FastSignal<void (const AttitudeData*)> imu_signal_;
+  base::FastSignal<
     void (const ReportedServoConfig*)> servo_config_signal_;
+  base::FastSignal<
+    void (const Pi3hatInterface::Stats*)> pi3hat_stats_signal_;
 
   std::vector<moteus::Value> values_cache_;
 
   std::vector<int> all_leg_ids_{0, 1, 2, 3};
-
-  boost::posix_time::ptime last_warn_timestamp_;
 };
 
 QuadrupedControl::QuadrupedControl(base::Context& context,
@@ -51,6 +51,13 @@ class QuadrupedControl : boost::noncopyable {
     bool enable_imu = true;
     bool servo_debug = false;
 
+    // Slowly changing servo registers (voltage, temperature, and
+    // fault) are only polled every Nth cycle, and the PID registers
+    // enabled by servo_debug every Mth.  Servos are staggered so that
+    // the bus load is the same every cycle.
+    int slow_poll_divider = 8;
+    int debug_poll_divider = 4;
+
     double command_timeout_s = 1.0;
 
     template <typename Archive>
@@ -60,10 +67,44 @@ class QuadrupedControl : boost::noncopyable {
       a->Visit(MJ_NVP(log_filename_base));
       a->Visit(MJ_NVP(enable_imu));
       a->Visit(MJ_NVP(servo_debug));
+      a->Visit(MJ_NVP(slow_poll_divider));
+      a->Visit(MJ_NVP(debug_poll_divider));
       a->Visit(MJ_NVP(command_timeout_s));
     }
   };
 
+  struct Poll {
+    // Which step of the register polling schedule this cycle was.
+    int phase = 0;
+
+    struct Bus {
+      int bus = 0;
+      // Bytes of register data requested and expected in reply this
+      // cycle, and the most for any cycle of the schedule.
+      int tx_bytes = 0;
+      int rx_bytes = 0;
+      int peak_tx_bytes = 0;
+      int peak_rx_bytes = 0;
+
+      template <typename Archive>
+      void Serialize(Archive* a) {
+        a->Visit(MJ_NVP(bus));
+        a->Visit(MJ_NVP(tx_bytes));
+        a->Visit(MJ_NVP(rx_bytes));
+        a->Visit(MJ_NVP(peak_tx_bytes));
+        a->Visit(MJ_NVP(peak_rx_bytes));
+      }
+    };
+
+    std::vector<Bus> buses;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(phase));
+      a->Visit(MJ_NVP(buses));
+    }
+  };
+
   struct Status {
     boost::posix_time::ptime timestamp;
 
@@ -74,6 +115,14 @@ class QuadrupedControl : boost::noncopyable {
     QuadrupedState state;
 
     int missing_replies = 0;
+    // The number of inner control cycles which have run since the
+    // planner last produced a new plan.
+    int cycles_since_plan = 0;
+    // The number of IMU samples received since the last cycle, and
+    // how many more were lost because they did not fit.
+    int imu_samples = 0;
+    int imu_dropped = 0;
+    Poll poll;
     ControlTiming::Status timing;
     bool performed_rezero = false;
 
@@ -85,6 +134,10 @@ class QuadrupedControl : boost::noncopyable {
       a->Visit(MJ_NVP(fault));
       a->Visit(MJ_NVP(state));
       a->Visit(MJ_NVP(missing_replies));
+      a->Visit(MJ_NVP(cycles_since_plan));
+      a->Visit(MJ_NVP(imu_samples));
+      a->Visit(MJ_NVP(imu_dropped));
+      a->Visit(MJ_NVP(poll));
       a->Visit(MJ_NVP(timing));
       a->Visit(MJ_NVP(performed_rezero));
     }
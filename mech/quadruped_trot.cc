@@ -144,7 +144,7 @@ class WalkContext {
       }
     }
     if (all_stance()) {
-      ws_.stance_elapsed_s += config_.period_s;
+      ws_.stance_elapsed_s += context_->period_s;
     } else {
       ws_.stance_elapsed_s = 0.0;
     }
@@ -462,14 +462,14 @@ class WalkContext {
     }
 
     leg_R.stance =
-        std::min(1.0, leg_R.stance + wc_.stance_restore * config_.period_s);
+        std::min(1.0, leg_R.stance + wc_.stance_restore * context_->period_s);
 
     const auto result_R = propagator(leg_R.position);
     leg_R.position = result_R.position;
     leg_R.velocity = result_R.velocity;  // we will overwrite Z below
 
     if (sleg.restore_remaining != 0.0) {
-      sleg.restore_remaining -= config_.period_s * sleg.restore_velocity;
+      sleg.restore_remaining -= context_->period_s * sleg.restore_velocity;
       if (sleg.restore_velocity * sleg.restore_remaining < 0.0) {
         // We are done restoring.
         sleg.restore_velocity = 0.0;
@@ -502,7 +502,7 @@ class WalkContext {
 
     leg_R.velocity.z() = sleg.restore_velocity + jump_z_velocity;
 
-    leg_R.position.z() += leg_R.velocity.z() * config_.period_s;
+    leg_R.position.z() += leg_R.velocity.z() * context_->period_s;
 
     // TODO: We should keep track of our current desired body
     // acceleration and feed it in here.
@@ -513,7 +513,7 @@ class WalkContext {
     if (!!leg_R.kp_scale) {
       double kp = leg_R.kp_scale->x();
 
-      kp += wc_.swing_damp_kp_restore * config_.period_s;
+      kp += wc_.swing_damp_kp_restore * context_->period_s;
 
       if (kp < 1.0) {
         leg_R.kp_scale = {kp, kp, kp};
@@ -525,7 +525,7 @@ class WalkContext {
     if (!!leg_R.kd_scale) {
       double kd = leg_R.kd_scale->x();
 
-      kd += wc_.swing_damp_kd_restore * config_.period_s;
+      kd += wc_.swing_damp_kd_restore * context_->period_s;
 
       if (kd < 1.0) {
         leg_R.kd_scale = {kd, kd, kd};
@@ -540,16 +540,16 @@ class WalkContext {
     PropagateLeg propagator(
         state_->robot.desired_R.v,
         state_->robot.desired_R.w,
-        config_.period_s);
+        context_->period_s);
 
     for (int vleg_idx = 0; vleg_idx < 2; vleg_idx++) {
       auto& vleg = ws_.vlegs[vleg_idx];
       if (vleg.mode == VLeg::kSwing) {
-        vleg.swing_elapsed_s += config_.period_s;
+        vleg.swing_elapsed_s += context_->period_s;
         vleg.stance_elapsed_s = 0.0;
         vleg.phase_s = vleg.swing_elapsed_s;
       } else if (vleg.mode == VLeg::kStance) {
-        vleg.stance_elapsed_s += config_.period_s;
+        vleg.stance_elapsed_s += context_->period_s;
         vleg.swing_elapsed_s = 0.0;
         vleg.phase_s = ws_.trot.swing_time + vleg.stance_elapsed_s;
       }
@@ -568,7 +568,7 @@ class WalkContext {
             leg_R.stance = 0.0;
             const auto swing_R =
                 context_->swing_trajectory[leg_idx].Advance(
-                    config_.period_s,
+                    context_->period_s,
                     -state_->robot.desired_R.v -
                     state_->robot.desired_R.w.cross(leg_R.position));
             leg_R.position = swing_R.position;
@@ -0,0 +1,109 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/quadruped_web_command.h"
+
+#include <cstring>
+
+namespace mjmech {
+namespace mech {
+
+namespace {
+constexpr uint8_t kJumpRepeat = 0x01;
+constexpr uint8_t kMaximizeFlight = 0x02;
+
+float ReadFloat(std::string_view data, std::size_t offset) {
+  uint32_t bits = 0;
+  for (int i = 0; i < 4; i++) {
+    bits |= static_cast<uint32_t>(
+        static_cast<uint8_t>(data[offset + i])) << (8 * i);
+  }
+  float result = 0.0f;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+void WriteFloat(std::string* out, std::size_t offset, double value) {
+  const float as_float = static_cast<float>(value);
+  uint32_t bits = 0;
+  std::memcpy(&bits, &as_float, sizeof(bits));
+  for (int i = 0; i < 4; i++) {
+    (*out)[offset + i] = static_cast<char>((bits >> (8 * i)) & 0xff);
+  }
+}
+}
+
+std::optional<QuadrupedCommand> DecodeQuadrupedWebCommand(
+    std::string_view data) {
+  if (data.size() != kQuadrupedWebCommandSize ||
+      static_cast<uint8_t>(data[0]) != kQuadrupedWebCommandVelocity) {
+    return {};
+  }
+
+  const auto mode = static_cast<uint8_t>(data[1]);
+  const auto log = static_cast<uint8_t>(data[2]);
+  const auto flags = static_cast<uint8_t>(data[3]);
+  if (mode >= QuadrupedCommand::kNumModes ||
+      log > QuadrupedCommand::kEnable) {
+    return {};
+  }
+
+  QuadrupedCommand result;
+  result.mode = static_cast<QuadrupedCommand::Mode>(mode);
+  result.log = static_cast<QuadrupedCommand::Log>(log);
+  for (int i = 0; i < 3; i++) {
+    result.v_R[i] = ReadFloat(data, 4 + 4 * i);
+    result.w_R[i] = ReadFloat(data, 16 + 4 * i);
+  }
+
+  if (result.mode == QuadrupedCommand::kWalk) {
+    QuadrupedCommand::Walk walk;
+    walk.step_height = ReadFloat(data, 28);
+    walk.maximize_flight = (flags & kMaximizeFlight) != 0;
+    result.walk = walk;
+  } else if (result.mode == QuadrupedCommand::kJump) {
+    QuadrupedCommand::Jump jump;
+    jump.acceleration = ReadFloat(data, 32);
+    jump.repeat = (flags & kJumpRepeat) != 0;
+    result.jump = jump;
+  }
+
+  return result;
+}
+
+std::string EncodeQuadrupedWebCommand(const QuadrupedCommand& command) {
+  std::string result(kQuadrupedWebCommandSize, '\0');
+  result[0] = static_cast<char>(kQuadrupedWebCommandVelocity);
+  result[1] = static_cast<char>(command.mode);
+  result[2] = static_cast<char>(command.log);
+
+  uint8_t flags = 0;
+  if (command.jump && command.jump->repeat) { flags |= kJumpRepeat; }
+  if (command.walk && command.walk->maximize_flight) {
+    flags |= kMaximizeFlight;
+  }
+  result[3] = static_cast<char>(flags);
+
+  for (int i = 0; i < 3; i++) {
+    WriteFloat(&result, 4 + 4 * i, command.v_R[i]);
+    WriteFloat(&result, 16 + 4 * i, command.w_R[i]);
+  }
+  WriteFloat(&result, 28, command.walk ? command.walk->step_height : 1.0);
+  WriteFloat(&result, 32, command.jump ? command.jump->acceleration : 0.0);
+
+  return result;
+}
+
+}
+}
@@ -0,0 +1,51 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "mech/quadruped_command.h"
+
+namespace mjmech {
+namespace mech {
+
+/// A fixed layout for the walk, jump, and rest velocity commands
+/// which the web UI sends many times a second.  All values are
+/// little endian.
+///
+///  offset  type  field
+///   0      u8    kind, always kQuadrupedWebCommandVelocity
+///   1      u8    mode
+///   2      u8    log
+///   3      u8    flags, bit 0 jump.repeat, bit 1 walk.maximize_flight
+///   4      f32   v_R x, y, z
+///   16     f32   w_R x, y, z
+///   28     f32   walk.step_height
+///   32     f32   jump.acceleration
+///
+/// jump is only set for kJump and walk only for kWalk.
+constexpr uint8_t kQuadrupedWebCommandVelocity = 1;
+constexpr std::size_t kQuadrupedWebCommandSize = 36;
+
+/// @return nullopt if @p data is not a valid command.
+std::optional<QuadrupedCommand> DecodeQuadrupedWebCommand(
+    std::string_view data);
+
+std::string EncodeQuadrupedWebCommand(const QuadrupedCommand&);
+
+}
+}
@@ -24,19 +24,16 @@
 // include GLFW.
 #include <GLFW/glfw3.h>
 
-#include "mjlib/base/buffer_stream.h"
 #include "mjlib/base/clipp.h"
 #include "mjlib/base/clipp_archive.h"
 #include "mjlib/base/limit.h"
 #include "mjlib/io/now.h"
 #include "mjlib/io/stream_factory.h"
-#include "mjlib/telemetry/format.h"
 #include "mjlib/imgui/imgui_application.h"
 
 #include "base/aspect_ratio.h"
 #include "base/interpolate.h"
 #include "base/point3d.h"
-#include "base/saturate.h"
 #include "base/sophus.h"
 
 #include "ffmpeg/codec.h"
@@ -56,6 +53,8 @@
 #include "mech/expo_map.h"
 #include "mech/nrfusb_client.h"
 #include "mech/quadruped_command.h"
+#include "mech/rf_link_quality.h"
+#include "mech/rf_slot_protocol.h"
 #include "mech/turret_control.h"
 
 namespace pl = std::placeholders;
@@ -104,8 +103,6 @@ class SlotCommand {
     StartRead();
   }
 
-  using Slot = NrfusbClient::Slot;
-
   void Command(QuadrupedCommand::Mode mode,
                const Sophus::SE3d& pose_RB,
                const base::Point3D& v_R,
@@ -117,70 +114,55 @@ class SlotCommand {
                bool turret_laser,
                int16_t turret_fire_sequence) {
     {
-      Slot slot0;
-      slot0.priority = 0xffffffff;
-      mjlib::base::BufferWriteStream bs({slot0.data, 15});
-      mjlib::telemetry::WriteStream ts{bs};
-
-      ts.Write(static_cast<int8_t>(mode));
+      RfQuadrupedCommand command;
+      command.mode = mode;
       if (mode == QuadrupedCommand::Mode::kJump) {
-        slot0.size = 4;
         // For now, always repeat.
-        ts.Write(static_cast<int8_t>(1));
-        ts.Write(static_cast<uint16_t>(jump_accel));
-      } else {
-        slot0.size = 1;
+        command.jump_repeat = true;
+        command.jump_acceleration = jump_accel;
       }
-      nrfusb_.tx_slot(kRemoteRobot, 0, slot0);
+      nrfusb_.tx_slot(kRemoteRobot, kQuadrupedCommandSlot,
+                      MakeRfSlot(command, 0xffffffff));
     }
 
     {
-      Slot slot2;
-      slot2.priority = 0xffffffff;
-      slot2.size = 6;
-      mjlib::base::BufferWriteStream bstream({slot2.data, slot2.size});
-      mjlib::telemetry::WriteStream tstream{bstream};
-      tstream.Write(base::Saturate<int16_t>(v_R.x()));
-      tstream.Write(base::Saturate<int16_t>(v_R.y()));
-      tstream.Write(base::Saturate<int16_t>(32767.0 * w_R.z() / (2 * M_PI)));
-      nrfusb_.tx_slot(kRemoteRobot, 2, slot2);
+      RfQuadrupedMovement movement;
+      movement.v_x_mm_s = v_R.x();
+      movement.v_y_mm_s = v_R.y();
+      movement.w_z_rad_s = w_R.z();
+      nrfusb_.tx_slot(kRemoteRobot, kQuadrupedMovementSlot,
+                      MakeRfSlot(movement, 0xffffffff));
     }
 
     {
-      Slot slot0;
-      slot0.priority = 0xffffffff;
-      slot0.size = 1;
-      slot0.data[0] = static_cast<uint8_t>(turret_mode);
-      nrfusb_.tx_slot(kRemoteTurret, 0, slot0);
+      RfTurretCommand command;
+      command.mode = static_cast<int>(turret_mode);
+      nrfusb_.tx_slot(kRemoteTurret, kTurretCommandSlot,
+                      MakeRfSlot(command, 0xffffffff));
     }
 
     {
-      Slot slot1;
-      slot1.priority = 0xffffffff;
-      slot1.size = 5;
-      mjlib::base::BufferWriteStream bstream({slot1.data, slot1.size});
-      mjlib::telemetry::WriteStream tstream{bstream};
-      tstream.Write(base::Saturate<int16_t>(32767.0 * turret_rate_dps.pitch / 400.0));
-      tstream.Write(base::Saturate<int16_t>(32767.0 * turret_rate_dps.yaw / 400.0));
-      tstream.Write(static_cast<int8_t>(turret_track ? 1 : 0));
-      nrfusb_.tx_slot(kRemoteTurret, 1, slot1);
+      RfTurretRate rate;
+      rate.pitch_rate_dps = turret_rate_dps.pitch;
+      rate.yaw_rate_dps = turret_rate_dps.yaw;
+      rate.track_target = turret_track;
+      nrfusb_.tx_slot(kRemoteTurret, kTurretRateSlot,
+                      MakeRfSlot(rate, 0xffffffff));
     }
 
     {
-      Slot slot2;
-      slot2.priority = 0xffffffff;
-      slot2.size = 3;
-      mjlib::base::BufferWriteStream bstream({slot2.data, slot2.size});
-      mjlib::telemetry::WriteStream tstream{bstream};
-      tstream.Write(static_cast<int8_t>(turret_laser ? 1 : 0));
-      tstream.Write(static_cast<int16_t>(turret_fire_sequence));
-      nrfusb_.tx_slot(kRemoteTurret, 2, slot2);
+      RfTurretWeaponCommand weapon;
+      weapon.laser_enable = turret_laser;
+      weapon.trigger_sequence = turret_fire_sequence;
+      nrfusb_.tx_slot(kRemoteTurret, kTurretWeaponCommandSlot,
+                      MakeRfSlot(weapon, 0xffffffff));
     }
   }
 
   struct Turret {
     TurretControl::Mode mode = TurretControl::Mode::kStop;
     int rx_count = 0;
+    RfLinkQuality::Status link;
     double imu_pitch_deg = 0.0;
     double imu_yaw_deg = 0.0;
     double imu_pitch_rate_dps = 0.0;
@@ -201,6 +183,7 @@ class SlotCommand {
     QuadrupedCommand::Mode mode = QuadrupedCommand::Mode::kStopped;
     int tx_count = 0;
     int rx_count = 0;
+    RfLinkQuality::Status link;
     base::Point3D v_R;
     base::Point3D w_LB;
     double min_voltage = 0.0;
@@ -214,6 +197,14 @@ class SlotCommand {
 
   const Data& data() const { return data_; }
 
+  /// Refresh the link statistics, which age even when nothing is
+  /// received.
+  void UpdateLink() {
+    const auto now = mjlib::io::Now(executor_.context());
+    data_.link = robot_link_.Update(now);
+    data_.turret.link = turret_link_.Update(now);
+  }
+
  private:
   void StartRead() {
     bitfield_ = 0;
@@ -239,67 +230,68 @@ class SlotCommand {
 
   void ProcessRobot() {
     const auto now = mjlib::io::Now(executor_.context());
-    receive_times_.push_back(now);
-    while (base::ConvertDurationToSeconds(now - receive_times_.front()) > 1.0) {
-      receive_times_.pop_front();
-    }
-
-    data_.rx_count = receive_times_.size();
+    robot_link_.Receive(now, bitfield_);
+    data_.rx_count = robot_link_.Update(now).rx_count;
 
     for (int i = 0; i < 15; i++) {
       if ((bitfield_ & (1 << i)) == 0) { continue; }
 
       const auto slot = nrfusb_.rx_slot(remote_, i);
-      if (i == 0) {
-        data_.mode = static_cast<QuadrupedCommand::Mode>(slot.data[0]);
-        data_.tx_count = slot.data[1];
-      } else if (i == 1) {
-        mjlib::base::BufferReadStream bs({slot.data, slot.size});
-        mjlib::telemetry::ReadStream ts{bs};
-        const double v_R_x = *ts.Read<int16_t>();
-        const double v_R_y = *ts.Read<int16_t>();
-        const double w_LB_z = *ts.Read<int16_t>();
-        data_.v_R = base::Point3D(v_R_x, v_R_y, 0.0);
-        data_.w_LB = base::Point3D(0., 0., w_LB_z);
-      } else if (i == 8) {
-        data_.min_voltage = slot.data[0] * 0.25;
-        data_.max_voltage = slot.data[1] * 0.25;
-        data_.min_temp_C = slot.data[2];
-        data_.max_temp_C = slot.data[3];
-        data_.fault = slot.data[4];
+      if (i == kQuadrupedStateSlot) {
+        const auto state = ReadRfSlot<RfModeStatus>(slot);
+        data_.mode = static_cast<QuadrupedCommand::Mode>(state.mode);
+        data_.tx_count = state.rx_count;
+        robot_link_.SetPeerRxCount(state.rx_count);
+      } else if (i == kQuadrupedMotionSlot) {
+        const auto motion = ReadRfSlot<RfQuadrupedMovement>(slot);
+        data_.v_R = base::Point3D(motion.v_x_mm_s, motion.v_y_mm_s, 0.0);
+        data_.w_LB = base::Point3D(0., 0., motion.w_z_rad_s);
+      } else if (i == kQuadrupedServoSummarySlot) {
+        const auto summary = ReadRfSlot<RfServoSummary>(slot);
+        data_.min_voltage = summary.min_voltage;
+        data_.max_voltage = summary.max_voltage;
+        data_.min_temp_C = summary.min_temp_C;
+        data_.max_temp_C = summary.max_temp_C;
+        data_.fault = summary.fault;
       }
     }
   }
 
   void ProcessTurret() {
+    turret_link_.Receive(mjlib::io::Now(executor_.context()), bitfield_);
+
     auto& t = data_.turret;
     for (int i = 0; i < 15; i++) {
       if ((bitfield_ & (1 << i)) == 0) { continue; }
 
       const auto slot = nrfusb_.rx_slot(remote_, i);
-      mjlib::base::BufferReadStream bs({slot.data, slot.size});
-      mjlib::telemetry::ReadStream ts{bs};
-      if (i == 0) {
-        t.mode = static_cast<TurretControl::Mode>(slot.data[0]);
-        t.rx_count = slot.data[1];
-      } else if (i == 1) {
-        t.imu_pitch_deg = *ts.Read<int16_t>() / 32767.0 * 180.0;
-        t.imu_yaw_deg = *ts.Read<int16_t>() / 32767.0 * 180.0;
-        t.imu_pitch_rate_dps = *ts.Read<int16_t>() / 32767.0 * 400.0;
-        t.imu_yaw_rate_dps = *ts.Read<int16_t>() / 32767.0 * 400.0;
-      } else if (i == 2) {
-        t.servo_pitch_deg = *ts.Read<int16_t>() / 32767.0 * 180.0;
-        t.servo_yaw_deg = *ts.Read<int16_t>() / 32767.0 * 180.0;
-      } else if (i == 3) {
-        t.armed = *ts.Read<int8_t>();
-        t.laser = *ts.Read<int8_t>();
-        t.shot_count = *ts.Read<int16_t>();
-      } else if (i == 8) {
-        t.min_voltage = slot.data[0] * 0.25;
-        t.max_voltage = slot.data[1] * 0.25;
-        t.min_temp_C = slot.data[2];
-        t.max_temp_C = slot.data[3];
-        t.fault = slot.data[4];
+      if (i == kTurretStateSlot) {
+        const auto state = ReadRfSlot<RfModeStatus>(slot);
+        t.mode = static_cast<TurretControl::Mode>(state.mode);
+        t.rx_count = state.rx_count;
+        turret_link_.SetPeerRxCount(state.rx_count);
+      } else if (i == kTurretImuSlot) {
+        const auto imu = ReadRfSlot<RfTurretImu>(slot);
+        t.imu_pitch_deg = imu.pitch_deg;
+        t.imu_yaw_deg = imu.yaw_deg;
+        t.imu_pitch_rate_dps = imu.pitch_rate_dps;
+        t.imu_yaw_rate_dps = imu.yaw_rate_dps;
+      } else if (i == kTurretServoSlot) {
+        const auto servo = ReadRfSlot<RfTurretServo>(slot);
+        t.servo_pitch_deg = servo.pitch_deg;
+        t.servo_yaw_deg = servo.yaw_deg;
+      } else if (i == kTurretWeaponSlot) {
+        const auto weapon = ReadRfSlot<RfTurretWeapon>(slot);
+        t.armed = weapon.armed;
+        t.laser = weapon.laser;
+        t.shot_count = weapon.shot_count;
+      } else if (i == kTurretServoSummarySlot) {
+        const auto summary = ReadRfSlot<RfServoSummary>(slot);
+        t.min_voltage = summary.min_voltage;
+        t.max_voltage = summary.max_voltage;
+        t.min_temp_C = summary.min_temp_C;
+        t.max_temp_C = summary.max_temp_C;
+        t.fault = summary.fault;
       }
     }
   }
@@ -310,9 +302,19 @@ class SlotCommand {
   NrfusbClient nrfusb_;
   Data data_;
 
-  std::deque<boost::posix_time::ptime> receive_times_;
+  RfLinkQuality robot_link_;
+  RfLinkQuality turret_link_;
 };
 
+void DrawLink(const RfLinkQuality::Status& link) {
+  ImGui::Text("link: %s %.0fHz loss %.0f%%",
+              get(mjlib::base::IsEnum<RfLinkQuality::State>::map(),
+                  link.state),
+              link.rate_hz, 100.0 * link.loss);
+  ImGui::Text("gap: %.0fms age: %.0fms",
+              1000.0 * link.max_gap_s, 1000.0 * link.age_s);
+}
+
 void DrawTelemetry(const SlotCommand* slot_command, bool turret) {
   ImGui::Begin("Telemetry");
   ImGui::SetWindowPos({50, 50}, ImGuiCond_FirstUseEver);
@@ -324,6 +326,7 @@ void DrawTelemetry(const SlotCommand* slot_command, bool turret) {
                 get(mjlib::base::IsEnum<QuadrupedCommand::Mode>::map(), d.mode));
     ImGui::Text("tx/rx: %d/%d",
                 d.tx_count, d.rx_count);
+    DrawLink(d.link);
     ImGui::Text("cmd: (%4.0f, %4.0f, %4.0f)",
                 d.v_R.x(), d.v_R.y(),
                 d.w_LB.z());
@@ -345,6 +348,7 @@ void DrawTelemetry(const SlotCommand* slot_command, bool turret) {
       ImGui::Text("Mode: %s",
                   get(mjlib::base::IsEnum<TurretControl::Mode>::map(), t.mode));
       ImGui::Text("tx: %d", t.rx_count);
+      DrawLink(t.link);
       ImGui::Text("pitch/yaw: (%6.1f, %6.1f)",
                   t.imu_pitch_deg, t.imu_yaw_deg);
       ImGui::Text("prate/yrate: (%4.0f, %4.0f)",
@@ -864,6 +868,7 @@ int do_main(int argc, char** argv) {
       reticle->Render();
     }
 
+    if (slot_command) { slot_command->UpdateLink(); }
     DrawTelemetry(slot_command.get(), turret);
     DrawGamepad(gamepad);
 
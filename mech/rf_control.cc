@@ -14,95 +14,41 @@
 
 /// @file
 ///
-/// # Received Commands #
-///
-/// The following slot protocol is used to receive commands.
-///
-/// ## Slot 0 - Primary Command ##
-///   byte 0: Desired mode, from QuadrupedCommand::Mode, remaining
-///           bytes are mode-specific
-///
-///    Zero Velocity - None
-///    Joint - Not implemented
-///    Leg - Not implemented
-///    StandUp - None
-///    Rest - none
-///    Jump
-///     byte 1: repeat
-///     byte 2-3: uint16_t acceleration
-///    Walk - none
-///   byte 1: messages received in last second
+/// The slots exchanged with the ground station are defined in
+/// mech/rf_slot_protocol.h.
 ///
-/// ## Slot 1 - pose_RB ##
-///
-///  * int16 x_m
-///  * int16 y_m
-///  * int16 z_m
-///  * int16 w (scaled to -1.0 -> 1.0)
-///  * int16 x (scaled to -1.0 -> 1.0)
-///  * int16 y (scaled to -1.0 -> 1.0)
-///  * int16 z (scaled to -1.0 -> 1.0)
-///
-/// ## Slot 2 - v_R, w_R ##
+/// # Received Commands #
 ///
-///  * int16 v_R.x
-///  * int16 v_R.y
-///  * int16 w_R.z (scaled to -+ 2 pi)
+///  * kQuadrupedCommandSlot - RfQuadrupedCommand, a new command is
+///    only issued when this slot is received
+///  * kQuadrupedPoseSlot - RfQuadrupedPose
+///  * kQuadrupedMovementSlot - RfQuadrupedMovement
 ///
 /// # Transmitted telemetry #
 ///
-/// The following protocol is used to transmit telemetry.
-///
-/// ## Slot 0 - Primary State ##
-///
-///  * int8_t mode (from QuadrupedCommand::Mode)
-///
-/// ## Slot 1 - Movement State ##
-///
-///  * int16 v_R.x
-///  * int16 v_R.y
-///  * int16 w_R.z (scaled to -+ 2 pi)
-///
-/// ## Slot 4 - Joints 1-3 ##
-///
-///  * 3x of the following struct
-///    * int8_t temp_C
-///    * int8_t fault
-///    * int8_t mode
-///
-/// ## Slot 5 - Joints 4-6 ##
+/// Priorities are adjusted to the link quality by RfSlotScheduler.
+/// Mode and fault slots are critical, and servo summaries are low
+/// value.
 ///
-/// Same as slot 4
-///
-/// ## Slot 6 - Joints 7-9 ##
-///
-/// Same as slot 4
-///
-/// ## Slot 7 - Joints 10-12 ##
-///
-/// Same as slot 4
-///
-/// ## Slot 8 - Joint Summary ##
-///
-///  * int8_t min_voltage
-///  * int8_t max_voltage
-///  * int8_t min_temp_C
-///  * int8_t max_temp_C
-///  * int8_t fault
-///
-/// ## Slot 14 - Fault ##
-///
-///  * char[15] - truncated text string
+///  * kQuadrupedStateSlot - RfModeStatus
+///  * kQuadrupedMotionSlot - RfQuadrupedMovement
+///  * kQuadrupedServoSummarySlot - RfServoSummary
+///  * kQuadrupedFaultSlot - truncated fault text
 
 
 #include "mech/rf_control.h"
 
 #include <boost/asio/post.hpp>
 
+#include "mjlib/base/clipp_archive.h"
 #include "mjlib/io/now.h"
+#include "mjlib/io/repeating_timer.h"
 
+#include "base/fast_signal.h"
 #include "base/telemetry_registry.h"
-#include "base/saturate.h"
+
+#include "mech/rf_link_quality.h"
+#include "mech/rf_slot_protocol.h"
 
 namespace pl = std::placeholders;
 
@@ -129,7 +75,6 @@ auto vmax = [](const auto& container, auto getter, auto incase) {
 };
 
 constexpr int kOnlyRemote = 0;
-constexpr double kVoltageScale = 4.0;
 }
 
 struct SlotData {
@@ -166,14 +111,39 @@ class RfControl::Impl {
         quadruped_control_(quadruped_control),
         rf_getter_(rf_getter) {
     context.telemetry_registry->Register("slotrf", &slotrf_signal_);
+    context.telemetry_registry->Register("rf_link", &rf_link_signal_);
   }
 
+  struct Parameters {
+    // Telemetry is refreshed at least this often, even when nothing
+    // is being received.
+    double telemetry_period_s = 0.05;
+    RfLinkQuality::Options link;
+    RfSlotScheduler::Options scheduler;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(telemetry_period_s));
+      a->Visit(MJ_NVP(link));
+      a->Visit(MJ_NVP(scheduler));
+    }
+  };
+
+  Parameters parameters_;
+
   void AsyncStart(mjlib::io::ErrorCallback callback) {
     rf_ = rf_getter_();
     BOOST_ASSERT(!!rf_);
 
+    link_ = RfLinkQuality(parameters_.link);
+    scheduler_ = RfSlotScheduler(parameters_.scheduler);
+
     StartRead();
 
+    timer_.start(
+        mjlib::base::ConvertSecondsToDuration(parameters_.telemetry_period_s),
+        std::bind(&Impl::HandleTimer, this, pl::_1));
+
     boost::asio::post(
         executor_,
         std::bind(std::move(callback), mjlib::base::error_code()));
@@ -190,11 +160,7 @@ class RfControl::Impl {
 
     const auto now = mjlib::io::Now(executor_.context());
     slot_data_.timestamp = now;
-    receive_times_.push_back(now);
-    while (mjlib::base::ConvertDurationToSeconds(
-               now - receive_times_.front()) > 1.0) {
-      receive_times_.pop_front();
-    }
+    link_.Receive(now, bitfield_);
 
     for (int i = 0; i < 15; i++) {
       if (!(bitfield_ & (1 << i))) { continue; }
@@ -209,7 +175,7 @@ class RfControl::Impl {
     slotrf_signal_(&slot_data_);
 
     // We only command when we receive a mode slot.
-    if (bitfield_ & 0x01) {
+    if (bitfield_ & (1 << kQuadrupedCommandSlot)) {
       SendCommand();
     }
 
@@ -218,77 +184,69 @@ class RfControl::Impl {
     StartRead();
   }
 
+  void HandleTimer(const mjlib::base::error_code& ec) {
+    if (ec == boost::asio::error::operation_aborted) { return; }
+    mjlib::base::FailIf(ec);
+
+    // The scheduler must also react when nothing arrives at all.
+    ReportTelemetry();
+  }
+
   void SendCommand() {
     // We just got a new command.  Formulate our command structure and
     // send it on.
     QuadrupedCommand command;
 
+    const auto& rx = slot_data_.rx;
+    auto decode = [&](auto* message, int slot) {
+      using Message = std::remove_pointer_t<decltype(message)>;
+      *message = DecodeRfSlot<Message>(rx[slot].data.data(), rx[slot].size);
+    };
+
+    RfQuadrupedCommand rf_command;
+    decode(&rf_command, kQuadrupedCommandSlot);
+
     command.mode = [&]() {
-      switch (slot_data_.rx[0].data[0]) {
-        case 1: {
-          return QuadrupedCommand::Mode::kStopped;
-        }
-        case 3: {
-          return QuadrupedCommand::Mode::kZeroVelocity;
-        }
-        case 7: {
-          return QuadrupedCommand::Mode::kRest;
+      switch (rf_command.mode) {
+        case QuadrupedCommand::Mode::kStopped:
+        case QuadrupedCommand::Mode::kZeroVelocity:
+        case QuadrupedCommand::Mode::kRest: {
+          return rf_command.mode;
         }
-        case 8: {
+        case QuadrupedCommand::Mode::kJump: {
           QuadrupedCommand::Jump jump;
-          jump.repeat = slot_data_.rx[0].data[1] != 0;
-          uint16_t acceleration = {};
-          std::memcpy(&acceleration, &slot_data_.rx[0].data[2], 2);
-          jump.acceleration = acceleration;
+          jump.repeat = rf_command.jump_repeat;
+          jump.acceleration = rf_command.jump_acceleration;
           command.jump = jump;
           return QuadrupedCommand::Mode::kJump;
         }
-        case 9: {
+        case QuadrupedCommand::Mode::kWalk: {
           command.walk = QuadrupedCommand::Walk();
           return QuadrupedCommand::Mode::kWalk;
         }
         default: {
           return QuadrupedCommand::Mode::kZeroVelocity;
         }
-
-        mjlib::base::AssertNotReached();
       }
     }();
 
-    auto read_int16 = [&](int slot, int pos) {
-      int16_t value = 0;
-      std::memcpy(&value, &slot_data_.rx[slot].data[pos], 2);
-      return value;
-    };
+    RfQuadrupedPose pose;
+    decode(&pose, kQuadrupedPoseSlot);
 
-    Eigen::Quaterniond quat{
-      read_int16(1, 6) / 32767.0,
-          read_int16(1, 8) / 32767.0,
-          read_int16(1, 10) / 32767.0,
-          read_int16(1, 12) / 32767.0
-          };
+    Eigen::Quaterniond quat{pose.w, pose.x, pose.y, pose.z};
     if (quat.norm() == 0.0) {
       quat = Eigen::Quaterniond::Identity();
     }
+    quat.normalize();
 
     command.rest.offset_RB = Sophus::SE3d(
-        quat,
-        Eigen::Vector3d(
-            read_int16(1, 0),
-            read_int16(1, 2),
-            read_int16(1, 4)));
-
-    command.v_R = {
-      read_int16(2, 0) * 1.0,
-      read_int16(2, 2) * 1.0,
-      0.0
-    };
+        quat, Eigen::Vector3d(pose.x_mm, pose.y_mm, pose.z_mm));
 
-    command.w_R = {
-      0.0,
-      0.0,
-      2.0 * M_PI * read_int16(2, 4) / 32767.0
-    };
+    RfQuadrupedMovement movement;
+    decode(&movement, kQuadrupedMovementSlot);
+
+    command.v_R = { movement.v_x_mm_s, movement.v_y_mm_s, 0.0 };
+    command.w_R = { 0.0, 0.0, movement.w_z_rad_s };
 
     // RF control takes precendence over everything if we're seeing
     // it.
@@ -305,67 +263,65 @@ class RfControl::Impl {
     }
     last_telemetry_ = now;
 
+    const auto& link = link_.Update(now);
+    auto send = [&](int slot_idx, RfSlotClass slot_class,
+                    const RfClient::Slot& slot) {
+      rf_->tx_slot(kOnlyRemote, slot_idx,
+                   scheduler_.Schedule(
+                       now, link.state, slot_idx, slot_class, slot));
+    };
+
     const auto& qs = quadruped_control_->status();
     const auto& s = qs.state;
 
     const bool fault = qs.mode == QuadrupedCommand::Mode::kFault;
 
-    using Slot = RfClient::Slot;
     {
-      Slot slot0;
-      slot0.size = 2;
-      slot0.priority = 0xffffffff;
-      slot0.data[0] = static_cast<uint8_t>(qs.mode);
-      slot0.data[1] = base::Saturate<uint8_t>(receive_times_.size());
-      rf_->tx_slot(kOnlyRemote, 0, slot0);
+      RfModeStatus state;
+      state.mode = static_cast<int>(qs.mode);
+      state.rx_count = link.rx_count;
+      send(kQuadrupedStateSlot, RfSlotClass::kCritical,
+           MakeRfSlot(state, 0xffffffff));
     }
     {
-      Slot slot1;
-      slot1.size = 6;
-      slot1.priority = 0xffffffff;
-      mjlib::base::BufferWriteStream bs({slot1.data, 6});
-      mjlib::telemetry::WriteStream ts{bs};
-      ts.Write(base::Saturate<int16_t>(s.robot.desired_R.v.x()));
-      ts.Write(base::Saturate<int16_t>(s.robot.desired_R.v.y()));
-      ts.Write(base::Saturate<int16_t>(
-                   32767.0 * s.robot.desired_R.w.z() / (2 * M_PI)));
-      rf_->tx_slot(kOnlyRemote, 1, slot1);
+      RfQuadrupedMovement motion;
+      motion.v_x_mm_s = s.robot.desired_R.v.x();
+      motion.v_y_mm_s = s.robot.desired_R.v.y();
+      motion.w_z_rad_s = s.robot.desired_R.w.z();
+      send(kQuadrupedMotionSlot, RfSlotClass::kNormal,
+           MakeRfSlot(motion, 0xffffffff));
     }
     {
-      Slot slot8;
-      slot8.size = 5;
-      slot8.priority = 0x55555555;
-      mjlib::base::BufferWriteStream bs({slot8.data, 5});
-      mjlib::telemetry::WriteStream ts{bs};
-      ts.Write(base::Saturate<int8_t>(kVoltageScale *
-                   vmin(s.joints, [](const auto& j) { return j.voltage; }, 0.0)));
-      ts.Write(base::Saturate<int8_t>(kVoltageScale *
-                   vmax(s.joints, [](const auto& j) { return j.voltage; }, 0.0)));
-      ts.Write(
-          base::Saturate<int8_t>(
-              vmin(s.joints, [](const auto& j) { return j.temperature_C; }, 0.0)));
-      ts.Write(
-          base::Saturate<int8_t>(
-              vmax(s.joints, [](const auto& j) { return j.temperature_C; }, 0.0)));
-      ts.Write(
-          base::Saturate<int8_t>(
-              vmax(s.joints, [](const auto& j) { return j.fault; }, 0)));
-      rf_->tx_slot(kOnlyRemote, 8, slot8);
+      RfServoSummary summary;
+      summary.min_voltage =
+          vmin(s.joints, [](const auto& j) { return j.voltage; }, 0.0);
+      summary.max_voltage =
+          vmax(s.joints, [](const auto& j) { return j.voltage; }, 0.0);
+      summary.min_temp_C =
+          vmin(s.joints, [](const auto& j) { return j.temperature_C; }, 0.0);
+      summary.max_temp_C =
+          vmax(s.joints, [](const auto& j) { return j.temperature_C; }, 0.0);
+      summary.fault = vmax(s.joints, [](const auto& j) { return j.fault; }, 0);
+      send(kQuadrupedServoSummarySlot, RfSlotClass::kLow,
+           MakeRfSlot(summary, 0x55555555));
     }
     {
-      Slot slot14;
+      RfClient::Slot slot14;
       if (!fault) {
         slot14.priority = 0x01010101;
         slot14.size = 0;
-        rf_->tx_slot(kOnlyRemote, 14, slot14);
       } else {
         slot14.priority = 0xaaaaaaaa;
-        auto size = std::min<size_t>(13, qs.fault.size());
+        auto size = std::min<size_t>(kRfFaultTextSize, qs.fault.size());
         slot14.size = size;
         std::memcpy(slot14.data, qs.fault.data(), size);
-        rf_->tx_slot(kOnlyRemote, 14, slot14);
       }
+      send(kQuadrupedFaultSlot, RfSlotClass::kCritical, slot14);
     }
+
+    rf_link_data_.link = link;
+    rf_link_data_.scheduler = scheduler_.status();
+    rf_link_signal_(&rf_link_data_);
   }
 
   boost::asio::any_io_executor executor_;
@@ -378,10 +334,15 @@ class RfControl::Impl {
   uint16_t bitfield_ = 0;
 
   SlotData slot_data_;
-  boost::signals2::signal<void (const SlotData*)> slotrf_signal_;
+  base::FastSignal<void (const SlotData*)> slotrf_signal_;
+
+  RfLinkQuality link_;
+  RfSlotScheduler scheduler_;
+  RfLinkTelemetry rf_link_data_;
+  base::FastSignal<void (const RfLinkTelemetry*)> rf_link_signal_;
 
   boost::posix_time::ptime last_telemetry_;
-  std::deque<boost::posix_time::ptime> receive_times_;
+  mjlib::io::RepeatingTimer timer_{executor_};
 };
 
 RfControl::RfControl(const base::Context& context,
@@ -396,7 +357,7 @@ void RfControl::AsyncStart(mjlib::io::ErrorCallback callback) {
 }
 
 clipp::group RfControl::program_options() {
-  return {};
+  return mjlib::base::ClippArchive().Accept(&impl_->parameters_).release();
 }
 
 }
@@ -0,0 +1,172 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/rf_link_quality.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "mjlib/base/time_conversions.h"
+
+namespace mjmech {
+namespace mech {
+
+namespace {
+double Seconds(boost::posix_time::time_duration duration) {
+  return mjlib::base::ConvertDurationToSeconds(duration);
+}
+}
+
+RfLinkQuality::RfLinkQuality(const Options& options)
+    : options_(options) {}
+
+void RfLinkQuality::Receive(boost::posix_time::ptime now, uint16_t bitfield) {
+  last_receive_ = now;
+  receive_times_.push_back(now);
+  while (Seconds(now - receive_times_.front()) > options_.window_s) {
+    receive_times_.pop_front();
+  }
+
+  for (int i = 0; i < kRfNumSlots; i++) {
+    if (bitfield & (1 << i)) { slot_times_[i] = now; }
+  }
+}
+
+const RfLinkQuality::Status& RfLinkQuality::Update(
+    boost::posix_time::ptime now) {
+  while (!receive_times_.empty() &&
+         Seconds(now - receive_times_.front()) > options_.window_s) {
+    receive_times_.pop_front();
+  }
+
+  auto& s = status_;
+  s.timestamp = now;
+  s.rx_count = receive_times_.size();
+  s.rate_hz = s.rx_count / options_.window_s;
+
+  for (int i = 0; i < kRfNumSlots; i++) {
+    s.slot_age_s[i] = slot_times_[i].is_not_a_date_time() ?
+        -1.0 : Seconds(now - slot_times_[i]);
+  }
+
+  if (last_receive_.is_not_a_date_time()) {
+    s.state = State::kNone;
+    s.loss = 0.0;
+    s.max_gap_s = 0.0;
+    s.age_s = 0.0;
+    return s;
+  }
+  s.age_s = Seconds(now - last_receive_);
+
+  // Every frame period without a reception is taken to be a lost
+  // frame, including the one in progress.
+  double lost = 0.0;
+  double max_gap_s = 0.0;
+  auto count_gap = [&](double gap_s) {
+    max_gap_s = std::max(max_gap_s, gap_s);
+    lost += std::max(0.0, std::round(gap_s / options_.frame_period_s) - 1.0);
+  };
+  for (std::size_t i = 1; i < receive_times_.size(); i++) {
+    count_gap(Seconds(receive_times_[i] - receive_times_[i - 1]));
+  }
+  count_gap(std::min(s.age_s, options_.window_s));
+
+  s.max_gap_s = max_gap_s;
+  s.loss = (lost + s.rx_count) > 0.0 ? lost / (lost + s.rx_count) : 1.0;
+
+  if (s.age_s > options_.lost_timeout_s) {
+    s.state = State::kLost;
+  } else if (s.loss > options_.degraded_loss) {
+    s.state = State::kDegraded;
+  } else {
+    s.state = State::kGood;
+  }
+
+  return s;
+}
+
+RfSlotScheduler::RfSlotScheduler(const Options& options)
+    : options_(options) {}
+
+RfClient::Slot RfSlotScheduler::Schedule(
+    boost::posix_time::ptime now,
+    RfLinkQuality::State state,
+    int slot_idx,
+    RfSlotClass slot_class,
+    RfClient::Slot slot) {
+  auto& sent = sent_.at(slot_idx);
+  if (sent.changed.is_not_a_date_time() ||
+      sent.size != slot.size ||
+      std::memcmp(sent.data.data(), slot.data, slot.size) != 0) {
+    sent.size = slot.size;
+    std::memcpy(sent.data.data(), slot.data, slot.size);
+    sent.changed = now;
+  }
+
+  const bool poor_link =
+      state == RfLinkQuality::State::kDegraded ||
+      state == RfLinkQuality::State::kLost;
+
+  const uint32_t requested = slot.priority;
+  switch (slot_class) {
+    case RfSlotClass::kCritical: {
+      if (poor_link ||
+          Seconds(now - sent.changed) < options_.change_boost_s) {
+        slot.priority = 0xffffffff;
+      }
+      break;
+    }
+    case RfSlotClass::kNormal: {
+      break;
+    }
+    case RfSlotClass::kLow: {
+      if (state == RfLinkQuality::State::kDegraded) {
+        slot.priority = Thin(slot.priority, options_.degraded_thin);
+      } else if (state == RfLinkQuality::State::kLost) {
+        slot.priority = Thin(slot.priority, options_.lost_thin);
+      }
+      break;
+    }
+  }
+
+  const uint16_t bit = 1 << slot_idx;
+  auto popcount = [](uint32_t value) {
+    int result = 0;
+    for (; value; value &= value - 1) { result++; }
+    return result;
+  };
+  const int delta = popcount(slot.priority) - popcount(requested);
+  status_.priority[slot_idx] = slot.priority;
+  status_.boosted = (status_.boosted & ~bit) | (delta > 0 ? bit : 0);
+  status_.throttled = (status_.throttled & ~bit) | (delta < 0 ? bit : 0);
+
+  return slot;
+}
+
+uint32_t RfSlotScheduler::Thin(uint32_t priority, int keep) {
+  if (priority == 0 || keep <= 1) { return priority; }
+
+  uint32_t result = 0;
+  int count = 0;
+  for (int i = 0; i < 32; i++) {
+    const uint32_t bit = uint32_t(1) << i;
+    if ((priority & bit) == 0) { continue; }
+    if ((count++ % keep) == 0) { result |= bit; }
+  }
+  return result;
+}
+
+}
+}
@@ -0,0 +1,235 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <map>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "mjlib/base/visitor.h"
+
+#include "mech/rf_client.h"
+
+namespace mjmech {
+namespace mech {
+
+constexpr int kRfNumSlots = 15;
+
+/// Estimates the health of the receive half of an RF link from the
+/// times at which slots arrive.
+///
+/// The radio sends every slot with a non-zero priority at least once
+/// each frame, so any gap much longer than one frame period implies
+/// that frames were lost.
+class RfLinkQuality {
+ public:
+  struct Options {
+    /// The radio frame period.
+    double frame_period_s = 0.02;
+    /// Statistics are computed over this window.
+    double window_s = 1.0;
+    /// Above this inferred loss fraction, the link is degraded.
+    double degraded_loss = 0.3;
+    /// With nothing received for this long, the link is lost.
+    double lost_timeout_s = 0.5;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(frame_period_s));
+      a->Visit(MJ_NVP(window_s));
+      a->Visit(MJ_NVP(degraded_loss));
+      a->Visit(MJ_NVP(lost_timeout_s));
+    }
+  };
+
+  enum class State {
+    kNone,
+    kGood,
+    kDegraded,
+    kLost,
+  };
+
+  struct Status {
+    boost::posix_time::ptime timestamp;
+    State state = State::kNone;
+
+    /// Receptions within the window.
+    int rx_count = 0;
+    double rate_hz = 0.0;
+    /// The inferred fraction of frames lost within the window.
+    double loss = 0.0;
+    double max_gap_s = 0.0;
+    /// The time since anything was received.
+    double age_s = 0.0;
+    /// The time since each slot was received, or -1 if never.
+    std::array<double, kRfNumSlots> slot_age_s = {};
+    /// The far end's rx_count, if it reports one, otherwise -1.
+    int peer_rx_count = -1;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(timestamp));
+      a->Visit(MJ_NVP(state));
+      a->Visit(MJ_NVP(rx_count));
+      a->Visit(MJ_NVP(rate_hz));
+      a->Visit(MJ_NVP(loss));
+      a->Visit(MJ_NVP(max_gap_s));
+      a->Visit(MJ_NVP(age_s));
+      a->Visit(MJ_NVP(slot_age_s));
+      a->Visit(MJ_NVP(peer_rx_count));
+    }
+  };
+
+  RfLinkQuality() {}
+  explicit RfLinkQuality(const Options&);
+
+  /// Record that the slots in @p bitfield were received at @p now.
+  void Receive(boost::posix_time::ptime now, uint16_t bitfield);
+
+  void SetPeerRxCount(int value) { status_.peer_rx_count = value; }
+
+  /// Recompute the status as of @p now.
+  const Status& Update(boost::posix_time::ptime now);
+
+  const Status& status() const { return status_; }
+
+ private:
+  Options options_;
+  boost::posix_time::ptime last_receive_;
+  std::deque<boost::posix_time::ptime> receive_times_;
+  std::array<boost::posix_time::ptime, kRfNumSlots> slot_times_;
+  Status status_;
+};
+
+/// How important a transmitted slot is to the far end.
+enum class RfSlotClass {
+  /// The far end must learn of any change promptly, like the mode or
+  /// a fault.
+  kCritical,
+  kNormal,
+  /// Only informational, may be sent less often when the link is
+  /// poor.
+  kLow,
+};
+
+/// Adjusts the priority of transmitted slots to suit the link.
+///
+/// A priority is a bitmask of the 32 frame cycle in which the slot is
+/// sent, so more bits means more airtime.  Critical slots are sent in
+/// every frame for a while after their content changes, and whenever
+/// the link is degraded or lost.  Low value slots are thinned as the
+/// link worsens, leaving room for the others.
+class RfSlotScheduler {
+ public:
+  struct Options {
+    /// After a critical slot changes, send it in every frame for this
+    /// long.
+    double change_boost_s = 0.2;
+    /// Keep one in this many frames of low value slots when the link
+    /// is degraded.
+    int degraded_thin = 2;
+    /// And this many when it is lost.
+    int lost_thin = 4;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(change_boost_s));
+      a->Visit(MJ_NVP(degraded_thin));
+      a->Visit(MJ_NVP(lost_thin));
+    }
+  };
+
+  struct Status {
+    std::array<uint32_t, kRfNumSlots> priority = {};
+    /// A 1 for each slot last scheduled with more airtime than was
+    /// requested.
+    uint16_t boosted = 0;
+    /// And with less.
+    uint16_t throttled = 0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(priority));
+      a->Visit(MJ_NVP(boosted));
+      a->Visit(MJ_NVP(throttled));
+    }
+  };
+
+  RfSlotScheduler() {}
+  explicit RfSlotScheduler(const Options&);
+
+  /// @return @p slot, with its priority adjusted.
+  RfClient::Slot Schedule(boost::posix_time::ptime now,
+                          RfLinkQuality::State state,
+                          int slot_idx,
+                          RfSlotClass slot_class,
+                          RfClient::Slot slot);
+
+  const Status& status() const { return status_; }
+
+  /// @return @p priority with only one in every @p keep of its set
+  /// bits remaining, but never none.
+  static uint32_t Thin(uint32_t priority, int keep);
+
+ private:
+  Options options_;
+
+  struct Sent {
+    uint8_t size = 0;
+    std::array<char, sizeof(RfClient::Slot::data)> data = {};
+    boost::posix_time::ptime changed;
+  };
+  std::array<Sent, kRfNumSlots> sent_;
+  Status status_;
+};
+
+/// The telemetry record emitted by each end of the link.
+struct RfLinkTelemetry {
+  RfLinkQuality::Status link;
+  RfSlotScheduler::Status scheduler;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(link));
+    a->Visit(MJ_NVP(scheduler));
+  }
+};
+
+}
+}
+
+namespace mjlib {
+namespace base {
+
+template <>
+struct IsEnum<mjmech::mech::RfLinkQuality::State> {
+  static constexpr bool value = true;
+
+  using S = mjmech::mech::RfLinkQuality::State;
+  static inline std::map<S, const char*> map() {
+    return {
+      { S::kNone, "none" },
+      { S::kGood, "good" },
+      { S::kDegraded, "degraded" },
+      { S::kLost, "lost" },
+    };
+  }
+};
+
+}
+}
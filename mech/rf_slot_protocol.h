@@ -0,0 +1,273 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cmath>
+
+#include "mech/quadruped_command.h"
+#include "mech/rf_slot_schema.h"
+
+/// @file
+///
+/// The slots exchanged between the robots and the ground station.
+/// Both sides use these definitions, so that they cannot disagree on
+/// the layout.  Each message lists its fields in kSchema, and ties
+/// them in the same order in Fields().
+
+namespace mjmech {
+namespace mech {
+
+/////////////////////////////////////////////
+// Quadruped, sent by the ground station.
+
+constexpr int kQuadrupedCommandSlot = 0;
+constexpr int kQuadrupedPoseSlot = 1;
+constexpr int kQuadrupedMovementSlot = 2;
+
+// Quadruped, sent by the robot.
+
+constexpr int kQuadrupedStateSlot = 0;
+constexpr int kQuadrupedMotionSlot = 1;
+constexpr int kQuadrupedServoSummarySlot = 8;
+constexpr int kQuadrupedFaultSlot = 14;
+
+/////////////////////////////////////////////
+// Turret, sent by the ground station.
+
+constexpr int kTurretCommandSlot = 0;
+constexpr int kTurretRateSlot = 1;
+constexpr int kTurretWeaponCommandSlot = 2;
+
+// Turret, sent by the robot.
+
+constexpr int kTurretStateSlot = 0;
+constexpr int kTurretImuSlot = 1;
+constexpr int kTurretServoSlot = 2;
+constexpr int kTurretWeaponSlot = 3;
+constexpr int kTurretServoSummarySlot = 8;
+constexpr int kTurretFaultSlot = 14;
+
+/// The fault slot holds a truncated text string.
+constexpr int kRfFaultTextSize = 13;
+
+/// The primary mode of a robot, and how many slots it has received
+/// in the last second.  The mode is a QuadrupedCommand::Mode or a
+/// TurretControl::Mode.
+struct RfModeStatus {
+  int mode = 0;
+  int rx_count = 0;
+
+  static constexpr auto kSchema = MakeRfSlotSchema(
+      RfSlotField::Integer("mode", 4),
+      RfSlotField::Integer("rx_count", 8));
+
+  template <typename Self>
+  static constexpr auto Fields(Self& self) {
+    return std::tie(self.mode, self.rx_count);
+  }
+};
+
+struct RfQuadrupedCommand {
+  QuadrupedCommand::Mode mode = QuadrupedCommand::kStopped;
+  bool jump_repeat = false;
+  double jump_acceleration = 0.0;
+
+  static constexpr auto kSchema = MakeRfSlotSchema(
+      RfSlotField::Integer("mode", 4),
+      RfSlotField::Flag("jump_repeat"),
+      RfSlotField::Unsigned("jump_acceleration", 12, 8190.0));
+
+  template <typename Self>
+  static constexpr auto Fields(Self& self) {
+    return std::tie(self.mode, self.jump_repeat, self.jump_acceleration);
+  }
+};
+
+/// QuadrupedCommand::rest.offset_RB.  The quaternion need not be
+/// normalized.
+struct RfQuadrupedPose {
+  double x_mm = 0.0;
+  double y_mm = 0.0;
+  double z_mm = 0.0;
+  double w = 1.0;
+  double x = 0.0;
+  double y = 0.0;
+  double z = 0.0;
+
+  static constexpr auto kSchema = MakeRfSlotSchema(
+      RfSlotField::Signed("x_mm", 12, 2047.0),
+      RfSlotField::Signed("y_mm", 12, 2047.0),
+      RfSlotField::Signed("z_mm", 12, 2047.0),
+      RfSlotField::Signed("w", 12, 1.0),
+      RfSlotField::Signed("x", 12, 1.0),
+      RfSlotField::Signed("y", 12, 1.0),
+      RfSlotField::Signed("z", 12, 1.0));
+
+  template <typename Self>
+  static constexpr auto Fields(Self& self) {
+    return std::tie(self.x_mm, self.y_mm, self.z_mm,
+                    self.w, self.x, self.y, self.z);
+  }
+};
+
+/// The commanded velocity of the quadruped, in the R frame.  The
+/// robot reports its desired velocity back in the same form.
+struct RfQuadrupedMovement {
+  double v_x_mm_s = 0.0;
+  double v_y_mm_s = 0.0;
+  double w_z_rad_s = 0.0;
+
+  static constexpr auto kSchema = MakeRfSlotSchema(
+      RfSlotField::Signed("v_x_mm_s", 12, 2047.0),
+      RfSlotField::Signed("v_y_mm_s", 12, 2047.0),
+      RfSlotField::Signed("w_z_rad_s", 12, 2.0 * M_PI));
+
+  template <typename Self>
+  static constexpr auto Fields(Self& self) {
+    return std::tie(self.v_x_mm_s, self.v_y_mm_s, self.w_z_rad_s);
+  }
+};
+
+/// The extremes across all servos of a robot.
+struct RfServoSummary {
+  double min_voltage = 0.0;
+  double max_voltage = 0.0;
+  double min_temp_C = 0.0;
+  double max_temp_C = 0.0;
+  int fault = 0;
+
+  static constexpr auto kSchema = MakeRfSlotSchema(
+      RfSlotField::Unsigned("min_voltage", 8, 63.75),
+      RfSlotField::Unsigned("max_voltage", 8, 63.75),
+      RfSlotField::Signed("min_temp_C", 8, 127.0),
+      RfSlotField::Signed("max_temp_C", 8, 127.0),
+      RfSlotField::Integer("fault", 8));
+
+  template <typename Self>
+  static constexpr auto Fields(Self& self) {
+    return std::tie(self.min_voltage, self.max_voltage,
+                    self.min_temp_C, self.max_temp_C, self.fault);
+  }
+};
+
+/// The mode is a TurretControl::Mode.
+struct RfTurretCommand {
+  int mode = 0;
+
+  static constexpr auto kSchema = MakeRfSlotSchema(
+      RfSlotField::Integer("mode", 4));
+
+  template <typename Self>
+  static constexpr auto Fields(Self& self) {
+    return std::tie(self.mode);
+  }
+};
+
+struct RfTurretRate {
+  double pitch_rate_dps = 0.0;
+  double yaw_rate_dps = 0.0;
+  bool track_target = false;
+
+  static constexpr auto kSchema = MakeRfSlotSchema(
+      RfSlotField::Signed("pitch_rate_dps", 12, 400.0),
+      RfSlotField::Signed("yaw_rate_dps", 12, 400.0),
+      RfSlotField::Flag("track_target"));
+
+  template <typename Self>
+  static constexpr auto Fields(Self& self) {
+    return std::tie(self.pitch_rate_dps, self.yaw_rate_dps,
+                    self.track_target);
+  }
+};
+
+struct RfTurretWeaponCommand {
+  bool laser_enable = false;
+  int16_t trigger_sequence = 0;
+
+  static constexpr auto kSchema = MakeRfSlotSchema(
+      RfSlotField::Flag("laser_enable"),
+      RfSlotField::Integer("trigger_sequence", 16, true));
+
+  template <typename Self>
+  static constexpr auto Fields(Self& self) {
+    return std::tie(self.laser_enable, self.trigger_sequence);
+  }
+};
+
+struct RfTurretImu {
+  double pitch_deg = 0.0;
+  double yaw_deg = 0.0;
+  double pitch_rate_dps = 0.0;
+  double yaw_rate_dps = 0.0;
+
+  static constexpr auto kSchema = MakeRfSlotSchema(
+      RfSlotField::Signed("pitch_deg", 12, 180.0),
+      RfSlotField::Signed("yaw_deg", 12, 180.0),
+      RfSlotField::Signed("pitch_rate_dps", 12, 400.0),
+      RfSlotField::Signed("yaw_rate_dps", 12, 400.0));
+
+  template <typename Self>
+  static constexpr auto Fields(Self& self) {
+    return std::tie(self.pitch_deg, self.yaw_deg,
+                    self.pitch_rate_dps, self.yaw_rate_dps);
+  }
+};
+
+struct RfTurretServo {
+  double pitch_deg = 0.0;
+  double yaw_deg = 0.0;
+
+  static constexpr auto kSchema = MakeRfSlotSchema(
+      RfSlotField::Signed("pitch_deg", 12, 180.0),
+      RfSlotField::Signed("yaw_deg", 12, 180.0));
+
+  template <typename Self>
+  static constexpr auto Fields(Self& self) {
+    return std::tie(self.pitch_deg, self.yaw_deg);
+  }
+};
+
+struct RfTurretWeapon {
+  bool armed = false;
+  bool laser = false;
+  int16_t shot_count = 0;
+
+  static constexpr auto kSchema = MakeRfSlotSchema(
+      RfSlotField::Flag("armed"),
+      RfSlotField::Flag("laser"),
+      RfSlotField::Integer("shot_count", 16, true));
+
+  template <typename Self>
+  static constexpr auto Fields(Self& self) {
+    return std::tie(self.armed, self.laser, self.shot_count);
+  }
+};
+
+static_assert(QuadrupedCommand::kNumModes <= 16,
+              "RfQuadrupedCommand::mode is only 4 bits");
+
+// The encoders and decoders must agree at compile time.
+static_assert(
+    DecodeRfSlot<RfQuadrupedMovement>(
+        EncodeRfSlot(RfQuadrupedMovement{-250.0, 40.0, 0.0})).v_x_mm_s ==
+    -250.0);
+static_assert(
+    DecodeRfSlot<RfQuadrupedCommand>(
+        EncodeRfSlot(RfQuadrupedCommand{
+            QuadrupedCommand::kJump, true, 2000.0})).mode ==
+    QuadrupedCommand::kJump);
+
+}
+}
@@ -0,0 +1,288 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+#include <fmt/format.h>
+
+#include "mech/rf_client.h"
+
+namespace mjmech {
+namespace mech {
+
+/// The largest payload which fits in one RF slot.
+constexpr int kRfSlotMaxSize = 15;
+
+/// One quantized field of an RF slot.
+///
+/// Values are stored as an integer count of @p scale, saturated to
+/// what fits in @p bits, in two's complement if @p is_signed.  The
+/// signed range is symmetric, so the most negative count is never
+/// sent.
+struct RfSlotField {
+  const char* name = "";
+  int bits = 0;
+  bool is_signed = false;
+  double scale = 1.0;
+
+  /// A signed field which represents -max_abs to max_abs.
+  static constexpr RfSlotField Signed(
+      const char* name, int bits, double max_abs) {
+    return {name, bits, true,
+            max_abs / static_cast<double>((int64_t(1) << (bits - 1)) - 1)};
+  }
+
+  /// An unsigned field which represents 0 to max.
+  static constexpr RfSlotField Unsigned(
+      const char* name, int bits, double max) {
+    return {name, bits, false,
+            max / static_cast<double>((int64_t(1) << bits) - 1)};
+  }
+
+  /// An integer with one count per unit.
+  static constexpr RfSlotField Integer(
+      const char* name, int bits, bool is_signed = false) {
+    return {name, bits, is_signed, 1.0};
+  }
+
+  static constexpr RfSlotField Flag(const char* name) {
+    return Integer(name, 1);
+  }
+
+  constexpr int64_t min_count() const {
+    return is_signed ? -max_count() : 0;
+  }
+
+  constexpr int64_t max_count() const {
+    return is_signed ?
+        (int64_t(1) << (bits - 1)) - 1 :
+        (int64_t(1) << bits) - 1;
+  }
+
+  /// @return the raw bits for @p value.  NaN is sent as zero.
+  constexpr uint32_t Quantize(double value) const {
+    if (value != value) { return 0; }
+    double counts = value / scale;
+    const double min = static_cast<double>(min_count());
+    const double max = static_cast<double>(max_count());
+    if (counts < min) { counts = min; }
+    if (counts > max) { counts = max; }
+    const int64_t rounded = counts >= 0.0 ?
+        static_cast<int64_t>(counts + 0.5) :
+        -static_cast<int64_t>(-counts + 0.5);
+    const uint64_t mask = (uint64_t(1) << bits) - 1;
+    return static_cast<uint32_t>(static_cast<uint64_t>(rounded) & mask);
+  }
+
+  constexpr double Dequantize(uint32_t raw) const {
+    int64_t counts = raw;
+    if (is_signed && (raw & (uint32_t(1) << (bits - 1)))) {
+      counts -= int64_t(1) << bits;
+    }
+    return static_cast<double>(counts) * scale;
+  }
+};
+
+/// The fields of one RF slot, which are packed least significant bit
+/// first, with no padding between them.
+template <std::size_t N>
+struct RfSlotSchema {
+  std::array<RfSlotField, N> fields;
+
+  constexpr int bit_offset(std::size_t index) const {
+    int result = 0;
+    for (std::size_t i = 0; i < index; i++) { result += fields[i].bits; }
+    return result;
+  }
+
+  constexpr int bits() const { return bit_offset(N); }
+
+  /// @return the number of bytes transmitted.
+  constexpr int size() const { return (bits() + 7) / 8; }
+
+  /// @return the fraction of the slot's capacity which carries data.
+  constexpr double utilization() const {
+    return static_cast<double>(bits()) / (8 * kRfSlotMaxSize);
+  }
+
+  /// @return a human readable table of the fields and the space they
+  /// use.
+  std::string Describe() const {
+    std::string result = fmt::format(
+        "{} bits in {} bytes, {:.0f}% of slot\n",
+        bits(), size(), 100.0 * utilization());
+    for (std::size_t i = 0; i < N; i++) {
+      const auto& field = fields[i];
+      result += fmt::format(
+          "  {:<20} bits {:3d}-{:3d} {} resolution {:g}\n",
+          field.name, bit_offset(i), bit_offset(i) + field.bits - 1,
+          field.is_signed ? "signed  " : "unsigned", field.scale);
+    }
+    return result;
+  }
+};
+
+template <typename... Fields>
+constexpr auto MakeRfSlotSchema(Fields... fields) {
+  return RfSlotSchema<sizeof...(Fields)>{{{fields...}}};
+}
+
+struct RfSlotBytes {
+  uint8_t size = 0;
+  std::array<uint8_t, kRfSlotMaxSize> data = {};
+};
+
+namespace detail {
+constexpr void WriteRfBits(std::array<uint8_t, kRfSlotMaxSize>* data,
+                           int offset, int bits, uint32_t raw) {
+  while (bits > 0) {
+    const int shift = offset % 8;
+    const int count = (8 - shift) < bits ? (8 - shift) : bits;
+    const uint32_t mask = (uint32_t(1) << count) - 1;
+    (*data)[offset / 8] |= static_cast<uint8_t>((raw & mask) << shift);
+    raw >>= count;
+    offset += count;
+    bits -= count;
+  }
+}
+
+constexpr uint32_t ReadRfBits(const std::array<uint8_t, kRfSlotMaxSize>& data,
+                              int offset, int bits) {
+  uint32_t result = 0;
+  int done = 0;
+  while (done < bits) {
+    const int shift = offset % 8;
+    const int count = (8 - shift) < (bits - done) ? (8 - shift) : (bits - done);
+    const uint32_t mask = (uint32_t(1) << count) - 1;
+    result |= ((data[offset / 8] >> shift) & mask) << done;
+    offset += count;
+    done += count;
+  }
+  return result;
+}
+
+template <typename T>
+constexpr uint32_t QuantizeRfValue(const RfSlotField& field, const T& value) {
+  if constexpr (std::is_enum_v<T>) {
+    return field.Quantize(static_cast<double>(static_cast<int64_t>(value)));
+  } else {
+    return field.Quantize(static_cast<double>(value));
+  }
+}
+
+template <typename T>
+constexpr T DequantizeRfValue(const RfSlotField& field, uint32_t raw) {
+  if constexpr (std::is_same_v<T, bool>) {
+    return raw != 0;
+  } else if constexpr (std::is_enum_v<T>) {
+    return static_cast<T>(
+        static_cast<std::underlying_type_t<T>>(field.Dequantize(raw)));
+  } else {
+    return static_cast<T>(field.Dequantize(raw));
+  }
+}
+
+template <typename Message>
+constexpr void CheckRfMessage() {
+  constexpr auto& schema = Message::kSchema;
+  static_assert(schema.size() <= kRfSlotMaxSize,
+                "RF slot schema does not fit in one slot");
+  using Tuple = decltype(Message::Fields(std::declval<Message&>()));
+  static_assert(std::tuple_size_v<Tuple> == schema.fields.size(),
+                "RF slot schema and message fields differ in number");
+}
+}
+
+/// Pack a message into its slot.
+///
+/// A Message has a constexpr RfSlotSchema named kSchema, and a static
+/// Fields(self) which returns a std::tie of its members in schema
+/// order.
+template <typename Message>
+constexpr RfSlotBytes EncodeRfSlot(const Message& message) {
+  detail::CheckRfMessage<Message>();
+  constexpr auto& schema = Message::kSchema;
+
+  RfSlotBytes result;
+  result.size = schema.size();
+  std::size_t index = 0;
+  int offset = 0;
+  std::apply([&](const auto&... values) {
+      ((detail::WriteRfBits(
+            &result.data, offset, schema.fields[index].bits,
+            detail::QuantizeRfValue(schema.fields[index], values)),
+        offset += schema.fields[index].bits,
+        index++), ...);
+    }, Message::Fields(message));
+  return result;
+}
+
+/// Unpack a message from a slot.  Any bytes beyond @p size are taken
+/// to be zero.
+template <typename Message>
+constexpr Message DecodeRfSlot(const uint8_t* data, std::size_t size) {
+  detail::CheckRfMessage<Message>();
+  constexpr auto& schema = Message::kSchema;
+
+  std::array<uint8_t, kRfSlotMaxSize> padded = {};
+  for (std::size_t i = 0; i < size && i < padded.size(); i++) {
+    padded[i] = data[i];
+  }
+
+  Message result;
+  std::size_t index = 0;
+  int offset = 0;
+  std::apply([&](auto&... values) {
+      ((values = detail::DequantizeRfValue<
+            std::remove_reference_t<decltype(values)>>(
+                schema.fields[index],
+                detail::ReadRfBits(
+                    padded, offset, schema.fields[index].bits)),
+        offset += schema.fields[index].bits,
+        index++), ...);
+    }, Message::Fields(result));
+  return result;
+}
+
+template <typename Message>
+constexpr Message DecodeRfSlot(const RfSlotBytes& bytes) {
+  return DecodeRfSlot<Message>(bytes.data.data(), bytes.size);
+}
+
+template <typename Message>
+RfClient::Slot MakeRfSlot(const Message& message, uint32_t priority) {
+  const auto bytes = EncodeRfSlot(message);
+  RfClient::Slot result;
+  result.priority = priority;
+  result.size = bytes.size;
+  for (int i = 0; i < bytes.size; i++) {
+    result.data[i] = static_cast<char>(bytes.data[i]);
+  }
+  return result;
+}
+
+template <typename Message>
+Message ReadRfSlot(const RfClient::Slot& slot) {
+  return DecodeRfSlot<Message>(
+      reinterpret_cast<const uint8_t*>(&slot.data[0]), slot.size);
+}
+
+}
+}
@@ -0,0 +1,392 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "mech/ring_detector.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace mjmech {
+namespace mech {
+
+namespace {
+// Each feature maps one pixel to a value which is low on the ring.
+
+struct GrayFeature {
+  static constexpr int kChannels = 1;
+  static int Get(const uint8_t* p) { return p[0]; }
+};
+
+struct LumaFeature {
+  static constexpr int kChannels = 3;
+  static int Get(const uint8_t* p) { return (p[0] + 2 * p[1] + p[2]) >> 2; }
+};
+
+/// How much more of channel @p Index there is than either of the
+/// others, with BGR ordering.
+template <int Index>
+struct ColorFeature {
+  static constexpr int kChannels = 3;
+  static int Get(const uint8_t* p) {
+    const int a = p[(Index + 1) % 3];
+    const int b = p[(Index + 2) % 3];
+    const int excess = p[Index] - (a > b ? a : b);
+    const int scaled = excess < 0 ? 0 : (excess > 127 ? 127 : excess);
+    return 255 - 2 * scaled;
+  }
+};
+
+using RedFeature = ColorFeature<2>;
+using BlueFeature = ColorFeature<0>;
+
+template <typename Feature>
+void AccumulateRow(const uint8_t* src, int width, uint16_t* sum) {
+  for (int x = 0; x < width; x++) {
+    sum[x] += Feature::Get(src + x * Feature::kChannels);
+  }
+}
+
+template <typename Functor>
+auto DispatchFeature(const cv::Mat& image, RingDetector::Color color,
+                     Functor functor) {
+  if (image.channels() == 1) { return functor(GrayFeature()); }
+  switch (color) {
+    case RingDetector::Color::kRed: { return functor(RedFeature()); }
+    case RingDetector::Color::kBlue: { return functor(BlueFeature()); }
+    case RingDetector::Color::kDark: { break; }
+  }
+  return functor(LumaFeature());
+}
+
+bool Near(double value, double expected, double tolerance, double slack) {
+  return std::abs(value - expected) <= tolerance * expected + slack;
+}
+
+struct Run {
+  int start = 0;
+  int length = 0;
+};
+}
+
+RingDetector::RingDetector() : RingDetector(Options()) {}
+
+RingDetector::RingDetector(const Options& options) : options_(options) {}
+
+void RingDetector::Detect(const cv::Mat& image, const cv::Rect& roi_in,
+                          std::vector<Target>* targets) {
+  targets->clear();
+  const cv::Rect roi = roi_in & cv::Rect(0, 0, image.cols, image.rows);
+  const int decimation = std::max(1, std::min(16, options_.decimation));
+  if (roi.width < decimation * 3 || roi.height < decimation * 3) { return; }
+
+  Classify(image, roi);
+  Threshold();
+  FindCandidates();
+
+  for (const auto& candidate : candidates_) {
+    // Decimated pixel i covers full pixels i * decimation onward,
+    // whose centers are at integer coordinates.
+    Eigen::Vector2d center(
+        roi.x + candidate.x * decimation - 0.5,
+        roi.y + candidate.y * decimation - 0.5);
+    double size = candidate.size * decimation;
+    if (!Refine(image, roi, &center, &size)) { continue; }
+    if (size < options_.min_size) { continue; }
+
+    // Several candidates may have refined to the same target.
+    const bool duplicate = std::any_of(
+        targets->begin(), targets->end(), [&](const Target& target) {
+          return (target.center - center).norm() < 0.25 * target.size;
+        });
+    if (duplicate) { continue; }
+
+    targets->push_back({center, size});
+  }
+}
+
+void RingDetector::Classify(const cv::Mat& image, const cv::Rect& roi) {
+  const int decimation = std::max(1, std::min(16, options_.decimation));
+  width_ = roi.width / decimation;
+  height_ = roi.height / decimation;
+  const int full_width = width_ * decimation;
+
+  row_sum_.resize(full_width);
+  small_.resize(width_ * height_);
+
+  DispatchFeature(image, options_.color, [&](auto feature) {
+      using Feature = decltype(feature);
+      const int area = decimation * decimation;
+      for (int sy = 0; sy < height_; sy++) {
+        std::fill(row_sum_.begin(), row_sum_.end(), 0);
+        for (int r = 0; r < decimation; r++) {
+          const uint8_t* src = image.ptr(roi.y + sy * decimation + r) +
+              roi.x * Feature::kChannels;
+          AccumulateRow<Feature>(src, full_width, row_sum_.data());
+        }
+
+        uint8_t* dst = &small_[sy * width_];
+        const uint16_t* sum = row_sum_.data();
+        for (int sx = 0; sx < width_; sx++) {
+          int total = 0;
+          for (int i = 0; i < decimation; i++) { total += sum[i]; }
+          dst[sx] = static_cast<uint8_t>(total / area);
+          sum += decimation;
+        }
+      }
+      return 0;
+    });
+}
+
+void RingDetector::Threshold() {
+  const int stride = width_ + 1;
+  integral_.assign(stride * (height_ + 1), 0);
+  for (int y = 0; y < height_; y++) {
+    uint32_t row = 0;
+    const uint8_t* src = &small_[y * width_];
+    const uint32_t* above = &integral_[y * stride];
+    uint32_t* dst = &integral_[(y + 1) * stride];
+    for (int x = 0; x < width_; x++) {
+      row += src[x];
+      dst[x + 1] = above[x + 1] + row;
+    }
+  }
+
+  mask_.resize(width_ * height_);
+  const int half = std::max(1, options_.threshold_window / 2);
+  const int offset = options_.threshold_offset;
+  for (int y = 0; y < height_; y++) {
+    const int y0 = std::max(0, y - half);
+    const int y1 = std::min(height_, y + half + 1);
+    const uint32_t* top = &integral_[y0 * stride];
+    const uint32_t* bottom = &integral_[y1 * stride];
+    const uint8_t* src = &small_[y * width_];
+    uint8_t* dst = &mask_[y * width_];
+    for (int x = 0; x < width_; x++) {
+      const int x0 = std::max(0, x - half);
+      const int x1 = std::min(width_, x + half + 1);
+      const uint32_t sum = bottom[x1] - bottom[x0] - top[x1] + top[x0];
+      const uint32_t area = (x1 - x0) * (y1 - y0);
+      dst[x] = (src[x] + offset) * area < sum ? 1 : 0;
+    }
+  }
+}
+
+void RingDetector::FindCandidates() {
+  candidates_.clear();
+
+  const double ratio = options_.ring_ratio;
+  const double tolerance = options_.tolerance;
+
+  // Walk from @p y along the column at @p x in the direction @p step,
+  // measuring the light center and then the ring beyond it.
+  auto walk = [&](int x, int y, int step, int* light, int* dark) {
+    int pos = y + step;
+    *light = 0;
+    while (pos >= 0 && pos < height_ && !mask_[pos * width_ + x]) {
+      (*light)++;
+      pos += step;
+    }
+    *dark = 0;
+    while (pos >= 0 && pos < height_ && mask_[pos * width_ + x]) {
+      (*dark)++;
+      pos += step;
+    }
+    // The ring must have light beyond it.
+    return *dark > 0 && pos >= 0 && pos < height_;
+  };
+
+  auto check = [&](int y, const Run& left, const Run& center,
+                   const Run& right) {
+    const double ring = 0.5 * (left.length + right.length);
+    if (!Near(left.length, ring, tolerance, 1.0) ||
+        !Near(right.length, ring, tolerance, 1.0) ||
+        !Near(center.length, ratio * ring, tolerance, 1.0)) {
+      return;
+    }
+
+    const int x = center.start + (center.length - 1) / 2;
+    int up_light = 0;
+    int up_dark = 0;
+    int down_light = 0;
+    int down_dark = 0;
+    if (!walk(x, y, -1, &up_light, &up_dark) ||
+        !walk(x, y, 1, &down_light, &down_dark)) {
+      return;
+    }
+    const int vertical_center = up_light + down_light + 1;
+    if (!Near(up_dark, ring, tolerance, 1.0) ||
+        !Near(down_dark, ring, tolerance, 1.0) ||
+        !Near(vertical_center, center.length, tolerance, 1.0)) {
+      return;
+    }
+
+    Candidate candidate;
+    candidate.x = center.start + 0.5 * center.length;
+    candidate.y = (y - up_light) + 0.5 * vertical_center;
+    candidate.size = 0.5 * (
+        left.length + center.length + right.length +
+        up_dark + vertical_center + down_dark);
+    candidate.count = 1;
+
+    for (auto& existing : candidates_) {
+      const double distance = 0.25 * existing.size + 1.0;
+      if (std::abs(existing.x - candidate.x) < distance &&
+          std::abs(existing.y - candidate.y) < distance) {
+        const double n = existing.count;
+        existing.x = (existing.x * n + candidate.x) / (n + 1);
+        existing.y = (existing.y * n + candidate.y) / (n + 1);
+        existing.size = (existing.size * n + candidate.size) / (n + 1);
+        existing.count++;
+        return;
+      }
+    }
+    candidates_.push_back(candidate);
+  };
+
+  for (int y = 1; y + 1 < height_; y++) {
+    const uint8_t* row = &mask_[y * width_];
+    // The last three runs, ending with a dark one.
+    std::array<Run, 3> runs;
+    int count = 0;
+    int x = 0;
+    // Skip anything touching the left edge, as the ring must have
+    // light outside of it.
+    while (x < width_ && row[x]) { x++; }
+    while (x < width_) {
+      const uint8_t value = row[x];
+      const int start = x;
+      while (x < width_ && row[x] == value) { x++; }
+      if (x == width_ && value) { break; }
+
+      runs[0] = runs[1];
+      runs[1] = runs[2];
+      runs[2] = {start, x - start};
+      count++;
+
+      if (value && count >= 3) { check(y, runs[0], runs[1], runs[2]); }
+    }
+  }
+}
+
+bool RingDetector::Refine(const cv::Mat& image, const cv::Rect& roi,
+                          Eigen::Vector2d* center, double* size) {
+  return DispatchFeature(image, options_.color, [&](auto feature) {
+      using Feature = decltype(feature);
+
+      auto sample = [&](int x, int y) {
+        return Feature::Get(image.ptr(y) + x * Feature::kChannels);
+      };
+
+      // The distances from the start to where the ring begins and
+      // ends, in each direction.
+      std::array<double, 4> inner = {};
+      std::array<double, 4> outer = {};
+      const std::array<std::array<int, 2>, 4> directions = {{
+          {1, 0}, {-1, 0}, {0, 1}, {0, -1} }};
+
+      // Iterating once more lets the rays pass through the refined
+      // center.
+      for (int iteration = 0; iteration < 2; iteration++) {
+        const int cx = static_cast<int>(std::round(center->x()));
+        const int cy = static_cast<int>(std::round(center->y()));
+        const int length = static_cast<int>(0.75 * *size) + 3;
+
+        auto& values = rays_;
+        const int count = length;
+        int lo = 255;
+        int hi = 0;
+        for (int d = 0; d < 4; d++) {
+          values[d].resize(count);
+          for (int k = 0; k < count; k++) {
+            const int x = cx + k * directions[d][0];
+            const int y = cy + k * directions[d][1];
+            if (x < roi.x || x >= roi.x + roi.width ||
+                y < roi.y || y >= roi.y + roi.height) {
+              return false;
+            }
+            const int value = sample(x, y);
+            values[d][k] = value;
+            lo = std::min(lo, value);
+            hi = std::max(hi, value);
+          }
+        }
+        if (hi - lo < options_.threshold_offset) { return false; }
+        const double threshold = 0.5 * (lo + hi);
+
+        for (int d = 0; d < 4; d++) {
+          const auto& v = values[d];
+          if (v[0] < threshold) { return false; }
+          int k = 1;
+          while (k < count && v[k] >= threshold) { k++; }
+          if (k == count) { return false; }
+          inner[d] = (k - 1) + (v[k - 1] - threshold) / (v[k - 1] - v[k]);
+          while (k < count && v[k] < threshold) { k++; }
+          if (k == count) { return false; }
+          outer[d] = (k - 1) + (threshold - v[k - 1]) / (v[k] - v[k - 1]);
+        }
+
+        const Eigen::Vector2d shift(
+            0.25 * (inner[0] - inner[1] + outer[0] - outer[1]),
+            0.25 * (inner[2] - inner[3] + outer[2] - outer[3]));
+        *center = Eigen::Vector2d(cx, cy) + shift;
+        *size = 0.5 * (outer[0] + outer[1] + outer[2] + outer[3]);
+      }
+
+      // The ring must have the expected proportions, and be roughly
+      // as wide as it is tall.
+      const double horizontal = outer[0] + outer[1];
+      const double vertical = outer[2] + outer[3];
+      if (!Near(horizontal, *size, options_.tolerance, 0.0) ||
+          !Near(vertical, *size, options_.tolerance, 0.0)) {
+        return false;
+      }
+      const double ring = 0.25 * (
+          outer[0] - inner[0] + outer[1] - inner[1] +
+          outer[2] - inner[2] + outer[3] - inner[3]);
+      const double light = 0.5 * (inner[0] + inner[1] + inner[2] + inner[3]);
+      return Near(light, options_.ring_ratio * ring, options_.tolerance, 1.0);
+    });
+}
+
+cv::Mat RingDetector::MakeTarget(int size, double ring_ratio) {
+  const int border = size / 8 + 2;
+  const int total = size + 2 * border;
+  const double outer_radius = 0.5 * size;
+  const double inner_radius = outer_radius - size / (2.0 + ring_ratio);
+  const double middle = 0.5 * total;
+
+  constexpr int kSamples = 4;
+  cv::Mat result(total, total, CV_8UC1);
+  for (int y = 0; y < total; y++) {
+    uint8_t* row = result.ptr(y);
+    for (int x = 0; x < total; x++) {
+      int dark = 0;
+      for (int j = 0; j < kSamples; j++) {
+        for (int i = 0; i < kSamples; i++) {
+          const double px = x + (i + 0.5) / kSamples - middle;
+          const double py = y + (j + 0.5) / kSamples - middle;
+          const double radius = std::hypot(px, py);
+          if (radius >= inner_radius && radius < outer_radius) { dark++; }
+        }
+      }
+      row[x] = static_cast<uint8_t>(
+          255 - (255 * dark) / (kSamples * kSamples));
+    }
+  }
+  return result;
+}
+
+}
+}
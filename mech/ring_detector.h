@@ -0,0 +1,153 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include <opencv2/core/core.hpp>
+
+#include "mjlib/base/visitor.h"
+
+namespace mjmech {
+namespace mech {
+
+/// Finds concentric ring targets: a dark ring around a light center,
+/// on a light background.
+///
+/// The image is classified and decimated in one pass, and candidates
+/// are found by looking for dark-light-dark runs of the right
+/// proportions along each row, which are then confirmed along the
+/// column.  Each candidate is refined by finding the ring's edges at
+/// full resolution, to sub-pixel accuracy.  All of this is done with
+/// simple loops over rows which the compiler can vectorize.
+class RingDetector {
+ public:
+  enum class Color {
+    /// The ring is darker than its surroundings.
+    kDark,
+    /// The ring is red, or blue, and its surroundings are not.
+    kRed,
+    kBlue,
+  };
+
+  struct Options {
+    Color color = Color::kDark;
+    /// Candidates are searched for in an image this many times
+    /// smaller in each dimension.
+    int decimation = 2;
+    /// A decimated pixel is part of the ring if it is this much
+    /// darker than the mean of the surrounding window...
+    int threshold_offset = 16;
+    /// ... which is this many decimated pixels square.
+    int threshold_window = 31;
+    /// The diameter of the light center divided by the width of the
+    /// ring.
+    double ring_ratio = 2.0;
+    /// How far the measured proportions may differ from ring_ratio,
+    /// as a fraction.
+    double tolerance = 0.5;
+    /// Targets smaller than this, in pixels across, are ignored.
+    double min_size = 8.0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(color));
+      a->Visit(MJ_NVP(decimation));
+      a->Visit(MJ_NVP(threshold_offset));
+      a->Visit(MJ_NVP(threshold_window));
+      a->Visit(MJ_NVP(ring_ratio));
+      a->Visit(MJ_NVP(tolerance));
+      a->Visit(MJ_NVP(min_size));
+    }
+  };
+
+  RingDetector();
+  explicit RingDetector(const Options&);
+
+  struct Target {
+    /// In pixels, relative to the whole image.
+    Eigen::Vector2d center;
+    /// The outside diameter of the ring in pixels.
+    double size = 0.0;
+  };
+
+  /// Find targets within @p roi of @p image, which is either
+  /// grayscale or BGR.
+  void Detect(const cv::Mat& image, const cv::Rect& roi,
+              std::vector<Target>* targets);
+
+  /// Render a grayscale target whose ring is @p size pixels across,
+  /// with a white border, suitable for printing.
+  static cv::Mat MakeTarget(int size, double ring_ratio = 2.0);
+
+ private:
+  void Classify(const cv::Mat& image, const cv::Rect& roi);
+  void Threshold();
+  void FindCandidates();
+  bool Refine(const cv::Mat& image, const cv::Rect& roi,
+              Eigen::Vector2d* center, double* size);
+
+  struct Candidate {
+    // In decimated pixels.
+    double x = 0.0;
+    double y = 0.0;
+    double size = 0.0;
+    int count = 0;
+  };
+
+  const Options options_;
+
+  // Scratch space, kept only to reuse its allocation.
+  int width_ = 0;
+  int height_ = 0;
+  std::vector<uint16_t> row_sum_;
+  /// The decimated image, where the ring is dark.
+  std::vector<uint8_t> small_;
+  std::vector<uint32_t> integral_;
+  /// 1 where the decimated image is part of a ring.
+  std::vector<uint8_t> mask_;
+  std::vector<Candidate> candidates_;
+  /// The full resolution values along each ray from a candidate.
+  std::array<std::vector<int>, 4> rays_;
+};
+
+}
+}
+
+namespace mjlib {
+namespace base {
+
+template <>
+struct IsEnum<mjmech::mech::RingDetector::Color> {
+  static constexpr bool value = true;
+
+  using C = mjmech::mech::RingDetector::Color;
+  static inline std::map<C, const char*> map() {
+    return {
+      { C::kDark, "dark" },
+      { C::kRed, "red" },
+      { C::kBlue, "blue" },
+    };
+  }
+};
+
+}
+}
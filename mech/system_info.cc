@@ -14,17 +14,27 @@
 
 #include "mech/system_info.h"
 
-#include <fstream>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
 #include <functional>
+#include <map>
+#include <optional>
+#include <string_view>
+#include <vector>
 
 #include <boost/asio/any_io_executor.hpp>
 #include <boost/asio/post.hpp>
-#include <boost/signals2/signal.hpp>
 
 #include "mjlib/base/time_conversions.h"
 #include "mjlib/io/now.h"
 #include "mjlib/io/repeating_timer.h"
 
+#include "base/fast_signal.h"
+#include "base/system_fd.h"
 #include "base/telemetry_registry.h"
 
 namespace pl = std::placeholders;
@@ -33,31 +43,172 @@ namespace mjmech {
 namespace mech {
 
 namespace {
+struct ThreadData {
+  int tid = 0;
+  std::string name;
+
+  // The CPU this thread last ran on.
+  int cpu = -1;
+
+  // Percent of one CPU used since the previous sample.
+  double cpu_percent = 0.0;
+
+  // The remainder are totals since the thread started.
+  double user_s = 0.0;
+  double system_s = 0.0;
+  double run_s = 0.0;
+  // Time spent runnable, but waiting for a CPU.
+  double wait_s = 0.0;
+  uint64_t voluntary_switches = 0;
+  uint64_t involuntary_switches = 0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(tid));
+    a->Visit(MJ_NVP(name));
+    a->Visit(MJ_NVP(cpu));
+    a->Visit(MJ_NVP(cpu_percent));
+    a->Visit(MJ_NVP(user_s));
+    a->Visit(MJ_NVP(system_s));
+    a->Visit(MJ_NVP(run_s));
+    a->Visit(MJ_NVP(wait_s));
+    a->Visit(MJ_NVP(voluntary_switches));
+    a->Visit(MJ_NVP(involuntary_switches));
+  }
+};
+
 struct Data {
   boost::posix_time::ptime timestamp;
+
+  // Items which are not available on this host are left at these
+  // defaults.
   double temp_C = 0.0;
+  // The raspberry pi firmware's throttling bitmask, or -1.
+  int64_t throttled = -1;
+  std::vector<double> cpu_freq_MHz;
+  double load_1m = 0.0;
+  double load_5m = 0.0;
+  double load_15m = 0.0;
+
+  double cpu_percent = 0.0;
+  int64_t rss_kb = 0;
+  uint64_t minor_faults = 0;
+  uint64_t major_faults = 0;
+
+  std::vector<ThreadData> threads;
 
   template <typename Archive>
   void Serialize(Archive* a) {
     a->Visit(MJ_NVP(timestamp));
     a->Visit(MJ_NVP(temp_C));
+    a->Visit(MJ_NVP(throttled));
+    a->Visit(MJ_NVP(cpu_freq_MHz));
+    a->Visit(MJ_NVP(load_1m));
+    a->Visit(MJ_NVP(load_5m));
+    a->Visit(MJ_NVP(load_15m));
+    a->Visit(MJ_NVP(cpu_percent));
+    a->Visit(MJ_NVP(rss_kb));
+    a->Visit(MJ_NVP(minor_faults));
+    a->Visit(MJ_NVP(major_faults));
+    a->Visit(MJ_NVP(threads));
+  }
+};
+
+/// A file in /proc or /sys which is opened once and then re-read
+/// from the beginning each time it is sampled.
+class ProcFile {
+ public:
+  ProcFile() {}
+  explicit ProcFile(const std::string& path)
+      : fd_(::open(path.c_str(), O_RDONLY | O_CLOEXEC)) {}
+
+  bool valid() { return fd_ >= 0; }
+
+  /// @return the current contents, which will be truncated if larger
+  /// than @p buffer, or an empty string on error.
+  std::string_view Read(char* buffer, std::size_t size) {
+    if (!valid()) { return {}; }
+    const auto result = ::pread(fd_, buffer, size, 0);
+    if (result <= 0) { return {}; }
+    return std::string_view(buffer, result);
   }
+
+ private:
+  base::SystemFd fd_;
 };
 
-#ifdef COM_GITHUB_MJBOTS_RASPBERRYPI
-void PopulateData(Data* data) {
-  {
-    std::ifstream inf("/sys/class/thermal/thermal_zone0/temp");
-    int temp_milliC = 0;
-    inf >> temp_milliC;
-    data->temp_C = temp_milliC * 0.001;
+/// Split @p line on whitespace into at most @p max items.
+std::vector<std::string_view> SplitFields(std::string_view line,
+                                          std::size_t max) {
+  std::vector<std::string_view> result;
+  std::size_t pos = 0;
+  while (result.size() < max) {
+    pos = line.find_first_not_of(" \t\n", pos);
+    if (pos == std::string_view::npos) { break; }
+    const auto end = line.find_first_of(" \t\n", pos);
+    result.push_back(line.substr(
+        pos, end == std::string_view::npos ? end : end - pos));
+    pos = end;
   }
+  return result;
+}
+
+double ParseDouble(std::string_view value) {
+  return std::strtod(std::string(value).c_str(), nullptr);
 }
-#else
-void PopulateData(Data* data) {
-  // Nothing for now.
+
+int64_t ParseInt(std::string_view value, int base = 10) {
+  return std::strtoll(std::string(value).c_str(), nullptr, base);
+}
+
+/// @return the value of a "key:  value" line in a status file.
+int64_t FindStatusValue(std::string_view status, std::string_view key) {
+  const std::string search = "\n" + std::string(key) + ":";
+  const auto pos = status.find(search);
+  if (pos == std::string_view::npos) { return 0; }
+  const auto fields = SplitFields(status.substr(pos + search.size()), 1);
+  if (fields.empty()) { return 0; }
+  return ParseInt(fields[0]);
+}
+
+/// The contents of a /proc/.../stat file.
+struct Stat {
+  std::string_view name;
+  int cpu = -1;
+  uint64_t utime = 0;
+  uint64_t stime = 0;
+  uint64_t minflt = 0;
+  uint64_t majflt = 0;
+  int64_t rss = 0;
+};
+
+Stat ParseStat(std::string_view stat) {
+  Stat result;
+
+  // The name is in parentheses, and may itself contain spaces or
+  // parentheses.
+  const auto open = stat.find('(');
+  const auto close = stat.rfind(')');
+  if (open == std::string_view::npos || close == std::string_view::npos) {
+    return result;
+  }
+  result.name = stat.substr(open + 1, close - open - 1);
+
+  // Fields are numbered from 1 as in proc(5), and the name is field
+  // 2, so fields[0] is field 3.
+  const auto fields = SplitFields(stat.substr(close + 1), 40);
+  auto field = [&](std::size_t number) -> std::string_view {
+    const auto index = number - 3;
+    return index < fields.size() ? fields[index] : std::string_view("0");
+  };
+  result.minflt = ParseInt(field(10));
+  result.majflt = ParseInt(field(12));
+  result.utime = ParseInt(field(14));
+  result.stime = ParseInt(field(15));
+  result.rss = ParseInt(field(24));
+  result.cpu = ParseInt(field(39));
+  return result;
 }
-#endif
 }
 
 class SystemInfo::Impl {
@@ -65,6 +216,14 @@ class SystemInfo::Impl {
   Impl(base::Context& context)
       : executor_(context.executor) {
     context.telemetry_registry->Register("system_info", &data_signal_);
+
+    for (int cpu = 0; ; cpu++) {
+      ProcFile file(
+          "/sys/devices/system/cpu/cpu" + std::to_string(cpu) +
+          "/cpufreq/scaling_cur_freq");
+      if (!file.valid()) { break; }
+      cpu_freq_.push_back(std::move(file));
+    }
   }
 
   void AsyncStart(mjlib::io::ErrorCallback callback) {
@@ -82,7 +241,15 @@ class SystemInfo::Impl {
     Data data;
     data.timestamp = mjlib::io::Now(executor_.context());
 
-    PopulateData(&data);
+    const auto now = std::chrono::steady_clock::now();
+    const double elapsed_s =
+        last_sample_ ?
+        std::chrono::duration<double>(now - *last_sample_).count() : 0.0;
+    last_sample_ = now;
+
+    PopulateSystem(&data);
+    PopulateProcess(&data, elapsed_s);
+    PopulateThreads(&data, elapsed_s);
 
     data_signal_(&data);
   }
@@ -94,11 +261,145 @@ class SystemInfo::Impl {
     return result;
   }
 
+ private:
+  struct ThreadFiles {
+    ProcFile stat;
+    ProcFile schedstat;
+    ProcFile status;
+    uint64_t last_ticks = 0;
+    bool seen = false;
+  };
+
+  std::string_view Read(ProcFile* file) {
+    return file->Read(buffer_, sizeof(buffer_));
+  }
+
+  double CpuPercent(uint64_t ticks, uint64_t last_ticks,
+                    double elapsed_s) const {
+    if (elapsed_s <= 0.0 || last_ticks == 0) { return 0.0; }
+    return 100.0 * (ticks - last_ticks) / ticks_per_s_ / elapsed_s;
+  }
+
+  void PopulateSystem(Data* data) {
+    if (const auto temp = Read(&temp_); !temp.empty()) {
+      data->temp_C = ParseInt(temp) * 0.001;
+    }
+    if (const auto throttled = Read(&throttled_); !throttled.empty()) {
+      // The firmware prints this as hex, without a 0x prefix.
+      data->throttled = ParseInt(throttled, 16);
+    }
+    for (auto& file : cpu_freq_) {
+      data->cpu_freq_MHz.push_back(ParseInt(Read(&file)) * 0.001);
+    }
+    const auto load = SplitFields(Read(&loadavg_), 3);
+    if (load.size() == 3) {
+      data->load_1m = ParseDouble(load[0]);
+      data->load_5m = ParseDouble(load[1]);
+      data->load_15m = ParseDouble(load[2]);
+    }
+  }
+
+  void PopulateProcess(Data* data, double elapsed_s) {
+    const auto stat = ParseStat(Read(&self_stat_));
+    const uint64_t ticks = stat.utime + stat.stime;
+    data->cpu_percent = CpuPercent(ticks, last_process_ticks_, elapsed_s);
+    last_process_ticks_ = ticks;
+    data->rss_kb = stat.rss * page_size_ / 1024;
+    data->minor_faults = stat.minflt;
+    data->major_faults = stat.majflt;
+  }
+
+  void PopulateThreads(Data* data, double elapsed_s) {
+    UpdateThreads();
+
+    for (auto& pair : threads_) {
+      const int tid = pair.first;
+      auto& files = pair.second;
+
+      ThreadData thread;
+      thread.tid = tid;
+
+      const auto stat = ParseStat(Read(&files.stat));
+      thread.name = std::string(stat.name);
+      thread.cpu = stat.cpu;
+      thread.user_s = static_cast<double>(stat.utime) / ticks_per_s_;
+      thread.system_s = static_cast<double>(stat.stime) / ticks_per_s_;
+      const uint64_t ticks = stat.utime + stat.stime;
+      thread.cpu_percent = CpuPercent(ticks, files.last_ticks, elapsed_s);
+      files.last_ticks = ticks;
+
+      // The schedstat file is only present if the kernel has
+      // CONFIG_SCHEDSTATS.
+      const auto schedstat = SplitFields(Read(&files.schedstat), 2);
+      if (schedstat.size() == 2) {
+        thread.run_s = ParseInt(schedstat[0]) * 1e-9;
+        thread.wait_s = ParseInt(schedstat[1]) * 1e-9;
+      }
+
+      const auto status = Read(&files.status);
+      thread.voluntary_switches =
+          FindStatusValue(status, "voluntary_ctxt_switches");
+      thread.involuntary_switches =
+          FindStatusValue(status, "nonvoluntary_ctxt_switches");
+
+      data->threads.push_back(std::move(thread));
+    }
+  }
+
+  void UpdateThreads() {
+    // Threads come and go rarely, but listing the directory is cheap
+    // compared to opening files, so that is all that is done each
+    // sample.
+    for (auto& pair : threads_) { pair.second.seen = false; }
+
+    DIR* dir = ::opendir("/proc/self/task");
+    if (dir == nullptr) { return; }
+    while (auto* entry = ::readdir(dir)) {
+      if (entry->d_name[0] == '.') { continue; }
+      const int tid = std::atoi(entry->d_name);
+      auto it = threads_.find(tid);
+      if (it == threads_.end()) {
+        const std::string prefix =
+            std::string("/proc/self/task/") + entry->d_name;
+        ThreadFiles files;
+        files.stat = ProcFile(prefix + "/stat");
+        files.schedstat = ProcFile(prefix + "/schedstat");
+        files.status = ProcFile(prefix + "/status");
+        it = threads_.emplace(tid, std::move(files)).first;
+      }
+      it->second.seen = true;
+    }
+    ::closedir(dir);
+
+    for (auto it = threads_.begin(); it != threads_.end();) {
+      if (!it->second.seen) {
+        it = threads_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
   boost::asio::any_io_executor executor_;
   mjlib::io::RepeatingTimer timer_{executor_};
 
   double period_s_ = 1.0;
-  boost::signals2::signal<void (const Data*)> data_signal_;
+  base::FastSignal<void (const Data*)> data_signal_;
+
+  const double ticks_per_s_ = ::sysconf(_SC_CLK_TCK);
+  const int64_t page_size_ = ::sysconf(_SC_PAGESIZE);
+
+  ProcFile temp_{"/sys/class/thermal/thermal_zone0/temp"};
+  ProcFile throttled_{"/sys/devices/platform/soc/soc:firmware/get_throttled"};
+  ProcFile loadavg_{"/proc/loadavg"};
+  ProcFile self_stat_{"/proc/self/stat"};
+  std::vector<ProcFile> cpu_freq_;
+  std::map<int, ThreadFiles> threads_;
+
+  std::optional<std::chrono::steady_clock::time_point> last_sample_;
+  uint64_t last_process_ticks_ = 0;
+
+  char buffer_[4096] = {};
 };
 
 SystemInfo::SystemInfo(base::Context& context)
@@ -24,6 +24,13 @@ namespace mjmech {
 namespace mech {
 
 /// Record information about the system on a periodic basis.
+///
+/// This includes temperature, CPU frequency and load for the host,
+/// memory and fault counts for the process, and CPU time and context
+/// switches for each of its threads.  Threads are identified by the
+/// names they give themselves, and the main thread has the name of
+/// the program.  Anything which is not available on the current host
+/// is left at its default.
 class SystemInfo : boost::noncopyable {
  public:
   SystemInfo(base::Context&);
@@ -14,48 +14,379 @@
 
 #include "target_tracker.h"
 
+#include <chrono>
+#include <cmath>
+#include <optional>
+
 #include <opencv2/aruco.hpp>
 #include <opencv2/core.hpp>
 #include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
 
 namespace mjmech {
 namespace mech {
 
 class TargetTracker::Impl {
  public:
-  Impl(const Options& options) {
+  Impl(const Options& options) : options_(options) {
     cv::setNumThreads(1);
   }
 
   Result Track(const cv::Mat& image) {
-    std::vector<int> marker_ids;
-    std::vector<std::vector<cv::Point2f>> marker_corners;
-
-    cv::aruco::detectMarkers(
-        image, aruco_dictionary_,
-        marker_corners, marker_ids,
-        aruco_parameters_);
+    const cv::Rect full(0, 0, image.cols, image.rows);
+    const bool use_roi = options_.roi_enable && tracking_;
+    const cv::Rect roi = use_roi ? PredictRoi(full) : full;
 
-    auto scale = [&](Eigen::Vector2d v) {
-      return Eigen::Vector2d(v.x() / image.cols, v.y() / image.rows);
-    };
+    const auto start = std::chrono::steady_clock::now();
     Result result;
-    for (const auto& corners : marker_corners) {
-      Eigen::Vector2d total;
-      for (const auto& corner : corners) {
-        total += Eigen::Vector2d(corner.x, corner.y);
+    Detect(image, roi, &result);
+    const auto end = std::chrono::steady_clock::now();
+
+    result.mode = use_roi ? Mode::kRoi : Mode::kFull;
+    result.roi = {roi.x, roi.y, roi.width, roi.height};
+    result.detect_s = std::chrono::duration<double>(end - start).count();
+
+    const Eigen::Vector2d image_size(image.cols, image.rows);
+    const Eigen::Vector2d reference =
+        tracking_ ? Predict() : Eigen::Vector2d(0.5 * image_size);
+
+    std::optional<Marker> best;
+    double best_distance = 0.0;
+    for (const auto& marker : markers_) {
+      result.targets.push_back(marker.center.cwiseQuotient(image_size));
+      result.sizes.push_back(marker.size / image.cols);
+
+      const double distance = (marker.center - reference).norm();
+      if (!best || distance < best_distance) {
+        best = marker;
+        best_distance = distance;
       }
-      result.targets.push_back(scale(total * (1.0 / corners.size())));
     }
+
+    Update(best);
+    result.misses = misses_;
+
     return result;
   }
 
+ private:
+  struct Marker {
+    Eigen::Vector2d center;
+    double size = 0.0;
+  };
+
+  using Corners = std::vector<cv::Point2f>;
+
+  /// Fill markers_ with everything found in @p roi, in full image
+  /// pixels.
+  void Detect(const cv::Mat& image, const cv::Rect& roi, Result* result) {
+    markers_.clear();
+
+    if (options_.engine == Engine::kRing) {
+      ring_detector_.Detect(image, roi, &ring_targets_);
+      for (const auto& target : ring_targets_) {
+        markers_.push_back({target.center, target.size});
+      }
+      return;
+    }
+
+    DetectPyramid(image, roi, result);
+
+    const Eigen::Vector2d offset(roi.x, roi.y);
+    for (const auto& corners : found_) {
+      Marker marker;
+      marker.center = Eigen::Vector2d::Zero();
+      for (const auto& corner : corners) {
+        marker.center += Eigen::Vector2d(corner.x, corner.y);
+      }
+      marker.center = marker.center * (1.0 / corners.size()) + offset;
+      marker.size = std::max(cv::norm(corners[2] - corners[0]),
+                             cv::norm(corners[3] - corners[1]));
+      markers_.push_back(marker);
+    }
+  }
+
+  /// Fill found_ with the corners of each ArUco marker, relative to
+  /// @p roi.
+  void DetectPyramid(const cv::Mat& image, const cv::Rect& roi,
+                     Result* result) {
+    found_.clear();
+
+    pyramid_.resize(std::max(0, options_.pyramid_levels) + 1);
+    pyramid_[0] = image(roi);
+    int levels = 0;
+    while (levels < options_.pyramid_levels) {
+      // Halving anything narrower would leave an empty image.
+      const auto& finer = pyramid_[levels];
+      if (finer.cols < 2 || finer.rows < 2) { break; }
+
+      levels++;
+      cv::resize(finer, pyramid_[levels], cv::Size(), 0.5, 0.5,
+                 cv::INTER_AREA);
+    }
+
+    auto whole = [&](int level) {
+      return cv::Rect(0, 0, pyramid_[level].cols, pyramid_[level].rows);
+    };
+
+    regions_.assign(1, whole(levels));
+    for (int level = levels; level >= 0 && !regions_.empty(); level--) {
+      const auto start = std::chrono::steady_clock::now();
+      const double scale = std::ldexp(1.0, level);
+
+      Level stats;
+      stats.level = level;
+      stats.regions = regions_.size();
+      next_regions_.clear();
+
+      for (const auto& region : regions_) {
+        stats.area += region.area();
+        cv::aruco::detectMarkers(
+            pyramid_[level](region), aruco_dictionary_,
+            marker_corners_, marker_ids_,
+            aruco_parameters_, rejected_corners_);
+
+        for (auto& corners : marker_corners_) {
+          for (auto& corner : corners) {
+            corner = ToFull(corner, region, scale);
+          }
+          if (level > 0) { RefineCorners(pyramid_[0], scale, &corners); }
+          AddFound(corners);
+          stats.markers++;
+        }
+
+        stats.candidates += rejected_corners_.size();
+        if (level == 0) { continue; }
+        for (const auto& corners : rejected_corners_) {
+          next_regions_.push_back(
+              FinerRegion(corners, region, whole(level - 1)));
+        }
+      }
+
+      if (level > 0) {
+        const bool escalate_all =
+            static_cast<int>(next_regions_.size()) >
+            options_.pyramid_max_regions ||
+            (stats.markers == 0 && next_regions_.empty() &&
+             options_.pyramid_escalate_empty);
+        if (escalate_all) {
+          next_regions_.assign(1, whole(level - 1));
+        } else {
+          MergeRegions(&next_regions_);
+        }
+      }
+      std::swap(regions_, next_regions_);
+
+      stats.area /= whole(level).area();
+      stats.detect_s = std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start).count();
+      result->levels.push_back(stats);
+    }
+  }
+
+  /// Map @p point from @p region of a pyramid level which is @p scale
+  /// times smaller than full resolution.
+  static cv::Point2f ToFull(const cv::Point2f& point,
+                            const cv::Rect& region, double scale) {
+    return cv::Point2f(
+        static_cast<float>((point.x + region.x + 0.5) * scale - 0.5),
+        static_cast<float>((point.y + region.y + 0.5) * scale - 0.5));
+  }
+
+  /// @return the area around @p corners, found in @p region, on the
+  /// next finer level.
+  static cv::Rect FinerRegion(const Corners& corners, const cv::Rect& region,
+                              const cv::Rect& finer) {
+    float x0 = corners[0].x;
+    float x1 = x0;
+    float y0 = corners[0].y;
+    float y1 = y0;
+    for (const auto& corner : corners) {
+      x0 = std::min(x0, corner.x);
+      x1 = std::max(x1, corner.x);
+      y0 = std::min(y0, corner.y);
+      y1 = std::max(y1, corner.y);
+    }
+    // Leave the quiet zone around the marker, and some more.
+    const float margin = std::max(4.0f, 0.5f * std::max(x1 - x0, y1 - y0));
+    const int left = static_cast<int>(2 * (region.x + x0 - margin));
+    const int top = static_cast<int>(2 * (region.y + y0 - margin));
+    const int right = static_cast<int>(std::ceil(2 * (region.x + x1 + margin)));
+    const int bottom =
+        static_cast<int>(std::ceil(2 * (region.y + y1 + margin)));
+    return cv::Rect(left, top, right - left, bottom - top) & finer;
+  }
+
+  static void MergeRegions(std::vector<cv::Rect>* regions) {
+    for (std::size_t i = 0; i < regions->size(); i++) {
+      for (std::size_t j = i + 1; j < regions->size();) {
+        auto& a = (*regions)[i];
+        const auto& b = (*regions)[j];
+        if ((a & b).area() > 0) {
+          a = a | b;
+          regions->erase(regions->begin() + j);
+          // The larger region may now overlap earlier ones.
+          j = i + 1;
+        } else {
+          j++;
+        }
+      }
+    }
+    regions->erase(
+        std::remove_if(regions->begin(), regions->end(),
+                       [](const cv::Rect& r) { return r.area() <= 0; }),
+        regions->end());
+  }
+
+  /// Corners found at a coarse level are only as accurate as its
+  /// pixels, so find them again in the full resolution image.
+  void RefineCorners(const cv::Mat& full, double scale, Corners* corners) {
+    const double side = std::max(cv::norm((*corners)[1] - (*corners)[0]),
+                                 cv::norm((*corners)[2] - (*corners)[1]));
+    // The window must not reach the corners of the marker's bits,
+    // which are a sixth of its side away.
+    const int window = std::max(
+        2, std::min(static_cast<int>(2 * scale),
+                    static_cast<int>(side / 12)));
+
+    float x0 = (*corners)[0].x;
+    float x1 = x0;
+    float y0 = (*corners)[0].y;
+    float y1 = y0;
+    for (const auto& corner : *corners) {
+      x0 = std::min(x0, corner.x);
+      x1 = std::max(x1, corner.x);
+      y0 = std::min(y0, corner.y);
+      y1 = std::max(y1, corner.y);
+    }
+    const int margin = window + 2;
+    const cv::Rect patch = cv::Rect(
+        static_cast<int>(x0) - margin, static_cast<int>(y0) - margin,
+        static_cast<int>(x1 - x0) + 2 * margin + 1,
+        static_cast<int>(y1 - y0) + 2 * margin + 1) &
+        cv::Rect(0, 0, full.cols, full.rows);
+    if (patch.area() <= 0) { return; }
+
+    if (full.channels() == 1) {
+      refine_gray_ = full(patch);
+    } else {
+      cv::cvtColor(full(patch), refine_gray_, cv::COLOR_BGR2GRAY);
+    }
+
+    const cv::Point2f offset(patch.x, patch.y);
+    for (auto& corner : *corners) { corner = corner - offset; }
+    cv::cornerSubPix(
+        refine_gray_, *corners, cv::Size(window, window), cv::Size(-1, -1),
+        cv::TermCriteria(cv::TermCriteria::COUNT | cv::TermCriteria::EPS,
+                         10, 0.01));
+    for (auto& corner : *corners) { corner = corner + offset; }
+  }
+
+  /// A marker may be found again at a finer level, which is more
+  /// accurate.
+  void AddFound(const Corners& corners) {
+    const auto center = [](const Corners& c) {
+      return 0.25f * (c[0] + c[1] + c[2] + c[3]);
+    };
+    const auto this_center = center(corners);
+    const double size = cv::norm(corners[2] - corners[0]);
+    for (auto& existing : found_) {
+      if (cv::norm(center(existing) - this_center) < 0.25 * size) {
+        existing = corners;
+        return;
+      }
+    }
+    found_.push_back(corners);
+  }
+
+  Eigen::Vector2d Predict() const {
+    return center_ + velocity_ * (misses_ + 1);
+  }
+
+  cv::Rect PredictRoi(const cv::Rect& full) const {
+    const Eigen::Vector2d predicted = Predict();
+    const double motion = velocity_.norm() * (misses_ + 1);
+    const int size = static_cast<int>(
+        std::max<double>(options_.roi_min_size,
+                         options_.roi_scale * size_ + 2.0 * motion));
+
+    cv::Rect roi = cv::Rect(
+        static_cast<int>(predicted.x()) - size / 2,
+        static_cast<int>(predicted.y()) - size / 2,
+        size, size) & full;
+    // If the prediction has left the image, look everywhere.
+    if (roi.area() == 0) { return full; }
+
+    // Near an edge, the region can be clipped to a sliver.  Widen it
+    // back into the image so that every pyramid level has a pixel.
+    const int min_side = 1 << std::max(0, options_.pyramid_levels);
+    auto widen = [&](int* start, int* length, int full_start,
+                     int full_length) {
+      if (*length >= min_side) { return; }
+      *length = std::min(min_side, full_length);
+      *start = std::max(
+          full_start, std::min(*start, full_start + full_length - *length));
+    };
+    widen(&roi.x, &roi.width, full.x, full.width);
+    widen(&roi.y, &roi.height, full.y, full.height);
+    return roi;
+  }
+
+  void Update(const std::optional<Marker>& marker) {
+    if (!marker) {
+      misses_++;
+      if (misses_ >= options_.max_misses) { tracking_ = false; }
+      return;
+    }
+
+    if (tracking_) {
+      const Eigen::Vector2d measured =
+          (marker->center - center_) / (misses_ + 1);
+      velocity_ = options_.velocity_alpha * measured +
+          (1.0 - options_.velocity_alpha) * velocity_;
+    } else {
+      velocity_ = Eigen::Vector2d::Zero();
+    }
+
+    center_ = marker->center;
+    size_ = marker->size;
+    tracking_ = true;
+    misses_ = 0;
+  }
+
+  const Options options_;
+
   cv::Ptr<cv::aruco::Dictionary> aruco_dictionary_ =
       cv::aruco::getPredefinedDictionary(cv::aruco::DICT_4X4_50);
   cv::Ptr<cv::aruco::DetectorParameters> aruco_parameters_ =
       cv::aruco::DetectorParameters::create();
+
+  RingDetector ring_detector_{options_.ring};
+
+  // Kept only to reuse their allocations.
+  std::vector<int> marker_ids_;
+  std::vector<Corners> marker_corners_;
+  std::vector<Corners> rejected_corners_;
+  std::vector<RingDetector::Target> ring_targets_;
+  std::vector<Marker> markers_;
+
+  std::vector<Corners> found_;
+  std::vector<cv::Mat> pyramid_;
+  std::vector<cv::Rect> regions_;
+  std::vector<cv::Rect> next_regions_;
+  cv::Mat refine_gray_;
+
+  // The last marker found, in pixels, and its velocity in pixels per
+  // frame.
+  bool tracking_ = false;
+  Eigen::Vector2d center_ = Eigen::Vector2d::Zero();
+  Eigen::Vector2d velocity_ = Eigen::Vector2d::Zero();
+  double size_ = 0.0;
+  int misses_ = 0;
 };
 
+TargetTracker::TargetTracker() : TargetTracker(Options()) {}
+
 TargetTracker::TargetTracker(const Options& options)
     : impl_(new Impl(options)) {}
 
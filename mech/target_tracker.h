@@ -14,28 +14,142 @@
 
 #pragma once
 
+#include <map>
+#include <memory>
+#include <vector>
+
 #include <Eigen/Core>
 
 #include <opencv2/core/core.hpp>
 
 #include "mjlib/base/visitor.h"
 
+#include "mech/ring_detector.h"
+
 namespace mjmech {
 namespace mech  {
 
+/// Finds targets in camera images, either ArUco markers or the
+/// concentric rings of RingDetector.
+///
+/// Once a marker is found, subsequent frames are only searched in a
+/// region of interest around where it is predicted to be, which is
+/// much cheaper than searching the whole frame.  After enough frames
+/// without a detection, the whole frame is searched again.
 class TargetTracker {
  public:
+  enum class Engine {
+    kAruco,
+    kRing,
+  };
+
   struct Options {
+    Engine engine = Engine::kAruco;
+    RingDetector::Options ring;
+
+    bool roi_enable = true;
+    /// The region of interest is this many times the size of the
+    /// last marker...
+    double roi_scale = 3.0;
+    /// ... plus the distance it is predicted to move, but no smaller
+    /// than this many pixels square.
+    int roi_min_size = 160;
+    /// After this many consecutive frames without a detection, the
+    /// whole frame is searched.
+    int max_misses = 3;
+    /// The weight given to each new measurement of the marker's
+    /// velocity.
+    double velocity_alpha = 0.5;
+
+    /// For ArUco, first search an image this many times halved in
+    /// size, and only search finer levels around candidates which
+    /// could not be decoded.  Markers found at a coarse level have
+    /// their corners refined at full resolution.  0 searches only at
+    /// full resolution.
+    int pyramid_levels = 0;
+    /// If a level finds nothing at all, search all of the next finer
+    /// one.
+    bool pyramid_escalate_empty = true;
+    /// If a level has more candidates than this, search all of the
+    /// next finer one rather than around each.
+    int pyramid_max_regions = 8;
+
     template <typename Archive>
     void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(engine));
+      a->Visit(MJ_NVP(ring));
+      a->Visit(MJ_NVP(roi_enable));
+      a->Visit(MJ_NVP(roi_scale));
+      a->Visit(MJ_NVP(roi_min_size));
+      a->Visit(MJ_NVP(max_misses));
+      a->Visit(MJ_NVP(velocity_alpha));
+      a->Visit(MJ_NVP(pyramid_levels));
+      a->Visit(MJ_NVP(pyramid_escalate_empty));
+      a->Visit(MJ_NVP(pyramid_max_regions));
     }
   };
 
-  TargetTracker(const Options& = Options());
+  TargetTracker();
+  TargetTracker(const Options&);
   ~TargetTracker();
 
+  enum class Mode {
+    kFull,
+    kRoi,
+  };
+
+  struct Roi {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(x));
+      a->Visit(MJ_NVP(y));
+      a->Visit(MJ_NVP(width));
+      a->Visit(MJ_NVP(height));
+    }
+  };
+
+  /// What was done at one level of the pyramid.
+  struct Level {
+    /// 0 is full resolution, and each level above is half the size.
+    int level = 0;
+    int regions = 0;
+    /// The area searched, as a fraction of the whole level.
+    double area = 0.0;
+    int markers = 0;
+    /// Candidates which could not be decoded at this level.
+    int candidates = 0;
+    double detect_s = 0.0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(level));
+      a->Visit(MJ_NVP(regions));
+      a->Visit(MJ_NVP(area));
+      a->Visit(MJ_NVP(markers));
+      a->Visit(MJ_NVP(candidates));
+      a->Visit(MJ_NVP(detect_s));
+    }
+  };
+
   struct Result {
+    /// Marker centers, normalized to the image size.
     std::vector<Eigen::Vector2d> targets;
+    /// The size of each target, as a fraction of the image width.
+    std::vector<double> sizes;
+
+    /// How this frame was searched.
+    Mode mode = Mode::kFull;
+    Roi roi;
+    double detect_s = 0.0;
+    /// Consecutive frames in which nothing was found.
+    int misses = 0;
+    /// From coarsest to finest, only for the ArUco engine.
+    std::vector<Level> levels;
   };
 
   Result Track(const cv::Mat&);
@@ -47,3 +161,35 @@ class TargetTracker {
 
 }
 }
+
+namespace mjlib {
+namespace base {
+
+template <>
+struct IsEnum<mjmech::mech::TargetTracker::Engine> {
+  static constexpr bool value = true;
+
+  using E = mjmech::mech::TargetTracker::Engine;
+  static inline std::map<E, const char*> map() {
+    return {
+      { E::kAruco, "aruco" },
+      { E::kRing, "ring" },
+    };
+  }
+};
+
+template <>
+struct IsEnum<mjmech::mech::TargetTracker::Mode> {
+  static constexpr bool value = true;
+
+  using M = mjmech::mech::TargetTracker::Mode;
+  static inline std::map<M, const char*> map() {
+    return {
+      { M::kFull, "full" },
+      { M::kRoi, "roi" },
+    };
+  }
+};
+
+}
+}
@@ -20,7 +20,9 @@
 #include "mjlib/base/limit.h"
 #include "mjlib/io/repeating_timer.h"
 
+#include "base/fast_signal.h"
 #include "base/logging.h"
+#include "base/mono_time.h"
 #include "base/telemetry_registry.h"
 
 #include "mech/moteus.h"
@@ -81,13 +83,13 @@ class TelepresenceControl::Impl {
   }
 
   void Command(const CommandData& data) {
-    const auto now = Now();
+    const auto now = clock_.Now();
 
     const bool higher_priority = data.priority >= current_command_.priority;
     const bool stale =
-        !current_command_timestamp_.is_not_a_date_time() &&
-        (mjlib::base::ConvertDurationToSeconds(
-            now - current_command_timestamp_) > parameters_.command_timeout_s);
+        current_command_timestamp_.is_set() &&
+        (base::MonoSeconds(now, current_command_timestamp_) >
+         parameters_.command_timeout_s);
 
     if (!higher_priority && !stale) {
       return;
@@ -97,7 +99,7 @@ class TelepresenceControl::Impl {
     current_command_timestamp_ = now;
 
     CommandLog command_log;
-    command_log.timestamp = Now();
+    command_log.timestamp = clock_.ToPtime(now);
     command_log.command = &current_command_;
     command_signal_(&command_log);
   }
@@ -111,7 +113,7 @@ class TelepresenceControl::Impl {
 
     outstanding_ = true;
 
-    timing_ = ControlTiming(executor_, timing_.cycle_start());
+    timing_ = ControlTiming(&clock_, timing_.cycle_start());
 
     RunControl();
   }
@@ -337,10 +339,11 @@ class TelepresenceControl::Impl {
 
 
   boost::posix_time::ptime Now() {
-    return mjlib::io::Now(executor_.context());
+    return clock_.PtimeNow();
   }
 
   boost::asio::any_io_executor executor_;
+  base::MonoClock clock_{executor_.context()};
   ClientGetter client_getter_;
 
   base::LogRef log_ = base::GetLogInstance("QuadrupedControl");
@@ -348,7 +351,7 @@ class TelepresenceControl::Impl {
   Status status_;
 
   CommandData current_command_;
-  boost::posix_time::ptime current_command_timestamp_;
+  base::MonoTime current_command_timestamp_;
   Parameters parameters_;
 
   using Client = mjlib::multiplex::AsioClient;
@@ -361,11 +364,11 @@ class TelepresenceControl::Impl {
   Request client_command_;
   Client::Reply client_command_reply_;
 
-  boost::signals2::signal<void (const Status*)> telepresence_signal_;
-  boost::signals2::signal<void (const CommandLog*)> command_signal_;
-  boost::signals2::signal<void (const ControlLog*)> control_signal_;
+  base::FastSignal<void (const Status*)> telepresence_signal_;
+  base::FastSignal<void (const CommandLog*)> command_signal_;
+  base::FastSignal<void (const ControlLog*)> control_signal_;
 
-  ControlTiming timing_{executor_, {}};
+  ControlTiming timing_{&clock_, {}};
 
   mjlib::base::PID pid_{&parameters_.pid, &status_.pid};
 };
@@ -0,0 +1,78 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/attitude_history.h"
+
+#include <boost/test/auto_unit_test.hpp>
+
+using mjmech::mech::AttitudeHistory;
+
+namespace {
+mjmech::base::MonoTime At(double seconds) {
+  return mjmech::base::MonoTime::FromNanoseconds(
+      mjmech::base::MonoNanoseconds(10.0 + seconds));
+}
+}
+
+BOOST_AUTO_TEST_CASE(AttitudeHistoryInterpolateTest) {
+  AttitudeHistory dut;
+  BOOST_TEST(!dut.Get(At(0.0)));
+
+  dut.Add({At(0.00), 1.0, 10.0});
+  dut.Add({At(0.01), 2.0, 20.0});
+  dut.Add({At(0.02), 4.0, 40.0});
+  // Out of order samples are ignored.
+  dut.Add({At(0.015), 100.0, 100.0});
+  BOOST_TEST(dut.size() == 3);
+
+  const auto tolerance = boost::test_tools::tolerance(1e-6);
+
+  const auto middle = dut.Get(At(0.015));
+  BOOST_TEST_REQUIRE(!!middle);
+  BOOST_TEST(middle->pitch_deg == 3.0, tolerance);
+  BOOST_TEST(middle->yaw_deg == 30.0, tolerance);
+
+  const auto exact = dut.Get(At(0.01));
+  BOOST_TEST(exact->pitch_deg == 2.0, tolerance);
+
+  // Outside the range held, the nearest end is used.
+  BOOST_TEST(dut.Get(At(-1.0))->pitch_deg == 1.0, tolerance);
+  BOOST_TEST(dut.Get(At(1.0))->pitch_deg == 4.0, tolerance);
+}
+
+BOOST_AUTO_TEST_CASE(AttitudeHistoryYawWrapTest) {
+  AttitudeHistory dut;
+  dut.Add({At(0.0), 0.0, 170.0});
+  dut.Add({At(0.1), 0.0, -170.0});
+
+  const auto tolerance = boost::test_tools::tolerance(1e-6);
+  BOOST_TEST(std::abs(dut.Get(At(0.05))->yaw_deg) == 180.0, tolerance);
+  BOOST_TEST(dut.Get(At(0.025))->yaw_deg == 175.0, tolerance);
+  BOOST_TEST(dut.Get(At(0.075))->yaw_deg == -175.0, tolerance);
+}
+
+BOOST_AUTO_TEST_CASE(AttitudeHistoryOverflowTest) {
+  AttitudeHistory dut;
+  for (int i = 0; i < AttitudeHistory::kSize * 2; i++) {
+    dut.Add({At(0.01 * i), static_cast<double>(i), 0.0});
+  }
+  BOOST_TEST(dut.size() == AttitudeHistory::kSize);
+
+  // Only the newest samples are kept.
+  const auto tolerance = boost::test_tools::tolerance(1e-6);
+  BOOST_TEST(dut.Get(At(0.0))->pitch_deg == AttitudeHistory::kSize,
+             tolerance);
+  const double last = AttitudeHistory::kSize * 2 - 1.5;
+  BOOST_TEST(dut.Get(At(0.01 * last))->pitch_deg == last, tolerance);
+}
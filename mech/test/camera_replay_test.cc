@@ -0,0 +1,108 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "mech/camera_replay.h"
+
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+#include <opencv2/imgcodecs.hpp>
+
+using mjmech::mech::CameraReplay;
+
+namespace fs = boost::filesystem;
+
+namespace {
+class TempDirectory {
+ public:
+  TempDirectory()
+      : path_(fs::temp_directory_path() / fs::unique_path()) {
+    fs::create_directories(path_);
+  }
+
+  ~TempDirectory() {
+    fs::remove_all(path_);
+  }
+
+  std::string path() const { return path_.string(); }
+
+  void WriteImage(const std::string& name) const {
+    cv::imwrite((path_ / name).string(),
+                cv::Mat(24, 32, CV_8UC3, cv::Scalar(10, 20, 30)));
+  }
+
+ private:
+  fs::path path_;
+};
+}
+
+BOOST_AUTO_TEST_CASE(CameraReplayTimestampTest) {
+  TempDirectory dir;
+  // These are written out of order, and with something which is not
+  // an image.
+  dir.WriteImage("mjbots-camera20200314T152301.250000.png");
+  dir.WriteImage("mjbots-camera20200314T152301.100000.png");
+  dir.WriteImage("mjbots-camera20200314T152302.png");
+  std::ofstream((fs::path(dir.path()) / "notes.txt").string()) << "hi";
+
+  CameraReplay dut(dir.path(), 30.0);
+
+  for (int pass = 0; pass < 2; pass++) {
+    cv::Mat image;
+    double time_s = -1.0;
+
+    BOOST_TEST_REQUIRE(dut.Read(&image, &time_s));
+    BOOST_TEST(image.cols == 32);
+    BOOST_TEST(image.rows == 24);
+    BOOST_TEST(time_s == 0.0);
+    BOOST_TEST(fs::path(dut.name()).filename().string() ==
+               "mjbots-camera20200314T152301.100000.png");
+
+    BOOST_TEST_REQUIRE(dut.Read(&image, &time_s));
+    BOOST_TEST(time_s == 0.15, boost::test_tools::tolerance(1e-9));
+
+    BOOST_TEST_REQUIRE(dut.Read(&image, &time_s));
+    BOOST_TEST(time_s == 0.9, boost::test_tools::tolerance(1e-9));
+
+    BOOST_TEST(!dut.Read(&image, &time_s));
+
+    dut.Rewind();
+  }
+}
+
+BOOST_AUTO_TEST_CASE(CameraReplayFrameRateTest) {
+  TempDirectory dir;
+  dir.WriteImage("a.png");
+  dir.WriteImage("b.jpg");
+
+  CameraReplay dut(dir.path(), 20.0);
+
+  cv::Mat image;
+  double time_s = -1.0;
+  BOOST_TEST_REQUIRE(dut.Read(&image, &time_s));
+  BOOST_TEST(time_s == 0.0);
+  BOOST_TEST_REQUIRE(dut.Read(&image, &time_s));
+  BOOST_TEST(time_s == 0.05, boost::test_tools::tolerance(1e-9));
+  BOOST_TEST(!dut.Read(&image, &time_s));
+}
+
+BOOST_AUTO_TEST_CASE(CameraReplayMissingTest) {
+  TempDirectory dir;
+  BOOST_CHECK_THROW(CameraReplay(dir.path(), 30.0), std::exception);
+  BOOST_CHECK_THROW(CameraReplay(dir.path() + "/missing.mp4", 30.0),
+                    std::exception);
+}
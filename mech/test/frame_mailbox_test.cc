@@ -0,0 +1,111 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/frame_mailbox.h"
+
+#include <atomic>
+#include <set>
+#include <thread>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjmech::mech;
+
+BOOST_AUTO_TEST_CASE(FrameMailboxNewestTest) {
+  FrameMailbox dut(3);
+
+  for (uint64_t i = 0; i < 3; i++) {
+    auto frame = dut.Acquire();
+    frame->sequence = i;
+    dut.Publish(frame);
+  }
+
+  // Only the newest frame is handed out, the rest were dropped.
+  auto taken = dut.Take();
+  BOOST_TEST_REQUIRE(!!taken);
+  BOOST_TEST(taken->sequence == 2);
+
+  const auto stats = dut.stats();
+  BOOST_TEST(stats.published == 3);
+  BOOST_TEST(stats.taken == 1);
+  BOOST_TEST(stats.dropped == 2);
+  BOOST_TEST(stats.allocated == 0);
+}
+
+BOOST_AUTO_TEST_CASE(FrameMailboxPoolTest) {
+  // One worker, plus the pending frame, plus the one being captured.
+  FrameMailbox dut(3);
+
+  // A frame held by a worker is never handed back to the producer.
+  auto first = dut.Acquire();
+  dut.Publish(first);
+  auto held = dut.Take();
+  first.reset();
+
+  for (int i = 0; i < 10; i++) {
+    auto frame = dut.Acquire();
+    BOOST_TEST(frame.get() != held.get());
+    dut.Publish(frame);
+  }
+  BOOST_TEST(dut.stats().allocated == 0);
+
+  // Holding more frames than the pool grows it.
+  auto extra1 = dut.Take();
+  auto extra2 = dut.Acquire();
+  auto extra3 = dut.Acquire();
+  BOOST_TEST(extra3.get() != extra2.get());
+  BOOST_TEST(dut.stats().allocated == 1);
+}
+
+BOOST_AUTO_TEST_CASE(FrameMailboxThreadTest) {
+  FrameMailbox dut(4);
+
+  std::atomic<uint64_t> processed{0};
+  std::atomic<bool> out_of_order{false};
+  std::vector<std::thread> workers;
+  for (int i = 0; i < 2; i++) {
+    workers.emplace_back([&]() {
+        uint64_t last = 0;
+        bool first = true;
+        while (auto frame = dut.Take()) {
+          // Each worker sees frames in increasing order.
+          if (!first && frame->sequence <= last) { out_of_order = true; }
+          first = false;
+          last = frame->sequence;
+          processed++;
+        }
+      });
+  }
+
+  constexpr uint64_t kFrames = 20000;
+  for (uint64_t i = 0; i < kFrames; i++) {
+    auto frame = dut.Acquire();
+    frame->sequence = i;
+    dut.Publish(std::move(frame));
+  }
+
+  dut.Close();
+  for (auto& worker : workers) { worker.join(); }
+
+  BOOST_TEST(!out_of_order.load());
+  const auto stats = dut.stats();
+  BOOST_TEST(stats.published == kFrames);
+  BOOST_TEST(stats.taken == processed.load());
+  // Close discards whatever was pending.
+  BOOST_TEST(stats.taken + stats.dropped <= kFrames);
+  BOOST_TEST(stats.taken + stats.dropped >= kFrames - 1);
+  BOOST_TEST(stats.allocated == 0);
+
+  BOOST_TEST(!dut.Take());
+}
@@ -0,0 +1,158 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/frame_recorder.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mech/camera_replay.h"
+
+using mjmech::mech::CameraFrame;
+using mjmech::mech::CameraReplay;
+using mjmech::mech::FrameRecorder;
+
+namespace fs = boost::filesystem;
+
+namespace {
+class TempDirectory {
+ public:
+  TempDirectory()
+      : path_(fs::temp_directory_path() / fs::unique_path()) {
+    fs::create_directories(path_);
+  }
+
+  ~TempDirectory() {
+    fs::remove_all(path_);
+  }
+
+  std::string path() const { return path_.string(); }
+  std::string prefix() const { return (path_ / "frame").string(); }
+
+  std::vector<std::string> Files(const std::string& extension) const {
+    std::vector<std::string> result;
+    for (fs::directory_iterator it(path_), end; it != end; ++it) {
+      if (it->path().extension() == extension) {
+        result.push_back(it->path().string());
+      }
+    }
+    return result;
+  }
+
+ private:
+  fs::path path_;
+};
+
+CameraFrame MakeFrame(uint64_t sequence) {
+  CameraFrame result;
+  result.image = cv::Mat(24, 32, CV_8UC3, cv::Scalar(10, 20, 30));
+  result.sequence = sequence;
+  result.capture_time = mjmech::base::MonoClock::ReadMonotonic() +
+      -mjmech::base::MonoNanoseconds(0.01 * (10 - sequence));
+  return result;
+}
+}
+
+BOOST_AUTO_TEST_CASE(FrameRecorderRawTest) {
+  TempDirectory dir;
+
+  FrameRecorder::Options options;
+  options.format = FrameRecorder::Format::kRaw;
+  options.depth = 10;
+
+  {
+    FrameRecorder dut(dir.prefix(), options, cv::Size(32, 24));
+    for (uint64_t i = 0; i < 3; i++) {
+      dut.SetState("yaw_deg=" + std::to_string(i));
+      BOOST_TEST(dut.Record(MakeFrame(i)));
+    }
+    dut.Flush();
+
+    const auto stats = dut.stats();
+    BOOST_TEST(stats.offered == 3);
+    BOOST_TEST(stats.written == 3);
+    BOOST_TEST(stats.dropped == 0);
+    BOOST_TEST(stats.errors == 0);
+    BOOST_TEST(stats.queued == 0);
+  }
+
+  BOOST_TEST(dir.Files(".ppm").size() == 3);
+
+  // The sidecar has a header and one line per frame, in order.
+  const auto sidecars = dir.Files(".csv");
+  BOOST_TEST_REQUIRE(sidecars.size() == 1);
+  std::ifstream inf(sidecars.front());
+  std::vector<std::string> lines;
+  for (std::string line; std::getline(inf, line);) { lines.push_back(line); }
+  BOOST_TEST_REQUIRE(lines.size() == 4);
+  BOOST_TEST(lines[0] == "file,sequence,timestamp,width,height,state");
+  for (int i = 0; i < 3; i++) {
+    const auto& line = lines[i + 1];
+    BOOST_TEST(line.find(".ppm," + std::to_string(i) + ",") !=
+               std::string::npos);
+    BOOST_TEST(line.find(",32,24,yaw_deg=" + std::to_string(i)) !=
+               std::string::npos);
+  }
+
+  // The names carry the capture time, so they can be replayed with
+  // their original spacing.
+  CameraReplay replay(dir.path(), 30.0);
+  cv::Mat image;
+  double time_s = 0.0;
+  std::vector<double> times;
+  while (replay.Read(&image, &time_s)) {
+    BOOST_TEST(image.cols == 32);
+    BOOST_TEST(image.rows == 24);
+    times.push_back(time_s);
+  }
+  BOOST_TEST_REQUIRE(times.size() == 3);
+  BOOST_TEST(times[1] > 0.005);
+  BOOST_TEST(times[2] > times[1]);
+}
+
+BOOST_AUTO_TEST_CASE(FrameRecorderDropTest) {
+  TempDirectory dir;
+
+  FrameRecorder::Options options;
+  options.format = FrameRecorder::Format::kPng;
+  options.png_compression = 9;
+  options.depth = 2;
+  options.sidecar = false;
+
+  constexpr int kFrames = 50;
+  CameraFrame frame;
+  frame.image = cv::Mat(480, 640, CV_8UC3, cv::Scalar(1, 2, 3));
+
+  FrameRecorder dut(dir.prefix(), options, frame.image.size());
+  int accepted = 0;
+  for (int i = 0; i < kFrames; i++) {
+    frame.sequence = i;
+    frame.capture_time = mjmech::base::MonoClock::ReadMonotonic();
+    if (dut.Record(frame)) { accepted++; }
+  }
+  dut.Flush();
+
+  // Whatever the writer kept up with, every frame is accounted for.
+  const auto stats = dut.stats();
+  BOOST_TEST(stats.offered == kFrames);
+  BOOST_TEST(stats.written == accepted);
+  BOOST_TEST(stats.written + stats.dropped == kFrames);
+  BOOST_TEST(stats.queued == 0);
+  BOOST_TEST(stats.max_write_s >= stats.write_s);
+  BOOST_TEST(dir.Files(".csv").empty());
+}
@@ -0,0 +1,182 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// @file
+///
+/// Measure the cost of packing telemetry with McastTelemetryEncoder,
+/// and the throughput and latency of McastTelemetryPublisher to
+/// McastTelemetryReceiver over loopback.
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <fmt/format.h>
+
+#include "mech/mcast_telemetry.h"
+
+namespace {
+namespace pt = boost::posix_time;
+
+constexpr int kNumItems = 40;
+constexpr int kEncodeIterations = 20000;
+constexpr auto kPeriod = std::chrono::milliseconds(1);
+constexpr auto kDuration = std::chrono::seconds(2);
+
+std::size_t ItemSize(int index) {
+  // A mix of small status records and a few larger ones.
+  return (index % 8 == 0) ? 2000 : (32 + 37 * index % 400);
+}
+
+std::string ItemName(int index) {
+  return fmt::format("item{}", index);
+}
+
+int64_t SteadyNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void RunEncode() {
+  using mjmech::mech::McastTelemetryEncoder;
+
+  McastTelemetryEncoder encoder;
+  const auto now = pt::microsec_clock::universal_time();
+  const auto expiration = now + pt::hours(1);
+
+  std::vector<std::string> data;
+  std::size_t payload = 0;
+  for (int i = 0; i < kNumItems; i++) {
+    data.push_back(std::string(ItemSize(i), 'x'));
+    payload += data.back().size();
+  }
+
+  uint64_t datagrams = 0;
+  uint64_t bytes = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int iteration = 0; iteration < kEncodeIterations; iteration++) {
+    for (int i = 0; i < kNumItems; i++) {
+      encoder.Set(ItemName(i), data[i], now, expiration);
+    }
+    encoder.Encode(now, 1372, -1, [&](std::string_view datagram) {
+        datagrams++;
+        bytes += datagram.size();
+      });
+  }
+  const auto end = std::chrono::steady_clock::now();
+  const double elapsed_s = std::chrono::duration<double>(end - start).count();
+
+  fmt::print("encode: {} items, {} bytes per tick\n", kNumItems, payload);
+  fmt::print("  {:.2f} us per tick\n", 1e6 * elapsed_s / kEncodeIterations);
+  fmt::print("  {:.1f} datagrams per tick ({} if sent one per item)\n",
+             static_cast<double>(datagrams) / kEncodeIterations, kNumItems);
+  fmt::print("  {:.1f}% overhead\n",
+             100.0 * (static_cast<double>(bytes) / kEncodeIterations -
+                      payload) / payload);
+}
+
+void RunLoopback() {
+  using namespace mjmech;
+
+  boost::asio::io_context context;
+  auto log = base::GetLogInstance("mcast_telemetry_benchmark");
+
+  base::UdpDataLink::Parameters tx_params;
+  tx_params.source = "127.0.0.1:0";
+  tx_params.dest = "127.0.0.1:13459";
+  base::UdpDataLink tx_link(context.get_executor(), log, tx_params);
+
+  base::UdpDataLink::Parameters rx_params;
+  rx_params.source = "127.0.0.1:13459";
+  rx_params.dest = ":";
+  base::UdpDataLink rx_link(context.get_executor(), log, rx_params);
+
+  mech::McastTelemetryPublisher publisher(
+      context.get_executor(), &tx_link, {});
+
+  uint64_t items = 0;
+  uint64_t bytes = 0;
+  std::vector<int64_t> latencies;
+  latencies.reserve(1000000);
+
+  mech::McastTelemetryReceiver receiver(&rx_link, [&](const auto& item) {
+      int64_t sent_ns = 0;
+      std::memcpy(&sent_ns, item.data.data(), sizeof(sent_ns));
+      latencies.push_back(SteadyNs() - sent_ns);
+      items++;
+      bytes += item.data.size();
+    });
+
+  std::vector<std::string> data;
+  for (int i = 0; i < kNumItems; i++) {
+    data.push_back(std::string(ItemSize(i), 'x'));
+  }
+
+  boost::asio::steady_timer timer(context);
+  const auto start = std::chrono::steady_clock::now();
+  int ticks = 0;
+
+  std::function<void ()> tick = [&]() {
+    const auto expiration = pt::microsec_clock::universal_time() +
+        pt::seconds(1);
+    for (int i = 0; i < kNumItems; i++) {
+      const int64_t now_ns = SteadyNs();
+      std::memcpy(&data[i][0], &now_ns, sizeof(now_ns));
+      publisher.SetTelemetry(ItemName(i), data[i], expiration);
+    }
+    publisher.Poll();
+    ticks++;
+
+    if (std::chrono::steady_clock::now() - start > kDuration) {
+      // Leave a little time for the last datagrams to arrive.
+      timer.expires_after(std::chrono::milliseconds(50));
+      timer.async_wait([&](const auto&) { context.stop(); });
+      return;
+    }
+    timer.expires_after(kPeriod);
+    timer.async_wait([&](const auto&) { tick(); });
+  };
+  tick();
+
+  context.run();
+
+  const double elapsed_s = std::chrono::duration<double>(kDuration).count();
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double p) {
+    if (latencies.empty()) { return 0.0; }
+    return latencies[static_cast<std::size_t>(
+        p * (latencies.size() - 1))] * 1e-3;
+  };
+
+  fmt::print("loopback: {} ticks of {} items\n", ticks, kNumItems);
+  fmt::print("  {:.0f} items/s  {:.1f} MB/s  {} datagrams sent\n",
+             items / elapsed_s, bytes / elapsed_s / 1e6,
+             publisher.stats().datagrams);
+  fmt::print("  delivered {} of {} items, {} datagrams lost\n",
+             items, ticks * kNumItems, receiver.stats().lost);
+  fmt::print("  latency us: p50 {:.1f}  p99 {:.1f}  max {:.1f}\n",
+             percentile(0.5), percentile(0.99), percentile(1.0));
+}
+}
+
+extern "C" int main(int, char**) {
+  RunEncode();
+  RunLoopback();
+  return 0;
+}
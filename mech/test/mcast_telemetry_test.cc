@@ -0,0 +1,305 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/mcast_telemetry.h"
+
+#include <map>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjmech::mech;
+
+namespace {
+namespace pt = boost::posix_time;
+
+const pt::ptime kStart(boost::gregorian::date(2020, 5, 1), pt::hours(12));
+
+struct Fixture {
+  McastTelemetryEncoder encoder;
+  McastTelemetryDecoder decoder{[this](const auto& item) {
+      received[std::string(item.name)] = std::string(item.data);
+      sequences[std::string(item.name)] = item.sequence;
+      ages[std::string(item.name)] = item.age_s;
+    }};
+
+  std::vector<std::string> datagrams;
+  std::map<std::string, std::string> received;
+  std::map<std::string, uint32_t> sequences;
+  std::map<std::string, double> ages;
+
+  void Encode(pt::ptime now, std::size_t max_size, int64_t budget = -1) {
+    datagrams.clear();
+    encoder.Encode(now, max_size, budget, [&](std::string_view datagram) {
+        BOOST_TEST(datagram.size() <= max_size);
+        datagrams.push_back(std::string(datagram));
+      });
+  }
+
+  void DecodeAll() {
+    for (const auto& datagram : datagrams) {
+      BOOST_TEST(decoder.Decode(datagram));
+    }
+  }
+};
+
+std::string MakeData(std::size_t size, int seed) {
+  std::string result;
+  for (std::size_t i = 0; i < size; i++) {
+    result.push_back(static_cast<char>((i * 7 + seed) & 0xff));
+  }
+  return result;
+}
+}
+
+BOOST_AUTO_TEST_CASE(McastTelemetryPackTest,
+                     * boost::unit_test::tolerance(1e-9)) {
+  Fixture dut;
+  const auto expiration = kStart + pt::seconds(1);
+  dut.encoder.Set("imu", MakeData(40, 1), kStart, expiration);
+  dut.encoder.Set("servo", MakeData(300, 2), kStart, expiration);
+  dut.encoder.Set("", MakeData(0, 0), kStart, expiration);
+  dut.encoder.Set("status", MakeData(100, 3),
+                  kStart + pt::milliseconds(10), expiration);
+
+  dut.Encode(kStart + pt::milliseconds(20), 1372);
+  // Everything fits in one datagram.
+  BOOST_TEST(dut.datagrams.size() == 1);
+  dut.DecodeAll();
+
+  BOOST_TEST(dut.received.size() == 4);
+  BOOST_TEST(dut.received["imu"] == MakeData(40, 1));
+  BOOST_TEST(dut.received["servo"] == MakeData(300, 2));
+  BOOST_TEST(dut.received["status"] == MakeData(100, 3));
+  BOOST_TEST(dut.received[""].empty());
+  BOOST_TEST(dut.ages["imu"] == 0.020);
+  BOOST_TEST(dut.ages["status"] == 0.010);
+
+  // Sending the same thing again delivers nothing new.
+  dut.received.clear();
+  dut.Encode(kStart + pt::milliseconds(30), 1372);
+  dut.DecodeAll();
+  BOOST_TEST(dut.received.empty());
+  BOOST_TEST(dut.decoder.stats().duplicates == 4);
+
+  // But an update does.
+  dut.encoder.Set("imu", MakeData(40, 5), kStart + pt::milliseconds(35),
+                  expiration);
+  dut.Encode(kStart + pt::milliseconds(40), 1372);
+  dut.DecodeAll();
+  BOOST_TEST(dut.received.size() == 1);
+  BOOST_TEST(dut.received["imu"] == MakeData(40, 5));
+  BOOST_TEST(dut.sequences["imu"] == 2);
+  BOOST_TEST(dut.decoder.stats().lost == 0);
+}
+
+BOOST_AUTO_TEST_CASE(McastTelemetryFirstFitTest) {
+  Fixture dut;
+  const auto expiration = kStart + pt::seconds(1);
+  for (int i = 0; i < 10; i++) {
+    dut.encoder.Set("item" + std::to_string(i), MakeData(300, i),
+                    kStart, expiration);
+  }
+
+  dut.Encode(kStart, 1000);
+  // Each chunk is 324 bytes, so three fit in each datagram.
+  BOOST_TEST(dut.datagrams.size() == 4);
+  dut.DecodeAll();
+  BOOST_TEST(dut.received.size() == 10);
+  for (int i = 0; i < 10; i++) {
+    BOOST_TEST(dut.received["item" + std::to_string(i)] == MakeData(300, i));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(McastTelemetryFragmentTest) {
+  Fixture dut;
+  const auto expiration = kStart + pt::seconds(1);
+  const auto big = MakeData(5000, 9);
+  dut.encoder.Set("image", big, kStart, expiration);
+  dut.encoder.Set("small", MakeData(20, 4), kStart, expiration);
+
+  dut.Encode(kStart, 512);
+  BOOST_TEST(dut.datagrams.size() == 11);
+
+  // Deliver out of order, with every datagram duplicated.
+  std::reverse(dut.datagrams.begin(), dut.datagrams.end());
+  dut.DecodeAll();
+  dut.DecodeAll();
+
+  BOOST_TEST(dut.received.size() == 2);
+  BOOST_TEST(dut.received["image"] == big);
+  BOOST_TEST(dut.received["small"] == MakeData(20, 4));
+  BOOST_TEST(dut.decoder.stats().items == 2);
+
+  // If a fragment of one version is lost, the next version replaces
+  // it.
+  dut.received.clear();
+  const auto big2 = MakeData(5000, 10);
+  dut.encoder.Set("image", big2, kStart + pt::milliseconds(1), expiration);
+  dut.Encode(kStart + pt::milliseconds(1), 512);
+  BOOST_TEST(dut.datagrams.size() == 11);
+  dut.datagrams.erase(dut.datagrams.begin() + 3);
+  dut.DecodeAll();
+  BOOST_TEST(dut.received.empty());
+
+  const auto big3 = MakeData(5000, 11);
+  dut.encoder.Set("image", big3, kStart + pt::milliseconds(2), expiration);
+  dut.Encode(kStart + pt::milliseconds(2), 512);
+  dut.DecodeAll();
+  BOOST_TEST(dut.received["image"] == big3);
+  BOOST_TEST(dut.decoder.stats().incomplete == 1);
+  BOOST_TEST(dut.decoder.stats().lost == 1);
+}
+
+BOOST_AUTO_TEST_CASE(McastTelemetryExpirationTest) {
+  Fixture dut;
+  dut.encoder.Set("short", "a", kStart, kStart + pt::milliseconds(100));
+  dut.encoder.Set("long", "b", kStart, kStart + pt::seconds(10));
+  dut.encoder.Set("forever", "c", kStart, pt::ptime());
+
+  dut.Encode(kStart + pt::milliseconds(50), 1000);
+  dut.DecodeAll();
+  BOOST_TEST(dut.received.size() == 3);
+  BOOST_TEST(dut.encoder.size() == 3);
+
+  dut.Encode(kStart + pt::milliseconds(100), 1000);
+  BOOST_TEST(dut.encoder.size() == 2);
+  BOOST_TEST(dut.encoder.stats().expired == 1);
+
+  dut.Encode(kStart + pt::seconds(100), 1000);
+  BOOST_TEST(dut.encoder.size() == 1);
+  BOOST_TEST(dut.encoder.stats().expired == 2);
+}
+
+BOOST_AUTO_TEST_CASE(McastTelemetryBudgetTest) {
+  Fixture dut;
+  const auto expiration = kStart + pt::seconds(10);
+  dut.encoder.Set("a", MakeData(100, 1), kStart, expiration);
+  dut.encoder.Set("b", MakeData(100, 2), kStart + pt::milliseconds(1),
+                  expiration);
+
+  // Only one item fits, and it is the newest.
+  dut.Encode(kStart + pt::milliseconds(2), 1000, 150);
+  dut.DecodeAll();
+  BOOST_TEST(dut.received.size() == 1);
+  BOOST_TEST(dut.received.count("b") == 1);
+  BOOST_TEST(dut.encoder.stats().deferred == 1);
+
+  // Now the unsent one takes priority, even though it is older.
+  dut.Encode(kStart + pt::milliseconds(3), 1000, 150);
+  dut.DecodeAll();
+  BOOST_TEST(dut.received.count("a") == 1);
+
+  // With both sent, the newest goes first again.
+  dut.received.clear();
+  dut.encoder.Set("a", MakeData(100, 3), kStart + pt::milliseconds(4),
+                  expiration);
+  dut.encoder.Set("b", MakeData(100, 4), kStart + pt::milliseconds(5),
+                  expiration);
+  dut.Encode(kStart + pt::milliseconds(6), 1000, 150);
+  dut.DecodeAll();
+  BOOST_TEST(dut.received.size() == 1);
+  BOOST_TEST(dut.received["b"] == MakeData(100, 4));
+}
+
+BOOST_AUTO_TEST_CASE(McastTelemetryMalformedTest) {
+  Fixture dut;
+  dut.encoder.Set("a", MakeData(100, 1), kStart, pt::ptime());
+  dut.Encode(kStart, 1000);
+  BOOST_TEST(dut.datagrams.size() == 1);
+
+  for (std::size_t size = 0; size < dut.datagrams[0].size(); size++) {
+    BOOST_TEST(!dut.decoder.Decode(dut.datagrams[0].substr(0, size)));
+  }
+  BOOST_TEST(dut.received.empty());
+
+  auto bad_version = dut.datagrams[0];
+  bad_version[0] = 9;
+  BOOST_TEST(!dut.decoder.Decode(bad_version));
+
+  BOOST_TEST(dut.decoder.Decode(dut.datagrams[0]));
+  BOOST_TEST(dut.received["a"] == MakeData(100, 1));
+}
+
+BOOST_AUTO_TEST_CASE(McastTelemetryRestartTest) {
+  Fixture dut;
+  const auto expiration = kStart + pt::seconds(1);
+  for (int i = 0; i < 5; i++) {
+    dut.encoder.Set("imu", MakeData(40, i), kStart, expiration);
+    dut.encoder.Set("image", MakeData(3000, i), kStart, expiration);
+    dut.Encode(kStart, 1000);
+    dut.DecodeAll();
+  }
+  BOOST_TEST(dut.sequences["imu"] == 5);
+
+  // A publisher which restarted counts from 1 again, and its items
+  // are still delivered.
+  dut.received.clear();
+  McastTelemetryEncoder restarted;
+  restarted.Set("imu", MakeData(40, 10), kStart, expiration);
+  restarted.Set("image", MakeData(3000, 10), kStart, expiration);
+  restarted.Encode(kStart, 1000, -1, [&](std::string_view datagram) {
+      BOOST_TEST(dut.decoder.Decode(datagram));
+    });
+
+  BOOST_TEST(dut.received["imu"] == MakeData(40, 10));
+  BOOST_TEST(dut.received["image"] == MakeData(3000, 10));
+  BOOST_TEST(dut.sequences["imu"] == 1);
+  BOOST_TEST(dut.decoder.stats().restarts == 1);
+  BOOST_TEST(dut.decoder.stats().duplicates == 0);
+  BOOST_TEST(dut.decoder.stats().lost == 0);
+}
+
+BOOST_AUTO_TEST_CASE(McastTelemetryLoopbackTest) {
+  boost::asio::io_context context;
+  auto log = mjmech::base::GetLogInstance("mcast_telemetry_test");
+
+  mjmech::base::UdpDataLink::Parameters tx_params;
+  tx_params.source = "127.0.0.1:0";
+  tx_params.dest = "127.0.0.1:13457";
+  mjmech::base::UdpDataLink tx_link(context.get_executor(), log, tx_params);
+
+  mjmech::base::UdpDataLink::Parameters rx_params;
+  rx_params.source = "127.0.0.1:13457";
+  rx_params.dest = ":";
+  mjmech::base::UdpDataLink rx_link(context.get_executor(), log, rx_params);
+
+  McastTelemetryPublisher::Options options;
+  options.period_s = 0.01;
+  McastTelemetryPublisher publisher(context.get_executor(), &tx_link, options);
+
+  std::map<std::string, std::string> received;
+  McastTelemetryReceiver receiver(&rx_link, [&](const auto& item) {
+      received[std::string(item.name)] = std::string(item.data);
+      if (received.size() == 3) { context.stop(); }
+    });
+
+  publisher.AsyncStart([](const auto& ec) { BOOST_TEST(!ec); });
+
+  const auto expiration = pt::microsec_clock::universal_time() +
+      pt::seconds(10);
+  publisher.SetTelemetry("imu", MakeData(50, 1), expiration);
+  publisher.SetTelemetry("servo", MakeData(4000, 2), expiration);
+  publisher.SetTelemetry("expired", MakeData(50, 3), kStart);
+  publisher.SetTelemetry("camera", MakeData(20, 4), expiration);
+
+  context.run_for(std::chrono::seconds(2));
+
+  BOOST_TEST(received.size() == 3);
+  BOOST_TEST(received["imu"] == MakeData(50, 1));
+  BOOST_TEST(received["servo"] == MakeData(4000, 2));
+  BOOST_TEST(received["camera"] == MakeData(20, 4));
+  BOOST_TEST(received.count("expired") == 0);
+  BOOST_TEST(publisher.stats().expired == 1);
+}
@@ -0,0 +1,181 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// @file
+///
+/// Compare the CPU time and heap allocations per line of the nrfusb
+/// receive parser and transmit formatter against the string based
+/// implementation they replaced.
+
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <optional>
+#include <sstream>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+
+#include <fmt/format.h>
+
+#include "mech/nrfusb_protocol.h"
+
+namespace {
+constexpr int kIterations = 200000;
+
+std::size_t g_allocations = 0;
+}
+
+void* operator new(std::size_t size) {
+  g_allocations++;
+  if (void* result = std::malloc(size)) { return result; }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+namespace {
+using mjmech::mech::NrfusbReceive;
+
+/// The previous implementation, as it was in NrfusbClient.
+namespace legacy {
+std::optional<std::string> ParseHexData(const std::string& data) {
+  if (data.size() % 2 != 0) { return {}; }
+  std::string result;
+  for (size_t i = 0; i < data.size(); i += 2) {
+    const int element = std::stoi(data.substr(i, 2), nullptr, 16);
+    result.push_back(static_cast<char>(element));
+  }
+  return result;
+}
+
+std::string FormatHexData(const std::string& data) {
+  std::ostringstream ostr;
+  for (char c : data) {
+    ostr << fmt::format("{:02x}", static_cast<int>(static_cast<uint8_t>(c)));
+  }
+  return ostr.str();
+}
+
+void HandleReceive(const std::string& line, NrfusbReceive* result) {
+  std::vector<std::string> fields;
+  boost::split(fields, line, boost::is_any_of(" "));
+  for (const auto& field : fields) {
+    const size_t pos = field.find(':');
+    if (pos == std::string::npos) { continue; }
+    const int slot_num = std::stoi(field.substr(0, pos));
+    if (slot_num < 0 || slot_num > 14) { continue; }
+    const auto maybe_data = ParseHexData(field.substr(pos + 1));
+    if (!maybe_data) { continue; }
+    auto& slot = result->slots[slot_num];
+    const auto to_copy =
+        std::min<std::size_t>(slot.data.size(), maybe_data->size());
+    std::memcpy(slot.data.data(), maybe_data->data(), to_copy);
+    slot.size = to_copy;
+    result->bitfield |= (1 << slot_num);
+  }
+}
+
+void HandleLine(const std::string& line_in, NrfusbReceive* result) {
+  std::string line = boost::trim_copy(line_in);
+  result->bitfield = 0;
+  if (line.substr(0, 5) == "rcv2 ") {
+    const auto rest = line.substr(5);
+    const auto space = rest.find(' ');
+    result->remote = std::strtol(rest.substr(0, space).c_str(), nullptr, 0);
+    if (space != std::string::npos) {
+      HandleReceive(rest.substr(space + 1), result);
+    }
+  } else if (line.substr(0, 4) == "rcv ") {
+    result->remote = 0;
+    HandleReceive(line.substr(4), result);
+  }
+}
+
+std::string Format(int remote, int slot_idx, uint32_t priority,
+                   const std::string& data) {
+  return fmt::format("slot pri2 {} {} {:08x}\nslot tx2 {} {} {}\n",
+                     remote, slot_idx, priority,
+                     remote, slot_idx, FormatHexData(data));
+}
+}
+
+struct Result {
+  double ns = 0.0;
+  double allocations = 0.0;
+};
+
+template <typename Functor>
+Result Time(Functor functor) {
+  const auto start_allocations = g_allocations;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; i++) {
+    functor();
+  }
+  const auto end = std::chrono::steady_clock::now();
+  Result result;
+  result.ns = std::chrono::duration<double, std::nano>(end - start).count() /
+      kIterations;
+  result.allocations =
+      static_cast<double>(g_allocations - start_allocations) / kIterations;
+  return result;
+}
+
+void Report(const std::string& name, const Result& legacy,
+            const Result& current) {
+  fmt::print("{:<8} legacy  {:8.0f} ns {:6.1f} allocs\n",
+             name, legacy.ns, legacy.allocations);
+  fmt::print("{:<8} current {:8.0f} ns {:6.1f} allocs  ({:.1f}x time)\n",
+             name, current.ns, current.allocations, legacy.ns / current.ns);
+}
+}
+
+extern "C" {
+int main(int argc, char** argv) {
+  // A typical line from a robot, with every status slot populated.
+  const std::string line =
+      "rcv2 1 0:0c4b 1:fe0fa0c3ff0700 2:1407f0ff 3:031f00 "
+      "8:b0b4d6e000 14:00000000000000000000000000\r\n";
+
+  NrfusbReceive receive;
+  const auto legacy_parse = Time([&]() {
+      std::istringstream in(line);
+      std::string copy;
+      std::getline(in, copy);
+      legacy::HandleLine(copy, &receive);
+      if (receive.bitfield != 0x410f) { std::abort(); }
+    });
+  const auto current_parse = Time([&]() {
+      if (!mjmech::mech::ParseNrfusbLine(line, &receive)) { std::abort(); }
+      if (receive.bitfield != 0x410f) { std::abort(); }
+    });
+  Report("parse", legacy_parse, current_parse);
+
+  const std::string data = "\x0c\x4b\x12\x00\xff\x7f\x80";
+  std::string output;
+  const auto legacy_format = Time([&]() {
+      output = legacy::Format(1, 2, 0xffffffff, data);
+    });
+  const auto current_format = Time([&]() {
+      std::array<char, mjmech::mech::kNrfusbMaxTransmitSize> buffer;
+      const auto size = mjmech::mech::FormatNrfusbTransmit(
+          1, 2, 0xffffffff, data.data(), data.size(), &buffer);
+      if (std::string_view(buffer.data(), size) != output) { std::abort(); }
+    });
+  Report("format", legacy_format, current_format);
+
+  return 0;
+}
+}
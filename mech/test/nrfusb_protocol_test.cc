@@ -0,0 +1,167 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/nrfusb_protocol.h"
+
+#include <random>
+#include <string>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include <fmt/format.h>
+
+using namespace mjmech::mech;
+
+namespace {
+std::string Data(const NrfusbReceive& receive, int slot) {
+  const auto& s = receive.slots[slot];
+  return std::string(reinterpret_cast<const char*>(s.data.data()), s.size);
+}
+
+std::string Format(int remote, int slot_idx, uint32_t priority,
+                   std::string_view data) {
+  std::array<char, kNrfusbMaxTransmitSize> buffer;
+  const auto size = FormatNrfusbTransmit(
+      remote, slot_idx, priority, data.data(), data.size(), &buffer);
+  BOOST_TEST(size <= buffer.size());
+  return std::string(buffer.data(), size);
+}
+}
+
+BOOST_AUTO_TEST_CASE(NrfusbParseReceiveTest) {
+  NrfusbReceive dut;
+  BOOST_TEST(ParseNrfusbLine("rcv 0:0102 3:ff\r\n", &dut));
+  BOOST_TEST(dut.remote == 0);
+  BOOST_TEST(dut.bitfield == 0x0009);
+  BOOST_TEST(Data(dut, 0) == std::string("\x01\x02"));
+  BOOST_TEST(Data(dut, 3) == std::string("\xff"));
+
+  BOOST_TEST(ParseNrfusbLine("rcv2 1 14:A0b1 2:", &dut));
+  BOOST_TEST(dut.remote == 1);
+  BOOST_TEST(dut.bitfield == 0x4004);
+  BOOST_TEST(Data(dut, 14) == std::string("\xa0\xb1"));
+  BOOST_TEST(dut.slots[2].size == 0);
+
+  BOOST_TEST(ParseNrfusbLine("rcv2 0x1 1:00", &dut));
+  BOOST_TEST(dut.remote == 1);
+}
+
+BOOST_AUTO_TEST_CASE(NrfusbParseRejectTest) {
+  NrfusbReceive dut;
+  BOOST_TEST(!ParseNrfusbLine("OK", &dut));
+  BOOST_TEST(!ParseNrfusbLine("", &dut));
+  BOOST_TEST(!ParseNrfusbLine("\n", &dut));
+  BOOST_TEST(!ParseNrfusbLine("rcvx 0:00", &dut));
+  BOOST_TEST(!ParseNrfusbLine("rcv2 x 0:00", &dut));
+  BOOST_TEST(!ParseNrfusbLine("rcv2", &dut));
+
+  // Malformed fields are skipped, but the rest of the line is used.
+  BOOST_TEST(ParseNrfusbLine(
+                 "rcv 15:00 -1:00 1:0g 2:012 x:00 4 5:05", &dut));
+  BOOST_TEST(dut.bitfield == 0x0020);
+  BOOST_TEST(Data(dut, 5) == std::string("\x05"));
+
+  // Slot data longer than a slot is truncated.
+  BOOST_TEST(ParseNrfusbLine(
+                 "rcv 1:" + std::string(40, '7'), &dut));
+  BOOST_TEST(dut.bitfield == 0x0002);
+  BOOST_TEST(dut.slots[1].size == kNrfusbMaxSlotSize);
+}
+
+BOOST_AUTO_TEST_CASE(NrfusbFormatTest) {
+  BOOST_TEST(Format(1, 14, 0x12345678, "\x01\xab") ==
+             "slot pri2 1 14 12345678\nslot tx2 1 14 01ab\n");
+  BOOST_TEST(Format(0, 0, 0, "") ==
+             "slot pri2 0 0 00000000\nslot tx2 0 0 \n");
+
+  // The longest possible output fits.
+  const std::string longest(kNrfusbMaxSlotSize, '\xff');
+  BOOST_TEST(Format(1000000000, 1000000000, 0xffffffff, longest) ==
+             fmt::format("slot pri2 {0} {0} ffffffff\nslot tx2 {0} {0} {1}\n",
+                         1000000000, std::string(32, 'f')));
+}
+
+BOOST_AUTO_TEST_CASE(NrfusbFuzzTest) {
+  std::mt19937 rng(1234);
+  const std::string alphabet = "rcv2 0123456789abcdefABCDEFx:-\r\n\t";
+
+  NrfusbReceive dut;
+  std::string line;
+  for (int i = 0; i < 20000; i++) {
+    // Build a valid line, so that mutations stay close to the
+    // grammar.
+    const int remote = rng() % 3;
+    line = (i % 2) ? fmt::format("rcv2 {}", remote) : "rcv";
+    uint16_t expected_bitfield = 0;
+    std::array<std::string, kNrfusbNumSlots> expected;
+    const int fields = rng() % 6;
+    for (int j = 0; j < fields; j++) {
+      const int slot = rng() % kNrfusbNumSlots;
+      std::string data;
+      const int size = rng() % (kNrfusbMaxSlotSize + 1);
+      for (int k = 0; k < size; k++) {
+        data.push_back(static_cast<char>(rng() & 0xff));
+      }
+      line += fmt::format(" {}:", slot);
+      for (const char c : data) {
+        line += fmt::format("{:02x}", static_cast<uint8_t>(c));
+      }
+      expected_bitfield |= (1 << slot);
+      expected[slot] = data;
+    }
+
+    const bool mutate = (rng() % 4) == 0;
+    if (!mutate) {
+      BOOST_TEST_REQUIRE(ParseNrfusbLine(line, &dut));
+      BOOST_TEST_REQUIRE(dut.bitfield == expected_bitfield);
+      BOOST_TEST_REQUIRE(dut.remote == ((i % 2) ? remote : 0));
+      for (int slot = 0; slot < kNrfusbNumSlots; slot++) {
+        if (expected_bitfield & (1 << slot)) {
+          BOOST_TEST_REQUIRE(Data(dut, slot) == expected[slot]);
+        }
+      }
+      continue;
+    }
+
+    const int mutations = 1 + rng() % 4;
+    for (int j = 0; j < mutations && !line.empty(); j++) {
+      const std::size_t pos = rng() % line.size();
+      switch (rng() % 3) {
+        case 0: {
+          line[pos] = alphabet[rng() % alphabet.size()];
+          break;
+        }
+        case 1: {
+          line.erase(pos, 1);
+          break;
+        }
+        case 2: {
+          line.insert(pos, 1, static_cast<char>(rng() & 0xff));
+          break;
+        }
+      }
+    }
+
+    // Any result is acceptable, so long as it is well formed.
+    if (ParseNrfusbLine(line, &dut)) {
+      BOOST_TEST_REQUIRE(dut.remote >= 0);
+      BOOST_TEST_REQUIRE((dut.bitfield & 0x8000) == 0);
+      for (int slot = 0; slot < kNrfusbNumSlots; slot++) {
+        if (dut.bitfield & (1 << slot)) {
+          BOOST_TEST_REQUIRE(dut.slots[slot].size <= kNrfusbMaxSlotSize);
+        }
+      }
+    }
+  }
+}
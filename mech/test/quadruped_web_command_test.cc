@@ -0,0 +1,95 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/quadruped_web_command.h"
+
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjmech::mech;
+
+BOOST_AUTO_TEST_CASE(QuadrupedWebCommandWalkTest) {
+  QuadrupedCommand command;
+  command.mode = QuadrupedCommand::kWalk;
+  command.log = QuadrupedCommand::kEnable;
+  command.v_R = mjmech::base::Point3D(120.0, -30.5, 0.0);
+  command.w_R = mjmech::base::Point3D(0.0, 0.0, 0.25);
+  QuadrupedCommand::Walk walk;
+  walk.step_height = 1.5;
+  walk.maximize_flight = true;
+  command.walk = walk;
+
+  const auto encoded = EncodeQuadrupedWebCommand(command);
+  BOOST_TEST(encoded.size() == kQuadrupedWebCommandSize);
+  BOOST_TEST(encoded[0] == kQuadrupedWebCommandVelocity);
+  BOOST_TEST(encoded[1] == QuadrupedCommand::kWalk);
+  BOOST_TEST(encoded[2] == QuadrupedCommand::kEnable);
+  BOOST_TEST(encoded[3] == 0x02);
+  // 120.0f is 0x42f00000, little endian.
+  BOOST_TEST(encoded.substr(4, 4) == std::string("\x00\x00\xf0\x42", 4));
+
+  const auto decoded = DecodeQuadrupedWebCommand(encoded);
+  BOOST_TEST_REQUIRE(!!decoded);
+  BOOST_TEST(decoded->mode == QuadrupedCommand::kWalk);
+  BOOST_TEST(decoded->log == QuadrupedCommand::kEnable);
+  BOOST_TEST(decoded->v_R.x() == 120.0);
+  BOOST_TEST(decoded->v_R.y() == -30.5);
+  BOOST_TEST(decoded->w_R.z() == 0.25);
+  BOOST_TEST_REQUIRE(!!decoded->walk);
+  BOOST_TEST(decoded->walk->step_height == 1.5);
+  BOOST_TEST(decoded->walk->maximize_flight == true);
+  BOOST_TEST(!decoded->jump);
+}
+
+BOOST_AUTO_TEST_CASE(QuadrupedWebCommandJumpTest) {
+  QuadrupedCommand command;
+  command.mode = QuadrupedCommand::kJump;
+  QuadrupedCommand::Jump jump;
+  jump.acceleration = 2000.0;
+  jump.repeat = true;
+  command.jump = jump;
+
+  const auto decoded =
+      DecodeQuadrupedWebCommand(EncodeQuadrupedWebCommand(command));
+  BOOST_TEST_REQUIRE(!!decoded);
+  BOOST_TEST(decoded->mode == QuadrupedCommand::kJump);
+  BOOST_TEST(decoded->log == QuadrupedCommand::kUnset);
+  BOOST_TEST_REQUIRE(!!decoded->jump);
+  BOOST_TEST(decoded->jump->acceleration == 2000.0);
+  BOOST_TEST(decoded->jump->repeat == true);
+  BOOST_TEST(!decoded->walk);
+}
+
+BOOST_AUTO_TEST_CASE(QuadrupedWebCommandInvalidTest) {
+  QuadrupedCommand command;
+  command.mode = QuadrupedCommand::kRest;
+  const auto good = EncodeQuadrupedWebCommand(command);
+  BOOST_TEST(!!DecodeQuadrupedWebCommand(good));
+
+  BOOST_TEST(!DecodeQuadrupedWebCommand(""));
+  BOOST_TEST(!DecodeQuadrupedWebCommand(std::string(1, '\0')));
+  BOOST_TEST(!DecodeQuadrupedWebCommand(good.substr(0, 35)));
+  BOOST_TEST(!DecodeQuadrupedWebCommand(good + "x"));
+
+  auto bad_kind = good;
+  bad_kind[0] = 7;
+  BOOST_TEST(!DecodeQuadrupedWebCommand(bad_kind));
+
+  auto bad_mode = good;
+  bad_mode[1] = QuadrupedCommand::kNumModes;
+  BOOST_TEST(!DecodeQuadrupedWebCommand(bad_mode));
+
+  auto bad_log = good;
+  bad_log[2] = 3;
+  BOOST_TEST(!DecodeQuadrupedWebCommand(bad_log));
+}
@@ -0,0 +1,135 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/rf_link_quality.h"
+
+#include <cmath>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjmech::mech;
+namespace pt = boost::posix_time;
+
+namespace {
+const pt::ptime kStart = pt::time_from_string("2020-01-01 00:00:00");
+
+pt::ptime At(double seconds) {
+  return kStart + pt::microseconds(static_cast<int64_t>(std::round(seconds * 1e6)));
+}
+
+using State = RfLinkQuality::State;
+}
+
+BOOST_AUTO_TEST_CASE(RfLinkQualityGoodTest) {
+  RfLinkQuality dut;
+  BOOST_TEST((dut.Update(At(0.0)).state == State::kNone));
+
+  for (int i = 0; i < 100; i++) {
+    dut.Receive(At(i * 0.02), (i % 2) ? 0x0003 : 0x0001);
+  }
+  const auto& status = dut.Update(At(99 * 0.02 + 0.005));
+  BOOST_TEST((status.state == State::kGood));
+  BOOST_TEST(status.rx_count == 50);
+  BOOST_TEST(status.loss == 0.0);
+  BOOST_TEST(status.max_gap_s == 0.02, boost::test_tools::tolerance(1e-6));
+  BOOST_TEST(status.slot_age_s[0] == 0.005, boost::test_tools::tolerance(1e-6));
+  BOOST_TEST(status.slot_age_s[1] == 0.005, boost::test_tools::tolerance(1e-6));
+  BOOST_TEST(status.slot_age_s[2] == -1.0);
+}
+
+BOOST_AUTO_TEST_CASE(RfLinkQualityLossTest) {
+  RfLinkQuality dut;
+
+  // Only one in every three frames arrives.
+  for (int i = 0; i < 150; i += 3) {
+    dut.Receive(At(i * 0.02), 0x0001);
+  }
+  const auto& status = dut.Update(At(149 * 0.02));
+  BOOST_TEST((status.state == State::kDegraded));
+  BOOST_TEST(status.loss == 2.0 / 3.0, boost::test_tools::tolerance(0.05));
+  BOOST_TEST(status.max_gap_s == 0.06, boost::test_tools::tolerance(1e-6));
+
+  // Then nothing at all.
+  BOOST_TEST((dut.Update(At(149 * 0.02 + 0.6)).state == State::kLost));
+  BOOST_TEST(dut.status().rx_count == 7);
+  BOOST_TEST(dut.status().loss > 0.8);
+  BOOST_TEST(dut.status().age_s == 0.64, boost::test_tools::tolerance(1e-6));
+
+  BOOST_TEST((dut.Update(At(10.0)).state == State::kLost));
+  BOOST_TEST(dut.status().rx_count == 0);
+  BOOST_TEST(dut.status().loss == 1.0);
+}
+
+BOOST_AUTO_TEST_CASE(RfSlotSchedulerThinTest) {
+  BOOST_TEST(RfSlotScheduler::Thin(0xffffffff, 1) == 0xffffffffu);
+  BOOST_TEST(RfSlotScheduler::Thin(0xffffffff, 2) == 0x55555555u);
+  BOOST_TEST(RfSlotScheduler::Thin(0x55555555, 2) == 0x11111111u);
+  BOOST_TEST(RfSlotScheduler::Thin(0x55555555, 4) == 0x01010101u);
+  BOOST_TEST(RfSlotScheduler::Thin(0x01000000, 4) == 0x01000000u);
+  BOOST_TEST(RfSlotScheduler::Thin(0, 4) == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(RfSlotSchedulerTest) {
+  RfSlotScheduler dut;
+
+  RfClient::Slot fault;
+  fault.priority = 0x01010101;
+
+  // A critical slot is boosted when first sent, and again when it
+  // changes, but not otherwise.
+  BOOST_TEST(dut.Schedule(At(0.0), State::kGood, 14,
+                          RfSlotClass::kCritical, fault).priority ==
+             0xffffffffu);
+  BOOST_TEST(dut.status().boosted == 0x4000);
+  BOOST_TEST(dut.Schedule(At(0.5), State::kGood, 14,
+                          RfSlotClass::kCritical, fault).priority ==
+             0x01010101u);
+  BOOST_TEST(dut.status().boosted == 0);
+
+  fault.size = 2;
+  fault.data[0] = 'e';
+  fault.data[1] = 'x';
+  BOOST_TEST(dut.Schedule(At(0.6), State::kGood, 14,
+                          RfSlotClass::kCritical, fault).priority ==
+             0xffffffffu);
+  BOOST_TEST(dut.Schedule(At(0.9), State::kGood, 14,
+                          RfSlotClass::kCritical, fault).priority ==
+             0x01010101u);
+
+  // And always on a poor link.
+  BOOST_TEST(dut.Schedule(At(1.0), State::kDegraded, 14,
+                          RfSlotClass::kCritical, fault).priority ==
+             0xffffffffu);
+
+  RfClient::Slot summary;
+  summary.priority = 0x55555555;
+  BOOST_TEST(dut.Schedule(At(1.0), State::kGood, 8,
+                          RfSlotClass::kLow, summary).priority ==
+             0x55555555u);
+  BOOST_TEST(dut.Schedule(At(1.0), State::kDegraded, 8,
+                          RfSlotClass::kLow, summary).priority ==
+             0x11111111u);
+  BOOST_TEST(dut.status().throttled == 0x0100);
+  BOOST_TEST(dut.Schedule(At(1.0), State::kLost, 8,
+                          RfSlotClass::kLow, summary).priority ==
+             0x01010101u);
+  BOOST_TEST(dut.status().priority[8] == 0x01010101u);
+
+  RfClient::Slot motion;
+  motion.priority = 0xffffffff;
+  BOOST_TEST(dut.Schedule(At(1.0), State::kLost, 1,
+                          RfSlotClass::kNormal, motion).priority ==
+             0xffffffffu);
+}
@@ -0,0 +1,152 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/rf_slot_protocol.h"
+
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjmech::mech;
+
+namespace {
+enum class Color {
+  kRed = 0,
+  kGreen = 5,
+};
+
+struct Sample {
+  bool flag = false;
+  Color color = Color::kRed;
+  double angle = 0.0;
+  int16_t counter = 0;
+  double level = 0.0;
+
+  static constexpr auto kSchema = MakeRfSlotSchema(
+      RfSlotField::Flag("flag"),
+      RfSlotField::Integer("color", 3),
+      RfSlotField::Signed("angle", 10, 180.0),
+      RfSlotField::Integer("counter", 16, true),
+      RfSlotField::Unsigned("level", 6, 63.0));
+
+  template <typename Self>
+  static constexpr auto Fields(Self& self) {
+    return std::tie(self.flag, self.color, self.angle,
+                    self.counter, self.level);
+  }
+};
+
+static_assert(Sample::kSchema.bits() == 36);
+static_assert(Sample::kSchema.size() == 5);
+static_assert(Sample::kSchema.bit_offset(3) == 14);
+}
+
+BOOST_AUTO_TEST_CASE(RfSlotSchemaRoundTripTest) {
+  Sample sample;
+  sample.flag = true;
+  sample.color = Color::kGreen;
+  sample.angle = -90.0;
+  sample.counter = -1234;
+  sample.level = 17.0;
+
+  const auto bytes = EncodeRfSlot(sample);
+  BOOST_TEST(bytes.size == 5);
+  // flag and color share the first bits.
+  BOOST_TEST((bytes.data[0] & 0x0f) == (1 | (5 << 1)));
+
+  const auto result = DecodeRfSlot<Sample>(bytes);
+  BOOST_TEST(result.flag == true);
+  BOOST_TEST((result.color == Color::kGreen));
+  BOOST_TEST(std::abs(result.angle - -90.0) <
+             Sample::kSchema.fields[2].scale / 2);
+  BOOST_TEST(result.counter == -1234);
+  BOOST_TEST(result.level == 17.0);
+}
+
+BOOST_AUTO_TEST_CASE(RfSlotSchemaSaturateTest) {
+  Sample sample;
+  sample.angle = 1000.0;
+  sample.level = -5.0;
+  auto result = DecodeRfSlot<Sample>(EncodeRfSlot(sample));
+  BOOST_TEST(result.angle == 180.0);
+  BOOST_TEST(result.level == 0.0);
+
+  sample.angle = -1000.0;
+  sample.level = 1000.0;
+  result = DecodeRfSlot<Sample>(EncodeRfSlot(sample));
+  BOOST_TEST(result.angle == -180.0);
+  BOOST_TEST(result.level == 63.0);
+
+  sample.angle = std::numeric_limits<double>::quiet_NaN();
+  result = DecodeRfSlot<Sample>(EncodeRfSlot(sample));
+  BOOST_TEST(result.angle == 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(RfSlotSchemaShortSlotTest) {
+  Sample sample;
+  sample.flag = true;
+  sample.counter = 100;
+  sample.level = 9.0;
+  const auto bytes = EncodeRfSlot(sample);
+
+  // Anything past the received bytes reads as zero.
+  const auto result = DecodeRfSlot<Sample>(bytes.data.data(), 1);
+  BOOST_TEST(result.flag == true);
+  BOOST_TEST(result.counter == 0);
+  BOOST_TEST(result.level == 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(RfSlotProtocolTest) {
+  // The quadruped movement is echoed back in telemetry, so zero must
+  // be exact and the resolution fine enough to be useful.
+  RfQuadrupedMovement movement;
+  movement.v_x_mm_s = 0.0;
+  movement.v_y_mm_s = -150.0;
+  movement.w_z_rad_s = 0.5;
+  const auto slot = MakeRfSlot(movement, 0x1234);
+  BOOST_TEST(slot.priority == 0x1234);
+  BOOST_TEST(slot.size == 5);
+
+  const auto result = ReadRfSlot<RfQuadrupedMovement>(slot);
+  BOOST_TEST(result.v_x_mm_s == 0.0);
+  BOOST_TEST(result.v_y_mm_s == -150.0);
+  BOOST_TEST(std::abs(result.w_z_rad_s - 0.5) < 0.002);
+
+  RfServoSummary summary;
+  summary.min_voltage = 18.25;
+  summary.max_voltage = 22.0;
+  summary.min_temp_C = -5.0;
+  summary.max_temp_C = 61.0;
+  summary.fault = 33;
+  const auto summary_result =
+      DecodeRfSlot<RfServoSummary>(EncodeRfSlot(summary));
+  BOOST_TEST(summary_result.min_voltage == 18.25);
+  BOOST_TEST(summary_result.max_voltage == 22.0);
+  BOOST_TEST(summary_result.min_temp_C == -5.0);
+  BOOST_TEST(summary_result.max_temp_C == 61.0);
+  BOOST_TEST(summary_result.fault == 33);
+
+  // Every slot is smaller than the hand packed one it replaced.
+  BOOST_TEST(RfQuadrupedCommand::kSchema.size() == 3);
+  BOOST_TEST(RfQuadrupedPose::kSchema.size() == 11);
+  BOOST_TEST(RfTurretRate::kSchema.size() == 4);
+  BOOST_TEST(RfTurretImu::kSchema.size() == 6);
+  BOOST_TEST(RfTurretServo::kSchema.size() == 3);
+  BOOST_TEST(RfTurretWeapon::kSchema.size() == 3);
+}
+
+BOOST_AUTO_TEST_CASE(RfSlotSchemaDescribeTest) {
+  const auto text = RfServoSummary::kSchema.Describe();
+  BOOST_TEST(text.find("40 bits in 5 bytes, 33% of slot") == 0);
+  BOOST_TEST(text.find("min_voltage") != std::string::npos);
+  BOOST_TEST(text.find("resolution 0.25") != std::string::npos);
+}
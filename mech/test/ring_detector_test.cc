@@ -0,0 +1,162 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "mech/ring_detector.h"
+
+#include <boost/test/auto_unit_test.hpp>
+
+using mjmech::mech::RingDetector;
+using Color = RingDetector::Color;
+
+namespace {
+constexpr int kWidth = 640;
+constexpr int kHeight = 480;
+
+cv::Mat MakeImage(int channels, uint8_t value = 200) {
+  cv::Mat result(kHeight, kWidth, channels == 3 ? CV_8UC3 : CV_8UC1);
+  for (int y = 0; y < kHeight; y++) {
+    std::fill(result.ptr(y), result.ptr(y) + kWidth * channels, value);
+  }
+  return result;
+}
+
+/// Paste a target of @p size with its top left corner at @p x, @p y,
+/// and return where its center should be found.  Dark pixels are
+/// drawn in @p bgr if the image is color.
+Eigen::Vector2d Paste(cv::Mat* image, int size, int x, int y,
+                      std::array<uint8_t, 3> bgr = {0, 0, 0}) {
+  const cv::Mat target = RingDetector::MakeTarget(size);
+  const int channels = image->channels();
+  for (int j = 0; j < target.rows; j++) {
+    const uint8_t* src = target.ptr(j);
+    uint8_t* dst = image->ptr(y + j) + x * channels;
+    for (int i = 0; i < target.cols; i++) {
+      const int value = src[i];
+      for (int c = 0; c < channels; c++) {
+        const int ink = channels == 3 ? bgr[c] : 0;
+        dst[i * channels + c] = static_cast<uint8_t>(
+            ink + (255 - ink) * value / 255);
+      }
+    }
+  }
+  return Eigen::Vector2d(x + 0.5 * target.cols - 0.5,
+                         y + 0.5 * target.rows - 0.5);
+}
+
+const cv::Rect kFull(0, 0, kWidth, kHeight);
+}
+
+BOOST_AUTO_TEST_CASE(RingDetectorSizeTest) {
+  RingDetector dut;
+  std::vector<RingDetector::Target> targets;
+
+  for (int size : { 16, 24, 41, 80, 150 }) {
+    BOOST_TEST_CONTEXT("size " << size) {
+      auto image = MakeImage(1);
+      const auto expected = Paste(&image, size, 203, 117);
+
+      dut.Detect(image, kFull, &targets);
+      BOOST_TEST_REQUIRE(targets.size() == 1);
+      BOOST_TEST((targets[0].center - expected).norm() < 0.3);
+      BOOST_TEST(targets[0].size == size, boost::test_tools::tolerance(0.1));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(RingDetectorMultipleTest) {
+  auto image = MakeImage(1);
+  const auto first = Paste(&image, 60, 50, 60);
+  const auto second = Paste(&image, 30, 400, 300);
+
+  RingDetector dut;
+  std::vector<RingDetector::Target> targets;
+  dut.Detect(image, kFull, &targets);
+  BOOST_TEST_REQUIRE(targets.size() == 2);
+  std::sort(targets.begin(), targets.end(), [](auto& a, auto& b) {
+      return a.center.x() < b.center.x();
+    });
+  BOOST_TEST((targets[0].center - first).norm() < 0.3);
+  BOOST_TEST((targets[1].center - second).norm() < 0.3);
+}
+
+BOOST_AUTO_TEST_CASE(RingDetectorRejectTest) {
+  auto image = MakeImage(1);
+  // A solid square and a bar have no light center.
+  for (int y = 100; y < 160; y++) {
+    std::fill(image.ptr(y) + 100, image.ptr(y) + 160, 0);
+    std::fill(image.ptr(y) + 300, image.ptr(y) + 310, 0);
+    std::fill(image.ptr(y) + 330, image.ptr(y) + 340, 0);
+  }
+
+  RingDetector dut;
+  std::vector<RingDetector::Target> targets;
+  dut.Detect(image, kFull, &targets);
+  BOOST_TEST(targets.empty());
+
+  // Nor does a blank image have anything.
+  dut.Detect(MakeImage(1), kFull, &targets);
+  BOOST_TEST(targets.empty());
+}
+
+BOOST_AUTO_TEST_CASE(RingDetectorRoiTest) {
+  auto image = MakeImage(1);
+  const auto expected = Paste(&image, 40, 400, 200);
+
+  RingDetector dut;
+  std::vector<RingDetector::Target> targets;
+
+  dut.Detect(image, cv::Rect(0, 0, 320, 480), &targets);
+  BOOST_TEST(targets.empty());
+
+  // Results are relative to the whole image, even with an odd
+  // offset.
+  dut.Detect(image, cv::Rect(371, 181, 101, 91), &targets);
+  BOOST_TEST_REQUIRE(targets.size() == 1);
+  BOOST_TEST((targets[0].center - expected).norm() < 0.3);
+}
+
+BOOST_AUTO_TEST_CASE(RingDetectorColorTest) {
+  auto image = MakeImage(3, 220);
+  const auto red = Paste(&image, 40, 100, 100, {30, 30, 230});
+  Paste(&image, 40, 400, 100, {0, 0, 0});
+
+  {
+    RingDetector::Options options;
+    options.color = Color::kRed;
+    RingDetector dut(options);
+    std::vector<RingDetector::Target> targets;
+    dut.Detect(image, kFull, &targets);
+    BOOST_TEST_REQUIRE(targets.size() == 1);
+    BOOST_TEST((targets[0].center - red).norm() < 0.3);
+  }
+
+  {
+    RingDetector::Options options;
+    options.color = Color::kBlue;
+    RingDetector dut(options);
+    std::vector<RingDetector::Target> targets;
+    dut.Detect(image, kFull, &targets);
+    BOOST_TEST(targets.empty());
+  }
+
+  {
+    // By intensity, the black ring is found, and the red one may be
+    // too.
+    RingDetector dut;
+    std::vector<RingDetector::Target> targets;
+    dut.Detect(image, kFull, &targets);
+    BOOST_TEST(targets.size() >= 1);
+  }
+}
@@ -0,0 +1,517 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/// @file
+///
+/// Run TargetTracker over an annotated corpus and report, for each
+/// engine, resolution and ArUco pyramid depth, and with and without
+/// the region of interest, the fraction of targets found, the false
+/// positives, and the time per frame.  With a pyramid, what was found
+/// and the time spent at each of its levels are reported too.  Exits
+/// non-zero if any configuration falls short of the thresholds, so
+/// that it can run as a test.
+///
+/// A corpus is a directory of images, or frames recorded by
+/// CameraDriver, along with a file "annotations.txt".  Each line of
+/// that names an image followed by the pixel centers of the markers
+/// in it, if any:
+///
+///   mjbots-camera20200314T152301.123456.png 640,360
+///   mjbots-camera20200314T152301.140000.png
+///
+/// Images which are not listed are skipped.  Without a corpus, a
+/// synthetic one with a moving target and sensor noise is used, drawn
+/// to suit each engine.
+///
+/// Then, for each engine and pyramid depth, targets of decreasing
+/// size are placed at random, to find the smallest, and so most
+/// distant, which can be reliably found.
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <sstream>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+
+#include <fmt/format.h>
+
+#include <opencv2/aruco.hpp>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "mjlib/base/clipp.h"
+#include "mjlib/base/clipp_archive.h"
+#include "mjlib/base/system_error.h"
+
+#include "mech/camera_replay.h"
+#include "mech/target_tracker.h"
+
+namespace fs = boost::filesystem;
+
+namespace {
+using mjmech::mech::CameraReplay;
+using mjmech::mech::RingDetector;
+using mjmech::mech::TargetTracker;
+using Engine = TargetTracker::Engine;
+
+struct Options {
+  std::string corpus;
+  /// The number of synthetic frames, when there is no corpus.
+  int frames = 300;
+  std::string engines = "aruco,ring";
+  std::string scales = "1.0,0.75,0.5";
+  /// Values of TargetTracker::Options::pyramid_levels to try with
+  /// ArUco.
+  std::string pyramids = "0,2";
+  /// A detection within this many pixels, at full resolution, of an
+  /// annotated center is a match.
+  double match_distance = 20.0;
+
+  double min_detection_rate = 0.9;
+  double max_false_positives = 0.02;
+  /// Zero to not check.
+  double max_ms_per_frame = 0.0;
+
+  /// Target sizes in pixels to try, largest first, and how many
+  /// frames of each.
+  std::string range_sizes = "160,120,80,60,40,30,24,20,16,12,10,8";
+  int range_frames = 10;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(corpus));
+    a->Visit(MJ_NVP(frames));
+    a->Visit(MJ_NVP(engines));
+    a->Visit(MJ_NVP(scales));
+    a->Visit(MJ_NVP(pyramids));
+    a->Visit(MJ_NVP(match_distance));
+    a->Visit(MJ_NVP(min_detection_rate));
+    a->Visit(MJ_NVP(max_false_positives));
+    a->Visit(MJ_NVP(max_ms_per_frame));
+    a->Visit(MJ_NVP(range_sizes));
+    a->Visit(MJ_NVP(range_frames));
+  }
+};
+
+struct Sample {
+  cv::Mat image;
+  std::vector<cv::Point2d> targets;
+};
+
+class Corpus {
+ public:
+  virtual ~Corpus() {}
+  virtual void Rewind() = 0;
+  /// @return false when there are no more samples.
+  virtual bool Next(Sample*) = 0;
+};
+
+class FileCorpus : public Corpus {
+ public:
+  FileCorpus(const std::string& directory)
+      : replay_(directory, 30.0) {
+    const auto path = fs::path(directory) / "annotations.txt";
+    std::ifstream inf(path.string());
+    if (!inf) {
+      throw mjlib::base::system_error::einval(
+          "Could not open: " + path.string());
+    }
+    std::string line;
+    while (std::getline(inf, line)) {
+      boost::trim(line);
+      if (line.empty() || line[0] == '#') { continue; }
+      std::istringstream istr(line);
+      std::string name;
+      istr >> name;
+      auto& targets = annotations_[name];
+      std::string center;
+      while (istr >> center) {
+        cv::Point2d point;
+        char comma = 0;
+        std::istringstream cstr(center);
+        if (!(cstr >> point.x >> comma >> point.y) || comma != ',') {
+          throw mjlib::base::system_error::einval(
+              "Malformed center '" + center + "' for " + name);
+        }
+        targets.push_back(point);
+      }
+    }
+  }
+
+  void Rewind() override { replay_.Rewind(); }
+
+  bool Next(Sample* sample) override {
+    double time_s = 0.0;
+    while (replay_.Read(&sample->image, &time_s)) {
+      const auto it = annotations_.find(
+          fs::path(replay_.name()).filename().string());
+      if (it == annotations_.end()) { continue; }
+      sample->targets = it->second;
+      return true;
+    }
+    return false;
+  }
+
+ private:
+  CameraReplay replay_;
+  std::map<std::string, std::vector<cv::Point2d>> annotations_;
+};
+
+constexpr int kWidth = 1280;
+constexpr int kHeight = 720;
+constexpr uint64_t kSeed = 1234;
+
+/// A target of the kind @p engine looks for, @p size pixels across.
+cv::Mat MakeTarget(Engine engine, int size) {
+  if (engine == Engine::kRing) { return RingDetector::MakeTarget(size); }
+
+  cv::Mat result;
+  cv::aruco::drawMarker(
+      cv::aruco::getPredefinedDictionary(cv::aruco::DICT_4X4_50),
+      3, size, result, 1);
+  return result;
+}
+
+/// Fill @p sample with a blank frame containing @p target with its
+/// top left corner at @p x, @p y, or no target if @p x is negative,
+/// then add noise.
+void Render(const cv::Mat& target, int x, int y, cv::RNG* rng,
+            Sample* sample) {
+  sample->image.create(kHeight, kWidth, CV_8UC1);
+  sample->image.setTo(cv::Scalar(200));
+  sample->targets.clear();
+
+  if (x >= 0) {
+    cv::Mat destination =
+        sample->image(cv::Rect(x, y, target.cols, target.rows));
+    target.copyTo(destination);
+    sample->targets.push_back(
+        {x + 0.5 * target.cols, y + 0.5 * target.rows});
+  }
+
+  cv::Mat noise(kHeight, kWidth, CV_16SC1);
+  rng->fill(noise, cv::RNG::NORMAL, 0, 8);
+  cv::Mat image16;
+  sample->image.convertTo(image16, CV_16SC1);
+  image16 += noise;
+  image16.convertTo(sample->image, CV_8UC1);
+}
+
+/// A target which wanders around the frame, disappearing now and
+/// then.
+class SyntheticCorpus : public Corpus {
+ public:
+  SyntheticCorpus(Engine engine, int frames)
+      : frames_(frames),
+        target_(MakeTarget(engine, kTargetSize)) {}
+
+  void Rewind() override {
+    index_ = 0;
+    rng_ = cv::RNG(kSeed);
+  }
+
+  bool Next(Sample* sample) override {
+    if (index_ >= frames_) { return false; }
+    const int i = index_++;
+
+    // Gone for 10 frames out of every 60.
+    if (i % 60 >= 50) {
+      Render(target_, -1, -1, &rng_, sample);
+      return true;
+    }
+
+    const double t = i / 30.0;
+    const int x = static_cast<int>(
+        (kWidth - target_.cols) * (0.5 + 0.45 * std::sin(0.7 * t)));
+    const int y = static_cast<int>(
+        (kHeight - target_.rows) * (0.5 + 0.45 * std::sin(1.1 * t)));
+    Render(target_, x, y, &rng_, sample);
+    return true;
+  }
+
+ private:
+  static constexpr int kTargetSize = 100;
+
+  const int frames_;
+  const cv::Mat target_;
+  int index_ = 0;
+  cv::RNG rng_{kSeed};
+};
+
+/// Targets of one size, each frame somewhere new.
+class RangeCorpus : public Corpus {
+ public:
+  RangeCorpus(Engine engine, int size, int frames)
+      : frames_(frames),
+        target_(MakeTarget(engine, size)) {}
+
+  void Rewind() override {
+    index_ = 0;
+    rng_ = cv::RNG(kSeed);
+  }
+
+  bool Next(Sample* sample) override {
+    if (index_ >= frames_) { return false; }
+    index_++;
+
+    const int x = rng_.uniform(0, kWidth - target_.cols);
+    const int y = rng_.uniform(0, kHeight - target_.rows);
+    Render(target_, x, y, &rng_, sample);
+    return true;
+  }
+
+ private:
+  const int frames_;
+  const cv::Mat target_;
+  int index_ = 0;
+  cv::RNG rng_{kSeed};
+};
+
+struct Config {
+  Engine engine = Engine::kAruco;
+  double scale = 1.0;
+  bool roi = false;
+  int pyramid = 0;
+};
+
+struct LevelScore {
+  /// Frames in which this level was searched at all.
+  int frames = 0;
+  double area = 0.0;
+  int markers = 0;
+  double ms = 0.0;
+};
+
+struct Score {
+  int frames = 0;
+  int targets = 0;
+  int found = 0;
+  int false_positives = 0;
+  std::vector<double> ms;
+  std::map<int, LevelScore> levels;
+
+  double detection_rate() const {
+    return targets ? static_cast<double>(found) / targets : 1.0;
+  }
+
+  double false_positives_per_frame() const {
+    return frames ? static_cast<double>(false_positives) / frames : 0.0;
+  }
+
+  double mean_ms() const {
+    if (ms.empty()) { return 0.0; }
+    double total = 0.0;
+    for (double value : ms) { total += value; }
+    return total / ms.size();
+  }
+
+  double percentile_ms(double fraction) const {
+    if (ms.empty()) { return 0.0; }
+    auto sorted = ms;
+    std::sort(sorted.begin(), sorted.end());
+    return sorted[std::min<std::size_t>(
+        sorted.size() - 1, static_cast<std::size_t>(fraction * sorted.size()))];
+  }
+};
+
+Score Run(Corpus* corpus, const Config& config, double match_distance) {
+  const double scale = config.scale;
+  TargetTracker::Options tracker_options;
+  tracker_options.engine = config.engine;
+  tracker_options.roi_enable = config.roi;
+  tracker_options.pyramid_levels = config.pyramid;
+  // Keep the region the same size relative to the image.
+  tracker_options.roi_min_size =
+      static_cast<int>(tracker_options.roi_min_size * scale);
+  TargetTracker tracker(tracker_options);
+
+  Score result;
+  Sample sample;
+  cv::Mat scaled;
+
+  corpus->Rewind();
+  while (corpus->Next(&sample)) {
+    const cv::Mat* image = &sample.image;
+    if (scale != 1.0) {
+      cv::resize(sample.image, scaled, cv::Size(), scale, scale,
+                 cv::INTER_AREA);
+      image = &scaled;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto tracked = tracker.Track(*image);
+    const auto end = std::chrono::steady_clock::now();
+    result.ms.push_back(
+        std::chrono::duration<double, std::milli>(end - start).count());
+
+    result.frames++;
+    result.targets += sample.targets.size();
+    for (const auto& level : tracked.levels) {
+      auto& level_score = result.levels[level.level];
+      level_score.frames++;
+      level_score.area += level.area;
+      level_score.markers += level.markers;
+      level_score.ms += 1e3 * level.detect_s;
+    }
+
+    // Each annotation may be matched by at most one detection.
+    std::vector<bool> matched(sample.targets.size(), false);
+    for (const auto& target : tracked.targets) {
+      const cv::Point2d found(target.x() * sample.image.cols,
+                              target.y() * sample.image.rows);
+      bool match = false;
+      for (std::size_t i = 0; i < sample.targets.size(); i++) {
+        if (matched[i]) { continue; }
+        if (cv::norm(found - sample.targets[i]) <= match_distance) {
+          matched[i] = true;
+          match = true;
+          break;
+        }
+      }
+      if (match) {
+        result.found++;
+      } else {
+        result.false_positives++;
+      }
+    }
+  }
+
+  return result;
+}
+
+std::vector<std::string> SplitList(const std::string& list) {
+  std::vector<std::string> result;
+  boost::split(result, list, boost::is_any_of(","));
+  return result;
+}
+
+/// The pyramid only applies to ArUco.
+std::vector<int> Pyramids(Engine engine, const std::string& list) {
+  if (engine != Engine::kAruco) { return {0}; }
+  std::vector<int> result;
+  for (const auto& item : SplitList(list)) {
+    result.push_back(std::stoi(item));
+  }
+  return result;
+}
+
+void PrintLevels(const Score& score) {
+  // Coarsest first, as they are searched.
+  for (auto it = score.levels.rbegin(); it != score.levels.rend(); ++it) {
+    const auto& level = it->second;
+    fmt::print("        level {}: searched {:5.1f}% of frames, "
+               "{:5.1f}% of area, found {:4d}, {:6.2f} ms/frame\n",
+               it->first, 100.0 * level.frames / score.frames,
+               level.frames ? 100.0 * level.area / level.frames : 0.0,
+               level.markers, level.ms / score.frames);
+  }
+}
+
+Engine ParseEngine(const std::string& name) {
+  for (const auto& pair : mjlib::base::IsEnum<Engine>::map()) {
+    if (name == pair.second) { return pair.first; }
+  }
+  throw mjlib::base::system_error::einval("Unknown engine: " + name);
+}
+}
+
+extern "C" int main(int argc, char** argv) {
+  Options options;
+
+  auto group = mjlib::base::ClippArchive().Accept(&options).group();
+  mjlib::base::ClippParse(argc, argv, group);
+
+  fmt::print("{:>6} {:>5} {:>3} {:>4} {:>6} {:>8} {:>6} {:>8} {:>8}\n",
+             "engine", "scale", "pyr", "roi", "frames", "detected", "fp/fr",
+             "ms/frame", "p95 ms");
+
+  bool pass = true;
+  for (const auto& engine_name : SplitList(options.engines)) {
+    const auto engine = ParseEngine(engine_name);
+    const auto pyramids = Pyramids(engine, options.pyramids);
+
+    std::unique_ptr<Corpus> corpus;
+    if (options.corpus.empty()) {
+      corpus = std::make_unique<SyntheticCorpus>(engine, options.frames);
+    } else {
+      corpus = std::make_unique<FileCorpus>(options.corpus);
+    }
+
+    for (const auto& scale_str : SplitList(options.scales)) {
+      for (int pyramid : pyramids) {
+        for (bool roi : { false, true }) {
+          Config config;
+          config.engine = engine;
+          config.scale = std::stod(scale_str);
+          config.roi = roi;
+          config.pyramid = pyramid;
+
+          const auto score = Run(corpus.get(), config, options.match_distance);
+          const bool ok =
+              score.detection_rate() >= options.min_detection_rate &&
+              score.false_positives_per_frame() <=
+              options.max_false_positives &&
+              (options.max_ms_per_frame <= 0.0 ||
+               score.mean_ms() <= options.max_ms_per_frame);
+          pass = pass && ok;
+
+          fmt::print(
+              "{:>6} {:5.2f} {:3d} {:>4} {:6d} {:7.1f}% {:6.3f} "
+              "{:8.2f} {:8.2f}{}\n",
+              engine_name, config.scale, pyramid, roi ? "on" : "off",
+              score.frames, 100.0 * score.detection_rate(),
+              score.false_positives_per_frame(),
+              score.mean_ms(), score.percentile_ms(0.95),
+              ok ? "" : "  FAIL");
+          if (pyramid > 0) { PrintLevels(score); }
+        }
+      }
+    }
+  }
+
+  if (options.range_frames > 0) {
+    fmt::print("\n{:>6} {:>3} {:>5} {:>8} {:>6} {:>8}\n",
+               "engine", "pyr", "size", "detected", "fp/fr", "ms/frame");
+    for (const auto& engine_name : SplitList(options.engines)) {
+      const auto engine = ParseEngine(engine_name);
+      for (int pyramid : Pyramids(engine, options.pyramids)) {
+        Config config;
+        config.engine = engine;
+        config.pyramid = pyramid;
+
+        int smallest = 0;
+        for (const auto& size_str : SplitList(options.range_sizes)) {
+          const int size = std::stoi(size_str);
+          RangeCorpus corpus(engine, size, options.range_frames);
+          const auto score = Run(&corpus, config, std::max(2.0, 0.5 * size));
+          fmt::print("{:>6} {:3d} {:5d} {:7.1f}% {:6.3f} {:8.2f}\n",
+                     engine_name, pyramid, size,
+                     100.0 * score.detection_rate(),
+                     score.false_positives_per_frame(), score.mean_ms());
+          if (score.detection_rate() < options.min_detection_rate) { break; }
+          smallest = size;
+        }
+        fmt::print("{:>6} {:3d} smallest reliable target: {} px\n",
+                   engine_name, pyramid, smallest);
+      }
+    }
+  }
+
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,224 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/target_tracker.h"
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include <opencv2/aruco.hpp>
+
+using namespace mjmech::mech;
+using Mode = TargetTracker::Mode;
+
+namespace {
+constexpr int kMarkerSize = 100;
+
+/// A 1280x720 frame, with a marker whose top left corner is at @p x,
+/// @p y, or no marker if @p x is negative.
+cv::Mat MakeFrame(int x, int y, int size = kMarkerSize) {
+  cv::Mat result(720, 1280, CV_8UC1, cv::Scalar(255));
+  if (x < 0) { return result; }
+
+  cv::Mat marker;
+  cv::aruco::drawMarker(
+      cv::aruco::getPredefinedDictionary(cv::aruco::DICT_4X4_50),
+      3, size, marker, 1);
+  cv::Mat destination = result(cv::Rect(x, y, size, size));
+  marker.copyTo(destination);
+  return result;
+}
+
+void CheckTarget(const TargetTracker::Result& result, int x, int y,
+                 int size = kMarkerSize) {
+  BOOST_TEST_REQUIRE(result.targets.size() == 1);
+  const auto tolerance = boost::test_tools::tolerance(2.0);
+  BOOST_TEST(result.targets[0].x() * 1280 == x + size / 2.0, tolerance);
+  BOOST_TEST(result.targets[0].y() * 720 == y + size / 2.0, tolerance);
+}
+}
+
+BOOST_AUTO_TEST_CASE(TargetTrackerRoiTest) {
+  TargetTracker::Options options;
+  options.max_misses = 3;
+  TargetTracker dut(options);
+
+  {
+    const auto result = dut.Track(MakeFrame(400, 300));
+    BOOST_TEST((result.mode == Mode::kFull));
+    BOOST_TEST(result.roi.width == 1280);
+    BOOST_TEST(result.misses == 0);
+    CheckTarget(result, 400, 300);
+  }
+
+  // Once found, only the area around the marker is searched, and
+  // it can move.
+  for (int x : { 420, 450, 480 }) {
+    const auto result = dut.Track(MakeFrame(x, 300));
+    BOOST_TEST((result.mode == Mode::kRoi));
+    BOOST_TEST(result.roi.width < 640);
+    BOOST_TEST(result.roi.x <= x);
+    BOOST_TEST(result.roi.x + result.roi.width >= x + kMarkerSize);
+    CheckTarget(result, x, 300);
+  }
+
+  // A marker outside the region is not seen until the tracker gives
+  // up and searches everywhere.
+  for (int i = 1; i <= 3; i++) {
+    const auto result = dut.Track(MakeFrame(1000, 500));
+    BOOST_TEST((result.mode == Mode::kRoi));
+    BOOST_TEST(result.targets.empty());
+    BOOST_TEST(result.misses == i);
+  }
+
+  {
+    const auto result = dut.Track(MakeFrame(1000, 500));
+    BOOST_TEST((result.mode == Mode::kFull));
+    BOOST_TEST(result.misses == 0);
+    CheckTarget(result, 1000, 500);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TargetTrackerRoiDisabledTest) {
+  TargetTracker::Options options;
+  options.roi_enable = false;
+  TargetTracker dut(options);
+
+  for (int i = 0; i < 3; i++) {
+    const auto result = dut.Track(MakeFrame(400, 300));
+    BOOST_TEST((result.mode == Mode::kFull));
+    CheckTarget(result, 400, 300);
+  }
+
+  const auto result = dut.Track(MakeFrame(-1, 0));
+  BOOST_TEST((result.mode == Mode::kFull));
+  BOOST_TEST(result.targets.empty());
+  BOOST_TEST(result.misses == 1);
+}
+
+BOOST_AUTO_TEST_CASE(TargetTrackerPyramidTest) {
+  TargetTracker::Options options;
+  options.roi_enable = false;
+  options.pyramid_levels = 2;
+  TargetTracker dut(options);
+
+  {
+    // A large marker is found at the coarsest level, and nothing
+    // else is searched.
+    const auto result = dut.Track(MakeFrame(300, 200, 240));
+    CheckTarget(result, 300, 200, 240);
+    BOOST_TEST_REQUIRE(result.levels.size() == 1);
+    BOOST_TEST(result.levels[0].level == 2);
+    BOOST_TEST(result.levels[0].markers == 1);
+  }
+
+  {
+    // A small one needs a finer level.
+    const auto result = dut.Track(MakeFrame(700, 400, 30));
+    CheckTarget(result, 700, 400, 30);
+    BOOST_TEST_REQUIRE(result.levels.size() >= 2);
+    BOOST_TEST(result.levels.front().level == 2);
+    BOOST_TEST(result.levels.front().markers == 0);
+    BOOST_TEST(result.levels.back().markers == 1);
+  }
+
+  {
+    // With nothing at all, every level is searched in full.
+    const auto result = dut.Track(MakeFrame(-1, 0));
+    BOOST_TEST(result.targets.empty());
+    BOOST_TEST_REQUIRE(result.levels.size() == 3);
+    for (const auto& level : result.levels) {
+      BOOST_TEST(level.area == 1.0);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TargetTrackerPyramidRoiTest) {
+  TargetTracker::Options options;
+  options.max_misses = 3;
+  options.pyramid_levels = 3;
+  // Make the predicted region as small as it can be.
+  options.roi_scale = 0.0;
+  options.roi_min_size = 1;
+  TargetTracker dut(options);
+
+  auto check_roi = [&](const TargetTracker::Result& result) {
+    // Every level of the pyramid needs at least one pixel.
+    BOOST_TEST(result.roi.width >= 8);
+    BOOST_TEST(result.roi.height >= 8);
+    BOOST_TEST(result.roi.x >= 0);
+    BOOST_TEST(result.roi.y >= 0);
+    BOOST_TEST(result.roi.x + result.roi.width <= 1280);
+    BOOST_TEST(result.roi.y + result.roi.height <= 720);
+  };
+
+  {
+    const auto result = dut.Track(MakeFrame(1100, 300));
+    BOOST_TEST((result.mode == Mode::kFull));
+    CheckTarget(result, 1100, 300);
+  }
+
+  // The marker runs off the right edge of the image.
+  {
+    const auto result = dut.Track(MakeFrame(1175, 300));
+    BOOST_TEST((result.mode == Mode::kRoi));
+    check_roi(result);
+  }
+
+  for (int i = 0; i < 2; i++) {
+    const auto result = dut.Track(MakeFrame(-1, 0));
+    BOOST_TEST((result.mode == Mode::kRoi));
+    check_roi(result);
+    BOOST_TEST(result.targets.empty());
+  }
+
+  const auto result = dut.Track(MakeFrame(-1, 0));
+  BOOST_TEST((result.mode == Mode::kFull));
+  BOOST_TEST(result.targets.empty());
+}
+
+BOOST_AUTO_TEST_CASE(TargetTrackerRingTest) {
+  TargetTracker::Options options;
+  options.engine = TargetTracker::Engine::kRing;
+  TargetTracker dut(options);
+
+  const cv::Mat target = RingDetector::MakeTarget(kMarkerSize);
+  auto make_frame = [&](int x, int y) {
+    cv::Mat result(720, 1280, CV_8UC1, cv::Scalar(255));
+    cv::Mat destination = result(cv::Rect(x, y, target.cols, target.rows));
+    target.copyTo(destination);
+    return result;
+  };
+  auto check = [&](const TargetTracker::Result& result, int x, int y) {
+    BOOST_TEST_REQUIRE(result.targets.size() == 1);
+    const auto tolerance = boost::test_tools::tolerance(0.5);
+    BOOST_TEST(result.targets[0].x() * 1280 == x + target.cols / 2.0 - 0.5,
+               tolerance);
+    BOOST_TEST(result.targets[0].y() * 720 == y + target.rows / 2.0 - 0.5,
+               tolerance);
+    BOOST_TEST_REQUIRE(result.sizes.size() == 1);
+    BOOST_TEST(result.sizes[0] * 1280 == kMarkerSize, tolerance);
+  };
+
+  {
+    const auto result = dut.Track(make_frame(400, 300));
+    BOOST_TEST((result.mode == Mode::kFull));
+    check(result, 400, 300);
+  }
+
+  for (int x : { 420, 450, 480 }) {
+    const auto result = dut.Track(make_frame(x, 300));
+    BOOST_TEST((result.mode == Mode::kRoi));
+    check(result, x, 300);
+  }
+}
@@ -0,0 +1,113 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// @file
+///
+/// Measure the cost of serializing one qc_status record with
+/// BinaryWriteArchive and with base::FusedBinaryWriter, and check that
+/// the two produce identical bytes.
+
+#include <chrono>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <fmt/format.h>
+
+#include "mjlib/base/fast_stream.h"
+#include "mjlib/telemetry/binary_write_archive.h"
+
+#include "base/fused_binary_writer.h"
+
+#include "mech/quadruped_control.h"
+
+namespace {
+constexpr int kIterations = 200000;
+
+using Status = mjmech::mech::QuadrupedControl::Status;
+
+Status MakeStatus() {
+  Status result;
+  result.timestamp = boost::posix_time::microsec_clock::universal_time();
+  result.mode = mjmech::mech::QuadrupedCommand::Mode::kWalk;
+  for (int i = 1; i <= 12; i++) {
+    mjmech::mech::QuadrupedState::Joint joint;
+    joint.id = i;
+    joint.angle_deg = 10.0 * i;
+    joint.velocity_dps = -3.0 * i;
+    joint.torque_Nm = 0.1 * i;
+    joint.temperature_C = 35.0;
+    joint.voltage = 22.0;
+    joint.mode = 10;
+    result.state.joints.push_back(joint);
+  }
+  for (int i = 0; i < 4; i++) {
+    mjmech::mech::QuadrupedState::Leg leg;
+    leg.leg = i;
+    leg.position = mjmech::base::Point3D(100.0 * i, 50.0, 200.0);
+    leg.stance = 1.0;
+    result.state.legs_B.push_back(leg);
+  }
+  result.poll.buses.resize(4);
+  return result;
+}
+
+template <typename Write>
+double Time(Write write) {
+  std::string buffer;
+  mjmech::base::detail::StringWriteStream stream(&buffer);
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; i++) {
+    buffer.clear();
+    write(stream);
+  }
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+      kIterations;
+}
+}
+
+extern "C" {
+int main(int argc, char** argv) {
+  const Status status = MakeStatus();
+
+  mjmech::base::FusedBinaryWriter<Status> writer;
+
+  mjlib::base::FastOStringStream reference;
+  mjlib::telemetry::BinaryWriteArchive(reference).Accept(&status);
+  mjlib::base::FastOStringStream fused;
+  writer.Write(fused, &status);
+
+  if (reference.str() != fused.str() || !writer.fused()) {
+    fmt::print("MISMATCH: archive {} bytes, fused {} bytes\n",
+               reference.str().size(), fused.str().size());
+    return 1;
+  }
+
+  const double archive_ns = Time([&](auto& stream) {
+      mjlib::telemetry::BinaryWriteArchive(stream).Accept(&status);
+    });
+  const double fused_ns = Time([&](auto& stream) {
+      writer.Write(stream, &status);
+    });
+
+  const auto& plan = mjmech::base::detail::GetPlan<Status>();
+  fmt::print("record      {:8d} bytes\n", reference.str().size());
+  fmt::print("plan        {:8d} ops, {} bytes fused\n",
+             plan.ops.size(), plan.fused_bytes());
+  fmt::print("archive     {:8.1f} ns/record\n", archive_ns);
+  fmt::print("fused       {:8.1f} ns/record\n", fused_ns);
+  fmt::print("ratio       {:8.1f}x\n", archive_ns / fused_ns);
+  return 0;
+}
+}
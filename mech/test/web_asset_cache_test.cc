@@ -0,0 +1,174 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/web_asset_cache.h"
+
+#include <zlib.h>
+
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+using mjmech::mech::WebAssetCache;
+
+namespace fs = boost::filesystem;
+
+namespace {
+class TempDirectory {
+ public:
+  TempDirectory()
+      : path_(fs::temp_directory_path() / fs::unique_path()) {
+    fs::create_directories(path_);
+  }
+
+  ~TempDirectory() {
+    fs::remove_all(path_);
+  }
+
+  std::string path() const { return path_.string(); }
+
+  void Write(const std::string& name, const std::string& data) {
+    const auto full = path_ / name;
+    fs::create_directories(full.parent_path());
+    std::ofstream(full.string(), std::ios::binary) << data;
+  }
+
+ private:
+  const fs::path path_;
+};
+
+std::string Gunzip(const std::string& data) {
+  z_stream stream = {};
+  BOOST_TEST_REQUIRE(inflateInit2(&stream, 15 + 16) == Z_OK);
+
+  std::string result(1 << 20, '\0');
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  stream.avail_in = data.size();
+  stream.next_out = reinterpret_cast<Bytef*>(&result[0]);
+  stream.avail_out = result.size();
+  BOOST_TEST(inflate(&stream, Z_FINISH) == Z_STREAM_END);
+  result.resize(stream.total_out);
+  inflateEnd(&stream);
+  return result;
+}
+
+std::string MakeScript() {
+  std::string result;
+  for (int i = 0; i < 200; i++) {
+    result += "function f" + std::to_string(i) + "() { return 1; }\n";
+  }
+  return result;
+}
+}
+
+BOOST_AUTO_TEST_CASE(WebAssetCacheBasicTest) {
+  TempDirectory dir;
+  const auto script = MakeScript();
+  dir.Write("index.html", "<html></html>");
+  dir.Write("js/app.js", script);
+  dir.Write("logo.png", std::string(2000, 'p'));
+
+  WebAssetCache dut({dir.path()});
+  BOOST_TEST(dut.size() == 3);
+  BOOST_TEST(dut.watch_directories().size() == 2);
+
+  // Paths are found however many separators they contain.
+  const auto app = dut.Find(dir.path() + "//js/app.js");
+  BOOST_TEST_REQUIRE(!!app);
+  BOOST_TEST(app->data == script);
+  BOOST_TEST(app->content_type == "application/javascript");
+  BOOST_TEST(app->gzip.size() < script.size() / 4);
+  BOOST_TEST(Gunzip(app->gzip) == script);
+  BOOST_TEST(app->etag.front() == '"');
+  BOOST_TEST(app->etag.back() == '"');
+
+  // Small files don't compress enough to be worth it, and images
+  // aren't tried at all.
+  const auto index = dut.Find(dir.path() + "/index.html");
+  BOOST_TEST_REQUIRE(!!index);
+  BOOST_TEST(index->gzip.empty());
+  const auto logo = dut.Find(dir.path() + "/logo.png");
+  BOOST_TEST_REQUIRE(!!logo);
+  BOOST_TEST(logo->gzip.empty());
+  BOOST_TEST(logo->etag != app->etag);
+
+  BOOST_TEST(!dut.Find(dir.path() + "/missing.html"));
+}
+
+BOOST_AUTO_TEST_CASE(WebAssetCacheRefreshTest) {
+  TempDirectory dir;
+  dir.Write("a.txt", "first");
+  dir.Write("b.txt", "bee");
+
+  WebAssetCache dut({dir.path()});
+  BOOST_TEST(dut.Refresh() == 0);
+
+  const auto before = dut.Find(dir.path() + "/a.txt");
+  BOOST_TEST_REQUIRE(!!before);
+
+  dir.Write("a.txt", "second version");
+  fs::remove(dir.path() + "/b.txt");
+  dir.Write("sub/c.txt", "new");
+
+  BOOST_TEST(dut.Refresh() == 3);
+  BOOST_TEST(dut.size() == 2);
+
+  const auto after = dut.Find(dir.path() + "/a.txt");
+  BOOST_TEST_REQUIRE(!!after);
+  BOOST_TEST(after->data == "second version");
+  BOOST_TEST(after->etag != before->etag);
+  // Readers holding the old version are unaffected.
+  BOOST_TEST(before->data == "first");
+
+  BOOST_TEST(!dut.Find(dir.path() + "/b.txt"));
+  BOOST_TEST(!!dut.Find(dir.path() + "/sub/c.txt"));
+  BOOST_TEST(dut.watch_directories().size() == 2);
+}
+
+BOOST_AUTO_TEST_CASE(WebAssetCacheMaxSizeTest) {
+  TempDirectory dir;
+  dir.Write("small.txt", std::string(100, 's'));
+  dir.Write("large.txt", std::string(1000, 'l'));
+
+  WebAssetCache dut({dir.path()}, 500);
+  BOOST_TEST(dut.size() == 1);
+  BOOST_TEST(!dut.Find(dir.path() + "/large.txt"));
+}
+
+BOOST_AUTO_TEST_CASE(AcceptsGzipTest) {
+  using mjmech::mech::AcceptsGzip;
+
+  BOOST_TEST(AcceptsGzip("gzip"));
+  BOOST_TEST(AcceptsGzip("gzip, deflate, br"));
+  BOOST_TEST(AcceptsGzip("deflate,GZIP"));
+  BOOST_TEST(AcceptsGzip("br;q=1.0, gzip;q=0.8, *;q=0.1"));
+  BOOST_TEST(AcceptsGzip("*"));
+  BOOST_TEST(!AcceptsGzip(""));
+  BOOST_TEST(!AcceptsGzip("deflate, br"));
+  BOOST_TEST(!AcceptsGzip("gzip;q=0"));
+  BOOST_TEST(!AcceptsGzip("gzip; q=0.000"));
+  BOOST_TEST(!AcceptsGzip("x-gzip2"));
+}
+
+BOOST_AUTO_TEST_CASE(EtagMatchesTest) {
+  using mjmech::mech::EtagMatches;
+
+  BOOST_TEST(EtagMatches("\"abc\"", "\"abc\""));
+  BOOST_TEST(EtagMatches("W/\"abc\"", "\"abc\""));
+  BOOST_TEST(EtagMatches("\"x\", \"abc\"", "\"abc\""));
+  BOOST_TEST(EtagMatches("*", "\"abc\""));
+  BOOST_TEST(!EtagMatches("\"abcd\"", "\"abc\""));
+  BOOST_TEST(!EtagMatches("", "\"abc\""));
+}
@@ -0,0 +1,165 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// @file
+///
+/// Compare the bytes and CPU time per message of the JSON and binary
+/// WebControl websocket protocols, for both a qc_status reply and a
+/// walk command.
+
+#include <chrono>
+#include <sstream>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <fmt/format.h>
+
+#include "mjlib/base/json5_read_archive.h"
+#include "mjlib/base/json5_write_archive.h"
+
+#include "base/fused_binary_writer.h"
+#include "base/telemetry_layout.h"
+
+#include "mech/quadruped_control.h"
+#include "mech/quadruped_web_command.h"
+
+namespace {
+constexpr int kIterations = 20000;
+
+using mjmech::mech::QuadrupedCommand;
+using Status = mjmech::mech::QuadrupedControl::Status;
+
+Status MakeStatus() {
+  Status result;
+  result.timestamp = boost::posix_time::microsec_clock::universal_time();
+  result.mode = QuadrupedCommand::Mode::kWalk;
+  for (int i = 1; i <= 12; i++) {
+    mjmech::mech::QuadrupedState::Joint joint;
+    joint.id = i;
+    joint.angle_deg = 10.0 * i;
+    joint.velocity_dps = -3.0 * i;
+    joint.torque_Nm = 0.1 * i;
+    joint.temperature_C = 35.0;
+    joint.voltage = 22.0;
+    joint.mode = 10;
+    result.state.joints.push_back(joint);
+  }
+  for (int i = 0; i < 4; i++) {
+    mjmech::mech::QuadrupedState::Leg leg;
+    leg.leg = i;
+    leg.position = mjmech::base::Point3D(100.0 * i, 50.0, 200.0);
+    leg.stance = 1.0;
+    result.state.legs_B.push_back(leg);
+  }
+  return result;
+}
+
+QuadrupedCommand MakeCommand() {
+  QuadrupedCommand result;
+  result.mode = QuadrupedCommand::kWalk;
+  result.log = QuadrupedCommand::kDisable;
+  result.v_R = mjmech::base::Point3D(150.0, -20.0, 0.0);
+  result.w_R = mjmech::base::Point3D(0.0, 0.0, 0.3);
+  QuadrupedCommand::Walk walk;
+  walk.step_height = 1.0;
+  result.walk = walk;
+  return result;
+}
+
+struct WebCommand {
+  std::optional<QuadrupedCommand> command;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(command));
+  }
+};
+
+template <typename Functor>
+double TimeNs(Functor functor) {
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; i++) {
+    functor();
+  }
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+      kIterations;
+}
+
+void Report(const std::string& name,
+            std::size_t json_bytes, double json_ns,
+            std::size_t binary_bytes, double binary_ns) {
+  fmt::print("{:<8} json   {:6d} bytes {:9.0f} ns\n",
+             name, json_bytes, json_ns);
+  fmt::print("{:<8} binary {:6d} bytes {:9.0f} ns  ({:.1f}x bytes, "
+             "{:.1f}x time)\n",
+             name, binary_bytes, binary_ns,
+             static_cast<double>(json_bytes) / binary_bytes,
+             json_ns / binary_ns);
+}
+}
+
+extern "C" {
+int main(int argc, char** argv) {
+  using JsonRead = mjlib::base::Json5ReadArchive;
+  using JsonWrite = mjlib::base::Json5WriteArchive;
+
+  const Status status = MakeStatus();
+
+  std::string json_status;
+  const double json_status_ns = TimeNs([&]() {
+      json_status = JsonWrite::Write(
+          status, JsonWrite::Options().set_standard(true));
+    });
+
+  mjmech::base::FusedBinaryWriter<Status> writer;
+  std::string binary_status;
+  mjmech::base::detail::StringWriteStream stream(&binary_status);
+  const double binary_status_ns = TimeNs([&]() {
+      binary_status.clear();
+      writer.Write(stream, &status);
+    });
+
+  const auto layout = mjmech::base::TelemetryLayoutWriter::Write<Status>();
+  fmt::print("layout   {:6d} bytes, sent once per connection\n",
+             layout.size());
+  Report("status", json_status.size(), json_status_ns,
+         binary_status.size(), binary_status_ns);
+
+  WebCommand web_command;
+  web_command.command = MakeCommand();
+  const std::string json_command = JsonWrite::Write(web_command);
+  const double json_command_ns = TimeNs([&]() {
+      // This mirrors the copies WebControl makes of every text frame.
+      std::string message = json_command;
+      std::istringstream istr(message);
+      const auto result = JsonRead::Read<WebCommand>(
+          istr, JsonRead::Options().set_permissive_nan(true));
+      if (!result.command) { std::abort(); }
+    });
+
+  const std::string binary_command =
+      mjmech::mech::EncodeQuadrupedWebCommand(*web_command.command);
+  const double binary_command_ns = TimeNs([&]() {
+      const auto result =
+          mjmech::mech::DecodeQuadrupedWebCommand(binary_command);
+      if (!result) { std::abort(); }
+    });
+
+  Report("command", json_command.size(), json_command_ns,
+         binary_command.size(), binary_command_ns);
+
+  return 0;
+}
+}
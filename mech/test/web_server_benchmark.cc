@@ -0,0 +1,163 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// @file
+///
+/// Measure requests per second and bytes transferred when WebServer
+/// serves a static file from disk, from the asset cache, from the
+/// cache with gzip, and as a conditional GET.
+///
+/// An optional argument names the file to serve.  Otherwise a
+/// synthetic script is used.
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/filesystem.hpp>
+
+#include <fmt/format.h>
+
+#include "mech/web_server.h"
+
+namespace {
+namespace beast = boost::beast;
+namespace fs = boost::filesystem;
+namespace http = beast::http;
+using tcp = boost::asio::ip::tcp;
+
+constexpr int kRequests = 5000;
+constexpr auto kMaxDuration = std::chrono::seconds(2);
+constexpr int kBasePort = 18970;
+
+std::string MakeScript() {
+  std::string result;
+  for (int i = 0; i < 2000; i++) {
+    result += fmt::format(
+        "function update{0}(status) {{\n"
+        "  document.getElementById('field{0}').innerHTML = status.value;\n"
+        "}}\n", i);
+  }
+  return result;
+}
+
+struct Scenario {
+  std::string name;
+  bool cache_assets = true;
+  bool gzip = false;
+  bool conditional = false;
+};
+
+void Run(const Scenario& scenario, int port, const std::string& root) {
+  boost::asio::io_context context;
+
+  mjmech::mech::WebServer::Options options;
+  options.address = "127.0.0.1";
+  options.port = port;
+  options.document_roots.push_back({"/", root});
+  options.cache_assets = scenario.cache_assets;
+
+  mjmech::mech::WebServer server(context.get_executor(), options);
+  server.AsyncStart([](const auto&) {});
+
+  tcp::socket socket(context);
+  const tcp::endpoint endpoint(
+      boost::asio::ip::make_address("127.0.0.1"), port);
+  for (int i = 0; ; i++) {
+    boost::system::error_code ec;
+    socket.connect(endpoint, ec);
+    if (!ec) { break; }
+    if (i > 100) { throw beast::system_error(ec); }
+    socket.close();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  beast::flat_buffer buffer;
+
+  auto request_once = [&](const std::string& etag) {
+    http::request<http::empty_body> request{http::verb::get, "/app.js", 11};
+    request.set(http::field::host, "localhost");
+    if (scenario.gzip) {
+      request.set(http::field::accept_encoding, "gzip, deflate");
+    }
+    if (!etag.empty()) {
+      request.set(http::field::if_none_match, etag);
+    }
+    http::write(socket, request);
+
+    http::response<http::string_body> response;
+    http::read(socket, buffer, response);
+    return response;
+  };
+
+  std::string etag;
+  if (scenario.conditional) {
+    etag = std::string(request_once("")[http::field::etag]);
+  }
+
+  std::size_t body_bytes = 0;
+  int status = 0;
+  int requests = 0;
+  const auto start = std::chrono::steady_clock::now();
+  auto end = start;
+  while (requests < kRequests && (end - start) < kMaxDuration) {
+    const auto response = request_once(etag);
+    body_bytes += response.body().size();
+    status = response.result_int();
+    requests++;
+    end = std::chrono::steady_clock::now();
+  }
+  const double elapsed_s =
+      std::chrono::duration<double>(end - start).count();
+
+  fmt::print("{:<14} {:>5}  {:9.0f} req/s  {:9.0f} bytes/req\n",
+             scenario.name, status, requests / elapsed_s,
+             static_cast<double>(body_bytes) / requests);
+}
+}
+
+extern "C" int main(int argc, char** argv) {
+  const auto root = fs::temp_directory_path() / fs::unique_path();
+  fs::create_directories(root);
+
+  std::string script;
+  if (argc > 1) {
+    std::ifstream inf(argv[1], std::ios::binary);
+    std::ostringstream ostr;
+    ostr << inf.rdbuf();
+    script = ostr.str();
+  } else {
+    script = MakeScript();
+  }
+  std::ofstream((root / "app.js").string(), std::ios::binary) << script;
+
+  fmt::print("serving {} bytes\n", script.size());
+
+  const Scenario scenarios[] = {
+    {"disk", false, false, false},
+    {"cache", true, false, false},
+    {"cache+gzip", true, true, false},
+    {"if-none-match", true, true, true},
+  };
+  int port = kBasePort;
+  for (const auto& scenario : scenarios) {
+    Run(scenario, port++, root.string());
+  }
+
+  fs::remove_all(root);
+  return 0;
+}
@@ -36,6 +36,8 @@ class Turret::Impl {
       hat_options.mounting.pitch_deg = 90;
       hat_options.mounting.roll_deg = 90;
       hat_options.rf_id = 88754;
+      // The turret keeps every IMU sample for latency compensation.
+      hat_options.imu_buffer = true;
 
       m_.pi3hat = std::make_unique<
         mjlib::io::Selector<Pi3hatInterface>>(executor_, "type");
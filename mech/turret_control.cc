@@ -14,15 +14,23 @@
 
 #include "mech/turret_control.h"
 
+#include <optional>
+
 #include <boost/asio/post.hpp>
 
+#include <fmt/format.h>
+
 #include "mjlib/base/clipp_archive.h"
 #include "mjlib/base/limit.h"
+#include "mjlib/io/now.h"
 #include "mjlib/io/repeating_timer.h"
 
+#include "base/fast_signal.h"
 #include "base/logging.h"
+#include "base/mono_time.h"
 #include "base/telemetry_registry.h"
 
+#include "mech/attitude_history.h"
 #include "mech/moteus.h"
 
 namespace pl = std::placeholders;
@@ -71,12 +79,39 @@ struct ControlLog {
 
 struct ImageLog {
   boost::posix_time::ptime timestamp;
+  // When the frame the targets were found in was captured.
+  boost::posix_time::ptime capture_timestamp;
   std::vector<Eigen::Vector2d> targets;
+  std::vector<double> sizes;
+  TargetTracker::Mode mode = TargetTracker::Mode::kFull;
+  TargetTracker::Roi roi;
+  double detect_s = 0.0;
+  int misses = 0;
+  std::vector<TargetTracker::Level> levels;
+
+  uint64_t sequence = 0;
+  // From capture until the result reached the control thread.
+  double latency_s = 0.0;
+  // Results discarded because a newer frame had already finished on
+  // another worker.
+  uint64_t stale_results = 0;
+  CameraDriver::Stats camera;
 
   template <typename Archive>
   void Serialize(Archive* a) {
     a->Visit(MJ_NVP(timestamp));
+    a->Visit(MJ_NVP(capture_timestamp));
     a->Visit(MJ_NVP(targets));
+    a->Visit(MJ_NVP(sizes));
+    a->Visit(MJ_NVP(mode));
+    a->Visit(MJ_NVP(roi));
+    a->Visit(MJ_NVP(detect_s));
+    a->Visit(MJ_NVP(misses));
+    a->Visit(MJ_NVP(levels));
+    a->Visit(MJ_NVP(sequence));
+    a->Visit(MJ_NVP(latency_s));
+    a->Visit(MJ_NVP(stale_results));
+    a->Visit(MJ_NVP(camera));
   }
 };
 }
@@ -98,9 +133,11 @@ class TurretControl::Impl {
   }
 
   void AsyncStart(mjlib::io::ErrorCallback callback) {
+    // Each worker gets its own tracker, created on first use.
+    target_trackers_.resize(std::max(1, parameters_.camera.workers));
     camera_ = std::make_unique<CameraDriver>(parameters_.camera);
     camera_->image_signal()->connect(
-        std::bind(&Impl::HandleImage_THREAD, this, pl::_1));
+        std::bind(&Impl::HandleImage_THREAD, this, pl::_1, pl::_2));
     client_ = client_getter_();
     imu_client_ = imu_getter_();
 
@@ -115,13 +152,13 @@ class TurretControl::Impl {
   }
 
   void Command(const CommandData& data) {
-    const auto now = Now();
+    const auto now = clock_.Now();
 
     const bool higher_priority = data.priority >= current_command_.priority;
     const bool stale =
-        !current_command_timestamp_.is_not_a_date_time() &&
-        (mjlib::base::ConvertDurationToSeconds(
-            now - current_command_timestamp_) > parameters_.command_timeout_s);
+        current_command_timestamp_.is_set() &&
+        (base::MonoSeconds(now, current_command_timestamp_) >
+         parameters_.command_timeout_s);
 
     if (!higher_priority && !stale) {
       return;
@@ -131,29 +168,54 @@ class TurretControl::Impl {
     current_command_timestamp_ = now;
 
     CommandLog command_log;
-    command_log.timestamp = Now();
+    command_log.timestamp = clock_.ToPtime(now);
     command_log.command = &current_command_;
     command_signal_(&command_log);
   }
 
   // private
 
-  void HandleImage_THREAD(const cv::Mat& image) {
-    // WE ARE IN A BG THREAD.
-    if (!target_tracker_) {
-      target_tracker_ = std::make_unique<TargetTracker>(parameters_.tracker);
+  void HandleImage_THREAD(const CameraFrame& frame, int worker) {
+    // WE ARE IN A BG THREAD, possibly one of several.
+    auto& target_tracker = target_trackers_.at(worker);
+    if (!target_tracker) {
+      target_tracker = std::make_unique<TargetTracker>(parameters_.tracker);
     }
-    const auto result = target_tracker_->Track(image);
+    const auto result = target_tracker->Track(frame.image);
 
     // Bounce these results back to the main thread.
     boost::asio::post(
         executor_,
-        std::bind(&Impl::HandleImage, this, result));
+        std::bind(&Impl::HandleImage, this,
+                  frame.sequence, frame.capture_time, result));
   }
 
-  void HandleImage(TargetTracker::Result result) {
+  void HandleImage(uint64_t sequence, base::MonoTime capture_time,
+                   TargetTracker::Result result) {
+    // With several workers, results can finish out of order.
+    if (!image_data_.timestamp.is_not_a_date_time() &&
+        sequence <= image_data_.sequence) {
+      image_data_.stale_results++;
+      return;
+    }
+
     image_data_.timestamp = Now();
+    image_data_.sequence = sequence;
+    image_data_.latency_s =
+        base::MonoSeconds(base::MonoClock::ReadMonotonic(), capture_time);
+    image_data_.capture_timestamp =
+        image_data_.timestamp -
+        mjlib::base::ConvertSecondsToDuration(image_data_.latency_s);
+    image_capture_time_ = capture_time;
+    image_capture_attitude_ = attitude_history_.Get(capture_time);
+    image_data_.camera = camera_->stats();
     image_data_.targets = result.targets;
+    image_data_.sizes = result.sizes;
+    image_data_.mode = result.mode;
+    image_data_.roi = result.roi;
+    image_data_.detect_s = result.detect_s;
+    image_data_.misses = result.misses;
+    image_data_.levels = result.levels;
     image_signal_(&image_data_);
   }
 
@@ -183,7 +245,7 @@ class TurretControl::Impl {
     if (!client_) { return; }
     if (outstanding_) { return; }
 
-    timing_ = ControlTiming(executor_, timing_.cycle_start());
+    timing_ = ControlTiming(&clock_, timing_.cycle_start());
 
     outstanding_ = true;
 
@@ -209,6 +271,8 @@ class TurretControl::Impl {
     if (status_outstanding_ > 0) { return; }
 
     imu_signal_(&imu_data_);
+    imu_client_->ReadImuBatch(&imu_batch_);
+    UpdateAttitudeHistory();
 
     UpdateStatus();
 
@@ -220,6 +284,17 @@ class TurretControl::Impl {
 
     RunControl();
     timing_.finish_control();
+
+    if (camera_->recording()) {
+      camera_->SetRecordState(fmt::format(
+          "mode={} pitch_deg={:.2f} yaw_deg={:.2f} "
+          "pitch_rate_dps={:.1f} yaw_rate_dps={:.1f} "
+          "command_pitch_deg={:.2f} command_yaw_deg={:.2f}",
+          static_cast<int>(status_.mode),
+          status_.imu.pitch_deg, status_.imu.yaw_deg,
+          status_.imu.pitch_rate_dps, status_.imu.yaw_rate_dps,
+          status_.control.pitch.angle_deg, status_.control.yaw.angle_deg));
+    }
   }
 
   void UpdateServo(const mjlib::multiplex::AsioClient::IdRegisterValue& reply,
@@ -337,6 +412,8 @@ class TurretControl::Impl {
     status_.imu.pitch_rate_dps = imu_data_.rate_dps.y();
     status_.imu.yaw_deg = imu_data_.euler_deg.yaw;
     status_.imu.yaw_rate_dps = imu_data_.rate_dps.z();
+    status_.imu.samples = imu_batch_.count;
+    status_.imu.dropped = imu_batch_.dropped;
 
     {
       const double alpha = parameters_.period_s / parameters_.voltage_filter_s;
@@ -425,7 +502,7 @@ class TurretControl::Impl {
       }
       if (Recent(image_data_.timestamp) && !image_data_.targets.empty()) {
         // Pick the target closest to the center.
-        const auto to_track = PickTarget();
+        const auto to_track = ProjectTarget(PickTarget());
         return std::make_pair(
             (to_track.y() - 0.5) * -parameters_.target_gain_dps,
             (to_track.x() - 0.5) * parameters_.target_gain_dps);
@@ -481,14 +558,14 @@ class TurretControl::Impl {
     control.pitch.torque_Nm =
         pitch_pid_.Apply(
             imu_data_.euler_deg.pitch, status_.control.pitch.angle_deg,
-            imu_data_.rate_dps.y(), pitch_rate_dps,
+            status_.imu.pitch_rate_dps, pitch_rate_dps,
             1.0 / parameters_.period_s);
 
     control.yaw.power = true;
     control.yaw.torque_Nm =
         yaw_pid_.Apply(
             imu_data_.euler_deg.yaw, status_.control.yaw.angle_deg,
-            imu_data_.rate_dps.z(), yaw_rate_dps,
+            status_.imu.yaw_rate_dps, yaw_rate_dps,
             1.0 / parameters_.period_s);
 
     Control(control);
@@ -533,6 +610,30 @@ class TurretControl::Impl {
     }
   }
 
+  void UpdateAttitudeHistory() {
+    // This uses the same clock as camera frames.
+    const auto mono_now = base::MonoClock::ReadMonotonic();
+
+    if (imu_batch_.count == 0) {
+      attitude_history_.Add({mono_now,
+                             imu_data_.euler_deg.pitch,
+                             imu_data_.euler_deg.yaw});
+      return;
+    }
+
+    // Buffered samples are stamped on the executor's time base, so
+    // they are placed by how long ago they were received.
+    const auto now = mjlib::io::Now(executor_.context());
+    for (int i = 0; i < imu_batch_.count; i++) {
+      const auto& sample = imu_batch_.samples[i];
+      const double age_s =
+          base::ConvertDurationToSeconds(now - sample.timestamp);
+      attitude_history_.Add({mono_now + -base::MonoNanoseconds(age_s),
+                             sample.euler_deg.pitch,
+                             sample.euler_deg.yaw});
+    }
+  }
+
   bool Recent(boost::posix_time::ptime timestamp) {
     return base::ConvertDurationToSeconds(Now() - timestamp) <
       parameters_.target_timeout_s;
@@ -550,6 +651,41 @@ class TurretControl::Impl {
     return *it;
   }
 
+  /// @return where @p target, as seen when its frame was captured,
+  /// would appear now.
+  Eigen::Vector2d ProjectTarget(const Eigen::Vector2d& target) {
+    auto& tracking = status_.tracking;
+    tracking.latency_s = base::MonoSeconds(
+        base::MonoClock::ReadMonotonic(), image_capture_time_);
+    tracking.pitch_correction_deg = 0.0;
+    tracking.yaw_correction_deg = 0.0;
+    tracking.target = target;
+
+    if (!parameters_.latency_compensation || !image_capture_attitude_) {
+      return target;
+    }
+
+    // A quarter turn swaps which sensor axis spans the image width.
+    const int rotation = ((parameters_.camera.rotation % 360) + 360) % 360;
+    const bool swapped = rotation == 90 || rotation == 270;
+    const double x_fov_deg = swapped ?
+        parameters_.camera_sensor_y_fov_deg :
+        parameters_.camera_sensor_x_fov_deg;
+    const double y_fov_deg = swapped ?
+        parameters_.camera_sensor_x_fov_deg :
+        parameters_.camera_sensor_y_fov_deg;
+
+    // Image x increases with yaw, and image y decreases with pitch.
+    tracking.pitch_correction_deg =
+        imu_data_.euler_deg.pitch - image_capture_attitude_->pitch_deg;
+    tracking.yaw_correction_deg = base::WrapNeg180To180(
+        imu_data_.euler_deg.yaw - image_capture_attitude_->yaw_deg);
+    tracking.target = target + Eigen::Vector2d(
+        -tracking.yaw_correction_deg / x_fov_deg,
+        tracking.pitch_correction_deg / y_fov_deg);
+    return tracking.target;
+  }
+
   void AddWeapon() {
     // Do our weapon.
     client_command_.push_back({});
@@ -611,10 +747,11 @@ class TurretControl::Impl {
 
 
   boost::posix_time::ptime Now() {
-    return mjlib::io::Now(executor_.context());
+    return clock_.PtimeNow();
   }
 
   boost::asio::any_io_executor executor_;
+  base::MonoClock clock_{executor_.context()};
   ClientGetter client_getter_;
   ImuGetter imu_getter_;
 
@@ -625,7 +762,7 @@ class TurretControl::Impl {
 
   int16_t last_trigger_sequence_ = 0;
   CommandData current_command_;
-  boost::posix_time::ptime current_command_timestamp_;
+  base::MonoTime current_command_timestamp_;
   Parameters parameters_;
 
   using Client = mjlib::multiplex::AsioClient;
@@ -646,15 +783,19 @@ class TurretControl::Impl {
   Client::Reply client_command_reply_;
 
   AttitudeData imu_data_;
+  AttitudeBatch imu_batch_;
   ImageLog image_data_;
-  boost::signals2::signal<void (const AttitudeData*)> imu_signal_;
-  boost::signals2::signal<void (const Status*)> turret_signal_;
-  boost::signals2::signal<void (const CommandLog*)> command_signal_;
-  boost::signals2::signal<void (const ControlLog*)> control_signal_;
-  boost::signals2::signal<void (const ImageLog*)> image_signal_;
-  boost::signals2::signal<void (const Weapon*)> weapon_signal_;
-
-  ControlTiming timing_{executor_, {}};
+  base::MonoTime image_capture_time_;
+  std::optional<AttitudeHistory::Sample> image_capture_attitude_;
+  AttitudeHistory attitude_history_;
+  base::FastSignal<void (const AttitudeData*)> imu_signal_;
+  base::FastSignal<void (const Status*)> turret_signal_;
+  base::FastSignal<void (const CommandLog*)> command_signal_;
+  base::FastSignal<void (const ControlLog*)> control_signal_;
+  base::FastSignal<void (const ImageLog*)> image_signal_;
+  base::FastSignal<void (const Weapon*)> weapon_signal_;
+
+  ControlTiming timing_{&clock_, {}};
 
   std::map<int, double> servo_sign_ = {
     { 1, 1.0 },
@@ -665,7 +806,7 @@ class TurretControl::Impl {
   mjlib::base::PID yaw_pid_{&parameters_.yaw, &status_.control.yaw.pid};
 
   std::unique_ptr<CameraDriver> camera_;
-  std::unique_ptr<TargetTracker> target_tracker_;
+  std::vector<std::unique_ptr<TargetTracker>> target_trackers_;
 };
 
 TurretControl::TurretControl(base::Context& context,
@@ -68,6 +68,19 @@ class TurretControl : boost::noncopyable {
     double target_gain_dps = 10.0;
     double target_timeout_s = 0.3;
 
+    /// Move targets from where they were seen when the frame was
+    /// captured to where they would be now, given how the gimbal has
+    /// moved in the meantime.
+    ///
+    /// This is off by default, as the fields of view below are only
+    /// nominal, and must be calibrated against the IMU for each
+    /// camera mode first.
+    bool latency_compensation = false;
+    /// The angles spanned by the width and height of the sensor,
+    /// before camera.rotation is applied.
+    double camera_sensor_x_fov_deg = 62.2;
+    double camera_sensor_y_fov_deg = 48.8;
+
     int laser_time_10ms = 100;  // 1s
     double fire_voltage = 6.0;
     double loader_voltage = 6.0;
@@ -92,6 +105,9 @@ class TurretControl : boost::noncopyable {
       a->Visit(MJ_NVP(max_rate_accel_dps2));
       a->Visit(MJ_NVP(target_gain_dps));
       a->Visit(MJ_NVP(target_timeout_s));
+      a->Visit(MJ_NVP(latency_compensation));
+      a->Visit(MJ_NVP(camera_sensor_x_fov_deg));
+      a->Visit(MJ_NVP(camera_sensor_y_fov_deg));
       a->Visit(MJ_NVP(laser_time_10ms));
       a->Visit(MJ_NVP(fire_voltage));
       a->Visit(MJ_NVP(loader_voltage));
@@ -191,17 +207,44 @@ class TurretControl : boost::noncopyable {
       double yaw_deg = 0.0;
       double yaw_rate_dps = 0.0;
 
+      // The number of IMU samples received since the last cycle.
+      int samples = 0;
+      int dropped = 0;
+
       template <typename Archive>
       void Serialize(Archive* a) {
         a->Visit(MJ_NVP(pitch_deg));
         a->Visit(MJ_NVP(pitch_rate_dps));
         a->Visit(MJ_NVP(yaw_deg));
         a->Visit(MJ_NVP(yaw_rate_dps));
+        a->Visit(MJ_NVP(samples));
+        a->Visit(MJ_NVP(dropped));
       }
     };
 
     Imu imu;
 
+    /// How the most recent target was used.
+    struct Tracking {
+      /// From capture of the frame until this control cycle.
+      double latency_s = 0.0;
+      /// How far the gimbal moved since capture.
+      double pitch_correction_deg = 0.0;
+      double yaw_correction_deg = 0.0;
+      /// The target after compensation, normalized to the image.
+      Eigen::Vector2d target = Eigen::Vector2d::Zero();
+
+      template <typename Archive>
+      void Serialize(Archive* a) {
+        a->Visit(MJ_NVP(latency_s));
+        a->Visit(MJ_NVP(pitch_correction_deg));
+        a->Visit(MJ_NVP(yaw_correction_deg));
+        a->Visit(MJ_NVP(target));
+      }
+    };
+
+    Tracking tracking;
+
     double imu_servo_pitch_deg = 0.0;
     double filtered_bus_V = 0.0;
 
@@ -216,6 +259,7 @@ class TurretControl : boost::noncopyable {
       a->Visit(MJ_NVP(yaw_servo));
       a->Visit(MJ_NVP(control));
       a->Visit(MJ_NVP(imu));
+      a->Visit(MJ_NVP(tracking));
       a->Visit(MJ_NVP(imu_servo_pitch_deg));
       a->Visit(MJ_NVP(filtered_bus_V));
     }
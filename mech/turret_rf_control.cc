@@ -14,77 +14,44 @@
 
 /// @file
 ///
-/// # Received Commands #
-///
-/// The following slot protocol is used to receive commands.
-///
-/// ## Slot 0 - Primary Command ##
-///   byte 0: Desired mode, from TurretControl::Mode, remaining
-///           bytes are mode-specific
-///
-///    Stop - None
-///    Active - None
-///   byte 1: messages received in last second
-///
-/// ## Slot 1 - rate ##
-///
-///  * int16 pitch_deg_s (scaled to -400/400)
-///  * int16 yaw_deg_s (scaled to -400/400)
+/// The slots exchanged with the ground station are defined in
+/// mech/rf_slot_protocol.h.
 ///
-/// ## Slot 2 - weapon ##
+/// # Received Commands #
 ///
-///  # int8 laser
-///  # int16 trigger_sequence
+///  * kTurretCommandSlot - RfTurretCommand, a new command is only
+///    issued when this slot is received
+///  * kTurretRateSlot - RfTurretRate
+///  * kTurretWeaponCommandSlot - RfTurretWeaponCommand
 ///
 /// # Transmitted telemetry #
 ///
-/// The following protocol is used to transmit telemetry.
-///
-/// ## Slot 0 - Primary State ##
-///
-///  * int8_t mode (from TurretControl::Mode)
-///  * int8_t received packets in last second
-///
-/// ## Slot 1 - IMU ##
-///
-///  * int16_t pitch_deg (-180/180)
-///  * int16_t yaw_deg (-180/180)
-///  * int16_t pitch_rate_dps (-400/400)
-///  * int16_t yaw_rate_dps (-400/400)
+/// Priorities are adjusted to the link quality by RfSlotScheduler.
+/// Mode and fault slots are critical, and servo summaries are low
+/// value.
 ///
-/// ## Slot 2 - Servo ##
-///
-///  * int16_t pitch_deg (-180/180)
-///  * int16_t yaw_deg (-180/180)
-///
-/// ## Slot 3 - Weapon ##
-///
-///  * int8_t armed
-///  * int8_t laser status
-///  * int16_t shot count
-///
-/// ## Slot 8 - Servo Summary ##
-///
-///  * int8_t min_voltage
-///  * int8_t max_voltage
-///  * int8_t min_temp_C
-///  * int8_t max_temp_C
-///  * int8_t fault
-///
-/// ## Slot 14 - Fault ##
-///
-///  * char[15] - truncated text string
+///  * kTurretStateSlot - RfModeStatus
+///  * kTurretImuSlot - RfTurretImu
+///  * kTurretServoSlot - RfTurretServo
+///  * kTurretWeaponSlot - RfTurretWeapon
+///  * kTurretServoSummarySlot - RfServoSummary
+///  * kTurretFaultSlot - truncated fault text
 
 
 #include "mech/turret_rf_control.h"
 
 #include <boost/asio/post.hpp>
 
-#include "mjlib/base/buffer_stream.h"
+#include "mjlib/base/clipp_archive.h"
 #include "mjlib/io/now.h"
+#include "mjlib/io/repeating_timer.h"
 
+#include "base/common.h"
+#include "base/fast_signal.h"
 #include "base/telemetry_registry.h"
-#include "base/saturate.h"
+
+#include "mech/rf_link_quality.h"
+#include "mech/rf_slot_protocol.h"
 
 namespace pl = std::placeholders;
 
@@ -111,7 +78,6 @@ auto vmax = [](const auto& container, auto getter, auto incase) {
 };
 
 constexpr int kOnlyRemote = 0;
-constexpr double kVoltageScale = 4.0;
 }
 
 struct SlotData {
@@ -148,14 +114,39 @@ class TurretRfControl::Impl {
         turret_control_(turret_control),
         rf_getter_(rf_getter) {
     context.telemetry_registry->Register("slotrf", &slotrf_signal_);
+    context.telemetry_registry->Register("rf_link", &rf_link_signal_);
   }
 
+  struct Parameters {
+    // Telemetry is refreshed at least this often, even when nothing
+    // is being received.
+    double telemetry_period_s = 0.05;
+    RfLinkQuality::Options link;
+    RfSlotScheduler::Options scheduler;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(telemetry_period_s));
+      a->Visit(MJ_NVP(link));
+      a->Visit(MJ_NVP(scheduler));
+    }
+  };
+
+  Parameters parameters_;
+
   void AsyncStart(mjlib::io::ErrorCallback callback) {
     rf_ = rf_getter_();
     BOOST_ASSERT(!rf_);
 
+    link_ = RfLinkQuality(parameters_.link);
+    scheduler_ = RfSlotScheduler(parameters_.scheduler);
+
     StartRead();
 
+    timer_.start(
+        mjlib::base::ConvertSecondsToDuration(parameters_.telemetry_period_s),
+        std::bind(&Impl::HandleTimer, this, pl::_1));
+
     boost::asio::post(
         executor_,
         std::bind(std::move(callback), mjlib::base::error_code()));
@@ -172,11 +163,7 @@ class TurretRfControl::Impl {
 
     const auto now = mjlib::io::Now(executor_.context());
     slot_data_.timestamp = now;
-    receive_times_.push_back(now);
-    while (mjlib::base::ConvertDurationToSeconds(
-               now - receive_times_.front()) > 1.0) {
-      receive_times_.pop_front();
-    }
+    link_.Receive(now, bitfield_);
 
     for (int i = 0; i < 15; i++) {
       if (!(bitfield_ & (1 << i))) { continue; }
@@ -191,7 +178,7 @@ class TurretRfControl::Impl {
     slotrf_signal_(&slot_data_);
 
     // We only command when we receive a mode slot.
-    if (bitfield_ & 0x01) {
+    if (bitfield_ & (1 << kTurretCommandSlot)) {
       SendCommand();
     }
 
@@ -200,13 +187,30 @@ class TurretRfControl::Impl {
     StartRead();
   }
 
+  void HandleTimer(const mjlib::base::error_code& ec) {
+    if (ec == boost::asio::error::operation_aborted) { return; }
+    mjlib::base::FailIf(ec);
+
+    // The scheduler must also react when nothing arrives at all.
+    ReportTelemetry();
+  }
+
   void SendCommand() {
     // We just got a new command.  Formulate our command structure and
     // send it on.
     TurretControl::CommandData command;
 
+    const auto& rx = slot_data_.rx;
+    auto decode = [&](auto* message, int slot) {
+      using Message = std::remove_pointer_t<decltype(message)>;
+      *message = DecodeRfSlot<Message>(rx[slot].data.data(), rx[slot].size);
+    };
+
+    RfTurretCommand rf_command;
+    decode(&rf_command, kTurretCommandSlot);
+
     command.mode = [&]() {
-      switch (slot_data_.rx[0].data[0]) {
+      switch (rf_command.mode) {
         case 0: {
           return TurretControl::Mode::kStop;
         }
@@ -221,18 +225,16 @@ class TurretRfControl::Impl {
       }
     }();
 
-    auto read_int16 = [&](int slot, int pos) {
-      int16_t value = 0;
-      std::memcpy(&value, &slot_data_.rx[slot].data[pos], 2);
-      return value;
-    };
-
-    command.pitch_rate_dps = 400.0 * read_int16(1, 0) / 32767.0;
-    command.yaw_rate_dps = 400.0 * read_int16(1, 2) / 32767.0;
-    command.track_target = slot_data_.rx[1].data[4] != 0;
+    RfTurretRate rate;
+    decode(&rate, kTurretRateSlot);
+    command.pitch_rate_dps = rate.pitch_rate_dps;
+    command.yaw_rate_dps = rate.yaw_rate_dps;
+    command.track_target = rate.track_target;
 
-    command.laser_enable = slot_data_.rx[2].data[0] ? true : false;
-    command.trigger_sequence = read_int16(2, 1);
+    RfTurretWeaponCommand weapon;
+    decode(&weapon, kTurretWeaponCommandSlot);
+    command.laser_enable = weapon.laser_enable;
+    command.trigger_sequence = weapon.trigger_sequence;
 
     // RF control takes precendence over everything if we're seeing
     // it.
@@ -249,91 +251,83 @@ class TurretRfControl::Impl {
     }
     last_telemetry_ = now;
 
+    const auto& link = link_.Update(now);
+    auto send = [&](int slot_idx, RfSlotClass slot_class,
+                    const RfClient::Slot& slot) {
+      rf_->tx_slot(kOnlyRemote, slot_idx,
+                   scheduler_.Schedule(
+                       now, link.state, slot_idx, slot_class, slot));
+    };
+
     const auto& s = turret_control_->status();
     const auto& w = turret_control_->weapon();
 
     const bool fault = s.mode == TurretControl::Mode::kFault;
 
-    using Slot = RfClient::Slot;
     {
-      Slot slot0;
-      slot0.size = 2;
-      slot0.priority = 0xffffffff;
-      slot0.data[0] = static_cast<uint8_t>(s.mode);
-      slot0.data[1] = base::Saturate<uint8_t>(receive_times_.size());
-      rf_->tx_slot(kOnlyRemote, 0, slot0);
+      RfModeStatus state;
+      state.mode = static_cast<int>(s.mode);
+      state.rx_count = link.rx_count;
+      send(kTurretStateSlot, RfSlotClass::kCritical,
+           MakeRfSlot(state, 0xffffffff));
     }
     {
-      Slot slot1;
-      slot1.size = 8;
-      slot1.priority = 0xffffffff;
-      mjlib::base::BufferWriteStream bs({slot1.data, slot1.size});
-      mjlib::telemetry::WriteStream ts{bs};
-      ts.Write(base::Saturate<int16_t>(32767.0 * s.imu.pitch_deg / 180.0));
-      ts.Write(base::Saturate<int16_t>(32767.0 * s.imu.yaw_deg / 180.0));
-      ts.Write(base::Saturate<int16_t>(32767.0 * s.imu.pitch_rate_dps /  400.0));
-      ts.Write(base::Saturate<int16_t>(32767.0 * s.imu.yaw_rate_dps / 400.0));
-      rf_->tx_slot(kOnlyRemote, 1, slot1);
+      RfTurretImu imu;
+      imu.pitch_deg = s.imu.pitch_deg;
+      imu.yaw_deg = s.imu.yaw_deg;
+      imu.pitch_rate_dps = s.imu.pitch_rate_dps;
+      imu.yaw_rate_dps = s.imu.yaw_rate_dps;
+      send(kTurretImuSlot, RfSlotClass::kNormal, MakeRfSlot(imu, 0xffffffff));
     }
     {
-      Slot slot2;
-      slot2.size = 4;
-      slot2.priority = fault ? 0x01010101 : 0xffffffff;
-      mjlib::base::BufferWriteStream bs({slot2.data, slot2.size});
-      mjlib::telemetry::WriteStream ts{bs};
-      ts.Write(base::Saturate<int16_t>(s.pitch_servo.angle_deg / 180.0 * 32767.0));
-      ts.Write(base::Saturate<int16_t>(base::WrapNegPiToPi(base::Radians(s.yaw_servo.angle_deg)) / M_PI * 32767.0));
-      rf_->tx_slot(kOnlyRemote, 2, slot2);
+      RfTurretServo servo;
+      servo.pitch_deg = s.pitch_servo.angle_deg;
+      servo.yaw_deg = base::Degrees(
+          base::WrapNegPiToPi(base::Radians(s.yaw_servo.angle_deg)));
+      send(kTurretServoSlot, RfSlotClass::kNormal,
+           MakeRfSlot(servo, fault ? 0x01010101 : 0xffffffff));
     }
     {
-      Slot slot3;
-      slot3.size = 4;
-      slot3.priority = fault ? 0x02020202 : 0xffffffff;
-      mjlib::base::BufferWriteStream bs({slot3.data, slot3.size});
-      mjlib::telemetry::WriteStream ts{bs};
-      ts.Write(static_cast<int8_t>(w.armed ? 1 : 0));
-      ts.Write(static_cast<int8_t>(w.laser_time_10ms ? 1 : 0));
-      ts.Write(static_cast<int16_t>(w.shot_count));
-      rf_->tx_slot(kOnlyRemote, 3, slot3);
+      RfTurretWeapon weapon;
+      weapon.armed = w.armed;
+      weapon.laser = w.laser_time_10ms != 0;
+      weapon.shot_count = static_cast<int16_t>(w.shot_count);
+      send(kTurretWeaponSlot, RfSlotClass::kNormal,
+           MakeRfSlot(weapon, fault ? 0x02020202 : 0xffffffff));
     }
-
     {
-      Slot slot8;
-      slot8.size = 5;
-      slot8.priority = 0x55555555;
-      mjlib::base::BufferWriteStream bs({slot8.data, 5});
-      mjlib::telemetry::WriteStream ts{bs};
       std::array<const TurretControl::Status::GimbalServo*, 2> servos{{
           &s.pitch_servo, &s.yaw_servo}};
-      ts.Write(base::Saturate<int8_t>(kVoltageScale *
-                   vmin(servos, [](const auto& j) { return j->voltage; }, 0.0)));
-      ts.Write(base::Saturate<int8_t>(kVoltageScale *
-                   vmax(servos, [](const auto& j) { return j->voltage; }, 0.0)));
-      ts.Write(
-          base::Saturate<int8_t>(
-              vmin(servos, [](const auto& j) { return j->temperature_C; }, 0.0)));
-      ts.Write(
-          base::Saturate<int8_t>(
-              vmax(servos, [](const auto& j) { return j->temperature_C; }, 0.0)));
-      ts.Write(
-          base::Saturate<int8_t>(
-              vmax(servos, [](const auto& j) { return j->fault; }, 0)));
-      rf_->tx_slot(kOnlyRemote, 8, slot8);
+      RfServoSummary summary;
+      summary.min_voltage =
+          vmin(servos, [](const auto& j) { return j->voltage; }, 0.0);
+      summary.max_voltage =
+          vmax(servos, [](const auto& j) { return j->voltage; }, 0.0);
+      summary.min_temp_C =
+          vmin(servos, [](const auto& j) { return j->temperature_C; }, 0.0);
+      summary.max_temp_C =
+          vmax(servos, [](const auto& j) { return j->temperature_C; }, 0.0);
+      summary.fault = vmax(servos, [](const auto& j) { return j->fault; }, 0);
+      send(kTurretServoSummarySlot, RfSlotClass::kLow,
+           MakeRfSlot(summary, 0x55555555));
     }
     {
-      Slot slot14;
+      RfClient::Slot slot14;
       if (!fault) {
         slot14.priority = 0x01010101;
         slot14.size = 0;
-        rf_->tx_slot(kOnlyRemote, 14, slot14);
       } else {
         slot14.priority = 0xaaaaaaaa;
-        auto size = std::min<size_t>(13, s.fault.size());
+        auto size = std::min<size_t>(kRfFaultTextSize, s.fault.size());
         slot14.size = size;
         std::memcpy(slot14.data, s.fault.data(), size);
-        rf_->tx_slot(kOnlyRemote, 14, slot14);
       }
+      send(kTurretFaultSlot, RfSlotClass::kCritical, slot14);
     }
+
+    rf_link_data_.link = link;
+    rf_link_data_.scheduler = scheduler_.status();
+    rf_link_signal_(&rf_link_data_);
   }
 
   boost::asio::any_io_executor executor_;
@@ -346,10 +340,15 @@ class TurretRfControl::Impl {
   uint16_t bitfield_ = 0;
 
   SlotData slot_data_;
-  boost::signals2::signal<void (const SlotData*)> slotrf_signal_;
+  base::FastSignal<void (const SlotData*)> slotrf_signal_;
+
+  RfLinkQuality link_;
+  RfSlotScheduler scheduler_;
+  RfLinkTelemetry rf_link_data_;
+  base::FastSignal<void (const RfLinkTelemetry*)> rf_link_signal_;
 
   boost::posix_time::ptime last_telemetry_;
-  std::deque<boost::posix_time::ptime> receive_times_;
+  mjlib::io::RepeatingTimer timer_{executor_};
 };
 
 TurretRfControl::TurretRfControl(
@@ -365,7 +364,7 @@ void TurretRfControl::AsyncStart(mjlib::io::ErrorCallback callback) {
 }
 
 clipp::group TurretRfControl::program_options() {
-  return {};
+  return mjlib::base::ClippArchive().Accept(&impl_->parameters_).release();
 }
 
 }
@@ -0,0 +1,254 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/web_asset_cache.h"
+
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include <fstream>
+#include <set>
+#include <sstream>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+
+#include <fmt/format.h>
+
+#include "mjlib/base/system_error.h"
+
+#include "mech/mime_type.h"
+
+namespace fs = boost::filesystem;
+
+namespace mjmech {
+namespace mech {
+
+namespace {
+/// Paths are formed by concatenation, so may contain repeated
+/// separators.
+std::string NormalizePath(std::string_view path) {
+  std::string result;
+  result.reserve(path.size());
+  for (const char c : path) {
+    if (c == '/' && !result.empty() && result.back() == '/') { continue; }
+    result.push_back(c);
+  }
+  return result;
+}
+
+uint64_t Fnv1a(std::string_view data) {
+  uint64_t result = 0xcbf29ce484222325ull;
+  for (const char c : data) {
+    result ^= static_cast<uint8_t>(c);
+    result *= 0x100000001b3ull;
+  }
+  return result;
+}
+
+bool IsCompressible(std::string_view content_type) {
+  return boost::starts_with(content_type, "text/") ||
+      content_type == "application/javascript" ||
+      content_type == "application/json" ||
+      content_type == "application/xml" ||
+      content_type == "image/svg+xml" ||
+      content_type == "image/vnd.microsoft.icon";
+}
+
+std::string_view Trim(std::string_view value) {
+  while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+    value.remove_prefix(1);
+  }
+  while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+    value.remove_suffix(1);
+  }
+  return value;
+}
+
+template <typename Functor>
+void ForEachListItem(std::string_view list, Functor functor) {
+  while (!list.empty()) {
+    const auto comma = list.find(',');
+    functor(Trim(list.substr(0, comma)));
+    if (comma == std::string_view::npos) { break; }
+    list.remove_prefix(comma + 1);
+  }
+}
+}
+
+WebAssetCache::WebAssetCache(std::vector<std::string> directories,
+                             std::size_t max_file_size)
+    : directories_(std::move(directories)),
+      max_file_size_(max_file_size) {
+  Refresh();
+}
+
+int WebAssetCache::Refresh() {
+  int changed = 0;
+  std::set<std::string> seen;
+  watch_directories_.clear();
+
+  for (const auto& directory : directories_) {
+    boost::system::error_code ec;
+    if (!fs::is_directory(directory, ec)) { continue; }
+    watch_directories_.push_back(directory);
+
+    boost::system::error_code iterator_ec;
+    for (fs::recursive_directory_iterator it(
+             directory, fs::symlink_option::recurse, iterator_ec), end;
+         !iterator_ec && it != end; it.increment(iterator_ec)) {
+      const auto& path = it->path();
+      if (fs::is_directory(path, ec)) {
+        watch_directories_.push_back(path.string());
+        continue;
+      }
+      if (!fs::is_regular_file(path, ec)) { continue; }
+
+      struct stat info = {};
+      if (::stat(path.c_str(), &info) != 0) { continue; }
+      const std::size_t size = info.st_size;
+      if (size > max_file_size_) { continue; }
+      const int64_t mtime_ns =
+          static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 +
+          info.st_mtim.tv_nsec;
+
+      const auto key = NormalizePath(path.string());
+      seen.insert(key);
+
+      const auto existing = assets_.find(key);
+      if (existing != assets_.end() &&
+          existing->second->mtime_ns == mtime_ns &&
+          existing->second->data.size() == size) {
+        continue;
+      }
+
+      auto asset = Load(path.string(), mtime_ns);
+      if (!asset) { continue; }
+      assets_[key] = std::move(asset);
+      changed++;
+    }
+  }
+
+  for (auto it = assets_.begin(); it != assets_.end();) {
+    if (seen.count(it->first) == 0) {
+      it = assets_.erase(it);
+      changed++;
+    } else {
+      ++it;
+    }
+  }
+
+  return changed;
+}
+
+std::shared_ptr<const WebAssetCache::Asset> WebAssetCache::Find(
+    std::string_view path) const {
+  const auto it = assets_.find(NormalizePath(path));
+  if (it == assets_.end()) { return {}; }
+  return it->second;
+}
+
+std::shared_ptr<const WebAssetCache::Asset> WebAssetCache::Load(
+    const std::string& path, int64_t mtime_ns) const {
+  std::ifstream inf(path, std::ios::binary);
+  if (!inf) { return {}; }
+  std::ostringstream ostr;
+  ostr << inf.rdbuf();
+
+  auto result = std::make_shared<Asset>();
+  result->content_type = std::string(GetMimeType(path));
+  result->data = ostr.str();
+  result->mtime_ns = mtime_ns;
+  result->etag = fmt::format(
+      "\"{:016x}-{:x}\"", Fnv1a(result->data), result->data.size());
+
+  if (IsCompressible(result->content_type)) {
+    auto gzip = GzipCompress(result->data);
+    // Only keep the compressed copy if it is worth the client's time
+    // to decompress it.
+    if (gzip.size() < result->data.size() * 9 / 10) {
+      result->gzip = std::move(gzip);
+    }
+  }
+
+  return result;
+}
+
+std::string GzipCompress(std::string_view data) {
+  z_stream stream = {};
+  // 16 more window bits selects the gzip format, rather than zlib.
+  if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED,
+                   15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+    throw mjlib::base::system_error::einval("deflateInit2 failed");
+  }
+
+  std::string result;
+  result.resize(deflateBound(&stream, data.size()));
+
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  stream.avail_in = data.size();
+  stream.next_out = reinterpret_cast<Bytef*>(&result[0]);
+  stream.avail_out = result.size();
+
+  const int err = deflate(&stream, Z_FINISH);
+  result.resize(stream.total_out);
+  deflateEnd(&stream);
+
+  if (err != Z_STREAM_END) {
+    throw mjlib::base::system_error::einval("deflate failed");
+  }
+
+  return result;
+}
+
+bool AcceptsGzip(std::string_view accept_encoding) {
+  bool result = false;
+  ForEachListItem(accept_encoding, [&](std::string_view item) {
+      const auto semicolon = item.find(';');
+      const auto coding = Trim(item.substr(0, semicolon));
+      if (!boost::iequals(coding, "gzip") && coding != "*") { return; }
+
+      if (semicolon != std::string_view::npos) {
+        auto params = Trim(item.substr(semicolon + 1));
+        if (boost::istarts_with(params, "q=")) {
+          params.remove_prefix(2);
+          // Any q value which is all zeros forbids the coding.
+          if (params.find_first_not_of("0.") == std::string_view::npos) {
+            return;
+          }
+        }
+      }
+      result = true;
+    });
+  return result;
+}
+
+bool EtagMatches(std::string_view if_none_match, std::string_view etag) {
+  // If-None-Match uses the weak comparison, so ignore any W/ prefix.
+  const auto strip_weak = [](std::string_view value) {
+    if (boost::starts_with(value, "W/")) { value.remove_prefix(2); }
+    return value;
+  };
+
+  bool result = false;
+  ForEachListItem(if_none_match, [&](std::string_view item) {
+      if (item == "*" || strip_weak(item) == strip_weak(etag)) {
+        result = true;
+      }
+    });
+  return result;
+}
+
+}
+}
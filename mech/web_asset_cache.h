@@ -0,0 +1,91 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mjmech {
+namespace mech {
+
+/// Holds every file beneath a set of directories in memory, so that
+/// WebServer need not touch the filesystem for each request.
+///
+/// This is not thread safe.  WebServer only uses it from its
+/// background thread.
+class WebAssetCache {
+ public:
+  struct Asset {
+    std::string content_type;
+    std::string data;
+
+    /// A gzip compressed copy of data, or empty if the content type
+    /// is not worth compressing.
+    std::string gzip;
+
+    /// A strong entity tag derived from the contents, including the
+    /// surrounding quotes.
+    std::string etag;
+
+    int64_t mtime_ns = 0;
+  };
+
+  /// Files larger than @p max_file_size are not cached.
+  explicit WebAssetCache(std::vector<std::string> directories,
+                         std::size_t max_file_size = 8 << 20);
+
+  /// Re-read any file which has been added, changed, or removed
+  /// since the last call.  @return the number of files affected.
+  int Refresh();
+
+  /// @return the asset for the file at @p path, or nullptr if it is
+  /// not cached.  The path is formed as it would be to open the file,
+  /// and must begin with one of the directories.
+  std::shared_ptr<const Asset> Find(std::string_view path) const;
+
+  /// @return every directory beneath the cached ones, including
+  /// themselves, as of the last Refresh.
+  const std::vector<std::string>& watch_directories() const {
+    return watch_directories_;
+  }
+
+  std::size_t size() const { return assets_.size(); }
+
+ private:
+  std::shared_ptr<const Asset> Load(const std::string& path,
+                                    int64_t mtime_ns) const;
+
+  const std::vector<std::string> directories_;
+  const std::size_t max_file_size_;
+
+  std::unordered_map<std::string, std::shared_ptr<const Asset>> assets_;
+  std::vector<std::string> watch_directories_;
+};
+
+/// @return @p data compressed in the gzip format.
+std::string GzipCompress(std::string_view data);
+
+/// @return true if an Accept-Encoding header value allows gzip.
+bool AcceptsGzip(std::string_view accept_encoding);
+
+/// @return true if an If-None-Match header value matches @p etag.
+bool EtagMatches(std::string_view if_none_match, std::string_view etag);
+
+}
+}
@@ -15,6 +15,8 @@
 #pragma once
 
 #include <memory>
+#include <optional>
+#include <string_view>
 
 #include <clipp/clipp.h>
 
@@ -27,7 +29,9 @@
 #include "mjlib/base/json5_read_archive.h"
 #include "mjlib/base/json5_write_archive.h"
 
+#include "base/fused_binary_writer.h"
 #include "base/logging.h"
+#include "base/telemetry_layout.h"
 
 #include "mech/quadruped_control.h"
 #include "mech/web_server.h"
@@ -36,12 +40,35 @@ namespace mjmech {
 namespace mech {
 
 /// Exposes an embedded web server with a command and control UI.
+///
+/// Clients normally exchange JSON text frames.  If they offer the
+/// kBinarySubprotocol websocket sub-protocol and the application
+/// supplies decode_binary_command, then:
+///
+///  * the first message from the server is a text frame holding the
+///    TelemetryLayoutWriter description of StatusClass
+///  * every status reply is a binary frame in the telemetry binary
+///    format
+///  * binary frames from the client are passed to
+///    decode_binary_command, except for a single zero byte, which
+///    requests status without a command
+///
+/// Text frames from the client are accepted in either case.
 template <typename CommandClass, typename StatusClass>
 class WebControl {
  public:
+  static constexpr const char* kBinarySubprotocol = "mjmech-binary-1";
+
+  using DecodeBinaryCommand =
+      std::function<std::optional<CommandClass> (std::string_view)>;
+
   struct Options {
     std::string asset_path;
     bool exclusive = true;
+
+    /// If set, kBinarySubprotocol is offered to clients.  It should
+    /// return nullopt for a frame which cannot be decoded.
+    DecodeBinaryCommand decode_binary_command;
   };
 
   using SetCommand = std::function<void (const CommandClass&)>;
@@ -61,9 +88,13 @@ class WebControl {
   struct Parameters {
     int port = 4778;
 
+    // Reload the web assets whenever they change on disk.
+    bool watch_assets = false;
+
     template <typename Archive>
     void Serialize(Archive* a) {
       a->Visit(MJ_NVP(port));
+      a->Visit(MJ_NVP(watch_assets));
     }
   };
 
@@ -75,14 +106,24 @@ class WebControl {
     WebServer::Options server_options;
 
     server_options.port = parameters_.port;
+    server_options.watch_assets = parameters_.watch_assets;
 
     server_options.document_roots.push_back(
         {std::string("/"), FindAssetPath()});
 
-    server_options.websocket_handlers.push_back(
-        {"/control",
-         std::bind(&WebControl::HandleControlWebsocket, this,
-                   std::placeholders::_1)});
+    WebServer::Options::Websocket control;
+    control.endpoint = "/control";
+    control.handler = std::bind(&WebControl::HandleControlWebsocket, this,
+                                std::placeholders::_1, std::placeholders::_2);
+    if (options_.decode_binary_command) {
+      if (status_layout_.find("\"unknown\"") == std::string::npos) {
+        control.subprotocols.push_back(kBinarySubprotocol);
+      } else {
+        log_.warn("Status layout cannot be described, "
+                  "binary websocket protocol disabled");
+      }
+    }
+    server_options.websocket_handlers.push_back(std::move(control));
 
     std::cout << "Starting web server\n";
     web_server_ = std::make_unique<WebServer>(executor_, server_options);
@@ -91,7 +132,8 @@ class WebControl {
   }
 
  private:
-  void HandleControlWebsocket(WebServer::WebsocketStream stream) {
+  void HandleControlWebsocket(WebServer::WebsocketStream stream,
+                              const std::string& subprotocol) {
     if (options_.exclusive) {
       const auto maybe = websocket_.lock();
       if (maybe) {
@@ -102,21 +144,35 @@ class WebControl {
     }
     // This stream is running on a different executor, thus we need to
     // keep it segregated.
-    auto websocket = std::make_shared<WebsocketServer>(this, std::move(stream));
+    auto websocket = std::make_shared<WebsocketServer>(
+        this, std::move(stream), subprotocol == kBinarySubprotocol);
     websocket->Start();
     websocket_ = websocket;
   }
 
   class WebsocketServer : public std::enable_shared_from_this<WebsocketServer> {
    public:
-    WebsocketServer(WebControl* parent, WebServer::WebsocketStream stream)
+    WebsocketServer(WebControl* parent, WebServer::WebsocketStream stream,
+                    bool binary)
         : parent_(parent),
           stream_(std::move(stream)),
-          executor_(stream_.get_executor()) {
+          executor_(stream_.get_executor()),
+          binary_(binary) {
     }
 
     void Start() {
-      StartRead();
+      if (!binary_) {
+        StartRead();
+        return;
+      }
+
+      // The client needs the layout before it can decode anything
+      // else we send.
+      stream_.text(true);
+      stream_.async_write(
+          boost::asio::buffer(parent_->status_layout_),
+          std::bind(&WebsocketServer::HandleWrite, this->shared_from_this(),
+                    std::placeholders::_1));
     }
 
     void StartRead() {
@@ -144,6 +200,11 @@ class WebControl {
       if (MaybeClose(ec)) { return; }
       mjlib::base::FailIf(ec);
 
+      if (!stream_.got_text()) {
+        HandleBinaryRead();
+        return;
+      }
+
       std::string message(static_cast<const char*>(buffer_.data().data()),
                           buffer_.size());
       buffer_.clear();
@@ -156,18 +217,7 @@ class WebControl {
                 istr,
                 JsonRead::Options().set_permissive_nan(true));
 
-        boost::asio::post(
-            parent_->executor_,
-            [self = this->shared_from_this(), command]() {
-              if (command.command) {
-                self->parent_->set_command_(*command.command);
-              }
-              const auto status = self->parent_->get_status_();
-
-              boost::asio::post(
-                  self->executor_,
-                  std::bind(&WebsocketServer::WriteReply, self, status));
-            });
+        PostCommand(command.command);
       } catch (mjlib::base::system_error& se) {
         if (se.code() == mjlib::base::error::kJsonParse) {
           // This we will just log, and then continue on.
@@ -180,10 +230,64 @@ class WebControl {
       }
     }
 
+    void HandleBinaryRead() {
+      const std::string_view message(
+          static_cast<const char*>(buffer_.data().data()), buffer_.size());
+
+      if (!binary_) {
+        log_.warn("Ignoring binary frame without binary sub-protocol");
+        buffer_.clear();
+        StartRead();
+        return;
+      }
+
+      std::optional<CommandClass> command;
+      if (message.size() != 1 || message[0] != 0) {
+        command = parent_->options_.decode_binary_command(message);
+        if (!command) {
+          log_.warn(fmt::format("Error decoding {} byte binary command",
+                                message.size()));
+          buffer_.clear();
+          StartRead();
+          return;
+        }
+      }
+      buffer_.clear();
+
+      PostCommand(command);
+    }
+
+    void PostCommand(const std::optional<CommandClass>& command) {
+      boost::asio::post(
+          parent_->executor_,
+          [self = this->shared_from_this(), command]() {
+            if (command) {
+              self->parent_->set_command_(*command);
+            }
+            const auto status = self->parent_->get_status_();
+
+            boost::asio::post(
+                self->executor_,
+                std::bind(&WebsocketServer::WriteReply, self, status));
+          });
+    }
+
     void WriteReply(const StatusClass& status) {
-      using JsonWrite = mjlib::base::Json5WriteArchive;
-      message_ = JsonWrite::Write(
-          status, JsonWrite::Options().set_standard(true));
+      if (binary_) {
+        message_.clear();
+        base::detail::StringWriteStream stream(&message_);
+        binary_writer_.Write(stream, &status);
+        if (!binary_writer_.fused() && !reported_unfused_) {
+          log_.warn("Status binary encoding reverted to BinaryWriteArchive");
+          reported_unfused_ = true;
+        }
+        stream_.binary(true);
+      } else {
+        using JsonWrite = mjlib::base::Json5WriteArchive;
+        message_ = JsonWrite::Write(
+            status, JsonWrite::Options().set_standard(true));
+        stream_.text(true);
+      }
 
       stream_.async_write(
           boost::asio::buffer(message_),
@@ -213,6 +317,10 @@ class WebControl {
 
     base::LogRef log_ = base::GetLogInstance("WebControl");
 
+    const bool binary_;
+    base::FusedBinaryWriter<StatusClass> binary_writer_;
+    bool reported_unfused_ = false;
+
     boost::beast::flat_buffer buffer_;
     std::string message_;
     uint32_t count_ = 0;
@@ -253,6 +361,8 @@ class WebControl {
   GetStatus get_status_;
 
   const Options options_;
+  const std::string status_layout_ =
+      base::TelemetryLayoutWriter::Write<StatusClass>();
 
   Parameters parameters_;
 
@@ -19,6 +19,13 @@ const CMD_MAX_RATE_Z = Math.PI * 60 / 180.0;
 const CMD_MAX_POSE_YAW = Math.PI * 20 / 180.0;
 const CMD_MAX_POSE_PITCH = Math.PI * 11 / 180.0;
 
+const BINARY_SUBPROTOCOL = "mjmech-binary-1";
+
+// See mech/quadruped_web_command.h.
+const BINARY_COMMAND_VELOCITY = 1;
+const BINARY_COMMAND_SIZE = 36;
+const BINARY_LOG_VALUES = { "unset" : 0, "disable" : 1, "enable" : 2 };
+
 const TRANSLATION_EPSILON = 0.025;
 const ROTATION_EPSILON = Math.PI * 7.0 / 180.0;
 
@@ -99,6 +106,103 @@ function asymmetricUnscale(value, minval, maxval) {
   return value / Math.abs(maxval);
 }
 
+// Decodes records in the telemetry binary format, given the JSON
+// layout written by base::TelemetryLayoutWriter.
+class LayoutDecoder {
+  constructor(layout) {
+    this._layout = layout;
+  }
+
+  // Return the enumeration values for a top level field, as a map
+  // from name to value, or null if there is no such enum.
+  enumValues(field) {
+    const fields = this._layout.object || [];
+    for (const [name, type] of fields) {
+      if (name != field || !type.enum) { continue; }
+      const result = {};
+      for (const [value, value_name] of Object.entries(type.enum)) {
+        result[value_name] = Number(value);
+      }
+      return result;
+    }
+    return null;
+  }
+
+  decode(buffer) {
+    this._view = new DataView(buffer);
+    this._offset = 0;
+    return this._read(this._layout);
+  }
+
+  _varuint() {
+    let result = 0;
+    let scale = 1;
+    for (;;) {
+      const byte = this._view.getUint8(this._offset++);
+      result += (byte & 0x7f) * scale;
+      if ((byte & 0x80) == 0) { return result; }
+      scale *= 128;
+    }
+  }
+
+  _scalar(type) {
+    const view = this._view;
+    const offset = this._offset;
+    switch (type) {
+      case "bool": this._offset += 1; return view.getUint8(offset) != 0;
+      case "i8": this._offset += 1; return view.getInt8(offset);
+      case "u8": this._offset += 1; return view.getUint8(offset);
+      case "i16": this._offset += 2; return view.getInt16(offset, true);
+      case "u16": this._offset += 2; return view.getUint16(offset, true);
+      case "i32": this._offset += 4; return view.getInt32(offset, true);
+      case "u32": this._offset += 4; return view.getUint32(offset, true);
+      case "i64":
+      case "timestamp":
+      case "duration":
+        this._offset += 8; return Number(view.getBigInt64(offset, true));
+      case "u64":
+        this._offset += 8; return Number(view.getBigUint64(offset, true));
+      case "f32": this._offset += 4; return view.getFloat32(offset, true);
+      case "f64": this._offset += 8; return view.getFloat64(offset, true);
+      case "string": {
+        const size = this._varuint();
+        const bytes = new Uint8Array(
+          view.buffer, view.byteOffset + this._offset, size);
+        this._offset += size;
+        return new TextDecoder().decode(bytes);
+      }
+    }
+    throw new Error(`unknown layout type ${type}`);
+  }
+
+  _read(type) {
+    if (typeof type === "string") { return this._scalar(type); }
+    if (type.object) {
+      const result = {};
+      for (const [name, field] of type.object) {
+        result[name] = this._read(field);
+      }
+      return result;
+    }
+    if (type.enum) {
+      const value = this._varuint();
+      return type.enum[value] || value;
+    }
+    if (type.vector) {
+      const count = this._varuint();
+      return iota(count).map(() => this._read(type.vector));
+    }
+    if (type.array) {
+      const [count, element] = type.array;
+      return iota(count).map(() => this._read(element));
+    }
+    if (type.optional) {
+      return this._varuint() == 0 ? null : this._read(type.optional);
+    }
+    throw new Error(`unknown layout type ${JSON.stringify(type)}`);
+  }
+};
+
 class Joystick {
   static BUTTON_START = 9;
   static BUTTON_SELECT = 8;
@@ -186,6 +290,7 @@ class Joystick {
 class Application {
   constructor() {
     this._websocket = null;
+    this._decoder = null;
     this._mode = "";
     this._state = null;
     this._joystick = new Joystick();
@@ -322,9 +427,12 @@ class Application {
       mode_check.checked = false;
     }
     this._state = null;
+    this._decoder = null;
 
     const location = window.location;
-    this._websocket = new WebSocket("ws://" + location.host + "/control");
+    this._websocket = new WebSocket(
+      "ws://" + location.host + "/control", [BINARY_SUBPROTOCOL]);
+    this._websocket.binaryType = "arraybuffer";
     this._websocket.addEventListener(
       'message', (e) => { this._handleWebsocketMessage(e); });
     this._websocket.addEventListener(
@@ -340,11 +448,50 @@ class Application {
   }
 
   _handleWebsocketMessage(e) {
-    this._state = JSON.parse(e.data)
+    if (this._websocket.protocol == BINARY_SUBPROTOCOL) {
+      if (typeof e.data === "string") {
+        // The first message describes the layout of all that follow.
+        this._decoder = new LayoutDecoder(JSON.parse(e.data));
+        return;
+      }
+      this._state = this._decoder.decode(e.data);
+    } else {
+      this._state = JSON.parse(e.data)
+    }
 
     this._updateState();
   }
 
+  _binaryReady() {
+    return (this._websocket.protocol == BINARY_SUBPROTOCOL &&
+            this._decoder !== null);
+  }
+
+  // Return the fixed layout form of a command, or null if it cannot
+  // be represented that way.
+  _encodeBinaryCommand(command) {
+    if (command.rest) { return null; }
+    const modes = this._decoder.enumValues("mode");
+    if (modes === null || !(command.mode in modes)) { return null; }
+
+    const buffer = new ArrayBuffer(BINARY_COMMAND_SIZE);
+    const view = new DataView(buffer);
+    view.setUint8(0, BINARY_COMMAND_VELOCITY);
+    view.setUint8(1, modes[command.mode]);
+    view.setUint8(2, BINARY_LOG_VALUES[command.log]);
+    view.setUint8(
+      3,
+      ((command.jump && command.jump.repeat) ? 0x01 : 0) |
+        ((command.walk && command.walk.maximize_flight) ? 0x02 : 0));
+    for (let i = 0; i < 3; i++) {
+      view.setFloat32(4 + 4 * i, command.v_R[i], true);
+      view.setFloat32(16 + 4 * i, command.w_R[i], true);
+    }
+    view.setFloat32(28, command.walk ? command.walk.step_height : 1.0, true);
+    view.setFloat32(32, command.jump ? command.jump.acceleration : 0.0, true);
+    return buffer;
+  }
+
   _handleWebsocketClose() {
     setTimeout(() => { this._openWebsocket()}, 500);
   }
@@ -427,7 +574,11 @@ class Application {
     // command.
     if (this._mode == "") {
       if (this._websocket.readyState == WebSocket.OPEN) {
-        this._websocket.send("{}");
+        if (this._binaryReady()) {
+          this._websocket.send(new Uint8Array([0]));
+        } else if (this._websocket.protocol != BINARY_SUBPROTOCOL) {
+          this._websocket.send("{}");
+        }
       }
       return;
     }
@@ -561,7 +712,13 @@ class Application {
     getElement('current_json_command').innerHTML = command_string;
 
     if (this._websocket.readyState == WebSocket.OPEN) {
-      this._websocket.send(command_string)
+      const binary = this._binaryReady() ?
+            this._encodeBinaryCommand(command["command"]) : null;
+      if (binary !== null) {
+        this._websocket.send(binary);
+      } else {
+        this._websocket.send(command_string)
+      }
     }
   }
 
@@ -14,9 +14,14 @@
 
 #include "mech/web_server.h"
 
+#include <pthread.h>
+#include <sys/inotify.h>
+
+#include <optional>
 #include <thread>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
@@ -24,10 +29,12 @@
 #include <fmt/format.h>
 
 #include "mjlib/base/fail.h"
+#include "mjlib/base/system_error.h"
 
 #include "base/logging.h"
 
 #include "mech/mime_type.h"
+#include "mech/web_asset_cache.h"
 
 namespace pl = std::placeholders;
 namespace fs = boost::filesystem;
@@ -86,8 +93,28 @@ class ResponseFactory {
   const http::request<http::string_body>* const request_;
 };
 
+/// @return the first of @p supported which the client offered in
+/// its Sec-WebSocket-Protocol header, or an empty string if none
+/// were.
+std::string SelectSubprotocol(std::string_view offered,
+                              const std::vector<std::string>& supported) {
+  for (const auto& candidate : supported) {
+    std::string_view remaining = offered;
+    while (!remaining.empty()) {
+      const auto comma = remaining.find(',');
+      auto item = remaining.substr(0, comma);
+      while (!item.empty() && item.front() == ' ') { item.remove_prefix(1); }
+      while (!item.empty() && item.back() == ' ') { item.remove_suffix(1); }
+      if (item == candidate) { return candidate; }
+      if (comma == std::string_view::npos) { break; }
+      remaining.remove_prefix(comma + 1);
+    }
+  }
+  return {};
+}
+
 template <typename Body>
-void StartWebsocket(WebServer::WebsocketHandler handler,
+void StartWebsocket(const WebServer::Options::Websocket& endpoint,
                     beast::tcp_stream socket,
                     http::request<Body> request) {
   using Stream = websocket::stream<beast::tcp_stream>;
@@ -97,16 +124,24 @@ void StartWebsocket(WebServer::WebsocketHandler handler,
   timeout_opt.handshake_timeout = std::chrono::seconds(10);
   timeout_opt.idle_timeout = std::chrono::seconds(10);
 
+  const auto offered = request[http::field::sec_websocket_protocol];
+  const std::string subprotocol = SelectSubprotocol(
+      std::string_view(offered.data(), offered.size()),
+      endpoint.subprotocols);
+
   websocket.set_option(timeout_opt);
   websocket.set_option(
       websocket::stream_base::decorator(
-          [](websocket::response_type& response) {
+          [subprotocol](websocket::response_type& response) {
             response.set(http::field::server,
                          std::string("mjmech WebServer"));
+            if (!subprotocol.empty()) {
+              response.set(http::field::sec_websocket_protocol, subprotocol);
+            }
           }));
   websocket.accept(request);
 
-  handler(std::move(websocket));
+  endpoint.handler(std::move(websocket), subprotocol);
 }
 } // namespace
 
@@ -134,6 +169,19 @@ class WebServer::Impl {
   }
 
   void ChildRun() {
+    ::pthread_setname_np(::pthread_self(), "web");
+
+    if (options_.cache_assets) {
+      std::vector<std::string> directories;
+      for (const auto& root : options_.document_roots) {
+        directories.push_back(root.root);
+      }
+      asset_cache_.emplace(std::move(directories));
+      log_.info(fmt::format("cached {} assets", asset_cache_->size()));
+
+      if (options_.watch_assets) { StartWatch(); }
+    }
+
     std::make_shared<Listener>(
         this, child_context_.get_executor(),
         tcp::endpoint(boost::asio::ip::make_address(options_.address),
@@ -206,7 +254,7 @@ class WebServer::Impl {
           // Websocket has its own timeout mechanism.
           stream_.expires_never();
 
-          StartWebsocket(handler.handler, std::move(stream_), std::move(request));
+          StartWebsocket(handler, std::move(stream_), std::move(request));
           return;
         }
       }
@@ -223,6 +271,14 @@ class WebServer::Impl {
 
         const std::string this_path =
             root.root + "/" + path.substr(root.prefix.size());
+
+        if (parent_->asset_cache_) {
+          auto asset = parent_->asset_cache_->Find(this_path);
+          if (asset) {
+            return SendAsset(request, response_factory, std::move(asset));
+          }
+        }
+
         if (!fs::exists(this_path)) { continue; }
 
         beast::error_code ec;
@@ -256,18 +312,74 @@ class WebServer::Impl {
       return send(response_factory.NotFound(std::string(request.target())));
     }
 
+    void SendAsset(const http::request<http::string_body>& request,
+                   const ResponseFactory& response_factory,
+                   std::shared_ptr<const WebAssetCache::Asset> asset) {
+      const auto setup = [&](auto* response) {
+        response_factory.SetupResponse(response, asset->content_type);
+        response->set(http::field::etag, asset->etag);
+        // Browsers may keep a copy, but must check with us before
+        // using it, so that changes show up on the next refresh.
+        response->set(http::field::cache_control, "no-cache");
+        if (!asset->gzip.empty()) {
+          response->set(http::field::vary, "Accept-Encoding");
+        }
+      };
+
+      const auto if_none_match = request[http::field::if_none_match];
+      if (!if_none_match.empty() &&
+          EtagMatches(std::string_view(if_none_match.data(),
+                                       if_none_match.size()),
+                      asset->etag)) {
+        http::response<http::empty_body> response{
+          http::status::not_modified, request.version()};
+        setup(&response);
+        return Send(std::move(response));
+      }
+
+      const auto accept_encoding = request[http::field::accept_encoding];
+      const bool gzip =
+          !asset->gzip.empty() &&
+          AcceptsGzip(std::string_view(accept_encoding.data(),
+                                       accept_encoding.size()));
+      const std::string& data = gzip ? asset->gzip : asset->data;
+
+      if (request.method() == http::verb::head) {
+        http::response<http::empty_body> response{
+          http::status::ok, request.version()};
+        setup(&response);
+        if (gzip) { response.set(http::field::content_encoding, "gzip"); }
+        response.content_length(data.size());
+        return Send(std::move(response));
+      }
+
+      // The body refers directly to the cached bytes, which the
+      // asset pointer keeps alive until the write completes.
+      http::response<http::span_body<const char>> response{
+        std::piecewise_construct,
+            std::make_tuple(data.data(), data.size()),
+            std::make_tuple(http::status::ok, request.version())};
+      setup(&response);
+      if (gzip) { response.set(http::field::content_encoding, "gzip"); }
+      response.content_length(data.size());
+      Send(std::move(response), std::move(asset));
+    }
+
     template <bool isRequest, typename Body>
-    void Send(http::message<isRequest, Body> message) {
+    void Send(http::message<isRequest, Body> message,
+              std::shared_ptr<const void> keep_alive = {}) {
       auto sp = std::make_shared<http::message<isRequest, Body>>(
           std::move(message));
       http::async_write(
           stream_,
           *sp,
-          std::bind(&Session::HandleWrite, shared_from_this(),
-                    pl::_1, sp->need_eof(), sp));
+          [self = shared_from_this(), sp, keep_alive](
+              beast::error_code ec, std::size_t) {
+            self->HandleWrite(ec, sp->need_eof());
+          });
     }
 
-    void HandleWrite(beast::error_code ec, bool close, std::shared_ptr<void>) {
+    void HandleWrite(beast::error_code ec, bool close) {
       if (ec) {
         log_.warn(fmt::format("Error writing: {}", ec.message()));
         Close();
@@ -348,11 +460,60 @@ class WebServer::Impl {
     base::LogRef log_ = base::GetLogInstance("WebServer");
   };
 
+  void StartWatch() {
+    const int fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    mjlib::base::system_error::throw_if(fd < 0, "inotify_init1");
+    inotify_.assign(fd);
+
+    AddWatches();
+    StartWatchRead();
+  }
+
+  void AddWatches() {
+    // Adding a watch for a directory which is already watched just
+    // returns the existing descriptor, so this can be repeated for
+    // each refresh to pick up new subdirectories.
+    for (const auto& directory : asset_cache_->watch_directories()) {
+      ::inotify_add_watch(
+          inotify_.native_handle(), directory.c_str(),
+          IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+          IN_MOVED_TO | IN_ATTRIB);
+    }
+  }
+
+  void StartWatchRead() {
+    inotify_.async_read_some(
+        boost::asio::buffer(inotify_buffer_),
+        std::bind(&Impl::HandleWatch, this, pl::_1));
+  }
+
+  void HandleWatch(const beast::error_code& ec) {
+    if (ec == boost::asio::error::operation_aborted) { return; }
+    mjlib::base::FailIf(ec);
+
+    // We don't care which files changed, as a refresh only reloads
+    // those whose size or modification time differ.
+    const int changed = asset_cache_->Refresh();
+    if (changed) {
+      log_.info(fmt::format("reloaded {} assets", changed));
+    }
+    AddWatches();
+
+    StartWatchRead();
+  }
+
   boost::asio::any_io_executor executor_;
   const Options options_;
 
   std::thread child_thread_;
   boost::asio::io_context child_context_;
+
+  // These are only accessed from child_thread_.
+  std::optional<WebAssetCache> asset_cache_;
+  boost::asio::posix::stream_descriptor inotify_{child_context_};
+  char inotify_buffer_[4096] = {};
+
+  base::LogRef log_ = base::GetLogInstance("WebServer");
 };
 
 WebServer::WebServer(const boost::asio::any_io_executor& executor,
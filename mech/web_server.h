@@ -18,6 +18,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <boost/asio/any_io_executor.hpp>
 
@@ -36,7 +37,10 @@ class WebServer {
  public:
   using WebsocketStream =
       boost::beast::websocket::stream<boost::beast::tcp_stream>;
-  using WebsocketHandler = std::function<void (WebsocketStream)>;
+  /// The second argument is the negotiated sub-protocol, or empty if
+  /// none was.
+  using WebsocketHandler =
+      std::function<void (WebsocketStream, const std::string&)>;
 
   struct Options {
     std::string address = "0.0.0.0";
@@ -54,16 +58,30 @@ class WebServer {
     /// prefixes are tried in order.
     std::vector<Root> document_roots;
 
+    /// If true, every file beneath the document roots is read into
+    /// memory when the server starts, along with a gzip compressed
+    /// copy and an ETag, and served from there.  Files which are not
+    /// cached are still served from disk.
+    bool cache_assets = true;
+
+    /// If true, the cache is refreshed whenever anything beneath the
+    /// document roots changes.
+    bool watch_assets = false;
+
     /// The following URL prefixes will be treated as exclusively
-    /// websocket endpoints.  No websocket "sub-protocols" are
-    /// supported.  Once the websocket connection has been upgraded,
-    /// the given handler will be invoked.  These websockets are given
-    /// an executor that runs in a background thread, and may only
-    /// execute in that thread.
+    /// websocket endpoints.  Once the websocket connection has been
+    /// upgraded, the given handler will be invoked.  These websockets
+    /// are given an executor that runs in a background thread, and
+    /// may only execute in that thread.
     struct Websocket {
       std::string endpoint;
 
       WebsocketHandler handler;
+
+      /// Sub-protocols which may be negotiated, in order of
+      /// preference.  If the client offers none of them, the
+      /// connection is still accepted with no sub-protocol.
+      std::vector<std::string> subprotocols;
     };
 
     std::vector<Websocket> websocket_handlers;